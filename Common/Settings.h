@@ -3,11 +3,9 @@
 using namespace Windows::Perception::Spatial;
 using namespace Windows::Foundation::Numerics;
 
-// If you are using a very high detail setting with spatial mapping, it can be beneficial
-// to use a 32-bit unsigned integer format for indices instead of the default 16-bit. 
-#define USE_32BIT_INDICES
-#undef USE_32BIT_INDICES
-
+// The observer delivers 32 bit indices, so that dense surfaces cannot overflow them. Every
+// surface whose vertices 16 bit indices can address is cached and uploaded with those, see
+// FitsIn16BitIndices() in Processing/MeshTypes.h.
 namespace Settings {
 	bool const DRAW_WIREFRAME_INIT_VALUE = true;
 	double const MAX_TRIANGLE_RES = 8000;
@@ -24,4 +22,142 @@ namespace Settings {
 	};
 
 	bool const MOCK_IMPROVEMENT = false;
+
+	// Per-surface grid and KD-tree over the world-space vertices, see Processing/SpatialIndex.h.
+	// The cell size should match the radius of the typical neighborhood query. Building them
+	// costs about three quarters of the processing of an update, so they are only built for
+	// the drift correction unless queries of RealtimeSurfaceMeshRenderer::GetSpatialIndex()
+	// need them too.
+	bool const BUILD_SPATIAL_INDEX = false;
+	float const SPATIAL_INDEX_CELL_SIZE = 0.05f;
+
+	// Point-to-plane ICP of every surface update against the other surfaces in the map, see
+	// Processing/Icp.h. Only the cached CPU positions are corrected, the rendered buffers keep
+	// the observer's data. Builds the spatial indices it aligns against, see above.
+	bool const ICP_DRIFT_CORRECTION = false;
+	float const ICP_MAX_CORRESPONDENCE_DISTANCE = 0.05f;
+	double const ICP_TIME_BUDGET_MS = 5.0;
+
+	// Connected components with fewer triangles or less area (m^2) than this are floaters, see
+	// Processing/MeshComponents.h. They are either removed from the drawn and cached triangles,
+	// or only flagged per face in SurfaceMesh::FloaterFaces() and the "floater" attribute
+	// channel, which the GLB export writes and COLOR_ATTRIBUTE can show in the OBJ exports.
+	bool const FILTER_FLOATERS = false;
+	bool const REMOVE_FLOATERS = true;
+	size_t const FLOATER_MIN_TRIANGLES = 20;
+	float const FLOATER_MIN_AREA = 0.01f;
+
+	// Bilateral denoising of the cached world-space positions of every update, see
+	// Processing/MeshDenoiser.h. The budget includes building the vertex adjacency.
+	bool const DENOISE_SURFACES = false;
+	int const DENOISE_ITERATIONS = 3;
+	double const DENOISE_TIME_BUDGET_MS = 5.0;
+
+	// SaveAppState also writes the map as meshes_<res>.smap, see Processing/SpatialMapFile.h.
+	// It is a fraction of the size of the OBJ files and can be memory-mapped by the tools.
+	bool const SAVE_BINARY_MAP = true;
+
+	// Compresses the surfaces of the binary map with Processing/MeshCodec.h to about a third,
+	// with positions on a grid of COMPRESSION_PRECISION meters. 0 keeps them bit-exact, which
+	// only saves about a quarter.
+	bool const COMPRESS_BINARY_MAP = false;
+	float const COMPRESSION_PRECISION = 0.0001f;
+
+	// SaveAppState also writes the map as meshes_<res>.glb, binary glTF with quantized
+	// positions and normals and one node per surface, see Processing/GlbFile.h. The combined
+	// scene adds all surfaces merged into a single mesh.
+	bool const SAVE_GLB = false;
+	bool const GLB_NORMALS = true;
+	bool const GLB_COMBINED_SCENE = false;
+
+	// SaveAppState appends only the surfaces added, updated or expired since the last save to
+	// meshes_<res>.journal instead of rewriting both exports, see Processing/MapJournal.h.
+	// Once the journal is larger than JOURNAL_COMPACT_BYTES it is folded into
+	// meshes_<res>.snapshot in the background. MeshTools replay turns any save into an export.
+	bool const JOURNAL_EXPORT = false;
+	size_t const JOURNAL_COMPACT_BYTES = 16 * 1024 * 1024;
+
+	// Exports run on a background thread with at most EXPORT_WORKERS formatting threads, see
+	// Processing/ExportPipeline.h. A save submitted while EXPORT_QUEUE_DEPTH others are
+	// pending supersedes the oldest of them. With an interval above 0 the map is also saved
+	// periodically while the app runs.
+	size_t const EXPORT_QUEUE_DEPTH = 1;
+	size_t const EXPORT_WORKERS = 1;
+	double const AUTOSAVE_INTERVAL_SECONDS = 0.;
+
+	// Records the raw buffers of every surface update and the surfaces of every observer event
+	// to surfaces_<res>.rec next to the exports, see Processing/SurfaceRecording.h. MeshTools
+	// replay-surfaces feeds a recording through the same processing as SurfaceMesh.
+	bool const RECORD_SURFACES = false;
+
+	// Scalar channels computed for every surface update, see Processing/MeshAttributes.h. The
+	// OBJ exports carry COLOR_ATTRIBUTE as gray vertex colors and the GLB export all channels
+	// as vertex attributes. OBJ_MATERIALS brings back the usemtl line before every face that
+	// Python/MTLCreator.py's Mesh.mtl colors, which doubles the size of the files.
+	bool const COMPUTE_ATTRIBUTES = true;
+	char const* const COLOR_ATTRIBUTE = "gradient";
+	bool const OBJ_MATERIALS = false;
+
+	// Writes one "vn" per distinct face normal of a surface, quantized to a thousandth, instead
+	// of one per face. OBJ_TRANSFORMS_ONLY writes meshes_transforms_<res>.txt with the
+	// mesh-to-world transform of every surface instead of the transformed OBJ, see
+	// ObjWriter::WriteWithTransforms() in Processing/ObjWriter.h.
+	bool const OBJ_DEDUPLICATE_NORMALS = true;
+	bool const OBJ_TRANSFORMS_ONLY = false;
+
+	// SaveAppState also writes meshes_<res>.cache with the surfaces relative to a persisted
+	// SpatialAnchor, see Processing/SurfaceCache.h. On the next launch every surface the
+	// observer reports with an unchanged update time is uploaded from the cache instead of
+	// being computed and processed again. The observer is only created once the anchor is
+	// loaded and located, or after WARM_START_ANCHOR_WAIT_SECONDS without the cache.
+	bool const WARM_START_CACHE = false;
+	double const WARM_START_ANCHOR_WAIT_SECONDS = 5.;
+
+	// With SPATIAL_MAPPING_PROFILE among the preprocessor definitions, the phases of every frame
+	// are timed, see Processing/FrameProfiler.h, and their percentiles logged every
+	// PROFILE_LOG_INTERVAL_SECONDS. Without it the timers are compiled out.
+	double const PROFILE_LOG_INTERVAL_SECONDS = 10.;
+
+	// Traces every surface update from the observer event to the frame that swaps its buffers
+	// in, see Processing/SurfaceTrace.h. SaveAppState writes the trace to trace_<res>.json,
+	// which chrome://tracing and ui.perfetto.dev open.
+	bool const TRACE_SURFACE_UPDATES = false;
+
+	// Appends a snapshot of the SurfaceMetrics, see Processing/Metrics.h, to metrics_<res>.jsonl
+	// as a line of JSON every METRICS_SNAPSHOT_INTERVAL_SECONDS, so that a session can be
+	// diagnosed after the fact. 0 only keeps them in memory. Past METRICS_FILE_MAX_BYTES the
+	// file is moved to metrics_<res>.jsonl.1 and started over. A line is 1 to 2 KB.
+	double const METRICS_SNAPSHOT_INTERVAL_SECONDS = 0.;
+	size_t const METRICS_FILE_MAX_BYTES = 4 * 1024 * 1024;
+
+	// Lets a feedback controller lower the triangle density down to MIN_TRIANGLE_RES, the
+	// TryComputeLatestMeshAsync calls in flight down to one and the retention of inactive
+	// surfaces down to MIN_INACTIVE_MESH_TIME while the frame time, the mesh processing time
+	// per frame or the memory of the map are over budget, and raise them again once there is
+	// headroom, see Processing/DensityController.h. MeshTools simulate-density replays a
+	// recording against the controller. The exports keep MAX_TRIANGLE_RES in their names.
+	bool const ADAPTIVE_DENSITY = false;
+	double const TARGET_FRAME_MS = 1000. / 60.;
+	double const MESH_PROCESSING_MS_PER_FRAME = 2.;
+	size_t const MAP_MEMORY_BUDGET_BYTES = 256 * 1024 * 1024;
+	double const MIN_TRIANGLE_RES = 1000;
+	size_t const MAX_CONCURRENT_MESH_COMPUTATIONS = 4;
+	float const MIN_INACTIVE_MESH_TIME = 60.0f;
+
+	// Reorders the triangles of every uploaded surface for the post-transform vertex cache and
+	// against overdraw, and its vertices in the order they are fetched, see
+	// Processing/VertexCache.h. It runs off the render thread with the creation of the
+	// buffers; the CPU caches and the exports keep the observer's order. MeshTools
+	// bench-vertexcache measures it on the captures.
+	bool const OPTIMIZE_VERTEX_CACHE = true;
+	size_t const VERTEX_CACHE_SIZE = 16;
+	float const OVERDRAW_CLUSTER_THRESHOLD = 1.05f;
+
+	// Partitions every surface into clusters of neighboring triangles with a bounding sphere
+	// and a normal cone, for culling and partial updates of parts of a surface, see
+	// Processing/MeshClusters.h. Published with the spatial index, the renderer still draws
+	// whole surfaces. MeshTools bench-clusters measures the build and the culling.
+	bool const BUILD_CLUSTERS = false;
+	size_t const MAX_CLUSTER_VERTICES = 64;
+	size_t const MAX_CLUSTER_TRIANGLES = 124;
 }
\ No newline at end of file
@@ -45,13 +45,17 @@ void RealtimeSurfaceMeshRenderer::Update(
 	SpatialCoordinateSystem^ coordinateSystem
 )
 {
+	PROFILE_PHASE(RendererUpdate);
+
 	std::lock_guard<std::mutex> guard(m_meshCollectionLock);
 
 	const float timeElapsed = static_cast<float>(timer.GetTotalSeconds());
+	int64_t active = 0;
+	int64_t pending = 0;
 
 	// Update meshes as needed, based on the current coordinate system.
 	// Also remove meshes that are inactive for too long.
-	for (auto iter = m_meshCollection.begin(); iter != m_meshCollection.end(); iter++)
+	for (auto iter = m_meshCollection.begin(); iter != m_meshCollection.end();)
 	{
 		auto& pair = *iter;
 		auto& surfaceMesh = pair.second;
@@ -64,15 +68,56 @@ void RealtimeSurfaceMeshRenderer::Update(
 			coordinateSystem
 		);
 
-		// Check to see if the mesh has expired.
+		// Check to see if the mesh has expired. An expired mesh takes no more updates and is
+		// erased with its buffers, caches and spatial index once its vertex task is done, as
+		// the task holds on to it. The observer adds it again if it lists the surface later.
 		float const lastActiveTime = surfaceMesh.LastActiveTime();
 		float const inactiveDuration = timeElapsed - lastActiveTime;
-		if (inactiveDuration > Settings::MAX_INACTIVE_MESH_TIME)
+		if (inactiveDuration > m_retentionSeconds.load(std::memory_order_relaxed))
 		{
 			surfaceMesh.Expired(true);
-			//m_meshCollection.erase(iter);
 		}
-	};
+		if (surfaceMesh.Expired() && !surfaceMesh.IsUpdating())
+		{
+			if (m_publishedSpatialIndices.erase(pair.first) > 0)
+			{
+				m_spatialIndex.Update(pair.first, nullptr);
+			}
+			iter = m_meshCollection.erase(iter);
+			m_expiredSurfaces++;
+			continue;
+		}
+
+		PublishSpatialIndex(pair.first, surfaceMesh);
+
+		active += surfaceMesh.IsActive() ? 1 : 0;
+		pending += surfaceMesh.UpdatePending() ? 1 : 0;
+		iter++;
+	}
+
+	SurfaceMetrics& metrics = SurfaceMetrics::Instance();
+	metrics.surfacesResident.Set(static_cast<int64_t>(m_meshCollection.size()));
+	metrics.surfacesActive.Set(active);
+	metrics.surfacesExpired.Set(m_expiredSurfaces);
+	metrics.surfacesPending.Set(pending);
+}
+
+// Hands the latest spatial index of a surface to readers of the collection. Only surfaces
+// that received a new index since the last frame cause a new snapshot.
+void RealtimeSurfaceMeshRenderer::PublishSpatialIndex(int const id, SurfaceMesh const& surfaceMesh)
+{
+	std::shared_ptr<SpatialIndex const> spatialIndex;
+	if (!surfaceMesh.Expired())
+	{
+		spatialIndex = surfaceMesh.GetSpatialIndex();
+	}
+
+	auto& published = m_publishedSpatialIndices[id];
+	if (published != spatialIndex.get())
+	{
+		published = spatialIndex.get();
+		m_spatialIndex.Update(id, std::move(spatialIndex));
+	}
 }
 
 void SpatialMapping::RealtimeSurfaceMeshRenderer::AddSurface(int const id, Windows::Perception::Spatial::Surfaces::SpatialSurfaceInfo^ newSurface)
@@ -97,21 +142,68 @@ void SpatialMapping::RealtimeSurfaceMeshRenderer::UpdateSurface(int const id, Wi
 	AddOrUpdateSurfaceAsync(id, newSurface);
 }
 
+void SpatialMapping::RealtimeSurfaceMeshRenderer::RestoreSurface(int const id, std::shared_ptr<SurfaceData const> cached, SpatialCoordinateSystem^ cacheCoordinateSystem)
+{
+	uint64_t const flow = SurfaceTrace::Instance().NewFlow();
+	TraceScope trace("RestoreSurface", flow, id);
+
+	std::lock_guard<std::mutex> guard(m_meshCollectionLock);
+
+	// Restored surfaces are not highlighted, they were part of the map before.
+	auto& surfaceMesh = m_meshCollection[id];
+	surfaceMesh.SetSpatialMap(id, &m_spatialIndex);
+	surfaceMesh.SetRecorder(m_recorder);
+	surfaceMesh.RestoreSurface(std::move(cached), cacheCoordinateSystem, flow);
+	surfaceMesh.IsActive(true);
+}
+
 Concurrency::task<void> SpatialMapping::RealtimeSurfaceMeshRenderer::AddOrUpdateSurfaceAsync(int const id, Windows::Perception::Spatial::Surfaces::SpatialSurfaceInfo^ newSurface)
 {
+	// A traced update is followed from here to the SwapVertexBuffers that shows it.
+	uint64_t const flow = SurfaceTrace::Instance().NewFlow();
+	TraceScope trace("AddOrUpdateSurfaceAsync", flow, id);
+	TraceClock::time_point const observed = TraceClock::now();
+
+	// At the limit of ApplyDensity() the update is dropped. The surface keeps its older update
+	// time, so the next ObservedSurfacesChanged asks for it again.
+	if (m_computations.fetch_add(1) >= m_maxComputations.load(std::memory_order_relaxed))
+	{
+		m_computations.fetch_sub(1);
+		return task_from_result();
+	}
+
 	auto options = ref new SpatialSurfaceMeshOptions();
 	options->IncludeVertexNormals = Settings::INCLUDE_VERTEX_NORMALS;
 
-	auto computeMeshTask = create_task(newSurface->TryComputeLatestMeshAsync(Settings::MAX_TRIANGLE_RES, options));
-	auto processMeshTask = computeMeshTask.then([this, id](SpatialSurfaceMesh^ mesh)
+	// 32 bit indices, whatever the density. SurfaceMesh narrows the surfaces that fit 16 bit.
+	unsigned int formatIndex = 0;
+	if (options->SupportedTriangleIndexFormats->IndexOf(Windows::Graphics::DirectX::DirectXPixelFormat::R32UInt, &formatIndex))
+	{
+		options->TriangleIndexFormat = Windows::Graphics::DirectX::DirectXPixelFormat::R32UInt;
+	}
+
+	auto computeMeshTask = create_task(newSurface->TryComputeLatestMeshAsync(m_triangleDensity.load(std::memory_order_relaxed), options));
+	TraceClock::time_point const requested = TraceClock::now();
+	SurfaceMetrics::Instance().updateQueueDepth.Add(1);
+	auto processMeshTask = computeMeshTask.then([this, id, flow, requested, observed](task<SpatialSurfaceMesh^> computed)
 		{
+			// The wait includes the dispatch to this thread after the mesh was computed.
+			TraceScope trace("UpdateSurface", flow, id, requested, "TryComputeLatestMeshAsync");
+			GaugeRelease const queueDepth(SurfaceMetrics::Instance().updateQueueDepth);
+
+			// Released even if the computation failed, or the limit would shrink for good.
+			m_computations.fetch_sub(1);
+			SpatialSurfaceMesh^ const mesh = computed.get();
+
 			if (mesh != nullptr)
 			{
 				std::lock_guard<std::mutex> guard(m_meshCollectionLock);
 
 				auto& surfaceMesh = m_meshCollection[id];
 				if (!surfaceMesh.Expired()) {
-					surfaceMesh.UpdateSurface(mesh);
+					surfaceMesh.SetSpatialMap(id, &m_spatialIndex);
+					surfaceMesh.SetRecorder(m_recorder);
+					surfaceMesh.UpdateSurface(mesh, flow, observed);
 					surfaceMesh.IsActive(true);
 				}
 			}
@@ -142,6 +234,8 @@ void RealtimeSurfaceMeshRenderer::HideInactiveMeshes(std::unordered_map<int, Gui
 // Renders one frame using the vertex, geometry, and pixel shaders.
 void RealtimeSurfaceMeshRenderer::Render(bool isStereo, bool useWireframe)
 {
+	PROFILE_PHASE(RendererRender);
+
 	// Loading is asynchronous. Only draw geometry after it's loaded.
 	if (!m_loadingComplete)
 	{
@@ -211,6 +305,12 @@ void RealtimeSurfaceMeshRenderer::Render(bool isStereo, bool useWireframe)
 void RealtimeSurfaceMeshRenderer::CreateDeviceDependentResources()
 {
 	m_meshCollection.clear();
+
+	for (auto const& [id, published] : m_publishedSpatialIndices)
+	{
+		m_spatialIndex.Update(id, nullptr);
+	}
+	m_publishedSpatialIndices.clear();
 	m_usingVprtShaders = m_deviceResources->GetDeviceSupportsVprt();
 
 	// On devices that do support the D3D11_FEATURE_D3D11_OPTIONS3::
@@ -355,6 +455,13 @@ void RealtimeSurfaceMeshRenderer::ReleaseDeviceDependentResources()
 	}
 }
 
+void SpatialMapping::RealtimeSurfaceMeshRenderer::ApplyDensity(DensitySettings const& settings)
+{
+	m_triangleDensity.store(settings.triangleDensity, std::memory_order_relaxed);
+	m_maxComputations.store(settings.concurrentComputations, std::memory_order_relaxed);
+	m_retentionSeconds.store(settings.retentionSeconds, std::memory_order_relaxed);
+}
+
 bool SpatialMapping::RealtimeSurfaceMeshRenderer::HasSurface(int const id)
 {
 	std::lock_guard<std::mutex> guard(m_meshCollectionLock);
@@ -375,4 +482,48 @@ Windows::Foundation::DateTime SpatialMapping::RealtimeSurfaceMeshRenderer::LastU
 		static const Windows::Foundation::DateTime zero;
 		return zero;
 	}
-}
\ No newline at end of file
+}
+
+void SpatialMapping::RealtimeSurfaceMeshRenderer::SnapshotSurfaces(SurfaceDataSnapshot& surfaces)
+{
+	std::lock_guard<std::mutex> guard(m_meshCollectionLock);
+
+	surfaces.clear();
+	surfaces.reserve(m_meshCollection.size());
+	for (auto const& [id, surfaceMesh] : m_meshCollection)
+	{
+		auto data = surfaceMesh.GetExportData();
+		if (!surfaceMesh.Expired() && data)
+		{
+			surfaces.push_back(std::move(data));
+		}
+	}
+}
+
+void SpatialMapping::RealtimeSurfaceMeshRenderer::SnapshotCacheTransforms(SpatialCoordinateSystem^ cacheCoordinateSystem, std::vector<CacheTransform>& transforms)
+{
+	std::lock_guard<std::mutex> guard(m_meshCollectionLock);
+
+	transforms.clear();
+	transforms.reserve(m_meshCollection.size());
+	for (auto& [id, surfaceMesh] : m_meshCollection)
+	{
+		CacheTransform transform;
+		if (!surfaceMesh.Expired() && surfaceMesh.TryGetCacheTransform(cacheCoordinateSystem, transform))
+		{
+			transforms.push_back(transform);
+		}
+	}
+}
+
+void SpatialMapping::RealtimeSurfaceMeshRenderer::SnapshotMemory(std::vector<std::pair<int, MemoryUsage>>& usage)
+{
+	std::lock_guard<std::mutex> guard(m_meshCollectionLock);
+
+	usage.clear();
+	usage.reserve(m_meshCollection.size());
+	for (auto const& [id, surfaceMesh] : m_meshCollection)
+	{
+		usage.emplace_back(id, surfaceMesh.GetMemoryUsage());
+	}
+}
@@ -15,7 +15,9 @@
 #include "Common\StepTimer.h"
 #include "Content\SurfaceMesh.h"
 #include "Content\ShaderStructures.h"
+#include "Processing\DensityController.h"
 
+#include <atomic>
 #include <memory>
 #include <unordered_map>
 #include <ppltasks.h>
@@ -38,6 +40,10 @@ namespace SpatialMapping
 		void AddSurface(int const id, Windows::Perception::Spatial::Surfaces::SpatialSurfaceInfo^ newSurface);
 		void UpdateSurface(int const id, Windows::Perception::Spatial::Surfaces::SpatialSurfaceInfo^ newSurface);
 
+		// Adds a surface from the SurfaceCache of the last session instead of computing its
+		// mesh, see SurfaceMesh::RestoreSurface().
+		void RestoreSurface(int const id, std::shared_ptr<SurfaceData const> cached, Windows::Perception::Spatial::SpatialCoordinateSystem^ cacheCoordinateSystem);
+
 		Windows::Foundation::DateTime LastUpdateTime(int const id);
 
 		void HideInactiveMeshes(
@@ -47,8 +53,30 @@ namespace SpatialMapping
 
 		std::unordered_map<int, SpatialMapping::SurfaceMesh>* MeshCollection() { return &m_meshCollection; }
 
+		// References to the immutable export data of all live surfaces. Cheap enough for the
+		// frame loop, the collection lock is only held while the pointers are copied.
+		void SnapshotSurfaces(SurfaceDataSnapshot& surfaces);
+
+		// The transforms of all live surfaces into the coordinate system of the SurfaceCache.
+		void SnapshotCacheTransforms(Windows::Perception::Spatial::SpatialCoordinateSystem^ cacheCoordinateSystem, std::vector<CacheTransform>& transforms);
+
+		// The bytes every surface in the collection holds, expired ones included. The totals
+		// and their high-water marks are in MemoryAccounting::Instance().
+		void SnapshotMemory(std::vector<std::pair<int, MemoryUsage>>& usage);
+
+		// Lock-free view of the spatial indices of all live surfaces.
+		std::shared_ptr<SpatialIndexSnapshot const> GetSpatialIndex() const { return m_spatialIndex.Snapshot(); }
+
+		// Passed on to every surface, which records its updates into it.
+		void SetRecorder(SurfaceRecorder* const recorder) { m_recorder = recorder; }
+
+		// The triangle density and the concurrent computations of later updates, and the time
+		// after which inactive surfaces expire, see Processing/DensityController.h.
+		void ApplyDensity(DensitySettings const& settings);
+
 	private:
 		Concurrency::task<void> AddOrUpdateSurfaceAsync(int const id, Windows::Perception::Spatial::Surfaces::SpatialSurfaceInfo^ newSurface);
+		void PublishSpatialIndex(int const id, SurfaceMesh const& surfaceMesh);
 
 		// Cached pointer to device resources.
 		std::shared_ptr<DX::DeviceResources>            m_deviceResources;
@@ -65,6 +93,21 @@ namespace SpatialMapping
 		// A way to lock map access.
 		std::mutex                                      m_meshCollectionLock;
 
+		// Spatial indices of the surfaces, published whenever a surface swaps in a new one.
+		SpatialIndexCollection                          m_spatialIndex;
+		std::unordered_map<int, SpatialIndex const*>    m_publishedSpatialIndices;
+
+		// Surfaces erased after the retention since the start, for SurfaceMetrics.
+		int64_t                                         m_expiredSurfaces = 0;
+
+		SurfaceRecorder*                                m_recorder = nullptr;
+
+		// Set by ApplyDensity(), read by the observer events and the frame loop.
+		std::atomic<double>                             m_triangleDensity{ Settings::MAX_TRIANGLE_RES };
+		std::atomic<size_t>                             m_maxComputations{ SIZE_MAX };
+		std::atomic<size_t>                             m_computations{ 0 };
+		std::atomic<float>                              m_retentionSeconds{ Settings::MAX_INACTIVE_MESH_TIME };
+
 		// If the current D3D Device supports VPRT, we can avoid using a geometry
 		// shader just to set the render target array index.
 		bool                                            m_usingVprtShaders = false;
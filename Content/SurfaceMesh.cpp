@@ -13,7 +13,11 @@
 
 #include <ppltasks.h>
 
+#include <chrono>
+#include <cstring>
+#include <limits>
 #include <thread>
+#include <utility>
 
 #include <DirectXCollision.h>
 #include <DirectXMath.h>
@@ -38,6 +42,65 @@ using namespace Windows::Storage::Streams;
 using namespace Windows::Graphics::DirectX;
 using namespace Platform;
 
+namespace
+{
+	IngestOptions IngestOptionsFromSettings(SpatialIndexCollection const* const spatialMap)
+	{
+		IngestOptions options;
+		options.filterFloaters = Settings::FILTER_FLOATERS;
+		options.removeFloaters = Settings::REMOVE_FLOATERS;
+		options.floaters.minTriangles = Settings::FLOATER_MIN_TRIANGLES;
+		options.floaters.minArea = Settings::FLOATER_MIN_AREA;
+
+		options.denoise = Settings::DENOISE_SURFACES;
+		options.denoising.iterations = Settings::DENOISE_ITERATIONS;
+		options.denoising.timeBudgetMilliseconds = Settings::DENOISE_TIME_BUDGET_MS;
+
+		options.correctDrift = Settings::ICP_DRIFT_CORRECTION;
+		options.icp.maxCorrespondenceDistance = Settings::ICP_MAX_CORRESPONDENCE_DISTANCE;
+		options.icp.timeBudgetMilliseconds = Settings::ICP_TIME_BUDGET_MS;
+		options.spatialMap = spatialMap;
+
+		options.buildSpatialIndex = Settings::BUILD_SPATIAL_INDEX || Settings::ICP_DRIFT_CORRECTION;
+		options.spatialIndexCellSize = Settings::SPATIAL_INDEX_CELL_SIZE;
+
+		options.buildClusters = Settings::BUILD_CLUSTERS;
+		options.clusters.maxVertices = Settings::MAX_CLUSTER_VERTICES;
+		options.clusters.maxTriangles = Settings::MAX_CLUSTER_TRIANGLES;
+
+		if (Settings::COMPUTE_ATTRIBUTES)
+		{
+			options.attributes = { AttributeKind::Gradient, AttributeKind::Surface, AttributeKind::PlaneDistance };
+		}
+		return options;
+	}
+
+	size_t MeshBytes(SpatialSurfaceMesh^ const surfaceMesh)
+	{
+		return surfaceMesh->VertexPositions->Data->Length +
+			(surfaceMesh->VertexNormals ? surfaceMesh->VertexNormals->Data->Length : 0) +
+			surfaceMesh->TriangleIndices->Data->Length;
+	}
+
+	// Reorders the triangles of an upload, in the observer's winding, for the vertex cache and
+	// its vertices for the vertex fetch, see Processing/VertexCache.h. The decoded positions
+	// are in the order of the vertex buffers, whose elements are copied into the remapped ones.
+	template <typename TIndex>
+	void OptimizeUpload(VertexCacheOptimizer& optimizer, std::vector<TIndex>& indices, Vector3 const* const positions, size_t const vertexCount,
+		void const* const vertexPositions, size_t const positionStride, void const* const vertexNormals, size_t const normalStride,
+		std::vector<uint8_t>& remappedPositions, std::vector<uint8_t>& remappedNormals)
+	{
+		VertexCacheOptions options;
+		options.cacheSize = Settings::VERTEX_CACHE_SIZE;
+		options.overdrawThreshold = Settings::OVERDRAW_CLUSTER_THRESHOLD;
+		options.reversedWinding = true;
+
+		optimizer.OptimizeTriangles(indices.data(), indices.size(), positions, vertexCount, options);
+		optimizer.OptimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+		optimizer.RemapVertices(vertexPositions, positionStride, remappedPositions);
+		optimizer.RemapVertices(vertexNormals, normalStride, remappedNormals);
+	}
+}
 
 SurfaceMesh::SurfaceMesh() {
 	std::lock_guard<std::mutex> lock(m_meshResourcesMutex);
@@ -48,15 +111,41 @@ SurfaceMesh::SurfaceMesh() {
 
 SurfaceMesh::~SurfaceMesh()
 {
+	// The vertex tasks take the lock, so the last one is waited for before.
+	m_updateVertexResourcesTask.wait();
+
 	std::lock_guard<std::mutex> lock(m_meshResourcesMutex);
 
 	ReleaseDeviceDependentResources();
 }
 
 void SurfaceMesh::UpdateSurface(
-	SpatialSurfaceMesh^ surfaceMesh)
+	SpatialSurfaceMesh^ surfaceMesh,
+	uint64_t flow,
+	TraceClock::time_point observed)
 {
+	// Held until its vertex task has uploaded it, or replaced by a newer update.
+	if (m_pendingSurfaceMesh)
+	{
+		m_memory.Add(MemoryCategory::PendingMesh, -static_cast<int64_t>(MeshBytes(m_pendingSurfaceMesh)));
+	}
+	if (surfaceMesh)
+	{
+		m_memory.Add(MemoryCategory::PendingMesh, static_cast<int64_t>(MeshBytes(surfaceMesh)));
+	}
 	m_pendingSurfaceMesh = surfaceMesh;
+	m_pendingFlow = flow;
+	m_pendingObserved = observed;
+}
+
+void SurfaceMesh::RestoreSurface(
+	std::shared_ptr<SurfaceData const> cached,
+	SpatialCoordinateSystem^ cacheCoordSystem,
+	uint64_t flow)
+{
+	m_pendingRestore = std::move(cached);
+	m_cacheCoordSystem = cacheCoordSystem;
+	m_pendingRestoreFlow = flow;
 }
 
 // Spatial Mapping surface meshes each have a transform. This transform is updated every frame.
@@ -66,6 +155,8 @@ void SurfaceMesh::UpdateTransform(
 	DX::StepTimer const& timer,
 	SpatialCoordinateSystem^ baseCoordinateSystem)
 {
+	PROFILE_PHASE(UpdateTransform);
+
 	UpdateVertexResources(device, baseCoordinateSystem);
 
 	{
@@ -76,9 +167,21 @@ void SurfaceMesh::UpdateTransform(
 			// Surface mesh resources are created off-thread so that they don't affect rendering latency.
 			// When a new update is ready, we should begin using the updated vertex position, normal, and 
 			// index buffers.
+			TraceScope trace("SwapVertexBuffers", m_updatedFlow, m_surfaceId, m_updateReadyTime, "next frame");
 			SwapVertexBuffers();
 			m_updateReady = false;
+
+			if (m_updatedObserved != TraceClock::time_point())
+			{
+				SurfaceMetrics::Instance().observerToRenderMilliseconds.Record(
+					std::chrono::duration<double, std::milli>(TraceClock::now() - m_updatedObserved).count());
+				m_updatedObserved = {};
+			}
 		}
+
+		// The vertex tasks set m_updateReady before they leave the queue, so an update is
+		// pending until it is swapped in or dropped by its task.
+		m_updatePending = m_pendingSurfaceMesh != nullptr || m_pendingRestore != nullptr || m_updateReady || m_queuedTasks.Value() > 0;
 	}
 
 	XMMATRIX transform;
@@ -112,7 +215,7 @@ void SurfaceMesh::UpdateTransform(
 		{
 			// If the transform can be acquired, this spatial mesh is valid right now and
 			// we have the information we need to draw it this frame.
-			transform = XMLoadFloat4x4(&tryTransform->Value);
+			transform = XMLoadFloat4x4(&m_meshProperties.meshToCoordSys) * XMLoadFloat4x4(&tryTransform->Value);
 			m_lastActiveTime = static_cast<float>(timer.GetTotalSeconds());
 		}
 		else
@@ -175,6 +278,8 @@ void SurfaceMesh::Draw(
 	bool usingVprtShaders,
 	bool isStereo)
 {
+	PROFILE_PHASE(Draw);
+
 	if (!m_constantBufferCreated || !m_loadingComplete)
 	{
 		// Resources are still being initialized.
@@ -252,25 +357,64 @@ void SurfaceMesh::CreateDirectXBuffer(
 	device->CreateBuffer(&bufferDescription, &bufferBytes, target);
 }
 
+void SurfaceMesh::CreateDirectXBuffer(
+	ID3D11Device* device,
+	D3D11_BIND_FLAG binding,
+	void const* data,
+	size_t bytes,
+	ID3D11Buffer** target)
+{
+	CD3D11_BUFFER_DESC bufferDescription(static_cast<UINT>(bytes), binding);
+	D3D11_SUBRESOURCE_DATA bufferBytes = { data, 0, 0 };
+	device->CreateBuffer(&bufferDescription, &bufferBytes, target);
+}
+
 void SurfaceMesh::UpdateVertexResources(
 	ID3D11Device* device, Windows::Perception::Spatial::SpatialCoordinateSystem^ worldCoordSystem = nullptr)
 {
 	if (!m_isExpired && !m_isShuttingDown && worldCoordSystem != nullptr) {
 
+		RestoreVertexResources(device, worldCoordSystem);
+
 		SpatialSurfaceMesh^ surfaceMesh = std::move(m_pendingSurfaceMesh);
+		uint64_t const flow = std::exchange(m_pendingFlow, 0);
+		TraceClock::time_point const observed = std::exchange(m_pendingObserved, {});
 		if (!surfaceMesh || surfaceMesh->TriangleIndices->ElementCount < 3)
 		{
 			// Not enough indices to draw a triangle or there is no pending mesh.
+			if (surfaceMesh)
+			{
+				m_memory.Add(MemoryCategory::PendingMesh, -static_cast<int64_t>(MeshBytes(surfaceMesh)));
+			}
 			return;
 		}
 
 		// Surface mesh resources are created off-thread, so that they don't affect rendering latency.
-		m_updateVertexResourcesTask.then([this, device, surfaceMesh, worldCoordSystem]()
+		TraceClock::time_point const queued = TraceClock::now();
+		m_queuedTasks.Add(1);
+		SurfaceMetrics::Instance().updateQueueDepth.Add(1);
+		m_updateVertexResourcesTask = m_updateVertexResourcesTask.then([this, device, surfaceMesh, worldCoordSystem, flow, queued, observed]()
 			{
+				PROFILE_PHASE(UpdateVertexResources);
+				TraceScope trace("UpdateVertexResources", flow, m_surfaceId, queued);
+				GaugeRelease const queueDepth(SurfaceMetrics::Instance().updateQueueDepth);
+				GaugeRelease const queuedTasks(m_queuedTasks);
+				CounterTimer const processing(SurfaceMetrics::Instance().meshProcessingMicroseconds);
+
 				// Create new Direct3D device resources for the updated buffers. These will be set aside
 				// for now, and then swapped into the active slot next time the render loop is ready to draw.
 				std::lock_guard<std::mutex> lock(m_meshResourcesMutex);
 
+				// An update that finishes after a newer one of the surface is dropped before it is
+				// ingested, which would publish its export data, spatial index and clusters in
+				// place of the newer ones.
+				auto const meshUpdateTime = surfaceMesh->SurfaceInfo->UpdateTime;
+				if (meshUpdateTime.UniversalTime <= m_lastUpdateTime.UniversalTime)
+				{
+					m_memory.Add(MemoryCategory::PendingMesh, -static_cast<int64_t>(MeshBytes(surfaceMesh)));
+					return;
+				}
+
 				IBuffer^ positions = surfaceMesh->VertexPositions->Data;
 				IBuffer^ const v_normals = surfaceMesh->VertexNormals->Data;
 				IBuffer^ indices = surfaceMesh->TriangleIndices->Data;
@@ -278,79 +422,98 @@ void SurfaceMesh::UpdateVertexResources(
 				SpatialCoordinateSystem^ const meshCoordSys = surfaceMesh->CoordinateSystem;
 				IBox<float4x4>^ const meshCoordSysToWorld = meshCoordSys->TryGetTransformTo(worldCoordSystem);
 				IBox<float4x4>^ const worldCoordSysToMesh = worldCoordSystem->TryGetTransformTo(meshCoordSys);
+				unsigned int indexCount = surfaceMesh->TriangleIndices->ElementCount;
+				DirectXPixelFormat const indexFormat = surfaceMesh->TriangleIndices->Format;
+				size_t const vertexCount = surfaceMesh->VertexPositions->ElementCount;
+				bool ingested = false;
+
+				// Compiled for both widths of the observer's indices.
+				auto const ingest = [&](XMSHORTN4 const* const positionData, auto* const indexData)
+					{
+						if (positionData == nullptr || indexData == nullptr) {
+							return;
+						}
 
-				if (meshCoordSysToWorld && worldCoordSysToMesh) {
-					XMSHORTN4* const positionData = GetDataFromIBuffer<XMSHORTN4>(positions);
-					IndexFormat* const indexData = GetDataFromIBuffer<IndexFormat>(indices);
-
-					if (positionData != nullptr && indexData != nullptr) {
-
-						m_positionsTransformed.clear();
-						m_positionsNotTransformed.clear();
+						SurfaceUpdate update;
+						Guid const guid = surfaceMesh->SurfaceInfo->Id;
+						std::memcpy(update.guid, &guid, sizeof(update.guid));
+						update.id = m_surfaceId;
+						update.updateTime = surfaceMesh->SurfaceInfo->UpdateTime.UniversalTime;
+						std::memcpy(update.meshToWorld, &meshCoordSysToWorld->Value, sizeof(update.meshToWorld));
 						float3 const pScale = surfaceMesh->VertexPositionScale;
+						update.vertexPositionScale = { pScale.x, pScale.y, pScale.z };
+						update.positions = reinterpret_cast<int16_t const*>(positionData);
+						update.normals = GetDataFromIBuffer<int8_t>(v_normals);
+						update.vertexCount = vertexCount;
+						update.indices = IndexView(indexData, indexCount);
 
-						for (int i = 0; i < surfaceMesh->VertexPositions->ElementCount; i++)
+						if (m_recorder != nullptr)
 						{
-							// Extract from device
-							XMFLOAT4 p;
-							XMVECTOR const vec = XMLoadShortN4(&positionData[i]);
-							XMStoreFloat4(&p, vec);
-
-							// Scale and transform
-							float3 const pScaled = float3(p.x * pScale.x, p.y * pScale.y, p.z * pScale.z);
-							float3 const pMeshToWorld = transform(pScaled, meshCoordSysToWorld->Value);
-
-							// Cache
-							m_positionsNotTransformed.push_back(pScaled);
-							m_positionsTransformed.push_back(pMeshToWorld);
-
-							// Insert back into app
-							//float3 const pWorldToMesh = transform(pMeshToWorld, worldCoordSysToMesh->Value);
-							//p = { pWorldToMesh.x / pScale.x, pWorldToMesh.y / pScale.y, pWorldToMesh.z / pScale.z, p.w };
-
-							//XMSHORTN4 pUpdated;
-							//XMVECTOR const vecUpdated = XMLoadFloat4(&p);
-							//XMStoreShortN4(&pUpdated, vecUpdated);
-
-							//positionData[i] = pUpdated;
+							// Before the floaters are removed from the observer's buffer below.
+							m_recorder->RecordUpdate(update);
 						}
 
-						m_indices.clear();
+						IngestResult const result = m_ingest.Ingest(update, indexData, indexCount, IngestOptionsFromSettings(m_spatialMap));
+						m_ingest.ReportMemory(m_memory);
+						ingested = true;
 
-						for (int i = 0; i < surfaceMesh->TriangleIndices->ElementCount; i += 3)
-						{
-							// Reverse index order
-							m_indices.emplace_back(indexData[i + 2]);
-							m_indices.emplace_back(indexData[i + 1]);
-							m_indices.emplace_back(indexData[i]);
-						}
+						// Removed floaters are neither uploaded to the GPU nor cached.
+						indexCount = static_cast<unsigned int>(result.indexCount);
+						LogDriftCorrection(result.icp);
+					};
 
-						m_faceNormals.clear();
+				if (meshCoordSysToWorld && worldCoordSysToMesh) {
+					XMSHORTN4 const* const positionData = GetDataFromIBuffer<XMSHORTN4>(positions);
+					if (indexFormat == DirectXPixelFormat::R32UInt)
+					{
+						ingest(positionData, GetDataFromIBuffer<uint32_t>(indices));
+					}
+					else
+					{
+						ingest(positionData, GetDataFromIBuffer<uint16_t>(indices));
+					}
+				}
 
-						auto crossProduct = [](float3 const& v1, float3 const& v2) -> float3 {
-							return float3(
-								v1.y * v2.z - v1.z * v2.y,
-								v1.x * v2.z - v1.z * v2.x,
-								v1.x * v2.y - v1.y * v2.x
-							);
-						};
+				// The observer delivers 32 bit indices, see RealtimeSurfaceMeshRenderer. Surfaces
+				// that 16 bit indices can address are uploaded with those, at half the size. The
+				// indices are copied in their own width when they are reordered for the vertex
+				// cache, which needs the positions the update decoded.
+				bool const wide = indexFormat == DirectXPixelFormat::R32UInt;
+				bool const optimize = Settings::OPTIMIZE_VERTEX_CACHE && ingested && v_normals != nullptr;
+				std::vector<uint16_t> indices16;
+				std::vector<uint32_t> indices32;
+				if (wide && FitsIn16BitIndices(vertexCount))
+				{
+					ConvertIndices(GetDataFromIBuffer<uint32_t>(indices), indexCount, indices16);
+				}
+				else if (optimize && wide)
+				{
+					ConvertIndices(GetDataFromIBuffer<uint32_t>(indices), indexCount, indices32);
+				}
+				else if (optimize)
+				{
+					ConvertIndices(GetDataFromIBuffer<uint16_t>(indices), indexCount, indices16);
+				}
 
-						auto normalize = [](float3 const& v) -> float3 {
-							auto const l = std::sqrt(std::pow(v.x, 2) + std::pow(v.y, 2) + std::pow(v.z, 2));
-							return float3(v.x / l, v.y / l, v.z / l);
+				// Empty when the observer's vertex buffers are uploaded as they are.
+				std::vector<uint8_t> remappedPositions;
+				std::vector<uint8_t> remappedNormals;
+				if (optimize)
+				{
+					auto const reorder = [&](auto& typed)
+						{
+							OptimizeUpload(m_vertexCache, typed, m_ingest.PositionsNotTransformed().data(), vertexCount,
+								GetDataFromIBuffer<uint8_t>(positions), surfaceMesh->VertexPositions->Stride,
+								GetDataFromIBuffer<uint8_t>(v_normals), surfaceMesh->VertexNormals->Stride,
+								remappedPositions, remappedNormals);
 						};
-
-						for (int i = 0; i < m_indices.size(); i += 3) {
-							auto const& v1 = m_positionsTransformed[m_indices[i]];
-							auto const& v2 = m_positionsTransformed[m_indices[i + 1]];
-							auto const& v3 = m_positionsTransformed[m_indices[i + 2]];
-							
-							float3 const edge1(v2.x - v1.x, v2.y - v1.y, v2.z - v1.z);
-							float3 const edge2(v3.x - v1.x, v3.y - v1.y, v3.z - v1.z);
-							float3 const normal(normalize(crossProduct(edge1, edge2)));
-
-							m_faceNormals.push_back(normal);
-						}
+					if (indices32.empty())
+					{
+						reorder(indices16);
+					}
+					else
+					{
+						reorder(indices32);
 					}
 				}
 
@@ -359,12 +522,36 @@ void SurfaceMesh::UpdateVertexResources(
 				Microsoft::WRL::ComPtr<ID3D11Buffer> updatedVertexNormals;
 				Microsoft::WRL::ComPtr<ID3D11Buffer> updatedTriangleIndices;
 
-				CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, positions, updatedVertexPositions.GetAddressOf());
-				CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, v_normals, updatedVertexNormals.GetAddressOf());
-				CreateDirectXBuffer(device, D3D11_BIND_INDEX_BUFFER, indices, updatedTriangleIndices.GetAddressOf());
+				size_t bufferBytes = 0;
+				if (remappedPositions.empty())
+				{
+					CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, positions, updatedVertexPositions.GetAddressOf());
+					CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, v_normals, updatedVertexNormals.GetAddressOf());
+					bufferBytes += positions->Length + v_normals->Length;
+				}
+				else
+				{
+					CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, remappedPositions.data(), remappedPositions.size(), updatedVertexPositions.GetAddressOf());
+					CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, remappedNormals.data(), remappedNormals.size(), updatedVertexNormals.GetAddressOf());
+					bufferBytes += remappedPositions.size() + remappedNormals.size();
+				}
+				if (!indices16.empty())
+				{
+					CreateDirectXBuffer(device, D3D11_BIND_INDEX_BUFFER, indices16.data(), indices16.size() * sizeof(uint16_t), updatedTriangleIndices.GetAddressOf());
+					bufferBytes += indices16.size() * sizeof(uint16_t);
+				}
+				else if (!indices32.empty())
+				{
+					CreateDirectXBuffer(device, D3D11_BIND_INDEX_BUFFER, indices32.data(), indices32.size() * sizeof(uint32_t), updatedTriangleIndices.GetAddressOf());
+					bufferBytes += indices32.size() * sizeof(uint32_t);
+				}
+				else
+				{
+					CreateDirectXBuffer(device, D3D11_BIND_INDEX_BUFFER, indices, updatedTriangleIndices.GetAddressOf());
+					bufferBytes += indices->Length;
+				}
 
 				// Before updating the meshes, check to ensure that there wasn't a more recent update.
-				auto const meshUpdateTime = surfaceMesh->SurfaceInfo->UpdateTime;
 				if (meshUpdateTime.UniversalTime > m_lastUpdateTime.UniversalTime)
 				{
 					// Prepare to swap in the new meshes.
@@ -378,18 +565,208 @@ void SurfaceMesh::UpdateVertexResources(
 					m_updatedMeshProperties.vertexPositionScale = surfaceMesh->VertexPositionScale;
 					m_updatedMeshProperties.vertexStride = surfaceMesh->VertexPositions->Stride;
 					m_updatedMeshProperties.normalStride = surfaceMesh->VertexNormals->Stride;
-					m_updatedMeshProperties.indexCount = surfaceMesh->TriangleIndices->ElementCount;
-					m_updatedMeshProperties.indexFormat = static_cast<DXGI_FORMAT>(surfaceMesh->TriangleIndices->Format);
+					m_updatedMeshProperties.indexCount = indexCount;
+					m_updatedMeshProperties.indexFormat = !indices16.empty() ? DXGI_FORMAT_R16_UINT : static_cast<DXGI_FORMAT>(indexFormat);
+					m_updatedMeshProperties.meshToCoordSys = float4x4::identity();
+					m_updatedMeshProperties.bufferBytes = bufferBytes;
+					m_memory.Set(MemoryCategory::GpuUpdatedBuffers, m_updatedMeshProperties.bufferBytes);
+					m_restoredSurface.reset();
 
 					// Send a signal to the render loop indicating that new resources are available to use.
 					m_updateReady = true;
+					m_updatedFlow = flow;
+					m_updatedObserved = observed;
+					m_updateReadyTime = TraceClock::now();
 					m_lastUpdateTime = meshUpdateTime;
 					m_loadingComplete = true;
 				}
+
+				// Released with the lambda, which no longer needs the observer's buffers.
+				m_memory.Add(MemoryCategory::PendingMesh, -static_cast<int64_t>(MeshBytes(surfaceMesh)));
 			});
 	}
 }
 
+// Creates the buffers of a cached surface in the layout of the observer's: SNORM16 positions
+// in mesh space, SNORM8 normals and the observer's winding.
+void SurfaceMesh::RestoreVertexResources(
+	ID3D11Device* device, SpatialCoordinateSystem^ worldCoordSystem)
+{
+	SpatialCoordinateSystem^ const cacheCoordSys = m_cacheCoordSystem;
+	if (!m_pendingRestore || !cacheCoordSys || m_pendingRestore->Indices().count < 3 || m_pendingSurfaceMesh)
+	{
+		// Nothing to restore, or an update of the observer is pending, which wins.
+		m_pendingRestore.reset();
+		m_pendingRestoreFlow = 0;
+		return;
+	}
+
+	// While the anchor is not located, e.g. right after launch or while tracking is lost, the
+	// surface stays pending and is tried again next frame.
+	IBox<float4x4>^ const cacheToWorld = cacheCoordSys->TryGetTransformTo(worldCoordSystem);
+	if (!cacheToWorld)
+	{
+		return;
+	}
+	float4x4 const cacheToWorldValue = cacheToWorld->Value;
+
+	std::shared_ptr<SurfaceData const> cached = std::move(m_pendingRestore);
+	uint64_t const flow = std::exchange(m_pendingRestoreFlow, 0);
+	TraceClock::time_point const queued = TraceClock::now();
+	m_queuedTasks.Add(1);
+	SurfaceMetrics::Instance().updateQueueDepth.Add(1);
+	m_updateVertexResourcesTask = m_updateVertexResourcesTask.then([this, device, cached, cacheCoordSys, cacheToWorldValue, flow, queued]()
+		{
+			PROFILE_PHASE(UpdateVertexResources);
+			TraceScope trace("UpdateVertexResources", flow, m_surfaceId, queued);
+			GaugeRelease const queueDepth(SurfaceMetrics::Instance().updateQueueDepth);
+			GaugeRelease const queuedTasks(m_queuedTasks);
+			CounterTimer const processing(SurfaceMetrics::Instance().meshProcessingMicroseconds);
+
+			std::lock_guard<std::mutex> lock(m_meshResourcesMutex);
+
+			// An update of the observer that arrived in the meantime wins.
+			if (cached->updateTime < m_lastUpdateTime.UniversalTime)
+			{
+				return;
+			}
+
+			size_t const vertexCount = cached->positionsNotTransformed.size();
+
+			m_ingest.Restore(*cached, reinterpret_cast<float const*>(&cacheToWorldValue), IngestOptionsFromSettings(m_spatialMap));
+			m_ingest.ReportMemory(m_memory);
+
+			Vector3 const scale = cached->vertexPositionScale;
+			std::vector<XMSHORTN4> positions(vertexCount);
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				Vector3 const& p = cached->positionsNotTransformed[v];
+				XMStoreShortN4(&positions[v], XMVectorSet(p.x / scale.x, p.y / scale.y, p.z / scale.z, 1.f));
+			}
+
+			// The cached indices are in the winding of the exports, for which the cross product
+			// points out of the surface like the observer's normals. Restore() stored them in
+			// the width for the vertices, which the index buffer keeps.
+			IndexView const exportIndices = m_ingest.Indices();
+			std::vector<Vector3> vertexNormals;
+			std::vector<uint16_t> indices16;
+			std::vector<uint32_t> indices32;
+			VisitIndices(exportIndices, [&](auto const* const typed)
+				{
+					if constexpr (sizeof(*typed) == sizeof(uint32_t))
+					{
+						ReverseWinding(typed, exportIndices.count, indices32);
+					}
+					else
+					{
+						ReverseWinding(typed, exportIndices.count, indices16);
+					}
+					ComputeVertexNormals(cached->positionsNotTransformed.data(), vertexCount, typed, exportIndices.count, vertexNormals);
+				});
+			void const* const indexData = exportIndices.is32Bit ? static_cast<void const*>(indices32.data()) : indices16.data();
+			size_t const indexCount = exportIndices.is32Bit ? indices32.size() : indices16.size();
+			size_t const indexBytes = exportIndices.is32Bit ? indices32.size() * sizeof(uint32_t) : indices16.size() * sizeof(uint16_t);
+
+			std::vector<XMBYTEN4> normals(vertexCount);
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				Vector3 const& n = vertexNormals[v];
+				XMStoreByteN4(&normals[v], XMVectorSet(n.x, n.y, n.z, 0.f));
+			}
+
+			// Like the observer's updates, the copies the cache keeps stay in their order.
+			std::vector<uint8_t> remappedPositions;
+			std::vector<uint8_t> remappedNormals;
+			if (Settings::OPTIMIZE_VERTEX_CACHE)
+			{
+				auto const reorder = [&](auto& typed)
+					{
+						OptimizeUpload(m_vertexCache, typed, cached->positionsNotTransformed.data(), vertexCount,
+							positions.data(), sizeof(XMSHORTN4), normals.data(), sizeof(XMBYTEN4), remappedPositions, remappedNormals);
+					};
+				if (exportIndices.is32Bit)
+				{
+					reorder(indices32);
+				}
+				else
+				{
+					reorder(indices16);
+				}
+			}
+			bool const remapped = !remappedPositions.empty();
+			void const* const positionData = remapped ? static_cast<void const*>(remappedPositions.data()) : positions.data();
+			void const* const normalData = remapped ? static_cast<void const*>(remappedNormals.data()) : normals.data();
+			size_t const positionBytes = remapped ? remappedPositions.size() : positions.size() * sizeof(XMSHORTN4);
+			size_t const normalBytes = remapped ? remappedNormals.size() : normals.size() * sizeof(XMBYTEN4);
+
+			Microsoft::WRL::ComPtr<ID3D11Buffer> updatedVertexPositions;
+			Microsoft::WRL::ComPtr<ID3D11Buffer> updatedVertexNormals;
+			Microsoft::WRL::ComPtr<ID3D11Buffer> updatedTriangleIndices;
+
+			CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, positionData, positionBytes, updatedVertexPositions.GetAddressOf());
+			CreateDirectXBuffer(device, D3D11_BIND_VERTEX_BUFFER, normalData, normalBytes, updatedVertexNormals.GetAddressOf());
+			CreateDirectXBuffer(device, D3D11_BIND_INDEX_BUFFER, indexData, indexBytes, updatedTriangleIndices.GetAddressOf());
+
+			m_updatedVertexPositionsBuffer.Swap(updatedVertexPositions);
+			m_updatedVertexNormalsBuffer.Swap(updatedVertexNormals);
+			m_updatedTriangleIndicesBuffer.Swap(updatedTriangleIndices);
+
+			m_updatedMeshProperties.localCoordSystem = cacheCoordSys;
+			m_updatedMeshProperties.meshToCoordSys = *reinterpret_cast<float4x4 const*>(cached->meshToWorld);
+			m_updatedMeshProperties.vertexPositionScale = { scale.x, scale.y, scale.z };
+			m_updatedMeshProperties.vertexStride = sizeof(XMSHORTN4);
+			m_updatedMeshProperties.normalStride = sizeof(XMBYTEN4);
+			m_updatedMeshProperties.indexCount = static_cast<unsigned int>(indexCount);
+			m_updatedMeshProperties.indexFormat = exportIndices.is32Bit ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+			m_updatedMeshProperties.bufferBytes = positionBytes + normalBytes + indexBytes;
+			m_memory.Set(MemoryCategory::GpuUpdatedBuffers, m_updatedMeshProperties.bufferBytes);
+
+			m_restoredSurface = cached;
+			m_updateReady = true;
+			m_updatedFlow = flow;
+			m_updatedObserved = {};
+			m_updateReadyTime = TraceClock::now();
+			m_lastUpdateTime.UniversalTime = cached->updateTime;
+			m_loadingComplete = true;
+		});
+}
+
+bool SurfaceMesh::TryGetCacheTransform(
+	SpatialCoordinateSystem^ cacheCoordSystem, CacheTransform& transform)
+{
+	std::lock_guard<std::mutex> lock(m_meshResourcesMutex);
+
+	// The properties of the update whose export data is published, swapped in or not.
+	SurfaceMeshProperties const& properties = m_updateReady ? m_updatedMeshProperties : m_meshProperties;
+	auto tryTransform = properties.localCoordSystem ? properties.localCoordSystem->TryGetTransformTo(cacheCoordSystem) : nullptr;
+	if (tryTransform == nullptr)
+	{
+		return false;
+	}
+
+	XMMATRIX const meshToCache = XMLoadFloat4x4(&properties.meshToCoordSys) * XMLoadFloat4x4(&tryTransform->Value);
+	XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(transform.meshToCache), meshToCache);
+	transform.id = m_surfaceId;
+	transform.updateTime = m_lastUpdateTime.UniversalTime;
+	return true;
+}
+
+void SurfaceMesh::LogDriftCorrection(IcpResult const& result) const
+{
+	if (result.iterations.empty())
+	{
+		return;
+	}
+
+	std::ostringstream os;
+	os << "ICP surface " << m_surfaceId << ":";
+	for (auto const& iteration : result.iterations)
+	{
+		os << " " << iteration.milliseconds << "ms/" << iteration.correspondences << "/" << iteration.rms * 1000. << "mm";
+	}
+	Helper::LogMessage(os.str());
+}
+
 void SurfaceMesh::CreateDeviceDependentResources(
 	ID3D11Device* device)
 {
@@ -415,7 +792,12 @@ void SurfaceMesh::ReleaseVertexResources()
 		m_pendingSurfaceMesh = m_surfaceMesh;
 		m_surfaceMesh = nullptr;
 	}
+	else if (m_restoredSurface)
+	{
+		m_pendingRestore = std::move(m_restoredSurface);
+	}
 
+	m_memory.Set(MemoryCategory::GpuBuffers, 0);
 	m_meshProperties = {};
 	GetVertexPositions().Reset();
 	GetVertexNormals().Reset();
@@ -431,6 +813,8 @@ void SurfaceMesh::SwapVertexBuffers()
 	m_triangleIndicesBuffer = m_updatedTriangleIndicesBuffer;
 
 	// Swap out the metadata: index count, index format, .
+	m_memory.Set(MemoryCategory::GpuBuffers, m_updatedMeshProperties.bufferBytes);
+	m_memory.Set(MemoryCategory::GpuUpdatedBuffers, 0);
 	m_meshProperties = m_updatedMeshProperties;
 
 	m_updatedMeshProperties = {};
@@ -450,9 +834,8 @@ void SurfaceMesh::ReleaseDeviceDependentResources()
 	// Clear out active resources.
 	ReleaseVertexResources();
 
-	m_positionsTransformed.clear();
-	m_faceNormals.clear();
-	m_indices.clear();
+	m_ingest.Clear();
+	m_ingest.ReportMemory(m_memory);
 
 	m_modelTransformBuffer.Reset();
 
@@ -14,6 +14,14 @@
 #include "Common\DeviceResources.h"
 #include "Common\Settings.h"
 #include "ShaderStructures.h"
+#include "Processing\ExportPipeline.h"
+#include "Processing\SpatialIndex.h"
+#include "Processing\MemoryAccounting.h"
+#include "Processing\Metrics.h"
+#include "Processing\SurfaceIngest.h"
+#include "Processing\SurfaceRecording.h"
+#include "Processing\SurfaceTrace.h"
+#include "Processing\VertexCache.h"
 
 #include <vector>
 
@@ -31,15 +39,31 @@ namespace SpatialMapping
 		unsigned int normalStride = 0;
 		unsigned int indexCount = 0;
 		DXGI_FORMAT  indexFormat = DXGI_FORMAT_UNKNOWN;
+
+		// Of the position, normal and index buffers, for the SurfaceMemory.
+		size_t bufferBytes = 0;
+
+		// Applied before the transform of localCoordSystem. Identity for the observer's meshes,
+		// the mesh-to-anchor transform for surfaces restored from the SurfaceCache.
+		Windows::Foundation::Numerics::float4x4 meshToCoordSys = Windows::Foundation::Numerics::float4x4::identity();
 	};
 
+	static_assert(sizeof(Windows::Foundation::Numerics::float3) == sizeof(Vector3), "float3 and Vector3 must share their layout.");
+
 	class SurfaceMesh final
 	{
 	public:
 		SurfaceMesh();
 		~SurfaceMesh();
 
-		void UpdateSurface(Windows::Perception::Spatial::Surfaces::SpatialSurfaceMesh^ surface);
+		// The flow of the SurfaceTrace the update belongs to, if it is traced, and the time of
+		// the observer event that reported it, for the latency in SurfaceMetrics.
+		void UpdateSurface(Windows::Perception::Spatial::Surfaces::SpatialSurfaceMesh^ surface, uint64_t flow = 0, TraceClock::time_point observed = {});
+
+		// Uploads a surface of the SurfaceCache, whose positions are relative to the coordinate
+		// system of the cache, in place of an observer mesh, as soon as that coordinate system is
+		// located. It is replaced by the next update.
+		void RestoreSurface(std::shared_ptr<SurfaceData const> cached, Windows::Perception::Spatial::SpatialCoordinateSystem^ cacheCoordSystem, uint64_t flow = 0);
 		void UpdateTransform(
 			ID3D11Device* device,
 			ID3D11DeviceContext* context,
@@ -52,22 +76,43 @@ namespace SpatialMapping
 		void ReleaseVertexResources();
 		void ReleaseDeviceDependentResources();
 
-#ifdef USE_32BIT_INDICES
-		using IndexFormat = uint32_t;
-#else
-		using IndexFormat = uint16_t;
-#endif
 		const bool& IsActive()       const { return m_isActive; }
+		// Whether an update was received that is not swapped in yet, as of the last UpdateTransform.
+		bool UpdatePending() const { return m_updatePending; }
+		// Whether a vertex task of the surface is queued or running, which holds on to it.
+		bool IsUpdating() const { return !m_updateVertexResourcesTask.is_done(); }
+		// The bytes this surface holds, see Processing/MemoryAccounting.h.
+		MemoryUsage GetMemoryUsage() const { return m_memory.Usage(); }
 		const float& LastActiveTime() const { return m_lastActiveTime; }
 		const Windows::Foundation::DateTime& LastUpdateTime() const { return m_lastUpdateTime; }
-		const std::vector<Windows::Foundation::Numerics::float3>* PositionsTransformed() const { return &m_positionsTransformed; }
-		const std::vector<Windows::Foundation::Numerics::float3>* PositionsNotTransformed() const { return &m_positionsNotTransformed; }
-		const std::vector<Windows::Foundation::Numerics::float3>* FaceNormals() const { return &m_faceNormals; }
-		const std::vector<IndexFormat>* Indices() const { return &m_indices; }
+		const std::vector<Vector3>* PositionsTransformed() const { return &m_ingest.PositionsTransformed(); }
+		const std::vector<Vector3>* PositionsNotTransformed() const { return &m_ingest.PositionsNotTransformed(); }
+		const std::vector<Vector3>* FaceNormals() const { return &m_ingest.FaceNormals(); }
+		IndexView Indices() const { return m_ingest.Indices(); }
+		const std::vector<AttributeChannel>* Attributes() const { return &m_ingest.Attributes(); }
+		const std::vector<uint8_t>* FloaterFaces() const { return &m_ingest.FloaterFaces(); }
+		const Windows::Foundation::Numerics::float4x4& MeshToWorld() const { return *reinterpret_cast<Windows::Foundation::Numerics::float4x4 const*>(m_ingest.MeshToWorld()); }
+		const Windows::Foundation::Numerics::float3& PositionScale() const { return *reinterpret_cast<Windows::Foundation::Numerics::float3 const*>(&m_ingest.PositionScale()); }
 		const SurfaceMeshProperties* GetSurfaceMeshProperties() const { return &m_meshProperties; }
 		Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexPositions() const { return m_vertexPositionsBuffer; }
 		Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexNormals() const { return m_vertexNormalsBuffer; }
 		Microsoft::WRL::ComPtr<ID3D11Buffer> GetTriangleIndices() const { return m_triangleIndicesBuffer; }
+		std::shared_ptr<SpatialIndex const> GetSpatialIndex() const { return m_ingest.GetSpatialIndex(); }
+		std::shared_ptr<SurfaceData const> GetExportData() const { return m_ingest.GetExportData(); }
+		std::shared_ptr<MeshClusters const> GetClusters() const { return m_ingest.GetClusters(); }
+
+		// The transform of the latest update into the coordinate system of the SurfaceCache.
+		// Returns false if the surface cannot be located relative to it.
+		bool TryGetCacheTransform(Windows::Perception::Spatial::SpatialCoordinateSystem^ cacheCoordSystem, CacheTransform& transform);
+
+		// The map that updates of this surface are aligned to when ICP_DRIFT_CORRECTION is set.
+		void SetSpatialMap(int const id, SpatialIndexCollection const* spatialMap) {
+			m_surfaceId = id;
+			m_spatialMap = spatialMap;
+		}
+
+		// Receives the raw buffers of every update when RECORD_SURFACES is set.
+		void SetRecorder(SurfaceRecorder* const recorder) { m_recorder = recorder; }
 
 
 		void IsActive(const bool& isActive) { m_isActive = isActive; }
@@ -84,22 +129,58 @@ namespace SpatialMapping
 
 	private:
 		void SwapVertexBuffers();
+		void RestoreVertexResources(ID3D11Device* device, Windows::Perception::Spatial::SpatialCoordinateSystem^ worldCoordSystem);
+		void LogDriftCorrection(IcpResult const& result) const;
 		void CreateDirectXBuffer(
 			ID3D11Device* device,
 			D3D11_BIND_FLAG binding,
 			Windows::Storage::Streams::IBuffer^ buffer,
 			ID3D11Buffer** target
 		);
+		void CreateDirectXBuffer(
+			ID3D11Device* device,
+			D3D11_BIND_FLAG binding,
+			void const* data,
+			size_t bytes,
+			ID3D11Buffer** target
+		);
 
+		// The last of the vertex tasks, each of which continues the one before.
 		concurrency::task<void> m_updateVertexResourcesTask = concurrency::task_from_result();
 
 		Windows::Perception::Spatial::Surfaces::SpatialSurfaceMesh^ m_pendingSurfaceMesh = nullptr;
 		Windows::Perception::Spatial::Surfaces::SpatialSurfaceMesh^ m_surfaceMesh = nullptr;
 
-		std::vector<float3> m_positionsTransformed;
-		std::vector<float3> m_positionsNotTransformed;
-		std::vector<float3> m_faceNormals;
-		std::vector<IndexFormat> m_indices;
+		// Kept while the surface shows the cached mesh, so that it is uploaded again after a
+		// device loss.
+		std::shared_ptr<SurfaceData const> m_pendingRestore;
+		std::shared_ptr<SurfaceData const> m_restoredSurface;
+		Windows::Perception::Spatial::SpatialCoordinateSystem^ m_cacheCoordSystem = nullptr;
+
+		// The traced updates on their way to the frame that swaps them in.
+		uint64_t m_pendingFlow = 0;
+		uint64_t m_pendingRestoreFlow = 0;
+		uint64_t m_updatedFlow = 0;
+		TraceClock::time_point m_updateReadyTime;
+
+		// For SurfaceMetrics: the observer events of the updates and the vertex tasks of this
+		// surface that are queued or running.
+		TraceClock::time_point m_pendingObserved;
+		TraceClock::time_point m_updatedObserved;
+		Gauge m_queuedTasks;
+
+		// Updated wherever a cache, buffer or pending mesh of the surface changes.
+		SurfaceMemory m_memory;
+
+		// The CPU caches, the spatial index and the export data of the last update.
+		SurfaceIngest m_ingest;
+
+		// Scratch of reordering the uploads, kept between the updates of the surface.
+		VertexCacheOptimizer m_vertexCache;
+
+		int m_surfaceId = 0;
+		SpatialIndexCollection const* m_spatialMap = nullptr;
+		SurfaceRecorder* m_recorder = nullptr;
 
 		Microsoft::WRL::ComPtr<ID3D11Buffer> m_vertexPositionsBuffer;
 		Microsoft::WRL::ComPtr<ID3D11Buffer> m_vertexNormalsBuffer;
@@ -119,6 +200,7 @@ namespace SpatialMapping
 		bool   m_constantBufferCreated = false;
 		bool   m_loadingComplete = false;
 		bool   m_updateReady = false;
+		bool   m_updatePending = false;
 		bool   m_isActive = false;
 		bool   m_isShuttingDown = false;
 		bool   m_isExpired = false;
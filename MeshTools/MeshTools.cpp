@@ -0,0 +1,4523 @@
+// Offline tools for the spatial maps exported by SpatialMappingMain::SaveAppState.
+// Only depends on the platform independent code in Processing/, so besides the Visual Studio
+// project it can be built on Linux with:
+//   g++ -std=c++17 -O2 -pthread -I.. MeshTools.cpp ../Processing/*.cpp -o MeshTools
+
+#include "Processing/DensityController.h"
+#include "Processing/DistanceEvaluator.h"
+#include "Processing/ExportPipeline.h"
+#include "Processing/FrameProfiler.h"
+#include "Processing/GlbFile.h"
+#include "Processing/Icp.h"
+#include "Processing/Json.h"
+#include "Processing/MapJournal.h"
+#include "Processing/MeshAttributes.h"
+#include "Processing/MeshClusters.h"
+#include "Processing/MeshCodec.h"
+#include "Processing/MeshComponents.h"
+#include "Processing/MeshDenoiser.h"
+#include "Processing/MemoryAccounting.h"
+#include "Processing/MeshNormals.h"
+#include "Processing/Metrics.h"
+#include "Processing/ObjReader.h"
+#include "Processing/ObjWriter.h"
+#include "Processing/ParallelFor.h"
+#include "Processing/Plane.h"
+#include "Processing/SpatialIndex.h"
+#include "Processing/SpatialMapFile.h"
+#include "Processing/SurfaceCache.h"
+#include "Processing/SurfaceIngest.h"
+#include "Processing/SurfaceRecording.h"
+#include "Processing/SurfaceTrace.h"
+#include "Processing/VertexCache.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	size_t const QueryBlockSize = 1024;
+
+	double MillisecondsSince(Clock::time_point const start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// The whole text as a finite number, false for anything else, e.g. a path given in its place.
+	bool TryParseFloat(std::string const& text, float& value)
+	{
+		char* end = nullptr;
+		float const parsed = std::strtof(text.c_str(), &end);
+		if (text.empty() || end != text.c_str() + text.size() || !std::isfinite(parsed))
+		{
+			return false;
+		}
+		value = parsed;
+		return true;
+	}
+
+	bool LoadMesh(std::string const& path, MeshData& mesh)
+	{
+		auto const start = Clock::now();
+		if (!ReadObj(path, mesh))
+		{
+			std::fprintf(stderr, "Could not read %s\n", path.c_str());
+			return false;
+		}
+
+		std::printf("Loaded %s: %zu vertices, %zu triangles, %zu objects (%.1f ms)\n",
+			path.c_str(), mesh.positions.size(), mesh.TriangleCount(), mesh.objects.size(), MillisecondsSince(start));
+		return true;
+	}
+
+	void PrintStatistics(char const* label, DistanceStatistics const& s)
+	{
+		// Distances are reported in millimeters, the captures are stored in meters.
+		std::printf("  %-22s n=%-7zu mean=%8.3f std=%8.3f rms=%8.3f min=%8.3f max=%8.3f\n",
+			label, s.count, s.mean * 1000., s.standardDeviation * 1000., s.rms * 1000., s.minimum * 1000., s.maximum * 1000.);
+
+		std::printf("  %-22s", "histogram [mm]");
+		float const binWidth = 2.f * s.histogramRange / s.histogram.size();
+		for (size_t i = 0; i < s.histogram.size(); i++)
+		{
+			if (s.histogram[i] > 0)
+			{
+				std::printf(" %+ld:%zu", std::lround((-s.histogramRange + i * binWidth) * 1000.f), s.histogram[i]);
+			}
+		}
+		std::printf("\n");
+	}
+
+	void PrintComparison(std::string const& capturePath, MeshData const& capture, MeshData const& reference)
+	{
+		auto const start = Clock::now();
+		MeshComparison const comparison = CompareMeshes(capture, reference);
+		double const elapsed = MillisecondsSince(start);
+
+		std::printf("%s\n", capturePath.c_str());
+		PrintStatistics("capture -> reference", comparison.captureToReference);
+		PrintStatistics("reference -> capture", comparison.referenceToCapture);
+		std::printf("  %-22s %.3f mm (%.1f ms)\n\n", "hausdorff", comparison.hausdorff * 1000., elapsed);
+	}
+
+	// MeshTools evaluate <reference.obj> <capture.obj>...
+	int Evaluate(std::vector<std::string> const& args)
+	{
+		if (args.size() < 2)
+		{
+			std::fprintf(stderr, "Usage: MeshTools evaluate <reference.obj> <capture.obj>...\n");
+			return EXIT_FAILURE;
+		}
+
+		MeshData reference;
+		if (!LoadMesh(args[0], reference))
+		{
+			return EXIT_FAILURE;
+		}
+
+		for (size_t i = 1; i < args.size(); i++)
+		{
+			MeshData capture;
+			if (!LoadMesh(args[i], capture))
+			{
+				return EXIT_FAILURE;
+			}
+			PrintComparison(args[i], capture, reference);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// MeshTools report [Data folder]
+	// Compares the plane-snapped captures in Data/Improved against the unprocessed 8000 capture.
+	int Report(std::vector<std::string> const& args)
+	{
+		std::string const data = args.empty() ? "Data" : args[0];
+		std::vector<std::string> const captures = {
+			"8000Improved_35.obj", "8000Improved_4.obj", "8000Improved_45.obj",
+			"8000Improved_5.obj", "8000Improved_55.obj", "8000Improved_6.obj"
+		};
+
+		std::vector<std::string> evaluateArgs = { data + "/NotImproved/Originals/8000Original.obj" };
+		for (auto const& capture : captures)
+		{
+			evaluateArgs.push_back(data + "/Improved/" + capture);
+		}
+		return Evaluate(evaluateArgs);
+	}
+
+	void PrintIcpResult(IcpResult const& result)
+	{
+		for (size_t i = 0; i < result.iterations.size(); i++)
+		{
+			auto const& iteration = result.iterations[i];
+			std::printf("  iteration %2zu: %8.2f ms, %7zu pairs, rms %8.3f mm\n",
+				i, iteration.milliseconds, iteration.correspondences, iteration.rms * 1000.);
+		}
+
+		auto const& m = result.transform.rotation;
+		double const cosine = std::max(-1.0, std::min(1.0, (m[0] + m[4] + m[8] - 1.0) / 2.0));
+		auto const& t = result.transform.translation;
+		std::printf("  %s after %zu iterations: rotation %.3f deg, translation (%.4f, %.4f, %.4f) m\n",
+			result.converged ? "converged" : "stopped", result.iterations.size(),
+			std::acos(cosine) * 180.0 / 3.14159265358979323846, t.x, t.y, t.z);
+	}
+
+	// MeshTools icp <target.obj> <source.obj> [--surfaces] [--budget ms] [rx ry rz tx ty tz]
+	// Aligns the source capture to the target, either as a whole or every surface ("o" object)
+	// on its own. The optional rotation in degrees and translation in meters perturb the source
+	// first, which turns a capture into its own ground truth.
+	int AlignCaptures(std::vector<std::string> const& args)
+	{
+		std::vector<std::string> paths;
+		std::vector<float> perturbation;
+		bool perSurface = false;
+		IcpOptions options;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--surfaces")
+			{
+				perSurface = true;
+			}
+			else if (args[i] == "--budget" && i + 1 < args.size())
+			{
+				options.timeBudgetMilliseconds = std::stod(args[++i]);
+			}
+			else if (paths.size() < 2)
+			{
+				paths.push_back(args[i]);
+			}
+			else
+			{
+				perturbation.push_back(std::stof(args[i]));
+			}
+		}
+
+		if (paths.size() < 2 || (!perturbation.empty() && perturbation.size() != 6))
+		{
+			std::fprintf(stderr, "Usage: MeshTools icp <target.obj> <source.obj> [--surfaces] [--budget ms] [rx ry rz tx ty tz]\n");
+			return EXIT_FAILURE;
+		}
+
+		MeshData target;
+		MeshData source;
+		if (!LoadMesh(paths[0], target) || !LoadMesh(paths[1], source))
+		{
+			return EXIT_FAILURE;
+		}
+
+		auto start = Clock::now();
+		std::vector<Vector3> normals;
+		ComputeVertexNormals(target.positions.data(), target.positions.size(), target.indices.data(), target.indices.size(), normals);
+		SpatialIndex index;
+		index.Build(target.positions.data(), target.positions.size(), options.maxCorrespondenceDistance, normals.data());
+		std::printf("Target index with normals: %.1f ms\n", MillisecondsSince(start));
+
+		if (!perturbation.empty())
+		{
+			float const toRadians = 3.14159265f / 180.f;
+			Vector3 const r{ perturbation[0] * toRadians, perturbation[1] * toRadians, perturbation[2] * toRadians };
+			Vector3 const t{ perturbation[3], perturbation[4], perturbation[5] };
+			ApplyTransform(RigidTransform::FromRotationVector(r, t), source.positions.data(), source.positions.size());
+		}
+
+		if (!perSurface)
+		{
+			start = Clock::now();
+			IcpResult const result = AlignToIndex(source.positions.data(), source.positions.size(), index, options);
+			std::printf("%s -> %s (%.1f ms)\n", paths[1].c_str(), paths[0].c_str(), MillisecondsSince(start));
+			PrintIcpResult(result);
+			return EXIT_SUCCESS;
+		}
+
+		for (auto const& object : source.objects)
+		{
+			start = Clock::now();
+			IcpResult const result = AlignToIndex(source.positions.data() + object.firstVertex, object.vertexCount, index, options);
+			std::printf("%s: %u vertices (%.1f ms)\n", object.name.c_str(), object.vertexCount, MillisecondsSince(start));
+			PrintIcpResult(result);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// MeshTools components [--min-triangles n] [--min-area m2] <capture.obj>...
+	// Floater removal per surface, as SurfaceMesh does it on ingestion, and what it saves
+	// further down the pipeline: the face normal pass stands in for per-triangle work.
+	int FilterComponents(std::vector<std::string> const& args)
+	{
+		ComponentFilterOptions options;
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--min-triangles" && i + 1 < args.size())
+			{
+				options.minTriangles = std::stoul(args[++i]);
+			}
+			else if (args[i] == "--min-area" && i + 1 < args.size())
+			{
+				options.minArea = std::stof(args[++i]);
+			}
+			else
+			{
+				paths.push_back(args[i]);
+			}
+		}
+
+		if (paths.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools components [--min-triangles n] [--min-area m2] <capture.obj>...\n");
+			return EXIT_FAILURE;
+		}
+
+		std::printf("Floaters: fewer than %zu triangles or less than %.4f m^2\n", options.minTriangles, options.minArea);
+		MeshComponents components;
+		for (auto const& path : paths)
+		{
+			MeshData mesh;
+			if (!LoadMesh(path, mesh))
+			{
+				return EXIT_FAILURE;
+			}
+
+			// Every surface is labeled on its own with surface-local indices, like on ingestion.
+			// The first pass grows the buffers, the timed second pass is the steady state.
+			std::vector<uint32_t> localIndices;
+			ComponentFilterResult total;
+			double filterMs = 0.;
+			for (int pass = 0; pass < 2; pass++)
+			{
+				total = {};
+				auto const start = Clock::now();
+				for (auto const& object : mesh.objects)
+				{
+					localIndices.assign(mesh.indices.begin() + object.firstIndex, mesh.indices.begin() + object.firstIndex + object.indexCount);
+					for (auto& index : localIndices)
+					{
+						index -= object.firstVertex;
+					}
+
+					components.Label(mesh.positions.data() + object.firstVertex, object.vertexCount, localIndices.data(), localIndices.size());
+					ComponentFilterResult result;
+					components.RemoveFloaters(localIndices.data(), localIndices.size(), options, result);
+					total.components += result.components;
+					total.removedComponents += result.removedComponents;
+					total.removedTriangles += result.removedTriangles;
+					total.removedArea += result.removedArea;
+				}
+				filterMs = MillisecondsSince(start);
+			}
+
+			auto const start = Clock::now();
+			std::vector<Vector3> faceNormals;
+			faceNormals.reserve(mesh.TriangleCount());
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			{
+				auto const& a = mesh.positions[mesh.indices[i]];
+				faceNormals.push_back(Normalize(Cross(mesh.positions[mesh.indices[i + 1]] - a, mesh.positions[mesh.indices[i + 2]] - a)));
+			}
+			double const perTriangleNs = MillisecondsSince(start) * 1e6 / mesh.TriangleCount();
+
+			std::printf("  %zu components, %zu floaters: %zu of %zu triangles (%.2f%%, %.4f m^2) removed\n",
+				total.components, total.removedComponents, total.removedTriangles, mesh.TriangleCount(),
+				100. * total.removedTriangles / mesh.TriangleCount(), total.removedArea);
+			std::printf("  labeling and filtering %.3f ms, saves %.3f ms per face normal pass (%.1f ns per triangle)\n",
+				filterMs, total.removedTriangles * perTriangleNs * 1e-6, perTriangleNs);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	DistanceStatistics PlaneResiduals(std::vector<Vector3> const& points, Plane const& plane)
+	{
+		std::vector<float> distances(points.size());
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			distances[i] = plane.SignedDistance(points[i]);
+		}
+		return SummarizeDistances(distances, 20, 0.05f);
+	}
+
+	// MeshTools denoise [--iterations n] [--budget ms] [--sigma m] <mesh.obj>...
+	// Bilateral denoising of each mesh as a whole. For planar sections such as
+	// Data/Improved/LeftWallSection.obj the residuals to the least-squares plane of the input
+	// measure the noise before and after.
+	int Denoise(std::vector<std::string> const& args)
+	{
+		DenoiseOptions options;
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--iterations" && i + 1 < args.size())
+			{
+				options.iterations = std::stoi(args[++i]);
+			}
+			else if (args[i] == "--budget" && i + 1 < args.size())
+			{
+				options.timeBudgetMilliseconds = std::stod(args[++i]);
+			}
+			else if (args[i] == "--sigma" && i + 1 < args.size())
+			{
+				options.spatialSigma = std::stof(args[++i]);
+			}
+			else
+			{
+				paths.push_back(args[i]);
+			}
+		}
+
+		if (paths.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools denoise [--iterations n] [--budget ms] [--sigma m] <mesh.obj>...\n");
+			return EXIT_FAILURE;
+		}
+
+		MeshDenoiser denoiser;
+		for (auto const& path : paths)
+		{
+			MeshData mesh;
+			if (!LoadMesh(path, mesh))
+			{
+				return EXIT_FAILURE;
+			}
+
+			std::vector<Vector3> const before = ReferencedPositions(mesh);
+			Plane const plane = FitPlane(before.data(), before.size());
+
+			DenoiseResult const result = denoiser.Denoise(mesh.positions.data(), mesh.positions.size(), mesh.indices.data(), mesh.indices.size(), options);
+			std::vector<Vector3> const after = ReferencedPositions(mesh);
+
+			std::printf("%s: %d iterations in %.2f ms, %.2f M vertices/s per iteration\n",
+				path.c_str(), result.iterations, result.milliseconds,
+				result.iterations > 0 ? mesh.positions.size() * result.iterations / (result.milliseconds * 1000.) : 0.);
+			PrintStatistics("plane residual before", PlaneResiduals(before, plane));
+			PrintStatistics("plane residual after", PlaneResiduals(after, plane));
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Surface caches as SurfaceMesh keeps them: local 32 bit indices and one normal per face.
+	// The not-transformed positions are a rigid transform of the loaded ones.
+	struct ExportSurfaces
+	{
+		std::vector<std::vector<uint32_t>> indices;
+		std::vector<Vector3> notTransformed;
+		std::vector<ObjSurface> surfaces;
+	};
+
+	void MakeExportSurfaces(MeshData const& mesh, ExportSurfaces& result)
+	{
+		RigidTransform const toLocal = RigidTransform::FromRotationVector({ 0.1f, -0.4f, 0.05f }, { -1.f, 0.2f, 0.5f });
+		result.notTransformed = mesh.positions;
+		ApplyTransform(toLocal, result.notTransformed.data(), result.notTransformed.size());
+
+		result.indices.resize(mesh.objects.size());
+		result.surfaces.resize(mesh.objects.size());
+		for (size_t o = 0; o < mesh.objects.size(); o++)
+		{
+			auto const& object = mesh.objects[o];
+			auto& indices = result.indices[o];
+			indices.assign(mesh.indices.begin() + object.firstIndex, mesh.indices.begin() + object.firstIndex + object.indexCount);
+			for (auto& index : indices)
+			{
+				index -= object.firstVertex;
+			}
+
+			auto& surface = result.surfaces[o];
+			surface.id = static_cast<int>(o);
+			surface.positionsTransformed = mesh.positions.data() + object.firstVertex;
+			surface.positionsNotTransformed = result.notTransformed.data() + object.firstVertex;
+			surface.vertexCount = object.vertexCount;
+			surface.faceNormals = mesh.faceNormals.data() + object.firstIndex / 3;
+			surface.faceNormalCount = object.indexCount / 3;
+			surface.indices = IndexView(indices.data(), indices.size());
+		}
+	}
+
+	// The std::ofstream exporter SaveAppState used before ObjWriter, kept as the reference for
+	// its output and speed.
+	void WriteObjStreams(std::vector<ObjSurface> const& surfaces, std::ostream& fileOutTransformed, std::ostream& fileOutNotTransformed)
+	{
+		fileOutTransformed << "mtllib Mesh.mtl\n";
+		fileOutNotTransformed << "mtllib Mesh.mtl\n";
+
+		int index_base_offset = 0;
+		for (auto const& mesh : surfaces)
+		{
+			fileOutTransformed << "o mesh_" << mesh.id << "\n";
+			fileOutNotTransformed << "o mesh_" << mesh.id << "\n";
+
+			for (size_t i = 0; i < mesh.vertexCount; i++)
+			{
+				auto const& p = mesh.positionsTransformed[i];
+				fileOutTransformed << "v " << p.x << " " << p.y << " " << p.z << "\n";
+			}
+			for (size_t i = 0; i < mesh.vertexCount; i++)
+			{
+				auto const& p = mesh.positionsNotTransformed[i];
+				fileOutNotTransformed << "v " << p.x << " " << p.y << " " << p.z << "\n";
+			}
+			for (size_t i = 0; i < mesh.faceNormalCount; i++)
+			{
+				auto const& n = mesh.faceNormals[i];
+				fileOutTransformed << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+				fileOutNotTransformed << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+			}
+
+			fileOutTransformed << "s off\n";
+			fileOutNotTransformed << "s off\n";
+
+			float const noFaces = mesh.indices.count / 3.f;
+			float const mtlIncrement = 1000.f / noFaces;
+			float mtlNumber = 1.f;
+
+			for (int i = 0; i < static_cast<int>(mesh.indices.count); i += 3)
+			{
+				fileOutTransformed << "usemtl Material." << std::setw(4) << std::setfill('0') << (int)std::floor(mtlNumber) << "\n";
+				fileOutNotTransformed << "usemtl Material." << std::setw(4) << std::setfill('0') << (int)std::floor(mtlNumber) << "\n";
+
+				int const i1 = mesh.indices[i] + index_base_offset + 1;
+				int const i2 = mesh.indices[i + 1] + index_base_offset + 1;
+				int const i3 = mesh.indices[i + 2] + index_base_offset + 1;
+				int const n_index = (i / 3) + index_base_offset + 1;
+
+				fileOutTransformed << "f " << i1 << "//" << n_index << " " << i2 << "//" << n_index << " " << i3 << "//" << n_index << "\n";
+				fileOutNotTransformed << "f " << i1 << "//" << n_index << " " << i2 << "//" << n_index << " " << i3 << "//" << n_index << "\n";
+
+				mtlNumber += mtlIncrement;
+			}
+
+			index_base_offset += static_cast<int>(mesh.vertexCount);
+		}
+	}
+
+	// MeshTools bench-export <capture.obj> [output folder] [repetitions]
+	// Exports the capture's surfaces with the former stream exporter and with ObjWriter, checks
+	// that the files are byte-identical and compares the times.
+	int BenchmarkExport(std::vector<std::string> const& args)
+	{
+		if (args.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-export <capture.obj> [output folder] [repetitions]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::string const folder = args.size() > 1 ? args[1] : ".";
+		int const repetitions = args.size() > 2 ? std::stoi(args[2]) : 5;
+
+		MeshData mesh;
+		if (!LoadMesh(args[0], mesh))
+		{
+			return EXIT_FAILURE;
+		}
+
+		ExportSurfaces surfaces;
+		MakeExportSurfaces(mesh, surfaces);
+
+		std::string const streamT = folder + "/stream_transformed.obj";
+		std::string const streamNT = folder + "/stream_not_transformed.obj";
+		std::string const writerT = folder + "/writer_transformed.obj";
+		std::string const writerNT = folder + "/writer_not_transformed.obj";
+
+		double streamMs = 1e30;
+		double writerMs = 1e30;
+		ObjWriter writer;
+		for (int r = 0; r < repetitions; r++)
+		{
+			auto start = Clock::now();
+			{
+				std::ofstream fileOutTransformed(streamT, std::ios::out);
+				std::ofstream fileOutNotTransformed(streamNT, std::ios::out);
+				WriteObjStreams(surfaces.surfaces, fileOutTransformed, fileOutNotTransformed);
+			}
+			streamMs = std::min(streamMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			if (!writer.Write(surfaces.surfaces, writerT, writerNT))
+			{
+				std::fprintf(stderr, "Could not write to %s\n", folder.c_str());
+				return EXIT_FAILURE;
+			}
+			writerMs = std::min(writerMs, MillisecondsSince(start));
+		}
+
+		auto const readFile = [](std::string const& path)
+		{
+			std::ifstream file(path, std::ios::binary);
+			return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		};
+		bool const identical = readFile(streamT) == readFile(writerT) && readFile(streamNT) == readFile(writerNT);
+		size_t const bytes = readFile(writerT).size() + readFile(writerNT).size();
+
+		std::printf("%zu surfaces, %.1f MB in two files, best of %d, %zu workers\n",
+			surfaces.surfaces.size(), bytes / 1e6, repetitions, WorkerCount());
+		std::printf("  std::ofstream  %8.1f ms  %7.1f MB/s\n", streamMs, bytes / 1e3 / streamMs);
+		std::printf("  ObjWriter      %8.1f ms  %7.1f MB/s  (%.1fx)\n", writerMs, bytes / 1e3 / writerMs, streamMs / writerMs);
+		std::printf("  output %s\n", identical ? "byte-identical" : "DIFFERS");
+		return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// The surface id of an "o mesh_<id>" object, its position in the file for other names.
+	int SurfaceId(MeshObject const& object, size_t const ordinal)
+	{
+		if (object.name.compare(0, 5, "mesh_") == 0 && object.name.size() > 5)
+		{
+			char* end = nullptr;
+			long const id = std::strtol(object.name.c_str() + 5, &end, 10);
+			if (*end == '\0')
+			{
+				return static_cast<int>(id);
+			}
+		}
+		return static_cast<int>(ordinal);
+	}
+
+	struct MapSurfaces
+	{
+		std::vector<std::vector<uint32_t>> indices;
+		std::vector<SpatialMapSurface> surfaces;
+	};
+
+	// Splits an export into its surfaces. The not-transformed export, if given, must have the
+	// same objects and provides the local positions.
+	bool MakeMapSurfaces(MeshData const& mesh, MeshData const* local, MapSurfaces& result)
+	{
+		if (local && (local->objects.size() != mesh.objects.size() || local->positions.size() != mesh.positions.size()))
+		{
+			std::fprintf(stderr, "The not-transformed export does not match the transformed one\n");
+			return false;
+		}
+
+		result.indices.resize(mesh.objects.size());
+		result.surfaces.resize(mesh.objects.size());
+		for (size_t o = 0; o < mesh.objects.size(); o++)
+		{
+			auto const& object = mesh.objects[o];
+			auto& indices = result.indices[o];
+			indices.assign(mesh.indices.begin() + object.firstIndex, mesh.indices.begin() + object.firstIndex + object.indexCount);
+			for (auto& index : indices)
+			{
+				index -= object.firstVertex;
+			}
+
+			auto& surface = result.surfaces[o];
+			surface.id = SurfaceId(object, o);
+			surface.positions = mesh.positions.data() + object.firstVertex;
+			surface.localPositions = local ? local->positions.data() + object.firstVertex : nullptr;
+			surface.vertexCount = object.vertexCount;
+			surface.faceNormals = mesh.faceNormals.data() + object.firstIndex / 3;
+			surface.faceNormalCount = object.indexCount / 3;
+			surface.indices = IndexView(indices.data(), indices.size());
+		}
+		return true;
+	}
+
+	// MeshTools to-binary [--compress precision] <map.smap> <transformed.obj> [not_transformed.obj]
+	// The OBJ export has no transforms, they are stored as identity. --compress stores the
+	// surfaces with MeshCodec at the given precision in meters, 0 for lossless.
+	int ConvertToBinary(std::vector<std::string> args)
+	{
+		MeshCodecOptions compression;
+		bool const compress = !args.empty() && args[0] == "--compress";
+		bool validPrecision = true;
+		if (compress)
+		{
+			validPrecision = args.size() > 1 && TryParseFloat(args[1], compression.positionPrecision) && compression.positionPrecision >= 0.f;
+			args.erase(args.begin(), args.begin() + std::min<size_t>(args.size(), 2));
+		}
+		if (!validPrecision || args.size() < 2)
+		{
+			std::fprintf(stderr, "Usage: MeshTools to-binary [--compress precision] <map.smap> <transformed.obj> [not_transformed.obj]\n");
+			return EXIT_FAILURE;
+		}
+
+		MeshData mesh;
+		MeshData local;
+		bool const hasLocal = args.size() > 2;
+		if (!LoadMesh(args[1], mesh) || (hasLocal && !LoadMesh(args[2], local)))
+		{
+			return EXIT_FAILURE;
+		}
+
+		MapSurfaces surfaces;
+		if (!MakeMapSurfaces(mesh, hasLocal ? &local : nullptr, surfaces))
+		{
+			return EXIT_FAILURE;
+		}
+
+		auto const start = Clock::now();
+		if (!SpatialMapFile::Write(args[0], surfaces.surfaces, compress ? &compression : nullptr))
+		{
+			std::fprintf(stderr, "Could not write %s\n", args[0].c_str());
+			return EXIT_FAILURE;
+		}
+		double const ms = MillisecondsSince(start);
+		std::printf("Wrote %s: %zu surfaces, %.1f KB (%.1f ms)\n", args[0].c_str(), surfaces.surfaces.size(),
+			std::filesystem::file_size(args[0]) / 1e3, ms);
+		return EXIT_SUCCESS;
+	}
+
+	// MeshTools to-obj <map.smap> <transformed.obj> <not_transformed.obj>
+	// Writes the same files as SaveAppState. Maps without local positions get the world-space
+	// ones in both files.
+	int ConvertToObj(std::vector<std::string> const& args)
+	{
+		if (args.size() < 3)
+		{
+			std::fprintf(stderr, "Usage: MeshTools to-obj <map.smap> <transformed.obj> <not_transformed.obj>\n");
+			return EXIT_FAILURE;
+		}
+
+		SpatialMapFile map;
+		if (!map.Open(args[0]))
+		{
+			std::fprintf(stderr, "Could not read %s\n", args[0].c_str());
+			return EXIT_FAILURE;
+		}
+
+		std::vector<ObjSurface> surfaces;
+		for (auto const& mapSurface : map.Surfaces())
+		{
+			ObjSurface surface;
+			surface.id = mapSurface.id;
+			surface.positionsTransformed = mapSurface.positions;
+			surface.positionsNotTransformed = mapSurface.localPositions ? mapSurface.localPositions : mapSurface.positions;
+			surface.vertexCount = mapSurface.vertexCount;
+			surface.faceNormals = mapSurface.faceNormals;
+			surface.faceNormalCount = mapSurface.faceNormalCount;
+			surface.indices = mapSurface.indices;
+			surfaces.push_back(surface);
+		}
+
+		auto const start = Clock::now();
+		ObjWriter writer;
+		if (!writer.Write(surfaces, args[1], args[2]))
+		{
+			std::fprintf(stderr, "Could not write %s\n", args[1].c_str());
+			return EXIT_FAILURE;
+		}
+		std::printf("Wrote %s and %s: %zu surfaces (%.1f ms)\n", args[1].c_str(), args[2].c_str(), surfaces.size(), MillisecondsSince(start));
+		return EXIT_SUCCESS;
+	}
+
+	bool SameBits(void const* a, void const* b, size_t const bytes)
+	{
+		return bytes == 0 || std::memcmp(a, b, bytes) == 0;
+	}
+
+	bool SameMesh(MeshData const& a, MeshData const& b)
+	{
+		bool same = a.positions.size() == b.positions.size() && a.faceNormals.size() == b.faceNormals.size() &&
+			a.indices == b.indices && a.objects.size() == b.objects.size() &&
+			a.materials == b.materials && a.faceMaterials == b.faceMaterials &&
+			SameBits(a.positions.data(), b.positions.data(), a.positions.size() * sizeof(Vector3)) &&
+			SameBits(a.faceNormals.data(), b.faceNormals.data(), a.faceNormals.size() * sizeof(Vector3));
+		for (size_t o = 0; same && o < a.objects.size(); o++)
+		{
+			same = a.objects[o].name == b.objects[o].name &&
+				a.objects[o].firstVertex == b.objects[o].firstVertex && a.objects[o].vertexCount == b.objects[o].vertexCount &&
+				a.objects[o].firstIndex == b.objects[o].firstIndex && a.objects[o].indexCount == b.objects[o].indexCount;
+		}
+		return same;
+	}
+
+	// MeshTools bench-objread [--repetitions n] <file.obj>...
+	// ReadObj throughput on one thread and on all workers, with and without the materials,
+	// and whether all of them read the same mesh. The files are in the page cache.
+	int BenchmarkObjRead(std::vector<std::string> const& args)
+	{
+		int repetitions = 10;
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--repetitions" && i + 1 < args.size())
+			{
+				repetitions = std::stoi(args[++i]);
+			}
+			else
+			{
+				paths.push_back(args[i]);
+			}
+		}
+		if (paths.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-objread [--repetitions n] <file.obj>...\n");
+			return EXIT_FAILURE;
+		}
+
+		std::printf("%zu workers, best of %d, MB/s\n", WorkerCount(), repetitions);
+		std::printf("%-44s %8s %10s %10s %12s %12s\n", "file", "MB", "1 thread", "all", "1 + mtl", "all + mtl");
+		bool same = true;
+		for (auto const& path : paths)
+		{
+			double const megabytes = std::filesystem::file_size(path) / 1e6;
+			MeshData reference;
+			if (!ReadObj(path, reference, {}))
+			{
+				std::fprintf(stderr, "Could not read %s\n", path.c_str());
+				return EXIT_FAILURE;
+			}
+
+			double rates[4];
+			bool fileSame = true;
+			for (size_t run = 0; run < 4; run++)
+			{
+				ObjReadOptions options;
+				options.maxWorkers = run % 2 == 0 ? 1 : 0;
+				options.materials = run >= 2;
+
+				MeshData mesh;
+				double best = 1e30;
+				for (int r = 0; r < repetitions; r++)
+				{
+					auto const start = Clock::now();
+					ReadObj(path, mesh, options);
+					best = std::min(best, MillisecondsSince(start));
+				}
+				rates[run] = megabytes * 1e3 / best;
+
+				if (options.materials)
+				{
+					reference.materials = mesh.materials;
+					reference.faceMaterials = mesh.faceMaterials;
+				}
+				fileSame = fileSame && SameMesh(reference, mesh);
+			}
+			same = same && fileSame;
+
+			std::string const name = std::filesystem::path(path).filename().string();
+			std::printf("%-44s %8.2f %10.1f %10.1f %12.1f %12.1f%s\n",
+				name.c_str(), megabytes, rates[0], rates[1], rates[2], rates[3], fileSame ? "" : "  DIFFERS");
+		}
+		return same ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// MeshTools bench-load <capture.obj> [output folder] [repetitions]
+	// Converts the capture and compares loading the OBJ with ReadObj against mapping the binary
+	// file, alone, with every byte touched and with a copy into a MeshData. Both files are in
+	// the page cache, so this is the parsing cost rather than the disk.
+	int BenchmarkLoad(std::vector<std::string> const& args)
+	{
+		if (args.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-load <capture.obj> [output folder] [repetitions]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::string const folder = args.size() > 1 ? args[1] : ".";
+		int const repetitions = args.size() > 2 ? std::stoi(args[2]) : 5;
+		std::string const mapPath = folder + "/bench_load.smap";
+		std::string const compressedPath = folder + "/bench_load_compressed.smap";
+
+		MeshData mesh;
+		if (!LoadMesh(args[0], mesh))
+		{
+			return EXIT_FAILURE;
+		}
+		MapSurfaces surfaces;
+		MakeMapSurfaces(mesh, nullptr, surfaces);
+		MeshCodecOptions const compression;
+		if (!SpatialMapFile::Write(mapPath, surfaces.surfaces) || !SpatialMapFile::Write(compressedPath, surfaces.surfaces, &compression))
+		{
+			std::fprintf(stderr, "Could not write %s\n", mapPath.c_str());
+			return EXIT_FAILURE;
+		}
+
+		double objMs = 1e30;
+		double openMs = 1e30;
+		double touchMs = 1e30;
+		double copyMs = 1e30;
+		double decodeMs = 1e30;
+		uint64_t checksum = 0;
+		MeshData fromObj;
+		MeshData fromMap;
+		for (int r = 0; r < repetitions; r++)
+		{
+			auto start = Clock::now();
+			ReadObj(args[0], fromObj);
+			objMs = std::min(objMs, MillisecondsSince(start));
+
+			SpatialMapFile map;
+			start = Clock::now();
+			map.Open(mapPath);
+			openMs = std::min(openMs, MillisecondsSince(start));
+			map.Close();
+
+			start = Clock::now();
+			map.Open(mapPath);
+			for (auto const& surface : map.Surfaces())
+			{
+				for (size_t i = 0; i < surface.vertexCount; i++)
+				{
+					checksum += static_cast<uint64_t>(static_cast<int64_t>(surface.positions[i].x * 1000.f));
+				}
+				for (size_t i = 0; i < surface.indices.count; i++)
+				{
+					checksum += surface.indices[i];
+				}
+				for (size_t i = 0; i < surface.faceNormalCount; i++)
+				{
+					checksum += static_cast<uint64_t>(static_cast<int64_t>(surface.faceNormals[i].y * 1000.f));
+				}
+			}
+			touchMs = std::min(touchMs, MillisecondsSince(start));
+			map.Close();
+
+			start = Clock::now();
+			map.Open(mapPath);
+			ToMeshData(map.Surfaces(), fromMap);
+			copyMs = std::min(copyMs, MillisecondsSince(start));
+			map.Close();
+
+			start = Clock::now();
+			map.Open(compressedPath);
+			decodeMs = std::min(decodeMs, MillisecondsSince(start));
+		}
+
+		bool identical = fromObj.positions.size() == fromMap.positions.size() &&
+			fromObj.indices == fromMap.indices &&
+			fromObj.faceNormals.size() == fromMap.faceNormals.size() &&
+			fromObj.objects.size() == fromMap.objects.size() &&
+			SameBits(fromObj.positions.data(), fromMap.positions.data(), fromObj.positions.size() * sizeof(Vector3)) &&
+			SameBits(fromObj.faceNormals.data(), fromMap.faceNormals.data(), fromObj.faceNormals.size() * sizeof(Vector3));
+		for (size_t o = 0; identical && o < fromObj.objects.size(); o++)
+		{
+			identical = fromObj.objects[o].firstVertex == fromMap.objects[o].firstVertex &&
+				fromObj.objects[o].indexCount == fromMap.objects[o].indexCount;
+		}
+
+		auto const fileSize = [](std::string const& path)
+		{
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			return static_cast<double>(file.tellg());
+		};
+		double const objBytes = fileSize(args[0]);
+		double const mapBytes = fileSize(mapPath);
+		double const compressedBytes = fileSize(compressedPath);
+
+		std::printf("OBJ %.1f MB, binary %.1f MB (%.1f%%), best of %d (checksum %llu)\n",
+			objBytes / 1e6, mapBytes / 1e6, 100. * mapBytes / objBytes, repetitions, static_cast<unsigned long long>(checksum));
+		std::printf("  ReadObj             %8.2f ms  %8.1f MB/s\n", objMs, objBytes / 1e3 / objMs);
+		std::printf("  map                 %8.3f ms  (%.0fx)\n", openMs, objMs / openMs);
+		std::printf("  map + read all      %8.3f ms  (%.0fx)\n", touchMs, objMs / touchMs);
+		std::printf("  map + ToMeshData    %8.3f ms  (%.0fx)\n", copyMs, objMs / copyMs);
+		std::printf("  compressed %.1f MB  %8.3f ms  %8.1f MB/s decoded\n", compressedBytes / 1e6, decodeMs, mapBytes / 1e3 / decodeMs);
+		std::printf("  geometry %s\n", identical ? "bit-identical" : "DIFFERS");
+		return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// MeshTools replay <journal path> [save index <transformed.obj> <not_transformed.obj>]
+	// Lists the saves of a journaled map, or writes the map of one of them as an OBJ export.
+	int Replay(std::vector<std::string> const& args)
+	{
+		if (args.size() != 1 && args.size() != 4)
+		{
+			std::fprintf(stderr, "Usage: MeshTools replay <journal path> [save index <transformed.obj> <not_transformed.obj>]\n");
+			return EXIT_FAILURE;
+		}
+
+		MapReplay replay;
+		if (!replay.Open(args[0]))
+		{
+			std::fprintf(stderr, "No saves in %s\n", args[0].c_str());
+			return EXIT_FAILURE;
+		}
+
+		if (args.size() == 1)
+		{
+			std::printf("%8s %20s %10s %10s %10s\n", "save", "time", "surfaces", "written", "expired");
+			for (auto const& point : replay.SavePoints())
+			{
+				std::printf("%8u %20lld %10zu %10zu %10zu\n", point.saveIndex, static_cast<long long>(point.saveTime),
+					point.surfaceCount, point.writtenSurfaces, point.expiredSurfaces);
+			}
+			return EXIT_SUCCESS;
+		}
+
+		std::vector<SpatialMapSurface> mapSurfaces;
+		if (!replay.Reconstruct(static_cast<uint32_t>(std::stoul(args[1])), mapSurfaces))
+		{
+			std::fprintf(stderr, "Save %s is not in %s\n", args[1].c_str(), args[0].c_str());
+			return EXIT_FAILURE;
+		}
+
+		std::vector<ObjSurface> surfaces;
+		for (auto const& mapSurface : mapSurfaces)
+		{
+			ObjSurface surface;
+			surface.id = mapSurface.id;
+			surface.positionsTransformed = mapSurface.positions;
+			surface.positionsNotTransformed = mapSurface.localPositions ? mapSurface.localPositions : mapSurface.positions;
+			surface.vertexCount = mapSurface.vertexCount;
+			surface.faceNormals = mapSurface.faceNormals;
+			surface.faceNormalCount = mapSurface.faceNormalCount;
+			surface.indices = mapSurface.indices;
+			surfaces.push_back(surface);
+		}
+
+		ObjWriter writer;
+		if (!writer.Write(surfaces, args[2], args[3]))
+		{
+			std::fprintf(stderr, "Could not write %s\n", args[2].c_str());
+			return EXIT_FAILURE;
+		}
+		std::printf("Wrote save %s: %zu surfaces\n", args[1].c_str(), surfaces.size());
+		return EXIT_SUCCESS;
+	}
+
+	uint64_t HashSurface(SpatialMapSurface const& surface)
+	{
+		// FNV-1a over the update time and the positions.
+		uint64_t hash = 14695981039346656037ull;
+		auto const add = [&hash](void const* data, size_t const bytes)
+		{
+			for (size_t i = 0; i < bytes; i++)
+			{
+				hash = (hash ^ static_cast<unsigned char const*>(data)[i]) * 1099511628211ull;
+			}
+		};
+		add(&surface.updateTime, sizeof(surface.updateTime));
+		add(surface.positions, surface.vertexCount * sizeof(Vector3));
+		return hash;
+	}
+
+	// MeshTools bench-journal <capture.obj> [output folder] [saves]
+	// Simulates a session of saves in which a fraction of the surfaces is updated between
+	// saves, one surface expires every fifth save and comes back two saves later. Compares a
+	// journal save with a full rewrite, compacts concurrently with the saves halfway through
+	// and checks that every save point replays to the map that was saved.
+	int BenchmarkJournal(std::vector<std::string> const& args)
+	{
+		if (args.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-journal <capture.obj> [output folder] [saves]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::string const folder = args.size() > 1 ? args[1] : ".";
+		int const saves = args.size() > 2 ? std::stoi(args[2]) : 20;
+		std::string const journalPath = folder + "/bench_journal";
+
+		MeshData mesh;
+		if (!LoadMesh(args[0], mesh))
+		{
+			return EXIT_FAILURE;
+		}
+		MapSurfaces capture;
+		MakeMapSurfaces(mesh, nullptr, capture);
+
+		ExportSurfaces exportSurfaces;
+		MakeExportSurfaces(mesh, exportSurfaces);
+		ObjWriter writer;
+		auto start = Clock::now();
+		writer.Write(exportSurfaces.surfaces, folder + "/bench_journal_t.obj", folder + "/bench_journal_nt.obj");
+		double const objMs = MillisecondsSince(start);
+
+		std::printf("%zu surfaces, %d saves, full OBJ export %.1f ms\n", capture.surfaces.size(), saves, objMs);
+		std::printf("%9s %9s %14s %14s %12s %14s %8s\n", "updated", "written", "journal [ms]", "full map [ms]", "journal [KB]", "compact [ms]", "replay");
+
+		bool allReplayed = true;
+		uint32_t finalSaveIndex = 0;
+		for (double const fraction : { 0., 0.02, 0.1, 0.5, 1. })
+		{
+			for (char const* extension : { ".snapshot", ".compacting", ".journal" })
+			{
+				std::remove((journalPath + extension).c_str());
+			}
+
+			// Owned copies of the positions, so that updates can change them.
+			std::vector<std::vector<Vector3>> positions(capture.surfaces.size());
+			std::vector<SpatialMapSurface> surfaces = capture.surfaces;
+			for (size_t s = 0; s < surfaces.size(); s++)
+			{
+				positions[s].assign(surfaces[s].positions, surfaces[s].positions + surfaces[s].vertexCount);
+				surfaces[s].positions = positions[s].data();
+				surfaces[s].updateTime = 1;
+			}
+
+			MapJournal journal;
+			journal.Open(journalPath);
+			journal.Save(surfaces, 0);
+
+			std::mt19937 random(7);
+			std::uniform_real_distribution<float> unit(0.f, 1.f);
+			std::map<uint32_t, std::vector<std::pair<int, uint64_t>>> expected;
+			uint32_t lastSaveIndex = 1;
+			double journalMs = 0.;
+			double fullMs = 0.;
+			double compactMs = 0.;
+			size_t written = 0;
+			uint64_t journalBytes = 0;
+			std::thread compactor;
+
+			for (int save = 1; save <= saves; save++)
+			{
+				std::vector<SpatialMapSurface> current;
+				for (size_t s = 0; s < surfaces.size(); s++)
+				{
+					if (unit(random) < fraction)
+					{
+						for (auto& p : positions[s])
+						{
+							p.y += 0.001f;
+						}
+						surfaces[s].updateTime++;
+					}
+
+					// Surface s expires at every fifth save and is back two saves later.
+					bool const expired = s == static_cast<size_t>(save / 5) % surfaces.size() && save % 5 < 2;
+					if (!expired)
+					{
+						current.push_back(surfaces[s]);
+					}
+				}
+
+				start = Clock::now();
+				JournalSaveResult result;
+				journal.Save(current, save, &result);
+				journalMs += MillisecondsSince(start);
+				written += result.writtenSurfaces;
+				journalBytes += result.bytes;
+				lastSaveIndex = std::max(lastSaveIndex, result.saveIndex);
+
+				start = Clock::now();
+				SpatialMapFile::Write(folder + "/bench_journal_full.smap", current);
+				fullMs += MillisecondsSince(start);
+
+				std::vector<std::pair<int, uint64_t>> state;
+				for (auto const& surface : current)
+				{
+					state.emplace_back(surface.id, HashSurface(surface));
+				}
+				std::sort(state.begin(), state.end());
+				if (result.saveIndex != 0)
+				{
+					expected[result.saveIndex] = std::move(state);
+				}
+
+				if (save == saves / 2)
+				{
+					compactor = std::thread([&]()
+						{
+							auto const compactStart = Clock::now();
+							journal.Compact();
+							compactMs = MillisecondsSince(compactStart);
+						});
+				}
+			}
+			if (compactor.joinable())
+			{
+				compactor.join();
+			}
+
+			// The saves before the compaction are folded into the snapshot, the others must
+			// replay exactly.
+			MapReplay replay;
+			replay.Open(journalPath);
+			size_t replayed = 0;
+			bool matches = true;
+			for (auto const& point : replay.SavePoints())
+			{
+				if (point.saveIndex < 2)
+				{
+					continue;
+				}
+				std::vector<SpatialMapSurface> state;
+				replay.Reconstruct(point.saveIndex, state);
+				std::vector<std::pair<int, uint64_t>> hashes;
+				for (auto const& surface : state)
+				{
+					hashes.emplace_back(surface.id, HashSurface(surface));
+				}
+				matches = matches && hashes == expected[point.saveIndex];
+				replayed++;
+			}
+			matches = matches && replay.SavePoints().back().saveIndex == lastSaveIndex;
+			allReplayed = allReplayed && matches;
+			finalSaveIndex = lastSaveIndex;
+
+			char replayText[32];
+			std::snprintf(replayText, sizeof(replayText), "%zu %s", replayed, matches ? "ok" : "DIFFERS");
+			std::printf("%8.0f%% %9.1f %14.3f %14.3f %12.1f %14.1f %8s\n", fraction * 100., static_cast<double>(written) / saves,
+				journalMs / saves, fullMs / saves, journalBytes / 1e3 / saves, compactMs, replayText);
+		}
+
+		// A save torn by a crash is dropped when the journal is opened again.
+		{
+			std::ifstream file(journalPath + ".journal", std::ios::binary | std::ios::ate);
+			auto const size = static_cast<uintmax_t>(file.tellg());
+			file.close();
+			std::filesystem::resize_file(journalPath + ".journal", size - 100);
+
+			MapJournal journal;
+			journal.Open(journalPath);
+			MapReplay replay;
+			replay.Open(journalPath);
+			bool const recovered = replay.SavePoints().back().saveIndex == finalSaveIndex - 1 &&
+				static_cast<uintmax_t>(replay.JournalBytes()) == std::filesystem::file_size(journalPath + ".journal");
+			std::printf("torn last save %s\n", recovered ? "dropped" : "NOT RECOVERED");
+			allReplayed = allReplayed && recovered;
+		}
+
+		return allReplayed ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Frame loop of bench-frames: the collection lock of RealtimeSurfaceMeshRenderer, and
+	// surfaces whose export data is replaced by a simulated update thread.
+	struct SimulatedMap
+	{
+		std::mutex lock;
+		std::vector<std::shared_ptr<SurfaceData const>> surfaces;
+
+		void Snapshot(SurfaceDataSnapshot& snapshot)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			snapshot = surfaces;
+		}
+	};
+
+	void SpinFor(double const milliseconds)
+	{
+		auto const start = Clock::now();
+		while (MillisecondsSince(start) < milliseconds)
+		{
+		}
+	}
+
+	double Percentile(std::vector<double> values, double const p)
+	{
+		std::sort(values.begin(), values.end());
+		return values.empty() ? 0. : values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+	}
+
+	// MeshTools bench-frames <capture.obj> [output folder] [frames] [budget ms]
+	// Runs a 60 Hz frame loop with 2 ms of work per frame while a thread keeps updating
+	// surfaces, and saves the map every 30 frames. Once synchronously in the frame, as
+	// SaveAppState did, and once through ExportPipeline. Fails if a frame of the pipeline run
+	// exceeds the budget. With a single core the export and update threads can only run in
+	// the frames' time, which the failure points out.
+	int BenchmarkFrames(std::vector<std::string> const& args)
+	{
+		if (args.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-frames <capture.obj> [output folder] [frames] [budget ms]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::string const folder = args.size() > 1 ? args[1] : ".";
+		int const frames = args.size() > 2 ? std::stoi(args[2]) : 300;
+		double const budget = args.size() > 3 ? std::stod(args[3]) : 1000. / 60.;
+		double const framePeriod = 1000. / 60.;
+		double const frameWork = 2.;
+		int const saveInterval = 30;
+
+		MeshData mesh;
+		if (!LoadMesh(args[0], mesh))
+		{
+			return EXIT_FAILURE;
+		}
+		ExportSurfaces exportSurfaces;
+		MakeExportSurfaces(mesh, exportSurfaces);
+
+		std::printf("%d frames, %.1f ms of work per frame, save every %d frames, budget %.2f ms, %zu workers\n",
+			frames, frameWork, saveInterval, budget, WorkerCount());
+		std::printf("%-10s %10s %10s %10s %10s %8s %12s %12s\n", "export", "p50 [ms]", "p99 [ms]", "max [ms]", "save [ms]", "over", "exports", "export [ms]");
+
+		bool withinBudget = true;
+		for (bool const usePipeline : { false, true })
+		{
+			SimulatedMap map;
+			for (auto const& surface : exportSurfaces.surfaces)
+			{
+				auto data = std::make_shared<SurfaceData>();
+				data->id = surface.id;
+				data->updateTime = 1;
+				data->positionsTransformed.assign(surface.positionsTransformed, surface.positionsTransformed + surface.vertexCount);
+				data->positionsNotTransformed.assign(surface.positionsNotTransformed, surface.positionsNotTransformed + surface.vertexCount);
+				data->faceNormals.assign(surface.faceNormals, surface.faceNormals + surface.faceNormalCount);
+				data->SetIndices(static_cast<uint32_t const*>(surface.indices.data), surface.indices.count);
+				map.surfaces.push_back(std::move(data));
+			}
+
+			// The update tasks of SurfaceMesh: copy and change a surface off the lock, swap it in.
+			std::atomic<bool> running{ true };
+			std::thread updater([&]()
+				{
+					std::mt19937 random(3);
+					while (running)
+					{
+						size_t const s = random() % map.surfaces.size();
+						std::shared_ptr<SurfaceData const> current;
+						{
+							std::lock_guard<std::mutex> guard(map.lock);
+							current = map.surfaces[s];
+						}
+						auto updated = std::make_shared<SurfaceData>(*current);
+						updated->updateTime++;
+						for (auto& p : updated->positionsTransformed)
+						{
+							p.y += 0.0001f;
+						}
+						{
+							std::lock_guard<std::mutex> guard(map.lock);
+							map.surfaces[s] = std::move(updated);
+						}
+						std::this_thread::sleep_for(std::chrono::milliseconds(20));
+					}
+				});
+
+			std::vector<double> frameTimes;
+			std::vector<double> saveTimes;
+			ObjWriter writer;
+			std::vector<ObjSurface> surfaces;
+			std::unique_ptr<ExportPipeline> pipeline;
+			if (usePipeline)
+			{
+				pipeline = std::make_unique<ExportPipeline>(1, 1);
+			}
+			std::vector<uint64_t> requests;
+
+			auto nextFrame = Clock::now();
+			for (int frame = 0; frame < frames; frame++)
+			{
+				std::this_thread::sleep_until(nextFrame);
+				nextFrame += std::chrono::microseconds(static_cast<int64_t>(framePeriod * 1000.));
+
+				auto const start = Clock::now();
+				{
+					// Renderer::Update and Render walk the collection under its lock.
+					std::lock_guard<std::mutex> guard(map.lock);
+					SpinFor(frameWork);
+				}
+
+				if (frame % saveInterval == saveInterval - 1)
+				{
+					auto const saveStart = Clock::now();
+					if (usePipeline)
+					{
+						ExportRequest request;
+						map.Snapshot(request.surfaces);
+						request.transformedPath = folder + "/frames_transformed.obj";
+						request.notTransformedPath = folder + "/frames_not_transformed.obj";
+						request.binaryPath = folder + "/frames.smap";
+						requests.push_back(pipeline->Submit(std::move(request)));
+					}
+					else
+					{
+						// The former SaveAppState: the live collection, formatted and written in the frame.
+						std::lock_guard<std::mutex> guard(map.lock);
+						surfaces.clear();
+						for (auto const& data : map.surfaces)
+						{
+							ObjSurface surface;
+							surface.id = data->id;
+							surface.positionsTransformed = data->positionsTransformed.data();
+							surface.positionsNotTransformed = data->positionsNotTransformed.data();
+							surface.vertexCount = data->positionsTransformed.size();
+							surface.faceNormals = data->faceNormals.data();
+							surface.faceNormalCount = data->faceNormals.size();
+							surface.indices = data->Indices();
+							surfaces.push_back(surface);
+						}
+						writer.Write(surfaces, folder + "/frames_transformed.obj", folder + "/frames_not_transformed.obj");
+					}
+					saveTimes.push_back(MillisecondsSince(saveStart));
+				}
+				frameTimes.push_back(MillisecondsSince(start));
+			}
+
+			size_t succeeded = 0;
+			double exportMs = 0.;
+			for (uint64_t const id : requests)
+			{
+				ExportProgress const progress = pipeline->Wait(id);
+				if (progress.state == ExportState::Succeeded)
+				{
+					succeeded++;
+					exportMs += progress.milliseconds;
+				}
+			}
+			running = false;
+			updater.join();
+
+			size_t const over = std::count_if(frameTimes.begin(), frameTimes.end(), [budget](double const t) { return t > budget; });
+			double const maxFrame = *std::max_element(frameTimes.begin(), frameTimes.end());
+			char exports[32];
+			char exportTime[32];
+			std::snprintf(exports, sizeof(exports), "%zu/%zu", usePipeline ? succeeded : saveTimes.size(), saveTimes.size());
+			std::snprintf(exportTime, sizeof(exportTime), "%.1f", usePipeline ? (succeeded ? exportMs / succeeded : 0.) : Percentile(saveTimes, 0.5));
+			std::printf("%-10s %10.2f %10.2f %10.2f %10.3f %8zu %12s %12s\n", usePipeline ? "pipeline" : "in frame",
+				Percentile(frameTimes, 0.5), Percentile(frameTimes, 0.99), maxFrame, Percentile(saveTimes, 0.5), over, exports, exportTime);
+
+			if (usePipeline)
+			{
+				withinBudget = over == 0;
+			}
+		}
+
+		std::printf("pipeline frames %s the budget\n", withinBudget ? "within" : "EXCEED");
+		if (!withinBudget && std::thread::hardware_concurrency() == 1)
+		{
+			std::printf("single core: the export and update threads ran in the frames' time\n");
+		}
+		return withinBudget ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// MeshTools to-glb <map.glb> <transformed.obj> [not_transformed.obj] [--combined] [--no-normals]
+	// The OBJ export has no transforms, so every surface is quantized to its bounding box.
+	int ConvertToGlb(std::vector<std::string> const& args)
+	{
+		GlbOptions options;
+		std::vector<std::string> paths;
+		for (auto const& arg : args)
+		{
+			if (arg == "--combined")
+			{
+				options.combinedScene = true;
+			}
+			else if (arg == "--no-normals")
+			{
+				options.normals = false;
+			}
+			else
+			{
+				paths.push_back(arg);
+			}
+		}
+		if (paths.size() < 2)
+		{
+			std::fprintf(stderr, "Usage: MeshTools to-glb <map.glb> <transformed.obj> [not_transformed.obj] [--combined] [--no-normals]\n");
+			return EXIT_FAILURE;
+		}
+
+		MeshData mesh;
+		MeshData local;
+		bool const hasLocal = paths.size() > 2;
+		if (!LoadMesh(paths[1], mesh) || (hasLocal && !LoadMesh(paths[2], local)))
+		{
+			return EXIT_FAILURE;
+		}
+
+		MapSurfaces surfaces;
+		if (!MakeMapSurfaces(mesh, hasLocal ? &local : nullptr, surfaces))
+		{
+			return EXIT_FAILURE;
+		}
+
+		auto const start = Clock::now();
+		GlbWriter writer;
+		if (!writer.Write(paths[0], surfaces.surfaces, options))
+		{
+			std::fprintf(stderr, "Could not write %s\n", paths[0].c_str());
+			return EXIT_FAILURE;
+		}
+		std::printf("Wrote %s: %zu surfaces (%.1f ms)\n", paths[0].c_str(), surfaces.surfaces.size(), MillisecondsSince(start));
+		return EXIT_SUCCESS;
+	}
+
+	// Largest distance between the vertices of two meshes with the same layout.
+	double MaxPositionError(MeshData const& a, MeshData const& b)
+	{
+		if (a.positions.size() != b.positions.size() || a.indices != b.indices)
+		{
+			return INFINITY;
+		}
+		double error = 0.;
+		for (size_t v = 0; v < a.positions.size(); v++)
+		{
+			error = std::max(error, static_cast<double>(Length(a.positions[v] - b.positions[v])));
+		}
+		return error;
+	}
+
+	// MeshTools bench-glb <capture.obj> [output folder] [repetitions]
+	// Sizes, write and load times of the GLB export against the OBJ export, and the largest
+	// position error after quantization. The device frame variant gives every surface a
+	// transform and local positions, like the surfaces of the app.
+	int BenchmarkGlb(std::vector<std::string> const& args)
+	{
+		if (args.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-glb <capture.obj> [output folder] [repetitions]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::string const folder = args.size() > 1 ? args[1] : ".";
+		int const repetitions = args.size() > 2 ? std::stoi(args[2]) : 5;
+
+		MeshData mesh;
+		if (!LoadMesh(args[0], mesh))
+		{
+			return EXIT_FAILURE;
+		}
+		MapSurfaces surfaces;
+		MakeMapSurfaces(mesh, nullptr, surfaces);
+
+		// Surfaces centered on their bounding box with the half extents as position scale, so
+		// the local positions are the SNORM range of the device.
+		std::vector<std::vector<Vector3>> localPositions(surfaces.surfaces.size());
+		std::vector<SpatialMapSurface> deviceSurfaces = surfaces.surfaces;
+		for (size_t s = 0; s < deviceSurfaces.size(); s++)
+		{
+			auto& surface = deviceSurfaces[s];
+			Vector3 minimum{ INFINITY, INFINITY, INFINITY };
+			Vector3 maximum{ -INFINITY, -INFINITY, -INFINITY };
+			for (size_t v = 0; v < surface.vertexCount; v++)
+			{
+				auto const& p = surface.positions[v];
+				minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+				maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+			}
+			Vector3 const center = (minimum + maximum) * 0.5f;
+			float const half = std::max(maximum.x - minimum.x, std::max(maximum.y - minimum.y, maximum.z - minimum.z)) * 0.5f;
+			surface.vertexPositionScale = { half, half, half };
+			surface.meshToWorld[12] = center.x;
+			surface.meshToWorld[13] = center.y;
+			surface.meshToWorld[14] = center.z;
+			for (size_t v = 0; v < surface.vertexCount; v++)
+			{
+				localPositions[s].push_back(surface.positions[v] - center);
+			}
+			surface.localPositions = localPositions[s].data();
+		}
+
+		std::string const objPath = folder + "/bench_glb.obj";
+		std::string const objLocalPath = folder + "/bench_glb_local.obj";
+		std::string const glbPath = folder + "/bench_glb.glb";
+		std::string const flatPath = folder + "/bench_glb_flat.glb";
+		std::string const devicePath = folder + "/bench_glb_device.glb";
+		std::string const combinedPath = folder + "/bench_glb_combined.glb";
+
+		std::vector<ObjSurface> objSurfaces;
+		for (auto const& mapSurface : surfaces.surfaces)
+		{
+			ObjSurface surface;
+			surface.id = mapSurface.id;
+			surface.positionsTransformed = mapSurface.positions;
+			surface.positionsNotTransformed = mapSurface.positions;
+			surface.vertexCount = mapSurface.vertexCount;
+			surface.faceNormals = mapSurface.faceNormals;
+			surface.faceNormalCount = mapSurface.faceNormalCount;
+			surface.indices = mapSurface.indices;
+			objSurfaces.push_back(surface);
+		}
+
+		GlbOptions flat;
+		flat.normals = false;
+		GlbOptions combined;
+		combined.combinedScene = true;
+
+		ObjWriter objWriter;
+		GlbWriter glbWriter;
+		double objWriteMs = 1e30;
+		double glbWriteMs = 1e30;
+		double objReadMs = 1e30;
+		double glbReadMs = 1e30;
+		double flatReadMs = 1e30;
+		MeshData fromObj;
+		MeshData fromGlb;
+		MeshData fromFlat;
+		for (int r = 0; r < repetitions; r++)
+		{
+			auto start = Clock::now();
+			objWriter.Write(objSurfaces, objPath, objLocalPath);
+			objWriteMs = std::min(objWriteMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			glbWriter.Write(glbPath, surfaces.surfaces);
+			glbWriteMs = std::min(glbWriteMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			ReadObj(objPath, fromObj);
+			objReadMs = std::min(objReadMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			ReadGlb(glbPath, fromGlb);
+			glbReadMs = std::min(glbReadMs, MillisecondsSince(start));
+
+			glbWriter.Write(flatPath, surfaces.surfaces, flat);
+			start = Clock::now();
+			ReadGlb(flatPath, fromFlat);
+			flatReadMs = std::min(flatReadMs, MillisecondsSince(start));
+		}
+
+		glbWriter.Write(devicePath, deviceSurfaces);
+		glbWriter.Write(combinedPath, surfaces.surfaces, combined);
+		MeshData fromDevice;
+		MeshData fromCombined;
+		bool const read = ReadGlb(devicePath, fromDevice) && ReadGlb(combinedPath, fromCombined, 1);
+		MeshData merged = fromCombined;
+		merged.objects.clear();
+
+		auto const fileSize = [](std::string const& path)
+		{
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			return static_cast<double>(file.tellg());
+		};
+		double const objBytes = fileSize(objPath);
+
+		std::printf("%zu surfaces, best of %d\n", surfaces.surfaces.size(), repetitions);
+		std::printf("  %-22s %8s %8s %9s %9s %10s\n", "", "MB", "ratio", "write ms", "read ms", "error mm");
+		std::printf("  %-22s %8.3f %8s %9.2f %9.2f %10s\n", "OBJ (transformed)", objBytes / 1e6, "1.0x", objWriteMs / 2., objReadMs, "-");
+		std::printf("  %-22s %8.3f %7.1fx %9.2f %9.2f %10.4f\n", "GLB", fileSize(glbPath) / 1e6, objBytes / fileSize(glbPath),
+			glbWriteMs, glbReadMs, MaxPositionError(mesh, fromGlb) * 1000.);
+		std::printf("  %-22s %8.3f %7.1fx %9s %9.2f %10.4f\n", "GLB without normals", fileSize(flatPath) / 1e6, objBytes / fileSize(flatPath),
+			"", flatReadMs, MaxPositionError(mesh, fromFlat) * 1000.);
+		std::printf("  %-22s %8.3f %7.1fx %9s %9s %10.4f\n", "GLB device frame", fileSize(devicePath) / 1e6, objBytes / fileSize(devicePath),
+			"", "", MaxPositionError(mesh, fromDevice) * 1000.);
+		std::printf("  %-22s %8.3f %7.1fx %9s %9s %10.4f\n", "GLB + combined scene", fileSize(combinedPath) / 1e6, objBytes / fileSize(combinedPath),
+			"", "", MaxPositionError(mesh, merged) * 1000.);
+		std::printf("  (the OBJ write time is per file, ObjWriter writes both exports in one pass)\n");
+
+		bool const valid = read && fromGlb.objects.size() == mesh.objects.size() && fromCombined.objects.size() == 1;
+		std::printf("  structure %s\n", valid ? "matches" : "DIFFERS");
+		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// MeshTools bench-attributes <capture.obj> [output folder] [repetitions]
+	// The attribute channels of every surface, and what exporting them as vertex colors and
+	// glTF attributes costs against the usemtl material per face of the legacy OBJ export:
+	// file sizes, write times, and read times with and without parsing the materials. Also
+	// checks that the gradient channel gives every face the gray of its legacy material.
+	int BenchmarkAttributes(std::vector<std::string> const& args)
+	{
+		if (args.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-attributes <capture.obj> [output folder] [repetitions]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::string const folder = args.size() > 1 ? args[1] : ".";
+		int const repetitions = args.size() > 2 ? std::stoi(args[2]) : 5;
+
+		MeshData mesh;
+		if (!LoadMesh(args[0], mesh))
+		{
+			return EXIT_FAILURE;
+		}
+		MapSurfaces surfaces;
+		MakeMapSurfaces(mesh, nullptr, surfaces);
+
+		AttributeKind const kinds[] = { AttributeKind::Gradient, AttributeKind::Surface, AttributeKind::PlaneDistance };
+		size_t const kindCount = sizeof(kinds) / sizeof(kinds[0]);
+		std::vector<std::vector<AttributeChannel>> channels(surfaces.surfaces.size(), std::vector<AttributeChannel>(kindCount));
+		double attributeMs[kindCount];
+		for (size_t k = 0; k < kindCount; k++)
+		{
+			attributeMs[k] = 1e30;
+			for (int r = 0; r < repetitions; r++)
+			{
+				auto const start = Clock::now();
+				for (size_t s = 0; s < surfaces.surfaces.size(); s++)
+				{
+					auto const& surface = surfaces.surfaces[s];
+					ComputeAttribute(kinds[k], surface.id, surface.positions, surface.vertexCount, surface.indices, channels[s][k]);
+				}
+				attributeMs[k] = std::min(attributeMs[k], MillisecondsSince(start));
+			}
+		}
+
+		std::vector<ObjSurface> objSurfaces;
+		for (size_t s = 0; s < surfaces.surfaces.size(); s++)
+		{
+			auto& mapSurface = surfaces.surfaces[s];
+			mapSurface.attributes = channels[s].data();
+			mapSurface.attributeCount = channels[s].size();
+
+			ObjSurface surface;
+			surface.id = mapSurface.id;
+			surface.positionsTransformed = mapSurface.positions;
+			surface.positionsNotTransformed = mapSurface.positions;
+			surface.vertexCount = mapSurface.vertexCount;
+			surface.faceNormals = mapSurface.faceNormals;
+			surface.faceNormalCount = mapSurface.faceNormalCount;
+			surface.indices = mapSurface.indices;
+			surface.attributes = mapSurface.attributes;
+			surface.attributeCount = mapSurface.attributeCount;
+			objSurfaces.push_back(surface);
+		}
+
+		std::string const materialsPath = folder + "/bench_attributes_materials.obj";
+		std::string const colorsPath = folder + "/bench_attributes_colors.obj";
+		std::string const scratchPath = folder + "/bench_attributes_scratch.obj";
+		std::string const glbPath = folder + "/bench_attributes.glb";
+		std::string const glbAttributesPath = folder + "/bench_attributes_attributes.glb";
+
+		ObjWriteOptions colors;
+		colors.materials = false;
+		colors.colorAttribute = AttributeName(AttributeKind::Gradient);
+		GlbOptions plain;
+		plain.attributes = false;
+		GlbOptions attributes;
+		attributes.colorAttribute = colors.colorAttribute;
+		ObjReadOptions withMaterials;
+		withMaterials.materials = true;
+
+		ObjWriter objWriter;
+		GlbWriter glbWriter;
+		double materialsWriteMs = 1e30;
+		double colorsWriteMs = 1e30;
+		double materialsReadMs = 1e30;
+		double materialsParseMs = 1e30;
+		double colorsReadMs = 1e30;
+		double glbWriteMs = 1e30;
+		double glbAttributesWriteMs = 1e30;
+		MeshData fromMaterials;
+		MeshData fromColors;
+		for (int r = 0; r < repetitions; r++)
+		{
+			auto start = Clock::now();
+			objWriter.Write(objSurfaces, materialsPath, scratchPath);
+			materialsWriteMs = std::min(materialsWriteMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			objWriter.Write(objSurfaces, colorsPath, scratchPath, colors);
+			colorsWriteMs = std::min(colorsWriteMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			ReadObj(materialsPath, fromMaterials);
+			materialsReadMs = std::min(materialsReadMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			ReadObj(materialsPath, fromMaterials, withMaterials);
+			materialsParseMs = std::min(materialsParseMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			ReadObj(colorsPath, fromColors);
+			colorsReadMs = std::min(colorsReadMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			glbWriter.Write(glbPath, surfaces.surfaces, plain);
+			glbWriteMs = std::min(glbWriteMs, MillisecondsSince(start));
+
+			start = Clock::now();
+			glbWriter.Write(glbAttributesPath, surfaces.surfaces, attributes);
+			glbAttributesWriteMs = std::min(glbAttributesWriteMs, MillisecondsSince(start));
+		}
+		std::remove(scratchPath.c_str());
+
+		// Material.NNNN has the gray value (NNNN - 1) / 1000.
+		size_t matching = 0;
+		size_t faces = 0;
+		for (size_t s = 0; s < surfaces.surfaces.size() && s < fromMaterials.objects.size(); s++)
+		{
+			auto const& object = fromMaterials.objects[s];
+			auto const& gradient = channels[s][0].values;
+			for (size_t f = 0; f < object.indexCount / 3 && f < gradient.size(); f++, faces++)
+			{
+				uint32_t const material = fromMaterials.faceMaterials[object.firstIndex / 3 + f];
+				int const number = material < fromMaterials.materials.size() ? std::atoi(fromMaterials.materials[material].c_str() + 9) : 0;
+				matching += std::lround(gradient[f] * 1000.f) == number - 1 ? 1 : 0;
+			}
+		}
+
+		auto const fileSize = [](std::string const& path)
+		{
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			return static_cast<double>(file.tellg());
+		};
+		double const materialsBytes = fileSize(materialsPath);
+
+		std::printf("%zu surfaces, %zu triangles, best of %d\n", surfaces.surfaces.size(), mesh.TriangleCount(), repetitions);
+		for (size_t k = 0; k < kindCount; k++)
+		{
+			std::printf("  %-16s %7.3f ms for all surfaces\n", AttributeName(kinds[k]), attributeMs[k]);
+		}
+		std::printf("  %-30s %8s %8s %9s %9s\n", "", "MB", "ratio", "write ms", "read ms");
+		std::printf("  %-30s %8.3f %8s %9.2f %9.2f\n", "OBJ usemtl per face", materialsBytes / 1e6, "1.00x", materialsWriteMs / 2., materialsReadMs);
+		std::printf("  %-30s %8s %8s %9s %9.2f\n", "  read with materials", "", "", "", materialsParseMs);
+		std::printf("  %-30s %8.3f %7.2fx %9.2f %9.2f\n", "OBJ vertex colors", fileSize(colorsPath) / 1e6, materialsBytes / fileSize(colorsPath), colorsWriteMs / 2., colorsReadMs);
+		std::printf("  %-30s %8.3f %7.2fx %9.2f %9s\n", "GLB", fileSize(glbPath) / 1e6, materialsBytes / fileSize(glbPath), glbWriteMs, "");
+		std::printf("  %-30s %8.3f %7.2fx %9.2f %9s\n", "GLB COLOR_0 + 3 attributes", fileSize(glbAttributesPath) / 1e6, materialsBytes / fileSize(glbAttributesPath), glbAttributesWriteMs, "");
+		std::printf("  (the OBJ write time is per file, ObjWriter writes both exports in one pass)\n");
+
+		bool const sameGeometry = fromColors.positions.size() == fromMaterials.positions.size() && fromColors.indices == fromMaterials.indices &&
+			fromColors.objects.size() == fromMaterials.objects.size();
+		std::printf("  gradient matches the legacy material of %zu of %zu faces, geometry %s\n", matching, faces, sameGeometry ? "identical" : "DIFFERS");
+		return sameGeometry ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// MeshTools bench-codec [--precision m] [--repetitions n] [--app-normals] <capture.obj>...
+	// Compression ratio and encode and decode speed of MeshCodec per capture, lossy at the given
+	// precision and lossless. Indices are stored with 16 bits like the app does, and speeds are
+	// in megabytes of uncompressed geometry per second. The face normals of the captures do not
+	// belong to their triangles, --app-normals recomputes them the way SurfaceMesh does.
+	int BenchmarkCodec(std::vector<std::string> const& args)
+	{
+		MeshCodecOptions lossy;
+		int repetitions = 5;
+		bool appNormals = false;
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--precision" && i + 1 < args.size())
+			{
+				lossy.positionPrecision = std::stof(args[++i]);
+			}
+			else if (args[i] == "--app-normals")
+			{
+				appNormals = true;
+			}
+			else if (args[i] == "--repetitions" && i + 1 < args.size())
+			{
+				repetitions = std::stoi(args[++i]);
+			}
+			else
+			{
+				paths.push_back(args[i]);
+			}
+		}
+		if (paths.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-codec [--precision m] [--repetitions n] [--app-normals] <capture.obj>...\n");
+			return EXIT_FAILURE;
+		}
+
+		MeshCodecOptions lossless;
+		lossless.positionPrecision = 0.f;
+
+		bool exact = true;
+		std::printf("%-44s %5s %9s %9s %7s %10s %10s %9s %9s\n",
+			"capture", "mode", "raw KB", "coded KB", "ratio", "enc MB/s", "dec MB/s", "pos mm", "normal deg");
+		for (auto const& path : paths)
+		{
+			MeshData mesh;
+			if (!ReadObj(path, mesh))
+			{
+				std::fprintf(stderr, "Could not read %s\n", path.c_str());
+				return EXIT_FAILURE;
+			}
+			MapSurfaces surfaces;
+			MakeMapSurfaces(mesh, nullptr, surfaces);
+
+			std::vector<std::vector<uint16_t>> indices16(surfaces.surfaces.size());
+			std::vector<std::vector<Vector3>> faceNormals(surfaces.surfaces.size());
+			double rawBytes = 0.;
+			for (size_t s = 0; s < surfaces.surfaces.size(); s++)
+			{
+				auto& surface = surfaces.surfaces[s];
+				indices16[s].assign(surfaces.indices[s].begin(), surfaces.indices[s].end());
+				surface.indices = IndexView(indices16[s].data(), indices16[s].size());
+				if (appNormals)
+				{
+					// Including the negated y of its cross product.
+					for (size_t i = 0; i + 2 < surface.indices.count; i += 3)
+					{
+						auto const& a = surface.positions[surface.indices[i]];
+						auto const normal = Cross(surface.positions[surface.indices[i + 1]] - a, surface.positions[surface.indices[i + 2]] - a);
+						faceNormals[s].push_back(Normalize({ normal.x, -normal.y, normal.z }));
+					}
+					surface.faceNormals = faceNormals[s].data();
+					surface.faceNormalCount = faceNormals[s].size();
+				}
+				rawBytes += surface.vertexCount * sizeof(Vector3) + surface.indices.count * sizeof(uint16_t) + surface.faceNormalCount * sizeof(Vector3);
+			}
+
+			for (auto const* options : { &lossy, &lossless })
+			{
+				std::vector<std::string> blobs(surfaces.surfaces.size());
+				std::vector<DecodedMesh> decoded(surfaces.surfaces.size());
+				std::vector<SpatialMapSurface> decodedSurfaces(surfaces.surfaces.size());
+				double encodeMs = 1e30;
+				double decodeMs = 1e30;
+				bool valid = true;
+				for (int r = 0; r < repetitions; r++)
+				{
+					auto start = Clock::now();
+					for (size_t s = 0; s < blobs.size(); s++)
+					{
+						MeshCodec::Encode(surfaces.surfaces[s], *options, blobs[s]);
+					}
+					encodeMs = std::min(encodeMs, MillisecondsSince(start));
+
+					start = Clock::now();
+					for (size_t s = 0; s < blobs.size(); s++)
+					{
+						valid = MeshCodec::Decode(blobs[s].data(), blobs[s].size(), decoded[s], decodedSurfaces[s]) && valid;
+					}
+					decodeMs = std::min(decodeMs, MillisecondsSince(start));
+				}
+
+				double codedBytes = 0.;
+				double positionError = 0.;
+				double normalError = 0.;
+				for (size_t s = 0; s < blobs.size() && valid; s++)
+				{
+					auto const& original = surfaces.surfaces[s];
+					auto const& restored = decodedSurfaces[s];
+					codedBytes += blobs[s].size();
+					valid = restored.vertexCount == original.vertexCount && restored.faceNormalCount == original.faceNormalCount &&
+						!restored.indices.is32Bit && SameBits(restored.indices.data, original.indices.data, original.indices.count * sizeof(uint16_t));
+					for (size_t v = 0; valid && v < original.vertexCount; v++)
+					{
+						auto const difference = restored.positions[v] - original.positions[v];
+						positionError = std::max(positionError, static_cast<double>(std::max(std::fabs(difference.x), std::max(std::fabs(difference.y), std::fabs(difference.z)))));
+					}
+					for (size_t n = 0; valid && n < original.faceNormalCount; n++)
+					{
+						// Slivers have no direction to keep.
+						auto const& a = original.faceNormals[n];
+						auto const& b = restored.faceNormals[n];
+						double const length = std::sqrt(static_cast<double>(a.x) * a.x + static_cast<double>(a.y) * a.y + static_cast<double>(a.z) * a.z);
+						double const restoredLength = std::sqrt(static_cast<double>(b.x) * b.x + static_cast<double>(b.y) * b.y + static_cast<double>(b.z) * b.z);
+						if (std::fabs(length - 1.) < 0.01 && restoredLength > 0.)
+						{
+							double const dot = static_cast<double>(a.x) * b.x + static_cast<double>(a.y) * b.y + static_cast<double>(a.z) * b.z;
+							double const cosine = std::min(1., dot / (length * restoredLength));
+							normalError = std::max(normalError, std::acos(cosine) * 180. / 3.14159265358979);
+						}
+					}
+				}
+
+				bool const isLossless = options == &lossless;
+				for (size_t s = 0; isLossless && s < blobs.size() && valid; s++)
+				{
+					auto const& original = surfaces.surfaces[s];
+					auto const& restored = decodedSurfaces[s];
+					valid = SameBits(restored.positions, original.positions, original.vertexCount * sizeof(Vector3)) &&
+						SameBits(restored.faceNormals, original.faceNormals, original.faceNormalCount * sizeof(Vector3));
+				}
+				exact = exact && valid;
+
+				std::string const name = std::filesystem::path(path).filename().string();
+				std::printf("%-44s %5s %9.1f %9.1f %6.2fx %10.1f %10.1f %9.4f %9.4f%s\n",
+					name.c_str(), isLossless ? "exact" : "lossy", rawBytes / 1e3, codedBytes / 1e3, rawBytes / codedBytes,
+					rawBytes / 1e3 / encodeMs, rawBytes / 1e3 / decodeMs, positionError * 1000., normalError, valid ? "" : "  DIFFERS");
+			}
+		}
+		return exact ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// Points scattered over the walls, floor and ceiling of a 5 x 3 x 5 m room with 1 cm of
+	// noise, which is roughly what the observer delivers.
+	std::vector<Vector3> GenerateRoomPoints(size_t const count, unsigned const seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<float> unit(0.f, 1.f);
+		std::normal_distribution<float> noise(0.f, 0.01f);
+
+		std::vector<Vector3> points(count);
+		for (auto& p : points)
+		{
+			int const side = static_cast<int>(unit(random) * 6.f) % 6;
+			float const u = unit(random);
+			float const v = unit(random);
+			float const n = noise(random);
+			switch (side)
+			{
+			case 0: p = { u * 5.f, n, v * 5.f }; break;
+			case 1: p = { u * 5.f, 3.f + n, v * 5.f }; break;
+			case 2: p = { n, v * 3.f, u * 5.f }; break;
+			case 3: p = { 5.f + n, v * 3.f, u * 5.f }; break;
+			case 4: p = { u * 5.f, v * 3.f, n }; break;
+			default: p = { u * 5.f, v * 3.f, 5.f + n }; break;
+			}
+		}
+		return points;
+	}
+
+	// Runs query(point, block) for every point on all workers and returns the throughput in
+	// queries per second.
+	template <typename Fn>
+	double QueriesPerSecond(std::vector<Vector3> const& queries, Fn&& query)
+	{
+		auto const start = Clock::now();
+		ParallelFor(queries.size(), QueryBlockSize, [&](size_t const begin, size_t const end, size_t const block)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					query(queries[i], block);
+				}
+			});
+		return queries.size() / (MillisecondsSince(start) / 1000.);
+	}
+
+	// MeshTools bench-index [radius in m] [k]
+	int BenchmarkSpatialIndex(std::vector<std::string> const& args)
+	{
+		float const radius = args.size() > 0 ? std::stof(args[0]) : 0.05f;
+		size_t const k = args.size() > 1 ? std::stoul(args[1]) : 8;
+		size_t const queryCount = 100000;
+
+		std::printf("%zu workers, radius %.3f m, k %zu, %zu queries\n", WorkerCount(), radius, k, queryCount);
+		std::printf("%10s %12s %12s %14s %14s %12s\n", "points", "grid [ms]", "kd [ms]", "radius [q/s]", "knn [q/s]", "avg found");
+
+		for (size_t const count : { size_t(20000), size_t(200000), size_t(2000000) })
+		{
+			std::vector<Vector3> const points = GenerateRoomPoints(count, 1);
+			std::vector<Vector3> const queries = GenerateRoomPoints(queryCount, 2);
+
+			auto start = Clock::now();
+			UniformGrid grid;
+			grid.Build(points.data(), points.size(), radius);
+			double const gridMs = MillisecondsSince(start);
+
+			start = Clock::now();
+			KdTree tree;
+			tree.Build(points.data(), points.size());
+			double const treeMs = MillisecondsSince(start);
+
+			std::vector<size_t> found(BlockCount(queries.size(), QueryBlockSize), 0);
+			double const radiusRate = QueriesPerSecond(queries, [&](Vector3 const& q, size_t const block)
+				{
+					grid.ForEachInRadius(q, radius, [&](uint32_t, float) { found[block]++; });
+				});
+
+			std::vector<std::vector<Neighbor>> neighbors(found.size());
+			double const knnRate = QueriesPerSecond(queries, [&](Vector3 const& q, size_t const block)
+				{
+					tree.KNearest(q, k, 1.f, neighbors[block]);
+				});
+
+			size_t total = 0;
+			for (size_t const n : found)
+			{
+				total += n;
+			}
+
+			std::printf("%10zu %12.1f %12.1f %14.0f %14.0f %12.1f\n",
+				count, gridMs, treeMs, radiusRate, knnRate, static_cast<double>(total) / queries.size());
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// Least-squares affine map from local to world positions, as a row-major float4x4 used with
+	// row vectors. Exports store both, but not the transform between them.
+	void FitMeshToWorld(Vector3 const* local, Vector3 const* world, size_t const count, float meshToWorld[16])
+	{
+		double a[4][7] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			double const x[4] = { local[i].x, local[i].y, local[i].z, 1. };
+			double const w[3] = { world[i].x, world[i].y, world[i].z };
+			for (int r = 0; r < 4; r++)
+			{
+				for (int c = 0; c < 4; c++)
+				{
+					a[r][c] += x[r] * x[c];
+				}
+				for (int c = 0; c < 3; c++)
+				{
+					a[r][4 + c] += x[r] * w[c];
+				}
+			}
+		}
+
+		// Gauss-Jordan with partial pivoting on the normal equations.
+		for (int k = 0; k < 4; k++)
+		{
+			int pivot = k;
+			for (int r = k + 1; r < 4; r++)
+			{
+				pivot = std::abs(a[r][k]) > std::abs(a[pivot][k]) ? r : pivot;
+			}
+			std::swap(a[k], a[pivot]);
+			if (std::abs(a[k][k]) < 1e-12)
+			{
+				// Degenerate surface, keep it where it is.
+				float const identity[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+				std::memcpy(meshToWorld, identity, sizeof(identity));
+				return;
+			}
+			for (int r = 0; r < 4; r++)
+			{
+				if (r != k)
+				{
+					double const f = a[r][k] / a[k][k];
+					for (int c = k; c < 7; c++)
+					{
+						a[r][c] -= f * a[k][c];
+					}
+				}
+			}
+		}
+
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				meshToWorld[r * 4 + c] = static_cast<float>(a[r][4 + c] / a[r][r]);
+			}
+			meshToWorld[r * 4 + 3] = r == 3 ? 1.f : 0.f;
+		}
+	}
+
+	// The buffers of one surface as the observer would have delivered them.
+	struct SyntheticSurface
+	{
+		SurfaceUpdate update;
+		std::vector<int16_t> positions;
+		std::vector<int8_t> normals;
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+	};
+
+	// Indices in 16 bit where they fit, like the observer's default format, or always in
+	// 32 bit like the format the app requests.
+	void MakeSyntheticSurface(SpatialMapSurface const& surface, SyntheticSurface& result, bool const wideIndices = false)
+	{
+		auto& update = result.update;
+		update.id = surface.id;
+		std::memcpy(update.guid, &surface.id, sizeof(surface.id));
+		FitMeshToWorld(surface.localPositions, surface.positions, surface.vertexCount, update.meshToWorld);
+
+		// The observer scales every surface to the SNORM16 range of its positions.
+		Vector3 scale;
+		for (size_t v = 0; v < surface.vertexCount; v++)
+		{
+			scale.x = std::max(scale.x, std::abs(surface.localPositions[v].x));
+			scale.y = std::max(scale.y, std::abs(surface.localPositions[v].y));
+			scale.z = std::max(scale.z, std::abs(surface.localPositions[v].z));
+		}
+		update.vertexPositionScale = { scale.x > 0.f ? scale.x : 1.f, scale.y > 0.f ? scale.y : 1.f, scale.z > 0.f ? scale.z : 1.f };
+
+		auto const snorm = [](float const value, float const range)
+		{
+			return static_cast<long>(std::lround(std::min(std::max(value, -1.f), 1.f) * range));
+		};
+
+		// Back to the observer's winding, SurfaceMesh reverses it again.
+		std::vector<uint32_t> observerIndices(surface.indices.count);
+		for (size_t i = 0; i + 2 < surface.indices.count; i += 3)
+		{
+			observerIndices[i] = surface.indices[i + 2];
+			observerIndices[i + 1] = surface.indices[i + 1];
+			observerIndices[i + 2] = surface.indices[i];
+		}
+
+		std::vector<Vector3> vertexNormals;
+		ComputeVertexNormals(surface.localPositions, surface.vertexCount, observerIndices.data(), observerIndices.size(), vertexNormals);
+
+		result.positions.resize(surface.vertexCount * 4);
+		result.normals.resize(surface.vertexCount * 4);
+		for (size_t v = 0; v < surface.vertexCount; v++)
+		{
+			Vector3 const& p = surface.localPositions[v];
+			Vector3 const& s = update.vertexPositionScale;
+			result.positions[v * 4] = static_cast<int16_t>(snorm(p.x / s.x, 32767.f));
+			result.positions[v * 4 + 1] = static_cast<int16_t>(snorm(p.y / s.y, 32767.f));
+			result.positions[v * 4 + 2] = static_cast<int16_t>(snorm(p.z / s.z, 32767.f));
+			result.positions[v * 4 + 3] = 32767;
+
+			Vector3 const n = Normalize(vertexNormals[v]);
+			result.normals[v * 4] = static_cast<int8_t>(snorm(n.x, 127.f));
+			result.normals[v * 4 + 1] = static_cast<int8_t>(snorm(n.y, 127.f));
+			result.normals[v * 4 + 2] = static_cast<int8_t>(snorm(n.z, 127.f));
+			result.normals[v * 4 + 3] = 0;
+		}
+
+		update.positions = result.positions.data();
+		update.normals = result.normals.data();
+		update.vertexCount = surface.vertexCount;
+		if (!wideIndices && FitsIn16BitIndices(surface.vertexCount))
+		{
+			result.indices16.assign(observerIndices.begin(), observerIndices.end());
+			update.indices = IndexView(result.indices16.data(), result.indices16.size());
+		}
+		else
+		{
+			result.indices32 = std::move(observerIndices);
+			update.indices = IndexView(result.indices32.data(), result.indices32.size());
+		}
+	}
+
+	// MeshTools record-surfaces [--rate updates/s] [--passes n] [--wide-indices] <out.rec> <transformed.obj> <not_transformed.obj>
+	// Synthesizes a recording from an export: every surface becomes one update with the
+	// transform fitted between the two files, SNORM16 positions and SNORM8 vertex normals.
+	// Every pass updates all surfaces once more and ends with an observer event. Reports the
+	// error of the world-space positions SurfaceIngest decodes against the export. With
+	// --wide-indices all updates have 32 bit indices, as the app requests from the observer.
+	int RecordSurfaces(std::vector<std::string> const& args)
+	{
+		double rate = 20.;
+		int passes = 1;
+		bool wideIndices = false;
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--rate" && i + 1 < args.size())
+			{
+				rate = std::stod(args[++i]);
+			}
+			else if (args[i] == "--passes" && i + 1 < args.size())
+			{
+				passes = std::stoi(args[++i]);
+			}
+			else if (args[i] == "--wide-indices")
+			{
+				wideIndices = true;
+			}
+			else
+			{
+				paths.push_back(args[i]);
+			}
+		}
+		if (paths.size() < 3 || rate <= 0. || passes < 1)
+		{
+			std::fprintf(stderr, "Usage: MeshTools record-surfaces [--rate updates/s] [--passes n] [--wide-indices] <out.rec> <transformed.obj> <not_transformed.obj>\n");
+			return EXIT_FAILURE;
+		}
+
+		MeshData mesh;
+		MeshData local;
+		MapSurfaces surfaces;
+		if (!LoadMesh(paths[1], mesh) || !LoadMesh(paths[2], local) || !MakeMapSurfaces(mesh, &local, surfaces))
+		{
+			return EXIT_FAILURE;
+		}
+
+		std::vector<SyntheticSurface> synthetic(surfaces.surfaces.size());
+		std::vector<int32_t> ids;
+		for (size_t s = 0; s < synthetic.size(); s++)
+		{
+			MakeSyntheticSurface(surfaces.surfaces[s], synthetic[s], wideIndices);
+			ids.push_back(synthetic[s].update.id);
+		}
+
+		SurfaceRecorder recorder;
+		if (!recorder.Open(paths[0]))
+		{
+			std::fprintf(stderr, "Could not write %s\n", paths[0].c_str());
+			return EXIT_FAILURE;
+		}
+
+		// Update times in 100 ns ticks like Windows::Foundation::DateTime, capture times in ns.
+		size_t updates = 0;
+		auto const period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / rate));
+		for (int pass = 0; pass < passes; pass++)
+		{
+			for (auto& surface : synthetic)
+			{
+				auto const captureTime = period * updates++;
+				surface.update.updateTime = captureTime.count() / 100;
+				recorder.RecordUpdate(surface.update, captureTime);
+			}
+			recorder.RecordObserved(ids.data(), ids.size(), period * updates);
+		}
+		uint64_t const bytes = recorder.Bytes();
+		recorder.Close();
+
+		// What the app would have cached, against what it exported.
+		double maxError = 0.;
+		double sumSquares = 0.;
+		size_t count = 0;
+		IngestOptions options;
+		options.buildSpatialIndex = false;
+		for (size_t s = 0; s < synthetic.size(); s++)
+		{
+			auto const& update = synthetic[s].update;
+			std::vector<uint32_t> indices(update.indices.count);
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				indices[i] = update.indices[i];
+			}
+
+			SurfaceIngest ingest;
+			ingest.Ingest(update, indices.data(), indices.size(), options);
+			auto const& decoded = ingest.PositionsTransformed();
+			for (size_t v = 0; v < decoded.size(); v++)
+			{
+				double const error = Length(decoded[v] - surfaces.surfaces[s].positions[v]);
+				maxError = std::max(maxError, error);
+				sumSquares += error * error;
+				count++;
+			}
+		}
+
+		std::printf("Wrote %s: %zu updates of %zu surfaces over %.1f s, %.1f MB\n",
+			paths[0].c_str(), updates, synthetic.size(), updates / rate, bytes / 1e6);
+		std::printf("  decoded positions against the export: rms %.3f mm, max %.3f mm\n",
+			std::sqrt(sumSquares / std::max<size_t>(count, 1)) * 1000., maxError * 1000.);
+		return EXIT_SUCCESS;
+	}
+
+	// MeshTools replay-surfaces [options] <recording.rec> [<transformed.obj> <not_transformed.obj>]
+	// Feeds a recording through SurfaceIngest, one instance per surface like the SurfaceMesh
+	// collection of the app, and publishes the spatial indices like the renderer. By default
+	// the updates run back to back; --realtime waits for their capture times and reports the
+	// latency from capture to the published update. Optionally exports the final map.
+	//   --realtime            Replay at the recorded pace
+	//   --floaters            FILTER_FLOATERS with the defaults of Common/Settings.h
+	//   --flag-floaters       FILTER_FLOATERS without REMOVE_FLOATERS
+	//   --denoise             DENOISE_SURFACES
+	//   --icp                 ICP_DRIFT_CORRECTION
+	//   --index               BUILD_SPATIAL_INDEX, implied by --icp
+	//   --clusters            BUILD_CLUSTERS
+	//   --profile             Print the percentiles of the profiled phases, see Processing/FrameProfiler.h
+	//   --trace path          Write the stages of every update as a Chrome trace, see Processing/SurfaceTrace.h
+	//   --metrics path        Append a snapshot of the SurfaceMetrics every second, see Processing/Metrics.h,
+	//                         and print the metrics of the replay
+	int ReplaySurfaces(std::vector<std::string> const& args)
+	{
+		bool realtime = false;
+		bool profile = false;
+		std::string tracePath;
+		std::string metricsPath;
+		IngestOptions options;
+		options.floaters.minTriangles = 20;
+		options.floaters.minArea = 0.01f;
+		options.denoising.iterations = 3;
+		options.denoising.timeBudgetMilliseconds = 5.;
+		options.icp.maxCorrespondenceDistance = 0.05f;
+		options.icp.timeBudgetMilliseconds = 5.;
+		options.buildSpatialIndex = false;
+		std::vector<std::string> paths;
+		for (size_t a = 0; a < args.size(); a++)
+		{
+			std::string const& arg = args[a];
+			if (arg == "--realtime")
+			{
+				realtime = true;
+			}
+			else if (arg == "--floaters")
+			{
+				options.filterFloaters = true;
+			}
+			else if (arg == "--flag-floaters")
+			{
+				options.filterFloaters = true;
+				options.removeFloaters = false;
+			}
+			else if (arg == "--denoise")
+			{
+				options.denoise = true;
+			}
+			else if (arg == "--icp")
+			{
+				options.correctDrift = true;
+			}
+			else if (arg == "--index")
+			{
+				options.buildSpatialIndex = true;
+			}
+			else if (arg == "--clusters")
+			{
+				options.buildClusters = true;
+			}
+			else if (arg == "--profile")
+			{
+				profile = true;
+			}
+			else if (arg == "--trace" && a + 1 < args.size())
+			{
+				tracePath = args[++a];
+			}
+			else if (arg == "--metrics" && a + 1 < args.size())
+			{
+				metricsPath = args[++a];
+			}
+			else
+			{
+				paths.push_back(arg);
+			}
+		}
+		if (paths.size() != 1 && paths.size() != 3)
+		{
+			std::fprintf(stderr, "Usage: MeshTools replay-surfaces [--realtime] [--floaters] [--flag-floaters] [--denoise] [--icp] [--index] [--clusters] [--profile] [--trace path] [--metrics path] <recording.rec> [<t.obj> <nt.obj>]\n");
+			return EXIT_FAILURE;
+		}
+
+		// Like the app, which builds the indices the drift correction aligns against.
+		options.buildSpatialIndex = options.buildSpatialIndex || options.correctDrift;
+		FrameProfiler::Instance().Enable(profile);
+		FrameProfiler::Instance().Reset();
+		if (!tracePath.empty())
+		{
+			SurfaceTrace::Instance().Start();
+		}
+		SurfaceMetrics& metrics = SurfaceMetrics::Instance();
+		MetricsSnapshot const metricsBefore = MetricsRegistry::Instance().Snapshot();
+		if (!metricsPath.empty() && !MetricsRegistry::Instance().StartSnapshots(metricsPath, 1.))
+		{
+			std::fprintf(stderr, "Could not open %s\n", metricsPath.c_str());
+			return EXIT_FAILURE;
+		}
+
+		SurfaceRecording recording;
+		if (!recording.Open(paths[0]))
+		{
+			std::fprintf(stderr, "Could not read %s\n", paths[0].c_str());
+			return EXIT_FAILURE;
+		}
+
+		SpatialIndexCollection spatialMap;
+		options.spatialMap = &spatialMap;
+		std::map<int, std::unique_ptr<SurfaceIngest>> ingests;
+		std::map<int, std::unique_ptr<SurfaceMemory>> memory;
+		std::vector<int> order;
+		MemoryAccounting::Instance().ResetHighWater();
+
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+		std::vector<double> processing;
+		std::vector<double> latencies;
+		size_t observerEvents = 0;
+		size_t triangles = 0;
+		size_t floaters = 0;
+		double inputBytes = 0.;
+
+		auto const start = Clock::now();
+		for (auto const& event : recording.Events())
+		{
+			if (realtime)
+			{
+				std::this_thread::sleep_until(start + event.captureTime);
+			}
+			if (event.kind == RecordKind::Observed)
+			{
+				TraceScope trace("OnSurfacesChanged", 0, 0);
+				observerEvents++;
+				continue;
+			}
+
+			// The stages of the app that run on the CPU, queued at the capture time when the
+			// replay keeps the recorded pace.
+			auto const& update = event.update;
+			uint64_t const flow = SurfaceTrace::Instance().NewFlow();
+			TraceScope trace("UpdateVertexResources", flow, update.id, realtime ? start + event.captureTime : TraceClock::time_point());
+			auto& ingest = ingests[update.id];
+			if (!ingest)
+			{
+				ingest = std::make_unique<SurfaceIngest>();
+				memory[update.id] = std::make_unique<SurfaceMemory>();
+				order.push_back(update.id);
+				metrics.surfacesResident.Set(static_cast<int64_t>(ingests.size()));
+			}
+
+			// SurfaceIngest compacts the observer's buffer, the mapped recording is read-only.
+			auto const updateStart = Clock::now();
+			IngestResult result;
+			if (update.indices.is32Bit)
+			{
+				auto const* const source = static_cast<uint32_t const*>(update.indices.data);
+				indices32.assign(source, source + update.indices.count);
+				result = ingest->Ingest(update, indices32.data(), indices32.size(), options);
+			}
+			else
+			{
+				auto const* const source = static_cast<uint16_t const*>(update.indices.data);
+				indices16.assign(source, source + update.indices.count);
+				result = ingest->Ingest(update, indices16.data(), indices16.size(), options);
+			}
+			if (options.buildSpatialIndex)
+			{
+				TraceScope publish("PublishSpatialIndex", flow, update.id);
+				spatialMap.Update(update.id, ingest->GetSpatialIndex());
+			}
+			auto const updateEnd = Clock::now();
+			ingest->ReportMemory(*memory[update.id]);
+
+			processing.push_back(std::chrono::duration<double, std::milli>(updateEnd - updateStart).count());
+			if (realtime)
+			{
+				latencies.push_back(std::chrono::duration<double, std::milli>(updateEnd - (start + event.captureTime)).count());
+				metrics.observerToRenderMilliseconds.Record(latencies.back());
+			}
+			triangles += result.indexCount / 3;
+			floaters += result.floaters.removedTriangles;
+			inputBytes += update.vertexCount * (update.normals ? 12. : 8.) + update.indices.count * (update.indices.is32Bit ? 4. : 2.);
+		}
+		double const totalMs = MillisecondsSince(start);
+		double const busyMs = std::accumulate(processing.begin(), processing.end(), 0.);
+
+		std::printf("%s: %zu updates of %zu surfaces, %zu observer events, %.1f MB%s\n", paths[0].c_str(),
+			processing.size(), ingests.size(), observerEvents, recording.Bytes() / 1e6, recording.IsTruncated() ? " (truncated)" : "");
+		std::printf("  %s replay %.1f ms, processing %.1f ms: %.1f updates/s, %.1f MB/s, %.2f Mtriangles/s\n",
+			realtime ? "real-time" : "max-speed", totalMs, busyMs,
+			processing.size() / busyMs * 1e3, inputBytes / 1e3 / busyMs, triangles / 1e3 / busyMs);
+		std::printf("  per update   p50 %7.2f ms  p95 %7.2f ms  p99 %7.2f ms  max %7.2f ms\n",
+			Percentile(processing, 0.5), Percentile(processing, 0.95), Percentile(processing, 0.99),
+			processing.empty() ? 0. : *std::max_element(processing.begin(), processing.end()));
+		if (realtime)
+		{
+			std::printf("  latency      p50 %7.2f ms  p95 %7.2f ms  p99 %7.2f ms  max %7.2f ms\n",
+				Percentile(latencies, 0.5), Percentile(latencies, 0.95), Percentile(latencies, 0.99),
+				latencies.empty() ? 0. : *std::max_element(latencies.begin(), latencies.end()));
+		}
+		if (options.filterFloaters && options.removeFloaters)
+		{
+			std::printf("  %zu floater triangles removed\n", floaters);
+		}
+		else if (options.filterFloaters)
+		{
+			// Counted in the published channels, which is what the exports see.
+			size_t flagged = 0;
+			for (auto const& ingest : ingests)
+			{
+				auto const data = ingest.second->GetExportData();
+				AttributeChannel const* const channel = data ? FindAttribute(data->attributes.data(), data->attributes.size(), FloaterAttributeName) : nullptr;
+				flagged += channel ? static_cast<size_t>(std::count(channel->values.begin(), channel->values.end(), 1.f)) : 0;
+			}
+			std::printf("  %zu floater triangles flagged over the updates, %zu in the final export data\n", floaters, flagged);
+		}
+		MemoryUsage const current = MemoryAccounting::Instance().Current();
+		std::printf("  memory       %.2f MB, peak %.2f MB: caches %.2f MB, export data %.2f MB, spatial index %.2f MB, clusters %.2f MB\n",
+			current.Total() / 1e6, MemoryAccounting::Instance().TotalHighWater() / 1e6, current[MemoryCategory::CpuCaches] / 1e6,
+			current[MemoryCategory::ExportData] / 1e6, current[MemoryCategory::SpatialIndex] / 1e6, current[MemoryCategory::Clusters] / 1e6);
+		if (profile)
+		{
+			std::printf("%s", FrameProfiler::Instance().Format().c_str());
+		}
+		if (!metricsPath.empty())
+		{
+			MetricsRegistry::Instance().StopSnapshots();
+			MetricsSnapshot snapshot = MetricsRegistry::Instance().Snapshot();
+			MetricsRegistry::ComputeRates(metricsBefore, snapshot);
+			std::printf("%s", MetricsRegistry::Format(snapshot).c_str());
+		}
+		if (!tracePath.empty())
+		{
+			SurfaceTrace::Instance().Stop();
+			if (!SurfaceTrace::Instance().WriteChromeTrace(tracePath))
+			{
+				std::fprintf(stderr, "Could not write %s\n", tracePath.c_str());
+				return EXIT_FAILURE;
+			}
+			std::printf("Wrote %s: %zu spans\n", tracePath.c_str(), SurfaceTrace::Instance().Spans().size());
+		}
+
+		if (paths.size() == 3)
+		{
+			// In the order the surfaces first appeared, which is the order of the export a
+			// recording was synthesized from.
+			std::vector<std::shared_ptr<SurfaceData const>> data;
+			std::vector<ObjSurface> surfaces;
+			for (int const id : order)
+			{
+				data.push_back(ingests[id]->GetExportData());
+				auto const& surfaceData = *data.back();
+				ObjSurface surface;
+				surface.id = surfaceData.id;
+				surface.positionsTransformed = surfaceData.positionsTransformed.data();
+				surface.positionsNotTransformed = surfaceData.positionsNotTransformed.data();
+				surface.vertexCount = surfaceData.positionsTransformed.size();
+				surface.faceNormals = surfaceData.faceNormals.data();
+				surface.faceNormalCount = surfaceData.faceNormals.size();
+				surface.indices = surfaceData.Indices();
+				surfaces.push_back(surface);
+			}
+
+			ObjWriter writer;
+			if (!writer.Write(surfaces, paths[1], paths[2]))
+			{
+				std::fprintf(stderr, "Could not write %s\n", paths[1].c_str());
+				return EXIT_FAILURE;
+			}
+			std::printf("Wrote %s and %s: %zu surfaces\n", paths[1].c_str(), paths[2].c_str(), surfaces.size());
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// MeshTools bench-objsize <transformed.obj> <not-transformed.obj> [output folder] [repetitions]
+	// Size and write time of the OBJ export pair with deduplicated normals and of the
+	// not-transformed export with transforms against the legacy layout. The transforms of
+	// the surfaces are fitted to the two captures. Checks the quantized normals against the
+	// face normals, and the transformed positions reconstructed from the transforms.
+	int BenchmarkObjSize(std::vector<std::string> const& args)
+	{
+		if (args.size() < 2)
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-objsize <transformed.obj> <not-transformed.obj> [output folder] [repetitions]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::string const folder = args.size() > 2 ? args[2] : ".";
+		int const repetitions = args.size() > 3 ? std::stoi(args[3]) : 5;
+
+		MeshData mesh;
+		MeshData local;
+		MapSurfaces surfaces;
+		if (!LoadMesh(args[0], mesh) || !LoadMesh(args[1], local) || !MakeMapSurfaces(mesh, &local, surfaces))
+		{
+			return EXIT_FAILURE;
+		}
+
+		std::vector<std::array<float, 16>> transforms(surfaces.surfaces.size());
+		std::vector<ObjSurface> objSurfaces;
+		for (size_t s = 0; s < surfaces.surfaces.size(); s++)
+		{
+			auto const& mapSurface = surfaces.surfaces[s];
+			FitMeshToWorld(mapSurface.localPositions, mapSurface.positions, mapSurface.vertexCount, transforms[s].data());
+
+			ObjSurface surface;
+			surface.id = mapSurface.id;
+			surface.positionsTransformed = mapSurface.positions;
+			surface.positionsNotTransformed = mapSurface.localPositions;
+			surface.vertexCount = mapSurface.vertexCount;
+			surface.faceNormals = mapSurface.faceNormals;
+			surface.faceNormalCount = mapSurface.faceNormalCount;
+			surface.indices = mapSurface.indices;
+			surface.meshToWorld = transforms[s].data();
+			objSurfaces.push_back(surface);
+		}
+
+		struct Variant
+		{
+			char const* label;
+			ObjWriteOptions options;
+			bool withTransforms;
+			std::string first;
+			std::string second;
+			double writeMs;
+		};
+		ObjWriteOptions legacy;
+		ObjWriteOptions deduplicated;
+		deduplicated.deduplicateNormals = true;
+		ObjWriteOptions compact = deduplicated;
+		compact.materials = false;
+		ObjWriteOptions coarse = compact;
+		coarse.normalPrecision = 1e-2f;
+		std::vector<Variant> variants = {
+			{ "legacy", legacy, false, folder + "/bench_objsize_t.obj", folder + "/bench_objsize_nt.obj", 1e30 },
+			{ "deduplicated normals", deduplicated, false, folder + "/bench_objsize_dedup_t.obj", folder + "/bench_objsize_dedup_nt.obj", 1e30 },
+			{ "  without materials", compact, false, folder + "/bench_objsize_compact_t.obj", folder + "/bench_objsize_compact_nt.obj", 1e30 },
+			{ "  normals to 0.01", coarse, false, folder + "/bench_objsize_coarse_t.obj", folder + "/bench_objsize_coarse_nt.obj", 1e30 },
+			{ "not-transformed + transforms", compact, true, folder + "/bench_objsize_local_nt.obj", folder + "/bench_objsize_transforms.txt", 1e30 },
+		};
+
+		ObjWriter writer;
+		for (int r = 0; r < repetitions; r++)
+		{
+			for (auto& variant : variants)
+			{
+				auto const start = Clock::now();
+				if (variant.withTransforms)
+				{
+					writer.WriteWithTransforms(objSurfaces, variant.first, variant.second, variant.options);
+				}
+				else
+				{
+					writer.Write(objSurfaces, variant.first, variant.second, variant.options);
+				}
+				variant.writeMs = std::min(variant.writeMs, MillisecondsSince(start));
+			}
+		}
+
+		auto const fileSize = [](std::string const& path)
+		{
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			return static_cast<double>(file.tellg());
+		};
+		auto const normalLines = [](std::string const& path)
+		{
+			std::ifstream file(path);
+			std::string line;
+			size_t count = 0;
+			while (std::getline(file, line))
+			{
+				count += line.compare(0, 3, "vn ") == 0 ? 1 : 0;
+			}
+			return count;
+		};
+
+		double const legacyBytes = fileSize(variants[0].first) + fileSize(variants[0].second);
+		std::printf("%zu surfaces, %zu triangles, best of %d\n", surfaces.surfaces.size(), mesh.TriangleCount(), repetitions);
+		std::printf("  %-30s %8s %8s %9s %9s\n", "", "MB", "ratio", "write ms", "vn lines");
+		for (auto const& variant : variants)
+		{
+			double const bytes = fileSize(variant.first) + fileSize(variant.second);
+			std::printf("  %-30s %8.3f %7.2fx %9.2f %9zu\n", variant.label, bytes / 1e6, legacyBytes / bytes, variant.writeMs, normalLines(variant.first));
+		}
+		std::printf("  (sizes and write times of both files together)\n");
+
+		// The deduplicated normals are within half a quantization step of the face normals.
+		MeshData fromDeduplicated;
+		ReadObj(variants[1].first, fromDeduplicated);
+		double normalError = fromDeduplicated.indices == mesh.indices ? 0. : INFINITY;
+		for (size_t t = 0; t < mesh.faceNormals.size() && t < fromDeduplicated.faceNormals.size(); t++)
+		{
+			Vector3 const& a = mesh.faceNormals[t];
+			Vector3 const& b = fromDeduplicated.faceNormals[t];
+			if (!std::isnan(a.x))
+			{
+				normalError = std::max(normalError, static_cast<double>(std::max(std::abs(a.x - b.x), std::max(std::abs(a.y - b.y), std::abs(a.z - b.z)))));
+			}
+		}
+
+		MeshData fromTransforms;
+		std::vector<ObjTransform> objTransforms;
+		bool const read = ReadObj(variants[4].first, fromTransforms) && ReadObjTransforms(variants[4].second, objTransforms);
+		size_t worldFrame = 0;
+		for (auto const& transform : objTransforms)
+		{
+			worldFrame += std::equal(transform.matrix, transform.matrix + 16, std::array<float, 16>{ 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f }.data()) ? 1 : 0;
+		}
+		size_t const applied = ApplyObjTransforms(objTransforms, fromTransforms);
+		double const positionError = MaxPositionError(mesh, fromTransforms);
+
+		std::printf("  largest normal component error %.6f, %zu normals for %zu faces\n", normalError, normalLines(variants[1].first), mesh.TriangleCount());
+		std::printf("  transforms reproduce the transformed export within %.4f mm, %zu of %zu surfaces kept in world space\n",
+			positionError * 1000., worldFrame, applied);
+		bool const valid = read && applied == surfaces.surfaces.size() && positionError < 1e-3 && normalError <= 0.5e-3 + 1e-6;
+		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// The CPU side of the buffers SurfaceMesh::RestoreVertexResources() uploads for a cached
+	// surface: SNORM16 positions, SNORM8 vertex normals and 16 bit indices in the observer's
+	// winding.
+	void PrepareRestoredBuffers(SurfaceData const& cached, std::vector<int16_t>& positions, std::vector<int8_t>& normals, std::vector<uint16_t>& indices)
+	{
+		auto const snorm = [](float const value, float const range)
+		{
+			return static_cast<long>(std::lround(std::min(std::max(value, -1.f), 1.f) * range));
+		};
+
+		IndexView const cachedIndices = cached.Indices();
+		std::vector<uint16_t> exportIndices(cachedIndices.count);
+		indices.resize(cachedIndices.count);
+		for (size_t i = 0; i < cachedIndices.count; i++)
+		{
+			exportIndices[i] = static_cast<uint16_t>(cachedIndices[i]);
+		}
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			indices[i] = exportIndices[i + 2];
+			indices[i + 1] = exportIndices[i + 1];
+			indices[i + 2] = exportIndices[i];
+		}
+
+		size_t const vertexCount = cached.positionsNotTransformed.size();
+		std::vector<Vector3> vertexNormals;
+		ComputeVertexNormals(cached.positionsNotTransformed.data(), vertexCount, exportIndices.data(), exportIndices.size(), vertexNormals);
+
+		Vector3 const& s = cached.vertexPositionScale;
+		positions.resize(vertexCount * 4);
+		normals.resize(vertexCount * 4);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			Vector3 const& p = cached.positionsNotTransformed[v];
+			positions[v * 4] = static_cast<int16_t>(snorm(p.x / s.x, 32767.f));
+			positions[v * 4 + 1] = static_cast<int16_t>(snorm(p.y / s.y, 32767.f));
+			positions[v * 4 + 2] = static_cast<int16_t>(snorm(p.z / s.z, 32767.f));
+			positions[v * 4 + 3] = 32767;
+
+			Vector3 const& n = vertexNormals[v];
+			normals[v * 4] = static_cast<int8_t>(snorm(n.x, 127.f));
+			normals[v * 4 + 1] = static_cast<int8_t>(snorm(n.y, 127.f));
+			normals[v * 4 + 2] = static_cast<int8_t>(snorm(n.z, 127.f));
+			normals[v * 4 + 3] = 0;
+		}
+	}
+
+	// MeshTools bench-warmstart [options] <recording.rec> [output folder] [repetitions]
+	// Time to the full map at launch, cold against a warm start from a SurfaceCache. Cold,
+	// the last update of every surface of the recording goes through SurfaceIngest like after
+	// the first observer event of a session. Warm, the cache saved from that map is opened,
+	// validated against the observed surfaces, and every unchanged surface is restored with
+	// the CPU side of its upload while the changed ones are processed cold. The observer's
+	// TryComputeLatestMeshAsync, which the warm start skips as well, is in neither time.
+	// The cache is saved relative to a rotated and shifted frame, as if the anchor of the
+	// last session were located somewhere else in the new one.
+	//   --changed fraction    Surfaces updated since the save, 0 by default
+	//   --floaters            FILTER_FLOATERS with the defaults of Common/Settings.h
+	//   --denoise             DENOISE_SURFACES
+	//   --icp                 ICP_DRIFT_CORRECTION
+	int BenchmarkWarmStart(std::vector<std::string> const& args)
+	{
+		double changed = 0.;
+		IngestOptions options;
+		options.floaters.minTriangles = 20;
+		options.floaters.minArea = 0.01f;
+		options.denoising.iterations = 3;
+		options.denoising.timeBudgetMilliseconds = 5.;
+		options.icp.maxCorrespondenceDistance = 0.05f;
+		options.icp.timeBudgetMilliseconds = 5.;
+		options.attributes = { AttributeKind::Gradient, AttributeKind::Surface, AttributeKind::PlaneDistance };
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--changed" && i + 1 < args.size())
+			{
+				changed = std::stod(args[++i]);
+			}
+			else if (args[i] == "--floaters")
+			{
+				options.filterFloaters = true;
+			}
+			else if (args[i] == "--denoise")
+			{
+				options.denoise = true;
+			}
+			else if (args[i] == "--icp")
+			{
+				options.correctDrift = true;
+			}
+			else
+			{
+				paths.push_back(args[i]);
+			}
+		}
+		if (paths.empty() || changed < 0. || changed > 1.)
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-warmstart [--changed fraction] [--floaters] [--denoise] [--icp] <recording.rec> [output folder] [repetitions]\n");
+			return EXIT_FAILURE;
+		}
+		std::string const folder = paths.size() > 1 ? paths[1] : ".";
+		int const repetitions = paths.size() > 2 ? std::stoi(paths[2]) : 5;
+
+		SurfaceRecording recording;
+		if (!recording.Open(paths[0]))
+		{
+			std::fprintf(stderr, "Could not read %s\n", paths[0].c_str());
+			return EXIT_FAILURE;
+		}
+
+		// The map at the end of the recording, in the order the surfaces first appeared.
+		std::map<int, SurfaceUpdate const*> latest;
+		std::vector<int> order;
+		for (auto const& event : recording.Events())
+		{
+			if (event.kind == RecordKind::Update)
+			{
+				if (latest.count(event.update.id) == 0)
+				{
+					order.push_back(event.update.id);
+				}
+				latest[event.update.id] = &event.update;
+			}
+		}
+
+		// What the observer reports at launch: a newer update time for the changed surfaces.
+		std::vector<int64_t> observedTimes(order.size());
+		size_t changedCount = 0;
+		for (size_t s = 0; s < order.size(); s++)
+		{
+			bool const isChanged = (static_cast<uint32_t>(s) * 2654435761u) % 1000u < changed * 1000.;
+			observedTimes[s] = latest[order[s]]->updateTime + (isChanged ? 1 : 0);
+			changedCount += isChanged ? 1 : 0;
+		}
+
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+		auto const ingestUpdate = [&](SurfaceIngest& ingest, SurfaceUpdate const& update)
+		{
+			if (update.indices.is32Bit)
+			{
+				auto const* const source = static_cast<uint32_t const*>(update.indices.data);
+				indices32.assign(source, source + update.indices.count);
+				ingest.Ingest(update, indices32.data(), indices32.size(), options);
+			}
+			else
+			{
+				auto const* const source = static_cast<uint16_t const*>(update.indices.data);
+				indices16.assign(source, source + update.indices.count);
+				ingest.Ingest(update, indices16.data(), indices16.size(), options);
+			}
+		};
+
+		// A rotation of 30 degrees about y and a shift, and back.
+		float const c = std::cos(0.5235988f);
+		float const s = std::sin(0.5235988f);
+		float const worldToCache[16] = { c, 0.f, -s, 0.f, 0.f, 1.f, 0.f, 0.f, s, 0.f, c, 0.f, 1.5f, -0.25f, 2.f, 1.f };
+		float const cacheToWorld[16] = {
+			c, 0.f, s, 0.f, 0.f, 1.f, 0.f, 0.f, -s, 0.f, c, 0.f,
+			-(1.5f * c - 2.f * s), 0.25f, -(1.5f * s + 2.f * c), 1.f };
+
+		std::vector<double> coldTimes;
+		std::vector<double> warmTimes;
+		std::vector<double> openTimes;
+		std::vector<std::unique_ptr<SurfaceIngest>> cold;
+		std::vector<std::unique_ptr<SurfaceIngest>> warm;
+		SurfaceCacheStatistics statistics;
+		std::string const cachePath = folder + "/warmstart.cache";
+		std::vector<int16_t> positions;
+		std::vector<int8_t> normals;
+		std::vector<uint16_t> uploadIndices;
+		for (int r = 0; r < repetitions; r++)
+		{
+			SpatialIndexCollection coldMap;
+			options.spatialMap = &coldMap;
+			cold.clear();
+			auto start = Clock::now();
+			for (int const id : order)
+			{
+				cold.push_back(std::make_unique<SurfaceIngest>());
+				ingestUpdate(*cold.back(), *latest[id]);
+				coldMap.Update(id, cold.back()->GetSpatialIndex());
+			}
+			coldTimes.push_back(MillisecondsSince(start));
+
+			if (r == 0)
+			{
+				// Saved by the last session: the export data with the transforms into the frame
+				// of its anchor.
+				SurfaceDataSnapshot snapshot;
+				std::vector<CacheTransform> transforms;
+				for (auto const& ingest : cold)
+				{
+					snapshot.push_back(ingest->GetExportData());
+					CacheTransform transform;
+					transform.id = snapshot.back()->id;
+					transform.updateTime = snapshot.back()->updateTime;
+					for (size_t row = 0; row < 4; row++)
+					{
+						for (size_t col = 0; col < 4; col++)
+						{
+							float sum = 0.f;
+							for (size_t k = 0; k < 4; k++)
+							{
+								sum += ingest->MeshToWorld()[4 * row + k] * worldToCache[4 * k + col];
+							}
+							transform.meshToCache[4 * row + col] = sum;
+						}
+					}
+					transforms.push_back(transform);
+				}
+				if (!SurfaceCache::Write(cachePath, snapshot, transforms))
+				{
+					std::fprintf(stderr, "Could not write %s\n", cachePath.c_str());
+					return EXIT_FAILURE;
+				}
+			}
+
+			SpatialIndexCollection warmMap;
+			options.spatialMap = &warmMap;
+			warm.clear();
+			start = Clock::now();
+			SurfaceCache cache;
+			if (!cache.Open(cachePath))
+			{
+				std::fprintf(stderr, "Could not read %s\n", cachePath.c_str());
+				return EXIT_FAILURE;
+			}
+			cache.Validate(order.data(), order.size());
+			openTimes.push_back(MillisecondsSince(start));
+			for (size_t i = 0; i < order.size(); i++)
+			{
+				warm.push_back(std::make_unique<SurfaceIngest>());
+				auto const cached = cache.Take(order[i], observedTimes[i]);
+				if (cached)
+				{
+					warm.back()->Restore(*cached, cacheToWorld, options);
+					PrepareRestoredBuffers(*cached, positions, normals, uploadIndices);
+				}
+				else
+				{
+					ingestUpdate(*warm.back(), *latest[order[i]]);
+				}
+				warmMap.Update(order[i], warm.back()->GetSpatialIndex());
+			}
+			warmTimes.push_back(MillisecondsSince(start));
+			statistics = cache.Statistics();
+		}
+
+		// The restored map against the one processed cold.
+		double maxError = 0.;
+		size_t differentNormals = 0;
+		size_t triangles = 0;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			auto const& a = cold[i]->PositionsTransformed();
+			auto const& b = warm[i]->PositionsTransformed();
+			for (size_t v = 0; v < std::min(a.size(), b.size()); v++)
+			{
+				maxError = std::max(maxError, static_cast<double>(Length(a[v] - b[v])));
+			}
+			auto const& na = cold[i]->FaceNormals();
+			auto const& nb = warm[i]->FaceNormals();
+			for (size_t f = 0; f < std::min(na.size(), nb.size()); f++)
+			{
+				differentNormals += Length(na[f] - nb[f]) > 1e-3f ? 1 : 0;
+			}
+			maxError = a.size() == b.size() && na.size() == nb.size() ? maxError : 1e30;
+			triangles += na.size();
+		}
+
+		auto const median = [](std::vector<double> values) { return Percentile(values, 0.5); };
+		auto const deviation = [](std::vector<double> const& values)
+		{
+			double const mean = std::accumulate(values.begin(), values.end(), 0.) / values.size();
+			double sum = 0.;
+			for (double const value : values)
+			{
+				sum += (value - mean) * (value - mean);
+			}
+			return std::sqrt(sum / values.size());
+		};
+
+		std::printf("%s: %zu surfaces, %zu triangles, %zu changed since the save\n", paths[0].c_str(), order.size(), triangles, changedCount);
+		std::printf("  cache %.2f MB\n", std::filesystem::file_size(cachePath) / 1e6);
+		std::printf("  cold  %8.2f ms  (sd %.2f)\n", median(coldTimes), deviation(coldTimes));
+		std::printf("  warm  %8.2f ms  (sd %.2f), of which open and validate %.2f ms  %.1fx\n",
+			median(warmTimes), deviation(warmTimes), median(openTimes), median(coldTimes) / median(warmTimes));
+		std::printf("  %zu restored, %zu stale, %zu dropped\n", statistics.restored, statistics.stale, statistics.dropped);
+		std::printf("  restored against cold: positions within %.4f mm, %zu face normals differ, of degenerate triangles\n", maxError * 1000., differentNormals);
+		return maxError < 1e-4 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+#ifdef SPATIAL_MAPPING_PROFILE
+	// Feeds the updates of a recording through SurfaceIngest back to back and returns the
+	// processing time in ms.
+	double IngestRecording(SurfaceRecording const& recording, IngestOptions options)
+	{
+		SpatialIndexCollection spatialMap;
+		options.spatialMap = &spatialMap;
+		std::map<int, std::unique_ptr<SurfaceIngest>> ingests;
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+
+		auto const start = Clock::now();
+		for (auto const& event : recording.Events())
+		{
+			if (event.kind != RecordKind::Update)
+			{
+				continue;
+			}
+			auto const& update = event.update;
+			auto& ingest = ingests[update.id];
+			if (!ingest)
+			{
+				ingest = std::make_unique<SurfaceIngest>();
+			}
+			if (update.indices.is32Bit)
+			{
+				auto const* const source = static_cast<uint32_t const*>(update.indices.data);
+				indices32.assign(source, source + update.indices.count);
+				ingest->Ingest(update, indices32.data(), indices32.size(), options);
+			}
+			else
+			{
+				auto const* const source = static_cast<uint16_t const*>(update.indices.data);
+				indices16.assign(source, source + update.indices.count);
+				ingest->Ingest(update, indices16.data(), indices16.size(), options);
+			}
+			spatialMap.Update(update.id, ingest->GetSpatialIndex());
+		}
+		return MillisecondsSince(start);
+	}
+#endif
+
+	// MeshTools bench-profiler [--surfaces n] [--threads n] <recording.rec> [repetitions]
+	// Cost of the FrameProfiler timers. Times a scoped timer on one thread and on several
+	// at once, while another thread summarizes the rings and checks that it never sees a torn
+	// or misattributed sample. From the cost of a timer follows the overhead on a frame of the
+	// app with the given number of surfaces: Main::Update and Render, the renderer's Update
+	// and Render, and UpdateTransform and Draw per surface. The recording is replayed with the
+	// profiler enabled and disabled at runtime, alternately, for the overhead on the processing.
+	//   --surfaces n          Surfaces per frame, 200 by default
+	//   --threads n           Recording threads, 4 by default
+	int BenchmarkProfiler(std::vector<std::string> const& args)
+	{
+#ifndef SPATIAL_MAPPING_PROFILE
+		(void)args;
+		std::fprintf(stderr, "Built without SPATIAL_MAPPING_PROFILE, the timers are compiled out\n");
+		return EXIT_FAILURE;
+#else
+		size_t surfaceCount = 200;
+		size_t threadCount = 4;
+		std::vector<std::string> paths;
+		for (size_t a = 0; a < args.size(); a++)
+		{
+			if (args[a] == "--surfaces" && a + 1 < args.size())
+			{
+				surfaceCount = std::stoul(args[++a]);
+			}
+			else if (args[a] == "--threads" && a + 1 < args.size())
+			{
+				threadCount = std::max<size_t>(1, std::stoul(args[++a]));
+			}
+			else
+			{
+				paths.push_back(args[a]);
+			}
+		}
+		if (paths.empty() || paths.size() > 2)
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-profiler [--surfaces n] [--threads n] <recording.rec> [repetitions]\n");
+			return EXIT_FAILURE;
+		}
+		size_t const repetitions = paths.size() > 1 ? std::max<size_t>(1, std::stoul(paths[1])) : 5;
+
+		SurfaceRecording recording;
+		if (!recording.Open(paths[0]))
+		{
+			std::fprintf(stderr, "Could not read %s\n", paths[0].c_str());
+			return EXIT_FAILURE;
+		}
+
+		FrameProfiler& profiler = FrameProfiler::Instance();
+		size_t const scopes = 1000000;
+
+		// A scope of the app, including the clock reads of the timer itself.
+		auto const timeScopes = [&](size_t const count)
+		{
+			auto const start = Clock::now();
+			for (size_t i = 0; i < count; i++)
+			{
+				PROFILE_PHASE(Draw);
+			}
+			return MillisecondsSince(start) * 1e6 / count;
+		};
+
+		profiler.Enable(false);
+		double const disabledNs = timeScopes(scopes);
+		profiler.Enable(true);
+		timeScopes(FrameProfiler::RingCapacity);
+		double const enabledNs = timeScopes(scopes);
+		profiler.Reset();
+
+		// Every thread records durations that identify its phase, the reader checks them.
+		std::atomic<bool> done{ false };
+		std::atomic<size_t> torn{ 0 };
+		std::atomic<size_t> summaries{ 0 };
+		std::thread reader([&]()
+			{
+				while (!done.load())
+				{
+					for (auto const& summary : profiler.Summaries())
+					{
+						double const expected = (static_cast<double>(summary.phase) + 1.) * 1e-3;
+						if (std::abs(summary.p50 - expected) > 1e-9 || std::abs(summary.max - expected) > 1e-9)
+						{
+							torn++;
+						}
+					}
+					summaries++;
+				}
+			});
+		std::vector<double> threadNs(threadCount);
+		std::vector<std::thread> writers;
+		auto const contendedStart = Clock::now();
+		for (size_t t = 0; t < threadCount; t++)
+		{
+			writers.emplace_back([&, t]()
+				{
+					auto const phase = static_cast<FramePhase>(t % static_cast<size_t>(FramePhase::Count));
+					auto const duration = std::chrono::microseconds(static_cast<size_t>(phase) + 1);
+					auto const start = Clock::now();
+					for (size_t i = 0; i < scopes; i++)
+					{
+						auto const now = FrameProfiler::Clock::now();
+						profiler.Record(phase, now, now + duration);
+					}
+					threadNs[t] = MillisecondsSince(start) * 1e6 / scopes;
+				});
+		}
+		for (auto& writer : writers)
+		{
+			writer.join();
+		}
+		double const contendedMs = MillisecondsSince(contendedStart);
+		done = true;
+		reader.join();
+
+		uint64_t recorded = 0;
+		for (auto const& summary : profiler.Summaries())
+		{
+			recorded += summary.recorded;
+		}
+		profiler.Reset();
+
+		// The phases of a frame, see the class comment of FrameProfiler.
+		double const frameScopes = 4. + 2. * surfaceCount;
+		double const frameOverheadUs = frameScopes * (enabledNs - disabledNs) * 1e-3;
+
+		IngestOptions options;
+		IngestRecording(recording, options);
+		std::vector<double> enabledTimes;
+		std::vector<double> disabledTimes;
+		for (size_t r = 0; r < repetitions; r++)
+		{
+			profiler.Enable(false);
+			disabledTimes.push_back(IngestRecording(recording, options));
+			profiler.Enable(true);
+			enabledTimes.push_back(IngestRecording(recording, options));
+		}
+		auto const median = [](std::vector<double> values)
+		{
+			std::sort(values.begin(), values.end());
+			return values[values.size() / 2];
+		};
+
+		std::printf("Scoped timer: %.1f ns enabled, %.1f ns disabled at runtime, compiled out without SPATIAL_MAPPING_PROFILE\n", enabledNs, disabledNs);
+		std::printf("  %zu threads: %.1f ns per sample (%.1f ms for %zu each), %zu summaries, %zu torn, %llu recorded\n",
+			threadCount, std::accumulate(threadNs.begin(), threadNs.end(), 0.) / threadCount, contendedMs, scopes, summaries.load(),
+			torn.load(), static_cast<unsigned long long>(recorded));
+		std::printf("  frame with %zu surfaces: %.0f timers, %.1f us, %.3f%% of a 60 Hz frame\n",
+			surfaceCount, frameScopes, frameOverheadUs, frameOverheadUs / 16666.7 * 100.);
+		std::printf("  replay %s: %.2f ms enabled, %.2f ms disabled, %+.2f%%\n", paths[0].c_str(),
+			median(enabledTimes), median(disabledTimes), (median(enabledTimes) / median(disabledTimes) - 1.) * 100.);
+		return torn == 0 && recorded == threadCount * scopes ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+	}
+	// The samples of one benchmark on one input, each the time of one iteration.
+	struct BenchmarkResult
+	{
+		std::string name;
+		std::string input;
+		size_t triangles = 0;
+
+		// Processed per iteration, for the throughput.
+		double items = 0.;
+		char const* unit = "";
+
+		// Per sample, chosen in the warm-up so that a sample takes at least MinSampleMs.
+		size_t iterations = 1;
+		std::vector<double> milliseconds;
+	};
+
+	struct SampleStatistics
+	{
+		double mean = 0.;
+		double stddev = 0.;
+		double min = 0.;
+		double median = 0.;
+		double max = 0.;
+	};
+
+	SampleStatistics Summarize(std::vector<double> const& samples)
+	{
+		SampleStatistics statistics;
+		if (samples.empty())
+		{
+			return statistics;
+		}
+		statistics.mean = std::accumulate(samples.begin(), samples.end(), 0.) / samples.size();
+		double squares = 0.;
+		for (double const sample : samples)
+		{
+			squares += (sample - statistics.mean) * (sample - statistics.mean);
+		}
+		statistics.stddev = samples.size() > 1 ? std::sqrt(squares / (samples.size() - 1)) : 0.;
+		statistics.min = *std::min_element(samples.begin(), samples.end());
+		statistics.median = Percentile(samples, 0.5);
+		statistics.max = *std::max_element(samples.begin(), samples.end());
+		return statistics;
+	}
+
+	// Benchmarks shorter than this are repeated within a sample, so that the clock resolution
+	// and the cost of reading it do not dominate.
+	double const MinSampleMs = 2.;
+
+	// Runs fn warmup times, at least once, untimed and then repetitions samples.
+	template <typename Fn>
+	BenchmarkResult RunBenchmark(char const* name, std::string const& input, size_t const triangles, double const items, char const* unit,
+		size_t const warmup, size_t const repetitions, Fn&& fn)
+	{
+		BenchmarkResult result;
+		result.name = name;
+		result.input = input;
+		result.triangles = triangles;
+		result.items = items;
+		result.unit = unit;
+
+		double warmupMs = 1e30;
+		for (size_t w = 0; w < std::max<size_t>(warmup, 1); w++)
+		{
+			auto const start = Clock::now();
+			fn();
+			warmupMs = std::min(warmupMs, MillisecondsSince(start));
+		}
+		result.iterations = warmupMs >= MinSampleMs ? 1 : static_cast<size_t>(std::ceil(MinSampleMs / std::max(warmupMs, 1e-6)));
+
+		for (size_t r = 0; r < repetitions; r++)
+		{
+			auto const start = Clock::now();
+			for (size_t i = 0; i < result.iterations; i++)
+			{
+				fn();
+			}
+			result.milliseconds.push_back(MillisecondsSince(start) / result.iterations);
+		}
+		return result;
+	}
+
+	void PrintBenchmark(BenchmarkResult const& result)
+	{
+		SampleStatistics const s = Summarize(result.milliseconds);
+		std::printf("  %-16s %10.4f %8.4f %6.1f%% %10.4f %10.4f %10.4f %12.0f %s/s\n", result.name.c_str(),
+			s.mean, s.stddev, s.mean > 0. ? s.stddev / s.mean * 100. : 0., s.min, s.median, s.max,
+			s.median > 0. ? result.items / s.median * 1e3 : 0., result.unit);
+	}
+
+	void AppendJsonNumber(std::string& json, char const* const key, double const value)
+	{
+		char text[96];
+		std::snprintf(text, sizeof(text), ",\"%s\":%.9g", key, value);
+		json += text;
+	}
+
+	std::string BenchmarksToJson(std::vector<BenchmarkResult> const& results, size_t const warmup, size_t const repetitions)
+	{
+		char text[128];
+		std::snprintf(text, sizeof(text), "{\"warmup\":%zu,\"repetitions\":%zu,\"workers\":%zu,\"benchmarks\":[", warmup, repetitions, WorkerCount());
+		std::string json = text;
+		for (size_t b = 0; b < results.size(); b++)
+		{
+			auto const& result = results[b];
+			SampleStatistics const s = Summarize(result.milliseconds);
+			json += b > 0 ? ",\n{\"name\":" : "\n{\"name\":";
+			AppendJsonString(json, result.name);
+			json += ",\"input\":";
+			AppendJsonString(json, result.input);
+			json += ",\"unit\":";
+			AppendJsonString(json, result.unit);
+			AppendJsonNumber(json, "triangles", static_cast<double>(result.triangles));
+			AppendJsonNumber(json, "items", result.items);
+			AppendJsonNumber(json, "iterations", static_cast<double>(result.iterations));
+			AppendJsonNumber(json, "mean_ms", s.mean);
+			AppendJsonNumber(json, "stddev_ms", s.stddev);
+			AppendJsonNumber(json, "cv", s.mean > 0. ? s.stddev / s.mean : 0.);
+			AppendJsonNumber(json, "min_ms", s.min);
+			AppendJsonNumber(json, "median_ms", s.median);
+			AppendJsonNumber(json, "max_ms", s.max);
+			AppendJsonNumber(json, "items_per_second", s.median > 0. ? result.items / s.median * 1e3 : 0.);
+			json += ",\"samples_ms\":[";
+			for (size_t r = 0; r < result.milliseconds.size(); r++)
+			{
+				std::snprintf(text, sizeof(text), r > 0 ? ",%.9g" : "%.9g", result.milliseconds[r]);
+				json += text;
+			}
+			json += "]}";
+		}
+		json += "\n]}\n";
+		return json;
+	}
+
+	// The captures of Data/NotImproved/Originals at every triangle resolution, <n>Original.obj,
+	// in the order of n.
+	std::vector<std::string> FindOriginals(std::string const& folder)
+	{
+		std::vector<std::pair<long, std::string>> found;
+		std::error_code error;
+		for (auto const& entry : std::filesystem::directory_iterator(folder, error))
+		{
+			std::string const name = entry.path().filename().string();
+			char* end = nullptr;
+			long const resolution = std::strtol(name.c_str(), &end, 10);
+			if (end != name.c_str() && std::strcmp(end, "Original.obj") == 0)
+			{
+				found.emplace_back(resolution, entry.path().string());
+			}
+		}
+		std::sort(found.begin(), found.end());
+
+		std::vector<std::string> paths;
+		for (auto const& [resolution, path] : found)
+		{
+			paths.push_back(path);
+		}
+		return paths;
+	}
+
+	// MeshTools bench-pipeline [options] [<capture.obj>... | <folder>]
+	// Times the stages of the surface pipeline on every capture, by default the ones of
+	// Data/NotImproved/Originals from 1000 to 8000 triangles per cubic meter. Every stage runs
+	// its warm-up, which also sizes the iterations of a sample, and then the repetitions. Prints
+	// mean, standard deviation, coefficient of variation, min, median and max per iteration
+	// and the throughput at the median, and writes all samples as JSON to track regressions.
+	//   ingest         SurfaceIngest of every surface as a SNORM16 observer update: decode,
+	//                  transform, reverse the winding, face normals and export data
+	//   reverse        ReverseWinding() of the observer's indices alone
+	//   spatial.build  SpatialIndex::Build() over the world-space vertices of every surface
+	//   clusters       MeshClusterBuilder::Build() of every surface with the default sizes
+	//   spatial.radius SpatialIndexSnapshot::RadiusQuery() of 5 cm around every 8th vertex
+	//   spatial.knn    SpatialIndexSnapshot::KNearest() of 8 within 50 cm of every 8th vertex
+	//   export.obj     ObjWriter::Format() of both OBJ exports as SaveAppState writes them
+	//   snap           SnapToPlanes() onto the walls and floor of Python/Improvement.py
+	// The queries run on one thread, ObjWriter on all workers. The tree has no mesh
+	// simplification stage, the observer simplifies to MAX_TRIANGLE_RES, so the densities
+	// stand in for it.
+	//   --warmup n            Untimed runs before the samples, 3 by default
+	//   --repetitions n       Samples per benchmark, 20 by default
+	//   --filter text         Only the benchmarks whose name contains the text
+	//   --json path           Write the results as JSON
+	int BenchmarkPipeline(std::vector<std::string> const& args)
+	{
+		size_t warmup = 3;
+		size_t repetitions = 20;
+		std::string filter;
+		std::string jsonPath;
+		std::vector<std::string> paths;
+		for (size_t a = 0; a < args.size(); a++)
+		{
+			if (args[a] == "--warmup" && a + 1 < args.size())
+			{
+				warmup = std::stoul(args[++a]);
+			}
+			else if (args[a] == "--repetitions" && a + 1 < args.size())
+			{
+				repetitions = std::max<size_t>(1, std::stoul(args[++a]));
+			}
+			else if (args[a] == "--filter" && a + 1 < args.size())
+			{
+				filter = args[++a];
+			}
+			else if (args[a] == "--json" && a + 1 < args.size())
+			{
+				jsonPath = args[++a];
+			}
+			else
+			{
+				paths.push_back(args[a]);
+			}
+		}
+		if (paths.empty())
+		{
+			paths.push_back("Data/NotImproved/Originals");
+		}
+		if (paths.size() == 1 && std::filesystem::is_directory(paths[0]))
+		{
+			paths = FindOriginals(paths[0]);
+		}
+		if (paths.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-pipeline [--warmup n] [--repetitions n] [--filter text] [--json path] [<capture.obj>... | <folder>]\n");
+			return EXIT_FAILURE;
+		}
+
+		// Right wall, left wall and floor of the captures, see Python/Improvement.py.
+		Plane const planes[] = {
+			Plane::FromPointAndNormal({ 2.069f, 0.607f, -1.447f }, { -0.220762f, 0.0020059f, 0.975326f }),
+			Plane::FromPointAndNormal({ 1.271f, 0.375f, 1.540f }, { -0.226781f, 0.00450384f, 0.973935f }),
+			Plane::FromPointAndNormal({ 1.706f, -1.510f, 0.053f }, { 0.00004f, 0.999996f, 0.002974f }) };
+		float const snapThreshold = 0.035f;
+		float const cellSize = 0.05f;
+		size_t const queryStride = 8;
+
+		std::printf("%zu workers, %zu warm-up runs, %zu samples, times per iteration in ms\n", WorkerCount(), warmup, repetitions);
+		std::vector<BenchmarkResult> results;
+		for (auto const& path : paths)
+		{
+			MeshData mesh;
+			if (!LoadMesh(path, mesh))
+			{
+				return EXIT_FAILURE;
+			}
+			std::string const input = std::filesystem::path(path).filename().string();
+			size_t const triangles = mesh.TriangleCount();
+			double const vertices = static_cast<double>(mesh.positions.size());
+
+			// The export stands in for both files, the not-transformed positions are moved by
+			// a rigid transform like in bench-export.
+			ExportSurfaces exportSurfaces;
+			MakeExportSurfaces(mesh, exportSurfaces);
+			MeshData local = mesh;
+			local.positions = exportSurfaces.notTransformed;
+			MapSurfaces mapSurfaces;
+			MakeMapSurfaces(mesh, &local, mapSurfaces);
+
+			std::vector<SyntheticSurface> synthetic(mapSurfaces.surfaces.size());
+			for (size_t s = 0; s < synthetic.size(); s++)
+			{
+				MakeSyntheticSurface(mapSurfaces.surfaces[s], synthetic[s]);
+			}
+
+			std::vector<Vector3> queries;
+			for (size_t v = 0; v < mesh.positions.size(); v += queryStride)
+			{
+				queries.push_back(mesh.positions[v]);
+			}
+
+			SpatialIndexCollection spatialMap;
+			for (auto const& surface : mapSurfaces.surfaces)
+			{
+				auto index = std::make_shared<SpatialIndex>();
+				index->Build(surface.positions, surface.vertexCount, cellSize);
+				spatialMap.Update(surface.id, std::move(index));
+			}
+			auto const snapshot = spatialMap.Snapshot();
+
+			std::printf("%s: %zu surfaces, %zu triangles\n", input.c_str(), synthetic.size(), triangles);
+			std::printf("  %-16s %10s %8s %7s %10s %10s %10s %14s\n", "benchmark", "mean", "stddev", "cv", "min", "median", "max", "throughput");
+			auto const run = [&](char const* name, double const items, char const* unit, auto&& fn)
+			{
+				if (!filter.empty() && std::string(name).find(filter) == std::string::npos)
+				{
+					return;
+				}
+				results.push_back(RunBenchmark(name, input, triangles, items, unit, warmup, repetitions, fn));
+				PrintBenchmark(results.back());
+			};
+
+			IngestOptions ingestOptions;
+			ingestOptions.buildSpatialIndex = false;
+			std::vector<std::unique_ptr<SurfaceIngest>> ingests(synthetic.size());
+			for (auto& ingest : ingests)
+			{
+				ingest = std::make_unique<SurfaceIngest>();
+			}
+			std::vector<uint16_t> indices16;
+			std::vector<uint32_t> indices32;
+			run("ingest", vertices, "vertices", [&]()
+				{
+					// The observer's buffer is compacted in place, so every update gets a copy.
+					for (size_t s = 0; s < synthetic.size(); s++)
+					{
+						auto const& update = synthetic[s].update;
+						if (update.indices.is32Bit)
+						{
+							indices32 = synthetic[s].indices32;
+							ingests[s]->Ingest(update, indices32.data(), indices32.size(), ingestOptions);
+						}
+						else
+						{
+							indices16 = synthetic[s].indices16;
+							ingests[s]->Ingest(update, indices16.data(), indices16.size(), ingestOptions);
+						}
+					}
+				});
+
+			run("reverse", static_cast<double>(triangles), "triangles", [&]()
+				{
+					for (auto const& surface : synthetic)
+					{
+						if (surface.update.indices.is32Bit)
+						{
+							ReverseWinding(surface.indices32.data(), surface.indices32.size(), indices32);
+						}
+						else
+						{
+							ReverseWinding(surface.indices16.data(), surface.indices16.size(), indices16);
+						}
+					}
+				});
+
+			SpatialIndex index;
+			run("spatial.build", vertices, "vertices", [&]()
+				{
+					for (auto const& surface : mapSurfaces.surfaces)
+					{
+						index.Build(surface.positions, surface.vertexCount, cellSize);
+					}
+				});
+
+			MeshClusterBuilder clusterBuilder;
+			MeshClusters clusters;
+			run("clusters", static_cast<double>(triangles), "triangles", [&]()
+				{
+					for (auto const& surface : mapSurfaces.surfaces)
+					{
+						clusterBuilder.Build(surface.positions, surface.vertexCount, surface.indices, ClusterOptions(), clusters);
+					}
+				});
+
+			std::vector<SurfaceNeighbor> neighbors;
+			size_t found = 0;
+			run("spatial.radius", static_cast<double>(queries.size()), "queries", [&]()
+				{
+					for (auto const& query : queries)
+					{
+						snapshot->RadiusQuery(query, cellSize, neighbors);
+						found += neighbors.size();
+					}
+				});
+			run("spatial.knn", static_cast<double>(queries.size()), "queries", [&]()
+				{
+					for (auto const& query : queries)
+					{
+						snapshot->KNearest(query, 8, 0.5f, neighbors);
+						found += neighbors.size();
+					}
+				});
+
+			ObjWriter writer;
+			ObjWriteOptions objOptions;
+			objOptions.materials = false;
+			objOptions.deduplicateNormals = true;
+			std::string transformed;
+			std::string notTransformed;
+			run("export.obj", static_cast<double>(triangles), "triangles", [&]()
+				{
+					writer.Format(exportSurfaces.surfaces, transformed, notTransformed, objOptions);
+				});
+
+			std::vector<Vector3> snapped;
+			run("snap", vertices, "vertices", [&]()
+				{
+					snapped = mesh.positions;
+					SnapToPlanes(snapped.data(), snapped.size(), planes, sizeof(planes) / sizeof(planes[0]), snapThreshold);
+				});
+
+			if (found == 0 && !queries.empty() && filter.empty())
+			{
+				std::fprintf(stderr, "The spatial queries found nothing\n");
+				return EXIT_FAILURE;
+			}
+		}
+
+		if (!jsonPath.empty())
+		{
+			std::ofstream file(jsonPath, std::ios::out | std::ios::binary);
+			file << BenchmarksToJson(results, warmup, repetitions);
+			if (!file)
+			{
+				std::fprintf(stderr, "Could not write %s\n", jsonPath.c_str());
+				return EXIT_FAILURE;
+			}
+			std::printf("Wrote %s: %zu results\n", jsonPath.c_str(), results.size());
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// The triangles of a list as a sorted set, each rotated to start at its smallest index, to
+	// check that a reordering kept every triangle with its winding.
+	template <typename TIndex>
+	std::vector<std::array<uint32_t, 3>> CanonicalTriangles(TIndex const* const indices, size_t const indexCount, std::vector<uint32_t> const* const remap = nullptr)
+	{
+		std::vector<std::array<uint32_t, 3>> triangles(indexCount / 3);
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			std::array<uint32_t, 3> triangle;
+			for (size_t c = 0; c < 3; c++)
+			{
+				triangle[c] = remap != nullptr ? (*remap)[indices[3 * t + c]] : indices[3 * t + c];
+			}
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			triangles[t] = triangle;
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	// MeshTools bench-vertexcache [options] [<capture.obj>... | <folder>]
+	// Reorders the observer's indices of every surface of the captures, by default the ones of
+	// Data/NotImproved/Originals, as SurfaceMesh does with OPTIMIZE_VERTEX_CACHE: Tipsify, the
+	// overdraw order of its clusters and the vertex fetch order. Prints the ACMR and ATVR of a
+	// FIFO cache of 16 and 32 vertices before and after, and the time per surface update of
+	// reordering and remapping the SNORM16 positions and SNORM8 normals. Fails if a triangle
+	// or its winding changed.
+	//   --cache n             Cache size Tipsify optimizes for, 16 by default
+	//   --threshold x         Overdraw cluster threshold, 1.05 by default, 0 for Tipsify only
+	//   --repetitions n       Timed runs, 20 by default
+	int BenchmarkVertexCache(std::vector<std::string> const& args)
+	{
+		VertexCacheOptions options;
+		options.reversedWinding = true;
+		size_t repetitions = 20;
+		std::vector<std::string> paths;
+		for (size_t a = 0; a < args.size(); a++)
+		{
+			if (args[a] == "--cache" && a + 1 < args.size())
+			{
+				options.cacheSize = std::max<size_t>(3, std::stoul(args[++a]));
+			}
+			else if (args[a] == "--threshold" && a + 1 < args.size())
+			{
+				options.overdrawThreshold = std::stof(args[++a]);
+			}
+			else if (args[a] == "--repetitions" && a + 1 < args.size())
+			{
+				repetitions = std::max<size_t>(1, std::stoul(args[++a]));
+			}
+			else
+			{
+				paths.push_back(args[a]);
+			}
+		}
+		if (paths.empty())
+		{
+			paths.push_back("Data/NotImproved/Originals");
+		}
+		if (paths.size() == 1 && std::filesystem::is_directory(paths[0]))
+		{
+			paths = FindOriginals(paths[0]);
+		}
+		if (paths.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-vertexcache [--cache n] [--threshold x] [--repetitions n] [<capture.obj>... | <folder>]\n");
+			return EXIT_FAILURE;
+		}
+
+		std::printf("Optimized for %zu vertices, overdraw threshold %.2f, median of %zu runs\n", options.cacheSize, options.overdrawThreshold, repetitions);
+		std::printf("%-28s %8s %9s %15s %15s %15s %15s %9s %9s\n", "capture", "surfaces", "triangles",
+			"ACMR 16", "ATVR 16", "ACMR 32", "ATVR 32", "ms", "us/surf");
+		bool preserved = true;
+		for (auto const& path : paths)
+		{
+			MeshData mesh;
+			if (!LoadMesh(path, mesh))
+			{
+				return EXIT_FAILURE;
+			}
+			ExportSurfaces exportSurfaces;
+			MakeExportSurfaces(mesh, exportSurfaces);
+			MeshData local = mesh;
+			local.positions = exportSurfaces.notTransformed;
+			MapSurfaces mapSurfaces;
+			MakeMapSurfaces(mesh, &local, mapSurfaces);
+			std::vector<SyntheticSurface> synthetic(mapSurfaces.surfaces.size());
+			for (size_t s = 0; s < synthetic.size(); s++)
+			{
+				MakeSyntheticSurface(mapSurfaces.surfaces[s], synthetic[s], true);
+			}
+
+			// Both orders through the same statistics, summed over the surfaces.
+			VertexCacheStatistics before[2];
+			VertexCacheStatistics after[2];
+			size_t const cacheSizes[2] = { 16, 32 };
+			auto const add = [](VertexCacheStatistics& sum, VertexCacheStatistics const& statistics)
+			{
+				sum.triangles += statistics.triangles;
+				sum.vertices += statistics.vertices;
+				sum.transformed += statistics.transformed;
+			};
+
+			VertexCacheOptimizer optimizer;
+			std::vector<std::vector<uint32_t>> reordered(synthetic.size());
+			std::vector<uint8_t> positions;
+			std::vector<uint8_t> normals;
+			auto const reorder = [&]()
+			{
+				for (size_t s = 0; s < synthetic.size(); s++)
+				{
+					auto const& surface = mapSurfaces.surfaces[s];
+					auto& indices = reordered[s];
+					indices = synthetic[s].indices32;
+					optimizer.OptimizeTriangles(indices.data(), indices.size(), surface.localPositions, surface.vertexCount, options);
+					optimizer.OptimizeVertexFetch(indices.data(), indices.size(), surface.vertexCount);
+					optimizer.RemapVertices(synthetic[s].positions.data(), 4 * sizeof(int16_t), positions);
+					optimizer.RemapVertices(synthetic[s].normals.data(), 4 * sizeof(int8_t), normals);
+				}
+			};
+			std::vector<double> times;
+			for (size_t r = 0; r < repetitions; r++)
+			{
+				auto const start = Clock::now();
+				reorder();
+				times.push_back(MillisecondsSince(start));
+			}
+			std::sort(times.begin(), times.end());
+			double const milliseconds = times[times.size() / 2];
+
+			for (size_t s = 0; s < synthetic.size(); s++)
+			{
+				auto const& original = synthetic[s].indices32;
+				size_t const vertexCount = mapSurfaces.surfaces[s].vertexCount;
+				for (size_t c = 0; c < 2; c++)
+				{
+					add(before[c], AnalyzeVertexCache(original.data(), original.size(), vertexCount, cacheSizes[c]));
+					add(after[c], AnalyzeVertexCache(reordered[s].data(), reordered[s].size(), vertexCount, cacheSizes[c]));
+				}
+
+				// The last run left the remap of the last surface only, so every surface is
+				// reordered once more to compare it.
+				std::vector<uint32_t> indices = original;
+				optimizer.OptimizeTriangles(indices.data(), indices.size(), mapSurfaces.surfaces[s].localPositions, vertexCount, options);
+				optimizer.OptimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+				preserved = preserved && indices == reordered[s]
+					&& CanonicalTriangles(original.data(), original.size(), &optimizer.Remap()) == CanonicalTriangles(indices.data(), indices.size());
+			}
+
+			auto const pair = [](double const from, double const to)
+			{
+				char text[32];
+				std::snprintf(text, sizeof(text), "%.3f -> %.3f", from, to);
+				return std::string(text);
+			};
+			std::printf("%-28s %8zu %9zu %15s %15s %15s %15s %9.3f %9.1f\n", std::filesystem::path(path).filename().string().c_str(),
+				synthetic.size(), before[0].triangles,
+				pair(before[0].Acmr(), after[0].Acmr()).c_str(), pair(before[0].Atvr(), after[0].Atvr()).c_str(),
+				pair(before[1].Acmr(), after[1].Acmr()).c_str(), pair(before[1].Atvr(), after[1].Atvr()).c_str(),
+				milliseconds, synthetic.empty() ? 0. : milliseconds * 1e3 / synthetic.size());
+		}
+
+		if (!preserved)
+		{
+			std::fprintf(stderr, "The reordering changed the triangles or is not deterministic\n");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// MeshTools bench-clusters [options] [<capture.obj>... | <folder>]
+	// Partitions every surface of the captures, by default the ones of
+	// Data/NotImproved/Originals, into clusters as SurfaceIngest does with BUILD_CLUSTERS, one
+	// builder per worker over the surfaces, and fails if the clusters differ from the ones of
+	// a single builder. Then culls them for viewpoints like the ones the captures were taken
+	// from: the app starts with the headset at the origin of the world, 1.5 m above the floor
+	// of the captures, and the user looks around the room from there and from 0.5 m to each
+	// side, in 8 directions 10 degrees below the horizon. Prints the build time, the sizes of
+	// the clusters and the fraction culled by the frustum, by the normal cones of the rest and
+	// in total, and the triangles culled against culling whole surfaces by their bounds.
+	//   --vertices n          Vertices per cluster, 64 by default
+	//   --triangles n         Triangles per cluster, 124 by default
+	//   --fov h v             Field of view in degrees, 30 by 17.5 of the HoloLens display by default
+	//   --repetitions n       Timed builds, 20 by default
+	int BenchmarkClusters(std::vector<std::string> const& args)
+	{
+		ClusterOptions options;
+		float horizontalFov = 30.f;
+		float verticalFov = 17.5f;
+		size_t repetitions = 20;
+		std::vector<std::string> paths;
+		for (size_t a = 0; a < args.size(); a++)
+		{
+			if (args[a] == "--vertices" && a + 1 < args.size())
+			{
+				options.maxVertices = std::stoul(args[++a]);
+			}
+			else if (args[a] == "--triangles" && a + 1 < args.size())
+			{
+				options.maxTriangles = std::stoul(args[++a]);
+			}
+			else if (args[a] == "--fov" && a + 2 < args.size())
+			{
+				horizontalFov = std::stof(args[++a]);
+				verticalFov = std::stof(args[++a]);
+			}
+			else if (args[a] == "--repetitions" && a + 1 < args.size())
+			{
+				repetitions = std::max<size_t>(1, std::stoul(args[++a]));
+			}
+			else
+			{
+				paths.push_back(args[a]);
+			}
+		}
+		if (paths.empty())
+		{
+			paths.push_back("Data/NotImproved/Originals");
+		}
+		if (paths.size() == 1 && std::filesystem::is_directory(paths[0]))
+		{
+			paths = FindOriginals(paths[0]);
+		}
+		if (paths.empty())
+		{
+			std::fprintf(stderr, "Usage: MeshTools bench-clusters [--vertices n] [--triangles n] [--fov h v] [--repetitions n] [<capture.obj>... | <folder>]\n");
+			return EXIT_FAILURE;
+		}
+
+		float const degrees = 3.14159265f / 180.f;
+		std::vector<ClusterView> views;
+		Vector3 const eyes[] = { { 0.f, 0.f, 0.f }, { 0.5f, 0.f, 0.f }, { -0.5f, 0.f, 0.f }, { 0.f, 0.f, 0.5f }, { 0.f, 0.f, -0.5f } };
+		for (Vector3 const& eye : eyes)
+		{
+			for (size_t d = 0; d < 8; d++)
+			{
+				float const yaw = d * 45.f * degrees;
+				float const pitch = -10.f * degrees;
+				Vector3 const forward{ std::cos(pitch) * std::sin(yaw), std::sin(pitch), -std::cos(pitch) * std::cos(yaw) };
+				views.push_back(ClusterView::FromLookAt(eye, forward, { 0.f, 1.f, 0.f }, horizontalFov * degrees, verticalFov * degrees, 0.1f, 20.f));
+			}
+		}
+
+		std::printf("%zu workers, %zu views of %.1f by %.1f degrees, median of %zu builds\n", WorkerCount(), views.size(), horizontalFov, verticalFov, repetitions);
+		std::printf("%-20s %8s %9s %8s %7s %7s %9s %9s %9s %9s %9s %14s\n", "capture", "surfaces", "triangles", "clusters",
+			"verts", "tris", "build ms", "frustum", "cone", "culled", "KB", "tris culled");
+		bool deterministic = true;
+		for (auto const& path : paths)
+		{
+			MeshData mesh;
+			if (!LoadMesh(path, mesh))
+			{
+				return EXIT_FAILURE;
+			}
+			MapSurfaces mapSurfaces;
+			MakeMapSurfaces(mesh, nullptr, mapSurfaces);
+			auto const& surfaces = mapSurfaces.surfaces;
+
+			std::vector<MeshClusterBuilder> builders(BlockCount(surfaces.size(), 1));
+			std::vector<MeshClusters> clusters(surfaces.size());
+			auto const build = [&]()
+			{
+				ParallelFor(surfaces.size(), 1, [&](size_t const begin, size_t const end, size_t const block)
+					{
+						for (size_t s = begin; s < end; s++)
+						{
+							builders[block].Build(surfaces[s].positions, surfaces[s].vertexCount, surfaces[s].indices, options, clusters[s]);
+						}
+					});
+			};
+			std::vector<double> times;
+			for (size_t r = 0; r < repetitions; r++)
+			{
+				auto const start = Clock::now();
+				build();
+				times.push_back(MillisecondsSince(start));
+			}
+			std::sort(times.begin(), times.end());
+
+			MeshClusterBuilder single;
+			MeshClusters reference;
+			size_t clusterCount = 0;
+			size_t clusterVertices = 0;
+			size_t bytes = 0;
+			for (size_t s = 0; s < surfaces.size(); s++)
+			{
+				single.Build(surfaces[s].positions, surfaces[s].vertexCount, surfaces[s].indices, options, reference);
+				deterministic = deterministic && reference.vertices == clusters[s].vertices && reference.triangles == clusters[s].triangles &&
+					reference.clusters.size() == clusters[s].clusters.size() &&
+					std::memcmp(reference.clusters.data(), clusters[s].clusters.data(), reference.clusters.size() * sizeof(MeshCluster)) == 0;
+				clusterCount += clusters[s].clusters.size();
+				clusterVertices += clusters[s].vertices.size();
+				bytes += clusters[s].Bytes();
+			}
+
+			// Whole surfaces are culled by the sphere around their bounding box.
+			std::vector<MeshCluster> surfaceBounds(surfaces.size());
+			for (size_t s = 0; s < surfaces.size(); s++)
+			{
+				Vector3 low = surfaces[s].positions[0];
+				Vector3 high = low;
+				for (size_t v = 0; v < surfaces[s].vertexCount; v++)
+				{
+					Vector3 const& p = surfaces[s].positions[v];
+					low = { std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z) };
+					high = { std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z) };
+				}
+				surfaceBounds[s].center = (low + high) * 0.5f;
+				surfaceBounds[s].radius = Length(high - low) * 0.5f;
+			}
+
+			size_t outside = 0;
+			size_t facingAway = 0;
+			size_t trianglesCulled = 0;
+			size_t surfaceTrianglesCulled = 0;
+			for (ClusterView const& view : views)
+			{
+				for (size_t s = 0; s < surfaces.size(); s++)
+				{
+					if (IsOutsideView(surfaceBounds[s], view))
+					{
+						surfaceTrianglesCulled += surfaces[s].indices.count / 3;
+					}
+					for (MeshCluster const& cluster : clusters[s].clusters)
+					{
+						bool const culledByFrustum = IsOutsideView(cluster, view);
+						bool const culledByCone = !culledByFrustum && IsFacingAway(cluster, view.eye);
+						outside += culledByFrustum ? 1 : 0;
+						facingAway += culledByCone ? 1 : 0;
+						trianglesCulled += culledByFrustum || culledByCone ? cluster.triangleCount : 0;
+					}
+				}
+			}
+
+			double const viewClusters = static_cast<double>(clusterCount) * views.size();
+			double const viewTriangles = static_cast<double>(mesh.TriangleCount()) * views.size();
+			char culledTriangles[32];
+			std::snprintf(culledTriangles, sizeof(culledTriangles), "%.1f -> %.1f%%", surfaceTrianglesCulled / viewTriangles * 100., trianglesCulled / viewTriangles * 100.);
+			std::printf("%-20s %8zu %9zu %8zu %7.1f %7.1f %9.3f %8.1f%% %8.1f%% %8.1f%% %9.1f %14s\n", std::filesystem::path(path).filename().string().c_str(),
+				surfaces.size(), mesh.TriangleCount(), clusterCount,
+				clusterCount > 0 ? static_cast<double>(clusterVertices) / clusterCount : 0.,
+				clusterCount > 0 ? static_cast<double>(mesh.TriangleCount()) / clusterCount : 0.,
+				times[times.size() / 2], outside / viewClusters * 100., facingAway / viewClusters * 100., (outside + facingAway) / viewClusters * 100.,
+				bytes / 1e3, culledTriangles);
+		}
+
+		if (!deterministic)
+		{
+			std::fprintf(stderr, "The clusters depend on the workers that built them\n");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// One surface update of a timing trace: when the observer delivered it, and what it cost
+	// and left behind at the density of the recording.
+	struct TraceUpdate
+	{
+		double seconds = 0.;
+		int id = 0;
+		double costMs = 0.;
+		size_t triangles = 0;
+		size_t bytes = 0;
+	};
+
+	// Times SurfaceIngest of every update of a recording, as SurfaceMesh runs it.
+	bool TimeRecording(std::string const& path, std::vector<TraceUpdate>& trace)
+	{
+		SurfaceRecording recording;
+		if (!recording.Open(path))
+		{
+			return false;
+		}
+
+		SpatialIndexCollection spatialMap;
+		IngestOptions options;
+		options.spatialMap = &spatialMap;
+		std::map<int, std::unique_ptr<SurfaceIngest>> ingests;
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+		for (auto const& event : recording.Events())
+		{
+			if (event.kind != RecordKind::Update)
+			{
+				continue;
+			}
+			auto const& update = event.update;
+			auto& ingest = ingests[update.id];
+			if (!ingest)
+			{
+				ingest = std::make_unique<SurfaceIngest>();
+			}
+
+			auto const start = Clock::now();
+			IngestResult result;
+			if (update.indices.is32Bit)
+			{
+				auto const* const source = static_cast<uint32_t const*>(update.indices.data);
+				indices32.assign(source, source + update.indices.count);
+				result = ingest->Ingest(update, indices32.data(), indices32.size(), options);
+			}
+			else
+			{
+				auto const* const source = static_cast<uint16_t const*>(update.indices.data);
+				indices16.assign(source, source + update.indices.count);
+				result = ingest->Ingest(update, indices16.data(), indices16.size(), options);
+			}
+			spatialMap.Update(update.id, ingest->GetSpatialIndex());
+
+			SurfaceMemory memory;
+			ingest->ReportMemory(memory);
+			TraceUpdate traced;
+			traced.seconds = std::chrono::duration<double>(event.captureTime).count();
+			traced.id = update.id;
+			traced.costMs = MillisecondsSince(start);
+			traced.triangles = result.indexCount / 3;
+			traced.bytes = memory.Usage().Total();
+			trace.push_back(traced);
+		}
+		return true;
+	}
+
+	bool ReadTimingTrace(std::string const& path, std::vector<TraceUpdate>& trace)
+	{
+		std::ifstream file(path);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			TraceUpdate traced;
+			if (std::sscanf(line.c_str(), "%lf,%d,%lf,%zu,%zu", &traced.seconds, &traced.id, &traced.costMs, &traced.triangles, &traced.bytes) == 5)
+			{
+				trace.push_back(traced);
+			}
+		}
+		return !trace.empty();
+	}
+
+	// The device the simulation runs the controller against.
+	struct DevicePlant
+	{
+		double recordedDensity = 8000.;
+		double costScale = 1.;
+		double renderMs = 8.;
+		double renderMsPerMillionTriangles = 20.;
+
+		// Latency of TryComputeLatestMeshAsync, during which the computation counts against
+		// the concurrent computations.
+		double computeMs = 50.;
+
+		// Share of the mesh processing of a frame that delays the frame, from the cores it
+		// takes from the render thread.
+		double contention = 0.5;
+	};
+
+	struct DensityRun
+	{
+		std::vector<double> frameMs;
+		std::vector<double> meshMs;
+		std::vector<double> memoryBytes;
+		std::vector<size_t> backlog;
+		DensitySettings final;
+		size_t adjustments = 0;
+		size_t dropped = 0;
+		size_t expired = 0;
+	};
+
+	// Plays the trace through the plant at the frames the plant allows, with a controller
+	// that adapts, or one that only reports the settings it starts at.
+	DensityRun SimulateDensity(std::vector<TraceUpdate> const& trace, double const seconds, DevicePlant const& plant,
+		DensityControllerOptions const& options, bool const adaptive, bool const verbose)
+	{
+		struct Resident
+		{
+			double lastUpdate = 0.;
+			double scale = 1.;
+			size_t triangles = 0;
+			size_t bytes = 0;
+		};
+
+		struct Computation
+		{
+			double done = 0.;
+			double scale = 1.;
+			TraceUpdate update;
+		};
+
+		DensityController controller(options);
+		DensityRun run;
+		double const traceSeconds = trace.back().seconds + 1.;
+		std::map<int, Resident> resident;
+		std::map<int, TraceUpdate> pending;
+		std::vector<Computation> computing;
+		size_t next = 0;
+		size_t repetition = 0;
+		double now = 0.;
+		while (now < seconds)
+		{
+			DensitySettings const settings = controller.Current();
+			double const scale = settings.triangleDensity / plant.recordedDensity;
+
+			// The observer events up to now. A repetition of the trace maps new surfaces, which
+			// is what a walk through a building looks like. An update that was not asked for
+			// before the next one of its surface is superseded.
+			bool observed = false;
+			while (trace[next].seconds + repetition * traceSeconds <= now)
+			{
+				TraceUpdate update = trace[next];
+				update.id += static_cast<int>(repetition) * 100000;
+				update.seconds += repetition * traceSeconds;
+				if (!pending.emplace(update.id, update).second)
+				{
+					pending[update.id] = update;
+					run.dropped++;
+				}
+				observed = true;
+				if (++next == trace.size())
+				{
+					next = 0;
+					repetition++;
+				}
+			}
+
+			// Like RealtimeSurfaceMeshRenderer::AddOrUpdateSurfaceAsync, every observer event
+			// asks for the surfaces with a newer update while fewer than the concurrent
+			// computations are in flight. The others wait for the next event.
+			if (observed)
+			{
+				for (auto update = pending.begin(); update != pending.end() && computing.size() < settings.concurrentComputations;)
+				{
+					computing.push_back({ now + plant.computeMs / 1000., scale, update->second });
+					update = pending.erase(update);
+				}
+			}
+
+			// The processing of a computed mesh, at the density it was asked for.
+			double meshMs = 0.;
+			for (auto computation = computing.begin(); computation != computing.end();)
+			{
+				if (computation->done > now)
+				{
+					++computation;
+					continue;
+				}
+				TraceUpdate const& update = computation->update;
+				meshMs += update.costMs * plant.costScale * computation->scale;
+				resident[update.id] = { now, computation->scale, update.triangles, update.bytes };
+				computation = computing.erase(computation);
+			}
+
+			double triangles = 0.;
+			double bytes = 0.;
+			for (auto surface = resident.begin(); surface != resident.end();)
+			{
+				if (now - surface->second.lastUpdate > settings.retentionSeconds)
+				{
+					surface = resident.erase(surface);
+					run.expired++;
+					continue;
+				}
+				triangles += surface->second.triangles * surface->second.scale;
+				bytes += surface->second.bytes * surface->second.scale;
+				++surface;
+			}
+
+			double const frameMs = plant.renderMs + plant.renderMsPerMillionTriangles * triangles / 1e6 + plant.contention * meshMs;
+			run.frameMs.push_back(frameMs);
+			run.meshMs.push_back(meshMs);
+			run.memoryBytes.push_back(bytes);
+			run.backlog.push_back(pending.size());
+
+			// Like SpatialMappingMain::UpdateDensity, the controller takes the work of the frame,
+			// not the vsync period it ends up taking below.
+			DensityMeasurement measurement;
+			measurement.frameMilliseconds = frameMs;
+			measurement.meshMilliseconds = meshMs;
+			measurement.memoryBytes = static_cast<size_t>(bytes);
+			if (adaptive && controller.Update(measurement) && verbose)
+			{
+				DensitySettings const& changed = controller.Current();
+				std::printf("  %8.2f s  density %6.0f  computations %zu  retention %5.0f s  (frame %.2f, mesh %.2f, memory %.2f)\n",
+					now, changed.triangleDensity, changed.concurrentComputations, changed.retentionSeconds,
+					controller.FrameLoad(), controller.MeshLoad(), controller.MemoryLoad());
+			}
+
+			// A late frame misses the next vsync.
+			double const periodMs = options.targetFrameMilliseconds;
+			now += std::ceil(frameMs / periodMs - 1e-9) * periodMs / 1000.;
+		}
+		run.final = controller.Current();
+		run.adjustments = controller.Adjustments();
+		return run;
+	}
+
+	// MeshTools simulate-density [options] <recording.rec | trace.csv>
+	// Runs the DensityController, see Processing/DensityController.h, against a model of the
+	// device fed with the surface updates of a recording. Like the app, every observer event
+	// asks for the updated surfaces while fewer than the concurrent computations are in
+	// flight, each computation takes --compute-ms and then costs its recorded processing time
+	// scaled by its density, and the frame takes a base render time, time per resident
+	// triangle and part of the mesh time. Surfaces past the retention are erased with their
+	// memory, like RealtimeSurfaceMeshRenderer does. The app retains surfaces from the last
+	// time the observer listed them, which the trace does not have: the simulation counts
+	// from their last update instead.
+	// The timing of a recording is measured with SurfaceIngest; a CSV trace of
+	// "seconds,surface,ms,triangles,bytes" lines makes the run deterministic. Fails if the
+	// controller misses a budget over the second half while it could still lower a setting
+	// that lowers that load, or if the updates waiting for a computation keep growing: more
+	// than the surfaces of one pass of the trace over the last quarter, and more than over the
+	// quarter before.
+	//   --seconds s           Simulated time, the trace repeats with new surfaces (default 300)
+	//   --trace-out path      Write the timing trace as CSV
+	//   --density d           Triangle density of the recording (default 8000)
+	//   --cost-scale x        Factor of the processing times, for a slower CPU (default 1)
+	//   --render-ms ms        Render time of an empty map (default 8)
+	//   --render-ms-per-mt ms Render time per million resident triangles (default 20)
+	//   --compute-ms ms       Latency of a mesh computation (default 50)
+	//   --contention x        Share of the mesh time that delays the frame (default 0.5)
+	//   --frame-ms ms         Frame budget (default 16.67)
+	//   --mesh-ms ms          Mesh processing budget per frame (default 2)
+	//   --memory-mb mb        Memory budget of the map (default 256)
+	//   --verbose             Print every adjustment
+	int SimulateDensity(std::vector<std::string> const& args)
+	{
+		double seconds = 300.;
+		std::string traceOutPath;
+		bool verbose = false;
+		DevicePlant plant;
+		DensityControllerOptions options;
+		std::vector<std::string> paths;
+		for (size_t a = 0; a < args.size(); a++)
+		{
+			std::string const& arg = args[a];
+			bool const hasValue = a + 1 < args.size();
+			if (arg == "--seconds" && hasValue)
+			{
+				seconds = std::stod(args[++a]);
+			}
+			else if (arg == "--trace-out" && hasValue)
+			{
+				traceOutPath = args[++a];
+			}
+			else if (arg == "--density" && hasValue)
+			{
+				plant.recordedDensity = std::stod(args[++a]);
+				options.maxTriangleDensity = plant.recordedDensity;
+			}
+			else if (arg == "--cost-scale" && hasValue)
+			{
+				plant.costScale = std::stod(args[++a]);
+			}
+			else if (arg == "--render-ms" && hasValue)
+			{
+				plant.renderMs = std::stod(args[++a]);
+			}
+			else if (arg == "--render-ms-per-mt" && hasValue)
+			{
+				plant.renderMsPerMillionTriangles = std::stod(args[++a]);
+			}
+			else if (arg == "--compute-ms" && hasValue)
+			{
+				plant.computeMs = std::stod(args[++a]);
+			}
+			else if (arg == "--contention" && hasValue)
+			{
+				plant.contention = std::stod(args[++a]);
+			}
+			else if (arg == "--frame-ms" && hasValue)
+			{
+				options.targetFrameMilliseconds = std::stod(args[++a]);
+			}
+			else if (arg == "--mesh-ms" && hasValue)
+			{
+				options.meshMillisecondsPerFrame = std::stod(args[++a]);
+			}
+			else if (arg == "--memory-mb" && hasValue)
+			{
+				options.memoryBudgetBytes = static_cast<size_t>(std::stod(args[++a]) * 1024. * 1024.);
+			}
+			else if (arg == "--verbose")
+			{
+				verbose = true;
+			}
+			else
+			{
+				paths.push_back(arg);
+			}
+		}
+		if (paths.size() != 1)
+		{
+			std::fprintf(stderr, "Usage: MeshTools simulate-density [--seconds s] [--trace-out path] [--density d] [--cost-scale x] [--render-ms ms] [--render-ms-per-mt ms] [--compute-ms ms] [--contention x] [--frame-ms ms] [--mesh-ms ms] [--memory-mb mb] [--verbose] <recording.rec | trace.csv>\n");
+			return EXIT_FAILURE;
+		}
+
+		std::vector<TraceUpdate> trace;
+		bool const csv = std::filesystem::path(paths[0]).extension() == ".csv";
+		if (!(csv ? ReadTimingTrace(paths[0], trace) : TimeRecording(paths[0], trace)) || trace.empty())
+		{
+			std::fprintf(stderr, "Could not read %s\n", paths[0].c_str());
+			return EXIT_FAILURE;
+		}
+		if (!traceOutPath.empty())
+		{
+			std::ofstream file(traceOutPath, std::ios::out | std::ios::binary);
+			for (auto const& update : trace)
+			{
+				char line[128];
+				std::snprintf(line, sizeof(line), "%.6f,%d,%.4f,%zu,%zu\n", update.seconds, update.id, update.costMs, update.triangles, update.bytes);
+				file << line;
+			}
+			if (!file)
+			{
+				std::fprintf(stderr, "Could not write %s\n", traceOutPath.c_str());
+				return EXIT_FAILURE;
+			}
+		}
+
+		double costMs = 0.;
+		for (auto const& update : trace)
+		{
+			costMs += update.costMs;
+		}
+		std::printf("%s: %zu updates over %.1f s, %.2f ms per update, simulated for %.0f s at cost x%.1f\n", paths[0].c_str(),
+			trace.size(), trace.back().seconds, costMs / trace.size(), seconds, plant.costScale);
+		std::printf("  budgets: frame %.2f ms, mesh %.2f ms per frame, memory %.1f MB\n",
+			options.targetFrameMilliseconds, options.meshMillisecondsPerFrame, options.memoryBudgetBytes / 1048576.);
+
+		// The budgets are judged over the second half, after the controller settled.
+		struct Outcome
+		{
+			double frameMs;
+			double frameP95;
+			double meshMs;
+			double memoryMB;
+			double backlog;
+			bool backlogGrowing;
+		};
+		std::set<int> ids;
+		for (auto const& update : trace)
+		{
+			ids.insert(update.id);
+		}
+		double const surfaces = static_cast<double>(ids.size());
+		auto const judge = [surfaces](DensityRun const& run)
+			{
+				size_t const half = run.frameMs.size() / 2;
+				std::vector<double> const frames(run.frameMs.begin() + half, run.frameMs.end());
+				double const count = static_cast<double>(frames.size());
+				Outcome outcome;
+				outcome.frameMs = std::accumulate(frames.begin(), frames.end(), 0.) / count;
+				outcome.frameP95 = Percentile(frames, 0.95);
+				outcome.meshMs = std::accumulate(run.meshMs.begin() + half, run.meshMs.end(), 0.) / count;
+				outcome.memoryMB = std::accumulate(run.memoryBytes.begin() + half, run.memoryBytes.end(), 0.) / count / 1048576.;
+				outcome.backlog = std::accumulate(run.backlog.begin() + half, run.backlog.end(), 0.) / count;
+
+				size_t const quarter = run.backlog.size() / 4;
+				double const third = std::accumulate(run.backlog.begin() + half, run.backlog.end() - quarter, 0.);
+				double const last = std::accumulate(run.backlog.end() - quarter, run.backlog.end(), 0.);
+				outcome.backlogGrowing = last / quarter > surfaces && last > third;
+				return outcome;
+			};
+
+		std::printf("  %-9s %7s %9s %9s %9s %8s %8s %6s %10s %8s %7s\n",
+			"", "frames", "frame ms", "p95 ms", "mesh ms", "memory", "backlog", "density", "computations", "retention", "changes");
+		bool held = true;
+		bool keptUp = true;
+		for (bool const adaptive : { false, true })
+		{
+			DensityRun const run = SimulateDensity(trace, seconds, plant, options, adaptive, verbose && adaptive);
+			Outcome const outcome = judge(run);
+			std::printf("  %-9s %7zu %9.2f %9.2f %9.3f %6.1f MB %8.1f %7.0f %12zu %7.0f s %7zu\n",
+				adaptive ? "adaptive" : "fixed", run.frameMs.size(), outcome.frameMs, outcome.frameP95, outcome.meshMs,
+				outcome.memoryMB, outcome.backlog, run.final.triangleDensity, run.final.concurrentComputations,
+				run.final.retentionSeconds, run.adjustments);
+			if (adaptive)
+			{
+				// A budget is missed fairly only when the settings that lower its load are at
+				// their minima.
+				bool const minDensity = run.final.triangleDensity <= options.minTriangleDensity;
+				bool const minComputations = run.final.concurrentComputations <= options.minConcurrentComputations;
+				bool const minRetention = run.final.retentionSeconds <= options.minRetentionSeconds;
+				held = (outcome.frameMs <= options.targetFrameMilliseconds || (minDensity && minRetention)) &&
+					(outcome.meshMs <= options.meshMillisecondsPerFrame || (minComputations && minDensity)) &&
+					(outcome.memoryMB * 1048576. <= options.memoryBudgetBytes || (minRetention && minDensity));
+				keptUp = !outcome.backlogGrowing;
+			}
+		}
+		if (!held)
+		{
+			std::fprintf(stderr, "The controller did not hold the budgets\n");
+			return EXIT_FAILURE;
+		}
+		if (!keptUp)
+		{
+			std::fprintf(stderr, "The updates waiting for a computation keep growing\n");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::fprintf(stderr,
+			"Usage: MeshTools <command> [arguments]\n"
+			"  evaluate <reference.obj> <capture.obj>...  Cloud-to-mesh and mesh-to-mesh distances\n"
+			"  report [Data folder]                       Data/Improved against Data/NotImproved\n"
+			"  bench-index [radius] [k]                   Spatial index build and query benchmark\n"
+			"  icp <target.obj> <source.obj> [options]    Point-to-plane alignment of two captures\n"
+			"  components [options] <capture.obj>...      Connected components and floater removal\n"
+			"  denoise [options] <mesh.obj>...            Bilateral denoising and plane residuals\n"
+			"  bench-export <capture.obj> [folder] [n]    OBJ export speed and byte-identity\n"
+			"  to-binary [opts] <smap> <t.obj> [nt.obj]   Convert an OBJ export to a binary map\n"
+			"  to-obj <map.smap> <t.obj> <nt.obj>         Convert a binary map to an OBJ export\n"
+			"  bench-objread [--repetitions n] <obj>...   Parallel OBJ reading throughput\n"
+			"  bench-load <capture.obj> [folder] [n]      OBJ against memory-mapped binary loading\n"
+			"  replay <journal> [save <t.obj> <nt.obj>]   List the saves of a journaled map or export one\n"
+			"  bench-journal <capture.obj> [folder] [n]   Journaled against full saves, compaction, replay\n"
+			"  bench-frames <capture.obj> [folder] [n]    Frame times while exporting in the background\n"
+			"  to-glb <map.glb> <t.obj> [nt.obj] [opts]   Convert an OBJ export to quantized binary glTF\n"
+			"  bench-glb <capture.obj> [folder] [n]       GLB against OBJ size, speed and precision\n"
+			"  bench-attributes <capture.obj> [dir] [n]   Vertex color and glTF attribute exports\n"
+			"  bench-codec [options] <capture.obj>...     Mesh compression ratio and speed\n"
+			"  record-surfaces [opts] <rec> <t> <nt>      Synthesize a surface recording from an export\n"
+			"  replay-surfaces [opts] <rec> [<t> <nt>]    Replay a recording through the surface processing\n"
+			"  bench-objsize <t.obj> <nt.obj> [dir] [n]   Deduplicated normals and transforms in OBJ exports\n"
+			"  bench-warmstart [opts] <rec> [dir] [n]     Time to the full map with and without the surface cache\n"
+			"  bench-profiler [opts] <rec> [n]            Overhead of the frame phase timers\n"
+			"  bench-pipeline [opts] [<obj>... | <dir>]   Pipeline stages over the captures, with JSON results\n"
+			"  bench-vertexcache [opts] [<obj>...]        Vertex cache and fetch reordering of the surfaces\n"
+			"  bench-clusters [opts] [<obj>...]           Surface clusters, their build time and culling\n"
+			"  simulate-density [opts] <rec | trace.csv>  Adaptive triangle density against a device model\n");
+		return EXIT_FAILURE;
+	}
+
+	std::string const command = argv[1];
+	std::vector<std::string> const args(argv + 2, argv + argc);
+
+	if (command == "evaluate")
+	{
+		return Evaluate(args);
+	}
+	if (command == "report")
+	{
+		return Report(args);
+	}
+	if (command == "bench-index")
+	{
+		return BenchmarkSpatialIndex(args);
+	}
+	if (command == "icp")
+	{
+		return AlignCaptures(args);
+	}
+	if (command == "components")
+	{
+		return FilterComponents(args);
+	}
+	if (command == "denoise")
+	{
+		return Denoise(args);
+	}
+	if (command == "bench-export")
+	{
+		return BenchmarkExport(args);
+	}
+	if (command == "bench-objread")
+	{
+		return BenchmarkObjRead(args);
+	}
+	if (command == "to-binary")
+	{
+		return ConvertToBinary(args);
+	}
+	if (command == "to-obj")
+	{
+		return ConvertToObj(args);
+	}
+	if (command == "bench-load")
+	{
+		return BenchmarkLoad(args);
+	}
+	if (command == "replay")
+	{
+		return Replay(args);
+	}
+	if (command == "bench-journal")
+	{
+		return BenchmarkJournal(args);
+	}
+	if (command == "bench-frames")
+	{
+		return BenchmarkFrames(args);
+	}
+	if (command == "to-glb")
+	{
+		return ConvertToGlb(args);
+	}
+	if (command == "bench-glb")
+	{
+		return BenchmarkGlb(args);
+	}
+	if (command == "bench-attributes")
+	{
+		return BenchmarkAttributes(args);
+	}
+	if (command == "bench-codec")
+	{
+		return BenchmarkCodec(args);
+	}
+	if (command == "record-surfaces")
+	{
+		return RecordSurfaces(args);
+	}
+	if (command == "replay-surfaces")
+	{
+		return ReplaySurfaces(args);
+	}
+	if (command == "bench-objsize")
+	{
+		return BenchmarkObjSize(args);
+	}
+	if (command == "bench-warmstart")
+	{
+		return BenchmarkWarmStart(args);
+	}
+	if (command == "bench-profiler")
+	{
+		return BenchmarkProfiler(args);
+	}
+	if (command == "bench-pipeline")
+	{
+		return BenchmarkPipeline(args);
+	}
+	if (command == "bench-vertexcache")
+	{
+		return BenchmarkVertexCache(args);
+	}
+	if (command == "bench-clusters")
+	{
+		return BenchmarkClusters(args);
+	}
+	if (command == "simulate-density")
+	{
+		return SimulateDensity(args);
+	}
+
+	std::fprintf(stderr, "Unknown command %s\n", command.c_str());
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+#include "DensityController.h"
+
+#include <algorithm>
+
+using namespace SpatialMapping;
+
+DensityController::DensityController(DensityControllerOptions const& options) :
+	m_options(options)
+{
+	m_settings.triangleDensity = options.maxTriangleDensity;
+	m_settings.concurrentComputations = options.maxConcurrentComputations;
+	m_settings.retentionSeconds = options.maxRetentionSeconds;
+}
+
+bool DensityController::Update(DensityMeasurement const& measurement)
+{
+	if (!m_measured)
+	{
+		m_frameMilliseconds = measurement.frameMilliseconds;
+		m_meshMilliseconds = measurement.meshMilliseconds;
+		m_memoryBytes = static_cast<double>(measurement.memoryBytes);
+		m_measured = true;
+	}
+	else
+	{
+		double const a = m_options.smoothing;
+		m_frameMilliseconds += a * (measurement.frameMilliseconds - m_frameMilliseconds);
+		m_meshMilliseconds += a * (measurement.meshMilliseconds - m_meshMilliseconds);
+		m_memoryBytes += a * (measurement.memoryBytes - m_memoryBytes);
+	}
+
+	if (++m_framesSinceAdjustment < m_options.holdFrames)
+	{
+		return false;
+	}
+
+	DensitySettings const before = m_settings;
+	double const frameLoad = FrameLoad();
+	double const meshLoad = MeshLoad();
+	double const memoryLoad = MemoryLoad();
+
+	// One setting per adjustment, chosen by the load that is over its budget: the mesh time
+	// spreads over more frames with fewer computations, the frame time shrinks with fewer
+	// triangles to draw, and the retention is what memory costs. Fewer computations do not
+	// make a frame cheaper to render, they only leave the updates waiting. The density is the
+	// last resort of the mesh time and of memory, the retention that of the frame time.
+	if (frameLoad > 1. || meshLoad > 1. || memoryLoad > 1.)
+	{
+		if (meshLoad > 1. && m_settings.concurrentComputations > m_options.minConcurrentComputations)
+		{
+			m_settings.concurrentComputations--;
+		}
+		else if (frameLoad > 1. && m_settings.triangleDensity > m_options.minTriangleDensity)
+		{
+			m_settings.triangleDensity = std::max(m_options.minTriangleDensity, m_settings.triangleDensity * m_options.densityDecrease);
+		}
+		else if (memoryLoad > 1. && m_settings.retentionSeconds > m_options.minRetentionSeconds)
+		{
+			m_settings.retentionSeconds = std::max(m_options.minRetentionSeconds, m_settings.retentionSeconds * m_options.retentionDecrease);
+		}
+		else if ((meshLoad > 1. || memoryLoad > 1.) && m_settings.triangleDensity > m_options.minTriangleDensity)
+		{
+			m_settings.triangleDensity = std::max(m_options.minTriangleDensity, m_settings.triangleDensity * m_options.densityDecrease);
+		}
+		else if (frameLoad > 1. && m_settings.retentionSeconds > m_options.minRetentionSeconds)
+		{
+			m_settings.retentionSeconds = std::max(m_options.minRetentionSeconds, m_settings.retentionSeconds * m_options.retentionDecrease);
+		}
+	}
+	else
+	{
+		// A setting is raised when the loads it adds to have headroom: the density adds to
+		// all three, the computations to the mesh time, the retention to the frame time and
+		// memory.
+		bool const frameRoom = frameLoad < m_options.headroom;
+		bool const meshRoom = meshLoad < m_options.headroom;
+		bool const memoryRoom = memoryLoad < m_options.headroom;
+		if (frameRoom && meshRoom && memoryRoom && m_settings.triangleDensity < m_options.maxTriangleDensity)
+		{
+			m_settings.triangleDensity = std::min(m_options.maxTriangleDensity, m_settings.triangleDensity + m_options.densityIncrease);
+		}
+		else if (meshRoom && m_settings.concurrentComputations < m_options.maxConcurrentComputations)
+		{
+			m_settings.concurrentComputations++;
+		}
+		else if (frameRoom && memoryRoom && m_settings.retentionSeconds < m_options.maxRetentionSeconds)
+		{
+			m_settings.retentionSeconds = std::min(m_options.maxRetentionSeconds, m_settings.retentionSeconds + m_options.retentionIncrease);
+		}
+	}
+
+	bool const changed = m_settings.triangleDensity != before.triangleDensity ||
+		m_settings.concurrentComputations != before.concurrentComputations ||
+		m_settings.retentionSeconds != before.retentionSeconds;
+	if (changed)
+	{
+		m_framesSinceAdjustment = 0;
+		m_adjustments++;
+	}
+	return changed;
+}
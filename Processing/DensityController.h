@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+
+namespace SpatialMapping
+{
+	struct DensityControllerOptions
+	{
+		// The budgets the controller holds: the frame time, the CPU time of the mesh
+		// processing per frame and the bytes of the map, see Processing/MemoryAccounting.h.
+		double targetFrameMilliseconds = 1000. / 60.;
+		double meshMillisecondsPerFrame = 2.;
+		size_t memoryBudgetBytes = 256 << 20;
+
+		// The ranges of the settings. The controller starts at their maxima.
+		double minTriangleDensity = 1000.;
+		double maxTriangleDensity = 8000.;
+		size_t minConcurrentComputations = 1;
+		size_t maxConcurrentComputations = 4;
+		float minRetentionSeconds = 60.f;
+		float maxRetentionSeconds = 600.f;
+
+		// Weight of a new frame in the smoothed loads.
+		double smoothing = 0.05;
+
+		// Frames between two adjustments, so that the effect of one is measured before the next.
+		size_t holdFrames = 30;
+
+		// Loads below this fraction of their budget let the controller raise the settings again.
+		double headroom = 0.75;
+
+		// Multiplicative decrease and additive increase, which settle just below a budget
+		// instead of oscillating around it.
+		double densityDecrease = 0.8;
+		double densityIncrease = 250.;
+		float retentionDecrease = 0.75f;
+		float retentionIncrease = 30.f;
+	};
+
+	// What the controller measures in one frame.
+	struct DensityMeasurement
+	{
+		// The CPU time of the frame, not the interval between frames, which vsync holds at
+		// the period of the display however little the frame takes.
+		double frameMilliseconds = 0.;
+
+		// Of all mesh processing that finished during the frame, on any thread.
+		double meshMilliseconds = 0.;
+		size_t memoryBytes = 0;
+	};
+
+	// What the controller sets.
+	struct DensitySettings
+	{
+		// Triangles per cubic meter requested from TryComputeLatestMeshAsync.
+		double triangleDensity = 0.;
+
+		// TryComputeLatestMeshAsync calls in flight; observer updates beyond them are taken
+		// up by a later ObservedSurfacesChanged.
+		size_t concurrentComputations = 0;
+
+		// Seconds a surface stays in the collection after it was last seen.
+		float retentionSeconds = 0.f;
+	};
+
+	// Feedback controller of the cost of the spatial mapping. Mesh time over budget lowers the
+	// concurrent computations, then the triangle density; frame time over budget lowers the
+	// density, then the retention; memory over budget shortens the retention, then lowers the
+	// density. A setting is raised again when the loads it adds to have headroom, the density
+	// before the computations and the retention. Pure logic without clocks or threads, so
+	// that a recorded session can be simulated, see MeshTools simulate-density.
+	class DensityController
+	{
+	public:
+		explicit DensityController(DensityControllerOptions const& options = {});
+
+		// Takes the measurements of one frame. Returns true if the settings changed.
+		bool Update(DensityMeasurement const& measurement);
+
+		DensitySettings const& Current() const { return m_settings; }
+		DensityControllerOptions const& Options() const { return m_options; }
+
+		// The smoothed measurements relative to their budgets.
+		double FrameLoad() const { return m_frameMilliseconds / m_options.targetFrameMilliseconds; }
+		double MeshLoad() const { return m_meshMilliseconds / m_options.meshMillisecondsPerFrame; }
+		double MemoryLoad() const { return m_memoryBytes / static_cast<double>(m_options.memoryBudgetBytes); }
+
+		size_t Adjustments() const { return m_adjustments; }
+
+	private:
+		DensityControllerOptions m_options;
+		DensitySettings m_settings;
+
+		bool m_measured = false;
+		double m_frameMilliseconds = 0.;
+		double m_meshMilliseconds = 0.;
+		double m_memoryBytes = 0.;
+
+		size_t m_framesSinceAdjustment = 0;
+		size_t m_adjustments = 0;
+	};
+}
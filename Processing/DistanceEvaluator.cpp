@@ -0,0 +1,327 @@
+#include "DistanceEvaluator.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	uint32_t const LeafSize = 4;
+	size_t const QueryBlockSize = 4096;
+
+	Vector3 Min(Vector3 const& a, Vector3 const& b) { return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }; }
+	Vector3 Max(Vector3 const& a, Vector3 const& b) { return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) }; }
+
+	float DistanceSquaredToBox(Vector3 const& p, Vector3 const& boxMin, Vector3 const& boxMax)
+	{
+		float const dx = std::max(std::max(boxMin.x - p.x, 0.f), p.x - boxMax.x);
+		float const dy = std::max(std::max(boxMin.y - p.y, 0.f), p.y - boxMax.y);
+		float const dz = std::max(std::max(boxMin.z - p.z, 0.f), p.z - boxMax.z);
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	// Closest point on triangle abc, see Ericson - Real-Time Collision Detection, 5.1.5.
+	Vector3 ClosestPointOnTriangle(Vector3 const& p, Vector3 const& a, Vector3 const& b, Vector3 const& c)
+	{
+		Vector3 const ab = b - a;
+		Vector3 const ac = c - a;
+		Vector3 const ap = p - a;
+
+		float const d1 = Dot(ab, ap);
+		float const d2 = Dot(ac, ap);
+		if (d1 <= 0.f && d2 <= 0.f)
+		{
+			return a;
+		}
+
+		Vector3 const bp = p - b;
+		float const d3 = Dot(ab, bp);
+		float const d4 = Dot(ac, bp);
+		if (d3 >= 0.f && d4 <= d3)
+		{
+			return b;
+		}
+
+		float const vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+		{
+			return a + ab * (d1 / (d1 - d3));
+		}
+
+		Vector3 const cp = p - c;
+		float const d5 = Dot(ab, cp);
+		float const d6 = Dot(ac, cp);
+		if (d6 >= 0.f && d5 <= d6)
+		{
+			return c;
+		}
+
+		float const vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+		{
+			return a + ac * (d2 / (d2 - d6));
+		}
+
+		float const va = d3 * d6 - d5 * d4;
+		if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+		{
+			return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+
+		float const denominator = 1.f / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+}
+
+std::vector<Vector3> SpatialMapping::ReferencedPositions(MeshData const& mesh)
+{
+	std::vector<bool> referenced(mesh.positions.size(), false);
+	for (uint32_t const index : mesh.indices)
+	{
+		referenced[index] = true;
+	}
+
+	std::vector<Vector3> positions;
+	positions.reserve(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		if (referenced[i])
+		{
+			positions.push_back(mesh.positions[i]);
+		}
+	}
+	return positions;
+}
+
+void TriangleBvh::Build(MeshData const& mesh)
+{
+	m_mesh = &mesh;
+	m_nodes.clear();
+
+	uint32_t const triangleCount = static_cast<uint32_t>(mesh.TriangleCount());
+	m_triangles.resize(triangleCount);
+	m_triangleNormals.resize(triangleCount);
+
+	std::vector<Vector3> centroids(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++)
+	{
+		auto const& a = mesh.positions[mesh.indices[t * 3]];
+		auto const& b = mesh.positions[mesh.indices[t * 3 + 1]];
+		auto const& c = mesh.positions[mesh.indices[t * 3 + 2]];
+
+		m_triangles[t] = t;
+		m_triangleNormals[t] = Normalize(Cross(b - a, c - a));
+		centroids[t] = (a + b + c) * (1.f / 3.f);
+	}
+
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	m_nodes.reserve(2 * (triangleCount / LeafSize + 1));
+	m_nodes.emplace_back();
+	BuildNode(0, 0, triangleCount, centroids);
+}
+
+void TriangleBvh::BuildNode(uint32_t const nodeIndex, uint32_t const first, uint32_t const count, std::vector<Vector3> const& centroids)
+{
+	Vector3 boundsMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+	Vector3 boundsMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	Vector3 centroidMin = boundsMin;
+	Vector3 centroidMax = boundsMax;
+
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		uint32_t const t = m_triangles[i];
+		for (int corner = 0; corner < 3; corner++)
+		{
+			auto const& p = m_mesh->positions[m_mesh->indices[t * 3 + corner]];
+			boundsMin = Min(boundsMin, p);
+			boundsMax = Max(boundsMax, p);
+		}
+		centroidMin = Min(centroidMin, centroids[t]);
+		centroidMax = Max(centroidMax, centroids[t]);
+	}
+
+	m_nodes[nodeIndex].boundsMin = boundsMin;
+	m_nodes[nodeIndex].boundsMax = boundsMax;
+
+	if (count <= LeafSize)
+	{
+		m_nodes[nodeIndex].first = first;
+		m_nodes[nodeIndex].count = count;
+		return;
+	}
+
+	// Median split along the longest axis of the centroid bounds.
+	Vector3 const extent = centroidMax - centroidMin;
+	int const axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	auto const component = [axis](Vector3 const& v) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); };
+
+	uint32_t const half = count / 2;
+	std::nth_element(
+		m_triangles.begin() + first,
+		m_triangles.begin() + first + half,
+		m_triangles.begin() + first + count,
+		[&](uint32_t const a, uint32_t const b) { return component(centroids[a]) < component(centroids[b]); });
+
+	// Children are stored next to each other so that only the first one has to be referenced.
+	uint32_t const childIndex = static_cast<uint32_t>(m_nodes.size());
+	m_nodes[nodeIndex].first = childIndex;
+	m_nodes[nodeIndex].count = 0;
+	m_nodes.emplace_back();
+	m_nodes.emplace_back();
+
+	BuildNode(childIndex, first, half, centroids);
+	BuildNode(childIndex + 1, first + half, count - half, centroids);
+}
+
+bool TriangleBvh::FindClosestPoint(Vector3 const& query, float const maxDistance, ClosestPoint& result) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	result.triangle = UINT32_MAX;
+	result.distanceSquared = maxDistance * maxDistance;
+
+	uint32_t stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		Node const& node = m_nodes[stack[--stackSize]];
+		if (DistanceSquaredToBox(query, node.boundsMin, node.boundsMax) >= result.distanceSquared)
+		{
+			continue;
+		}
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				uint32_t const t = m_triangles[i];
+				Vector3 const p = ClosestPointOnTriangle(
+					query,
+					m_mesh->positions[m_mesh->indices[t * 3]],
+					m_mesh->positions[m_mesh->indices[t * 3 + 1]],
+					m_mesh->positions[m_mesh->indices[t * 3 + 2]]);
+
+				float const d = LengthSquared(p - query);
+				if (d < result.distanceSquared)
+				{
+					result.distanceSquared = d;
+					result.point = p;
+					result.triangle = t;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so that the search radius shrinks early.
+		Node const& left = m_nodes[node.first];
+		Node const& right = m_nodes[node.first + 1];
+		float const dLeft = DistanceSquaredToBox(query, left.boundsMin, left.boundsMax);
+		float const dRight = DistanceSquaredToBox(query, right.boundsMin, right.boundsMax);
+
+		if (dLeft < dRight)
+		{
+			stack[stackSize++] = node.first + 1;
+			stack[stackSize++] = node.first;
+		}
+		else
+		{
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = node.first + 1;
+		}
+	}
+
+	return result.triangle != UINT32_MAX;
+}
+
+std::vector<float> SpatialMapping::ComputeSignedDistances(std::vector<Vector3> const& points, TriangleBvh const& reference)
+{
+	std::vector<float> distances(points.size(), 0.f);
+
+	ParallelFor(points.size(), QueryBlockSize, [&](size_t const begin, size_t const end, size_t)
+		{
+			ClosestPoint closest;
+			for (size_t i = begin; i < end; i++)
+			{
+				if (reference.FindClosestPoint(points[i], FLT_MAX, closest))
+				{
+					float const d = std::sqrt(closest.distanceSquared);
+					bool const inFront = Dot(points[i] - closest.point, reference.TriangleNormal(closest.triangle)) >= 0.f;
+					distances[i] = inFront ? d : -d;
+				}
+			}
+		});
+
+	return distances;
+}
+
+DistanceStatistics SpatialMapping::SummarizeDistances(std::vector<float> const& distances, int const histogramBins, float const histogramRange)
+{
+	DistanceStatistics statistics;
+	statistics.count = distances.size();
+	statistics.histogramRange = histogramRange;
+	statistics.histogram.assign(std::max(1, histogramBins), 0);
+
+	if (distances.empty())
+	{
+		return statistics;
+	}
+
+	double sum = 0.;
+	double sumSquared = 0.;
+	statistics.minimum = DBL_MAX;
+	statistics.maximum = -DBL_MAX;
+
+	float const binScale = statistics.histogram.size() / (2.f * histogramRange);
+	int const lastBin = static_cast<int>(statistics.histogram.size()) - 1;
+
+	for (float const d : distances)
+	{
+		sum += d;
+		sumSquared += static_cast<double>(d) * d;
+		statistics.minimum = std::min<double>(statistics.minimum, d);
+		statistics.maximum = std::max<double>(statistics.maximum, d);
+
+		int const bin = static_cast<int>(std::floor((d + histogramRange) * binScale));
+		statistics.histogram[std::clamp(bin, 0, lastBin)]++;
+	}
+
+	double const n = static_cast<double>(distances.size());
+	statistics.mean = sum / n;
+	statistics.rms = std::sqrt(sumSquared / n);
+	statistics.standardDeviation = std::sqrt(std::max(0., sumSquared / n - statistics.mean * statistics.mean));
+	statistics.maximumAbsolute = std::max(std::abs(statistics.minimum), std::abs(statistics.maximum));
+	return statistics;
+}
+
+MeshComparison SpatialMapping::CompareMeshes(
+	MeshData const& capture,
+	MeshData const& reference,
+	int const histogramBins,
+	float const histogramRange)
+{
+	TriangleBvh referenceBvh;
+	TriangleBvh captureBvh;
+	referenceBvh.Build(reference);
+	captureBvh.Build(capture);
+
+	MeshComparison comparison;
+	comparison.captureToReference = SummarizeDistances(
+		ComputeSignedDistances(ReferencedPositions(capture), referenceBvh), histogramBins, histogramRange);
+	comparison.referenceToCapture = SummarizeDistances(
+		ComputeSignedDistances(ReferencedPositions(reference), captureBvh), histogramBins, histogramRange);
+	comparison.hausdorff = std::max(
+		comparison.captureToReference.maximumAbsolute,
+		comparison.referenceToCapture.maximumAbsolute);
+	return comparison;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct ClosestPoint
+	{
+		Vector3 point;
+		uint32_t triangle = UINT32_MAX;
+		float distanceSquared = 0.f;
+	};
+
+	// Bounding volume hierarchy over the triangles of a MeshData, used to find the closest
+	// point on a reference surface. The tree only references the mesh, which must outlive it.
+	// Queries are read-only and may run concurrently.
+	class TriangleBvh
+	{
+	public:
+		void Build(MeshData const& mesh);
+
+		// Returns false if the mesh is empty or nothing lies within maxDistance.
+		bool FindClosestPoint(Vector3 const& query, float maxDistance, ClosestPoint& result) const;
+
+		// Geometric normal of a triangle, following the winding of the index buffer.
+		Vector3 const& TriangleNormal(uint32_t const triangle) const { return m_triangleNormals[triangle]; }
+		size_t NodeCount() const { return m_nodes.size(); }
+
+	private:
+		struct Node
+		{
+			Vector3 boundsMin;
+			Vector3 boundsMax;
+			uint32_t first = 0; // First child for interior nodes, first triangle for leaves.
+			uint32_t count = 0; // Number of triangles, 0 for interior nodes.
+		};
+
+		void BuildNode(uint32_t nodeIndex, uint32_t first, uint32_t count, std::vector<Vector3> const& centroids);
+
+		MeshData const* m_mesh = nullptr;
+		std::vector<Node> m_nodes;
+		std::vector<uint32_t> m_triangles;
+		std::vector<Vector3> m_triangleNormals;
+	};
+
+	struct DistanceStatistics
+	{
+		size_t count = 0;
+		double mean = 0.;
+		double standardDeviation = 0.;
+		double rms = 0.;
+		double minimum = 0.;
+		double maximum = 0.;
+		double maximumAbsolute = 0.;
+
+		// Histogram of signed distances over [-histogramRange, histogramRange]. Values outside
+		// the range are counted in the first and last bin.
+		float histogramRange = 0.f;
+		std::vector<size_t> histogram;
+	};
+
+	struct MeshComparison
+	{
+		DistanceStatistics captureToReference;
+		DistanceStatistics referenceToCapture;
+		double hausdorff = 0.;
+	};
+
+	// Signed distance from every point to the reference surface. The sign follows the normal
+	// of the closest triangle, positive in front of the surface.
+	std::vector<float> ComputeSignedDistances(std::vector<Vector3> const& points, TriangleBvh const& reference);
+
+	// The device delivers vertices that no triangle references. They are not part of the
+	// surface, so they are skipped when sampling a mesh.
+	std::vector<Vector3> ReferencedPositions(MeshData const& mesh);
+
+	DistanceStatistics SummarizeDistances(std::vector<float> const& distances, int histogramBins, float histogramRange);
+
+	// Point-to-mesh distances in both directions, sampled at the vertices used by the triangles of
+	// either mesh, and the symmetric Hausdorff distance between them.
+	MeshComparison CompareMeshes(
+		MeshData const& capture,
+		MeshData const& reference,
+		int histogramBins = 20,
+		float histogramRange = 0.05f);
+}
@@ -0,0 +1,299 @@
+#include "ExportPipeline.h"
+
+#include "Metrics.h"
+#include "SurfaceCache.h"
+#include "SurfaceTrace.h"
+
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace SpatialMapping;
+
+namespace
+{
+	// Finished states kept for Wait().
+	size_t const FinishedHistory = 32;
+
+	// The export competes with the frame loop for the cores; the scheduler should prefer the
+	// frame loop when both are runnable.
+	void LowerThreadPriority()
+	{
+#ifdef _WIN32
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+		// On Linux the nice value is per thread.
+		setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+	}
+}
+
+size_t SurfaceData::Bytes() const
+{
+	size_t bytes = sizeof(SurfaceData) + (positionsTransformed.capacity() + positionsNotTransformed.capacity() + faceNormals.capacity()) * sizeof(Vector3) +
+		indices16.capacity() * sizeof(uint16_t) + indices32.capacity() * sizeof(uint32_t);
+	for (auto const& channel : attributes)
+	{
+		bytes += channel.values.capacity() * sizeof(float);
+	}
+	return bytes;
+}
+
+ExportPipeline::ExportPipeline(size_t const maxQueueDepth, size_t const maxWorkers) :
+	m_maxQueueDepth(std::max<size_t>(1, maxQueueDepth)),
+	m_objWriter(maxWorkers)
+{
+	m_thread = std::thread([this]() { Run(); });
+}
+
+ExportPipeline::~ExportPipeline()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		m_stopping = true;
+	}
+	m_changed.notify_all();
+	m_thread.join();
+}
+
+uint64_t ExportPipeline::Submit(ExportRequest request)
+{
+	ExportProgress superseded;
+	uint64_t id;
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (m_queue.size() >= m_maxQueueDepth)
+		{
+			superseded = m_queue.front().progress;
+			superseded.state = ExportState::Superseded;
+			m_queue.pop_front();
+		}
+
+		id = m_nextId++;
+		Job job;
+		job.request = std::move(request);
+		job.progress.id = id;
+		job.progress.stepCount =
+			(job.request.transformedPath.empty() && job.request.transformsPath.empty() ? 0 : 1) +
+			(job.request.binaryPath.empty() ? 0 : 1) +
+			(job.request.glbPath.empty() ? 0 : 1) +
+			(job.request.journalPath.empty() ? 0 : 1) +
+			(job.request.cachePath.empty() ? 0 : 1) +
+			(job.request.tracePath.empty() ? 0 : 1);
+		m_last = job.progress;
+		m_queue.push_back(std::move(job));
+	}
+	m_changed.notify_all();
+
+	if (superseded.id != 0)
+	{
+		Finish(superseded);
+	}
+	return id;
+}
+
+ExportProgress ExportPipeline::Wait(uint64_t const id)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_changed.wait(lock, [&]()
+		{
+			bool const queued = std::any_of(m_queue.begin(), m_queue.end(), [id](Job const& job) { return job.progress.id == id; });
+			return id != m_runningId && !queued;
+		});
+
+	auto const finished = m_finished.find(id);
+	if (finished == m_finished.end())
+	{
+		// Finished so long ago that it is no longer in the history.
+		ExportProgress progress;
+		progress.id = id;
+		progress.state = ExportState::Succeeded;
+		return progress;
+	}
+	return finished->second;
+}
+
+ExportProgress ExportPipeline::LastProgress() const
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	return m_last;
+}
+
+void ExportPipeline::OnProgress(std::function<void(ExportProgress const&)> callback)
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	m_callback = std::move(callback);
+}
+
+void ExportPipeline::Report(ExportProgress const& progress)
+{
+	std::function<void(ExportProgress const&)> callback;
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (progress.id == m_last.id)
+		{
+			m_last = progress;
+		}
+		callback = m_callback;
+	}
+	if (callback)
+	{
+		callback(progress);
+	}
+}
+
+void ExportPipeline::Finish(ExportProgress const& progress)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (progress.id == m_runningId)
+		{
+			m_runningId = 0;
+		}
+		m_finished[progress.id] = progress;
+		while (m_finished.size() > FinishedHistory)
+		{
+			m_finished.erase(m_finished.begin());
+		}
+	}
+	Report(progress);
+	m_changed.notify_all();
+}
+
+void ExportPipeline::Run()
+{
+	LowerThreadPriority();
+
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_changed.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+			if (m_queue.empty())
+			{
+				return;
+			}
+			job = std::move(m_queue.front());
+			m_queue.pop_front();
+			m_runningId = job.progress.id;
+		}
+
+		auto const start = std::chrono::steady_clock::now();
+		job.progress.state = ExportState::Running;
+		Report(job.progress);
+
+		bool const succeeded = Execute(job);
+
+		job.progress.state = succeeded ? ExportState::Succeeded : ExportState::Failed;
+		job.progress.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		SurfaceMetrics::Instance().exportMilliseconds.Record(job.progress.milliseconds);
+
+		// The snapshot is released here, not when the next request replaces it.
+		job.request.surfaces.clear();
+		Finish(job.progress);
+	}
+}
+
+bool ExportPipeline::Execute(Job& job)
+{
+	auto const& request = job.request;
+
+	m_objSurfaces.clear();
+	m_mapSurfaces.clear();
+	for (auto const& data : request.surfaces)
+	{
+		ObjSurface surface;
+		surface.id = data->id;
+		surface.positionsTransformed = data->positionsTransformed.data();
+		surface.positionsNotTransformed = data->positionsNotTransformed.data();
+		surface.vertexCount = data->positionsTransformed.size();
+		surface.faceNormals = data->faceNormals.data();
+		surface.faceNormalCount = data->faceNormals.size();
+		surface.indices = data->Indices();
+		surface.meshToWorld = data->meshToWorld;
+		surface.attributes = data->attributes.data();
+		surface.attributeCount = data->attributes.size();
+		m_objSurfaces.push_back(surface);
+
+		SpatialMapSurface mapSurface;
+		mapSurface.id = data->id;
+		mapSurface.updateTime = data->updateTime;
+		std::copy(data->meshToWorld, data->meshToWorld + 16, mapSurface.meshToWorld);
+		mapSurface.vertexPositionScale = data->vertexPositionScale;
+		mapSurface.positions = surface.positionsTransformed;
+		mapSurface.localPositions = surface.positionsNotTransformed;
+		mapSurface.vertexCount = surface.vertexCount;
+		mapSurface.faceNormals = surface.faceNormals;
+		mapSurface.faceNormalCount = surface.faceNormalCount;
+		mapSurface.indices = surface.indices;
+		mapSurface.attributes = surface.attributes;
+		mapSurface.attributeCount = surface.attributeCount;
+		m_mapSurfaces.push_back(mapSurface);
+	}
+
+	bool succeeded = true;
+	auto const step = [&](bool const stepSucceeded)
+	{
+		succeeded = succeeded && stepSucceeded;
+		job.progress.completedSteps++;
+		Report(job.progress);
+	};
+
+	if (!request.transformsPath.empty())
+	{
+		step(m_objWriter.WriteWithTransforms(m_objSurfaces, request.notTransformedPath, request.transformsPath, request.objOptions));
+	}
+	else if (!request.transformedPath.empty())
+	{
+		step(m_objWriter.Write(m_objSurfaces, request.transformedPath, request.notTransformedPath, request.objOptions));
+	}
+
+	if (!request.binaryPath.empty())
+	{
+		step(SpatialMapFile::Write(request.binaryPath, m_mapSurfaces, request.compressBinary ? &request.compression : nullptr));
+	}
+
+	if (!request.glbPath.empty())
+	{
+		step(m_glbWriter.Write(request.glbPath, m_mapSurfaces, request.glbOptions));
+	}
+
+	if (!request.journalPath.empty())
+	{
+		bool saved = true;
+		if (request.journalPath != m_journalPath)
+		{
+			saved = m_journal.Open(request.journalPath);
+			m_journalPath = saved ? request.journalPath : std::string();
+		}
+		saved = saved && m_journal.Save(m_mapSurfaces, request.saveTime);
+
+		// Compacting here delays the next request, which is cheaper than a second thread
+		// competing with the frame loop.
+		if (saved && m_journal.JournalBytes() > request.compactJournalBytes)
+		{
+			m_journal.Compact();
+		}
+		step(saved);
+	}
+
+	if (!request.cachePath.empty())
+	{
+		step(SurfaceCache::Write(request.cachePath, request.surfaces, request.cacheTransforms, request.cacheAnchorSave));
+	}
+
+	if (!request.tracePath.empty())
+	{
+		step(SurfaceTrace::Instance().WriteChromeTrace(request.tracePath));
+	}
+
+	return succeeded;
+}
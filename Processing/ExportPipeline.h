@@ -0,0 +1,186 @@
+#pragma once
+
+#include "GlbFile.h"
+#include "MeshCodec.h"
+#include "MapJournal.h"
+#include "MeshAttributes.h"
+#include "MeshTypes.h"
+#include "ObjWriter.h"
+#include "SpatialMapFile.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// Immutable copy of the CPU caches of one SurfaceMesh. A new one is published with every
+	// update, so an export can hold on to it while the surface keeps changing.
+	struct SurfaceData
+	{
+		int id = 0;
+		int64_t updateTime = 0;
+		float meshToWorld[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+		Vector3 vertexPositionScale{ 1.f, 1.f, 1.f };
+
+		std::vector<Vector3> positionsTransformed;
+		std::vector<Vector3> positionsNotTransformed;
+		std::vector<Vector3> faceNormals;
+		std::vector<AttributeChannel> attributes;
+
+		// Only one of them is used, matching the index format of the surface.
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+
+		void SetIndices(uint16_t const* indices, size_t const count) { indices16.assign(indices, indices + count); indices32.clear(); }
+		void SetIndices(uint32_t const* indices, size_t const count) { indices32.assign(indices, indices + count); indices16.clear(); }
+
+		IndexView Indices() const
+		{
+			return indices16.empty() ? IndexView(indices32.data(), indices32.size()) : IndexView(indices16.data(), indices16.size());
+		}
+
+		// Allocated by the arrays.
+		size_t Bytes() const;
+	};
+
+	using SurfaceDataSnapshot = std::vector<std::shared_ptr<SurfaceData const>>;
+
+	// The transform of a surface into the coordinate system the cache is saved in, taken for
+	// the update the export data of the surface was published with.
+	struct CacheTransform
+	{
+		int id = 0;
+		int64_t updateTime = 0;
+
+		// Row-major like float4x4, points are row vectors.
+		float meshToCache[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+	};
+
+	// One save of the map. Every output whose path is empty is skipped.
+	struct ExportRequest
+	{
+		SurfaceDataSnapshot surfaces;
+		int64_t saveTime = 0;
+
+		std::string transformedPath;
+		std::string notTransformedPath;
+
+		// Replaces the transformed OBJ: the not-transformed one is written with the transforms
+		// of the surfaces in this file, see ObjWriter::WriteWithTransforms().
+		std::string transformsPath;
+
+		std::string binaryPath;
+		std::string glbPath;
+		std::string journalPath;
+
+		ObjWriteOptions objOptions;
+		GlbOptions glbOptions;
+
+		// Stores the binary map with MeshCodec.
+		bool compressBinary = false;
+		MeshCodecOptions compression;
+
+		// The journal is compacted after the save once it is larger than this.
+		uint64_t compactJournalBytes = UINT64_MAX;
+
+		// The surfaces with a transform in cacheTransforms for a warm start of the next
+		// session, see Processing/SurfaceCache.h.
+		std::string cachePath;
+		std::vector<CacheTransform> cacheTransforms;
+
+		// The save of the anchor cacheTransforms lead to, recorded in the cache.
+		uint32_t cacheAnchorSave = 0;
+
+		// The spans recorded by the SurfaceTrace so far, as a Chrome trace.
+		std::string tracePath;
+	};
+
+	enum class ExportState
+	{
+		Queued,
+		Running,
+		Succeeded,
+		Failed,
+		// Dropped from a full queue in favor of a newer request, which contains its changes.
+		Superseded
+	};
+
+	struct ExportProgress
+	{
+		uint64_t id = 0;
+		ExportState state = ExportState::Queued;
+		size_t completedSteps = 0;
+		size_t stepCount = 0;
+		double milliseconds = 0.;
+	};
+
+	// Writes the exports of SaveAppState on a background thread. Submit() never blocks: it
+	// only moves the snapshot into a queue of at most maxQueueDepth pending requests, and
+	// when that is full the oldest pending request is superseded.
+	class ExportPipeline
+	{
+	public:
+		// maxWorkers limits the threads formatting the OBJ files, so that the export leaves
+		// cores to the frame loop.
+		explicit ExportPipeline(size_t maxQueueDepth = 1, size_t maxWorkers = 1);
+
+		// Finishes the pending requests.
+		~ExportPipeline();
+
+		ExportPipeline(ExportPipeline const&) = delete;
+		ExportPipeline& operator=(ExportPipeline const&) = delete;
+
+		uint64_t Submit(ExportRequest request);
+
+		// Blocks until the request has finished or was superseded and returns its final state.
+		ExportProgress Wait(uint64_t id);
+
+		// The state of the most recent request.
+		ExportProgress LastProgress() const;
+
+		// Called on the export thread whenever a request changes state or completes a step.
+		void OnProgress(std::function<void(ExportProgress const&)> callback);
+
+	private:
+		struct Job
+		{
+			ExportRequest request;
+			ExportProgress progress;
+		};
+
+		void Run();
+		bool Execute(Job& job);
+		void Report(ExportProgress const& progress);
+		void Finish(ExportProgress const& progress);
+
+		size_t const m_maxQueueDepth;
+		ObjWriter m_objWriter;
+		GlbWriter m_glbWriter;
+		MapJournal m_journal;
+		std::string m_journalPath;
+
+		// Reused between requests.
+		std::vector<ObjSurface> m_objSurfaces;
+		std::vector<SpatialMapSurface> m_mapSurfaces;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_changed;
+		std::deque<Job> m_queue;
+		std::map<uint64_t, ExportProgress> m_finished;
+		ExportProgress m_last;
+		uint64_t m_nextId = 1;
+		uint64_t m_runningId = 0;
+		bool m_stopping = false;
+		std::function<void(ExportProgress const&)> m_callback;
+
+		std::thread m_thread;
+	};
+}
@@ -0,0 +1,211 @@
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	size_t const PhaseCount = static_cast<size_t>(FramePhase::Count);
+
+	// A sample is one word, so that a reader never sees half of one: the duration in ns, the
+	// lap of the ring it was written in, and the phase.
+	int const DurationBits = 40;
+	int const LapBits = 19;
+	uint64_t const DurationMask = (uint64_t(1) << DurationBits) - 1;
+	uint64_t const LapMask = (uint64_t(1) << LapBits) - 1;
+
+	static_assert(PhaseCount <= 32, "The phase is stored in 5 bits of a sample");
+
+	uint64_t Lap(uint64_t const index)
+	{
+		return (index / FrameProfiler::RingCapacity) & LapMask;
+	}
+
+	double Percentile(std::vector<double> const& sorted, double const p)
+	{
+		if (sorted.empty())
+		{
+			return 0.;
+		}
+		size_t const i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+		return sorted[std::min(i, sorted.size() - 1)];
+	}
+}
+
+char const* SpatialMapping::PhaseName(FramePhase const phase)
+{
+	switch (phase)
+	{
+	case FramePhase::MainUpdate:
+		return "Main::Update";
+	case FramePhase::MainRender:
+		return "Main::Render";
+	case FramePhase::RendererUpdate:
+		return "Renderer::Update";
+	case FramePhase::UpdateTransform:
+		return "SurfaceMesh::UpdateTransform";
+	case FramePhase::RendererRender:
+		return "Renderer::Render";
+	case FramePhase::Draw:
+		return "SurfaceMesh::Draw";
+	case FramePhase::UpdateVertexResources:
+		return "SurfaceMesh::UpdateVertexResources";
+	case FramePhase::Ingest:
+		return "SurfaceIngest";
+	default:
+		return "?";
+	}
+}
+
+FrameProfiler::Ring::Ring()
+{
+	for (auto& sample : samples)
+	{
+		sample.store(0, std::memory_order_relaxed);
+	}
+	for (size_t p = 0; p < PhaseCount; p++)
+	{
+		recorded[p].store(0, std::memory_order_relaxed);
+		recordedAtReset[p].store(0, std::memory_order_relaxed);
+	}
+}
+
+FrameProfiler::RingLease::~RingLease()
+{
+	if (ring != nullptr)
+	{
+		ring->inUse.store(false, std::memory_order_release);
+	}
+}
+
+FrameProfiler& FrameProfiler::Instance()
+{
+	static FrameProfiler profiler;
+	return profiler;
+}
+
+FrameProfiler::Ring& FrameProfiler::ThreadRing()
+{
+	thread_local RingLease lease;
+	if (lease.ring == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto const& ring : m_rings)
+		{
+			bool expected = false;
+			if (ring->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			{
+				lease.ring = ring.get();
+				break;
+			}
+		}
+		if (lease.ring == nullptr)
+		{
+			m_rings.push_back(std::make_unique<Ring>());
+			lease.ring = m_rings.back().get();
+		}
+	}
+	return *lease.ring;
+}
+
+void FrameProfiler::Record(FramePhase const phase, Clock::time_point const start, Clock::time_point const end)
+{
+	Ring& ring = ThreadRing();
+	uint64_t const nanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+	// Only this thread writes the ring, so relaxed loads of its own counters suffice.
+	uint64_t const written = ring.written.load(std::memory_order_relaxed);
+	uint64_t const sample = (static_cast<uint64_t>(phase) << (DurationBits + LapBits)) | (Lap(written) << DurationBits) | std::min(nanoseconds, DurationMask);
+	ring.samples[written % RingCapacity].store(sample, std::memory_order_relaxed);
+	auto& recorded = ring.recorded[static_cast<size_t>(phase)];
+	recorded.store(recorded.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	ring.written.store(written + 1, std::memory_order_release);
+}
+
+std::vector<PhaseSummary> FrameProfiler::Summaries() const
+{
+	std::vector<std::vector<double>> durations(PhaseCount);
+	std::vector<uint64_t> recorded(PhaseCount, 0);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto const& ring : m_rings)
+		{
+			uint64_t const written = ring->written.load(std::memory_order_acquire);
+			uint64_t const resetAt = ring->resetAt.load(std::memory_order_relaxed);
+			uint64_t const begin = std::max(resetAt, written > RingCapacity ? written - RingCapacity : 0);
+			for (uint64_t i = begin; i < written; i++)
+			{
+				// Samples the owner overwrote in the meantime belong to a later lap.
+				uint64_t const sample = ring->samples[i % RingCapacity].load(std::memory_order_relaxed);
+				size_t const phase = static_cast<size_t>(sample >> (DurationBits + LapBits));
+				if (((sample >> DurationBits) & LapMask) == Lap(i) && phase < PhaseCount)
+				{
+					durations[phase].push_back(static_cast<double>(sample & DurationMask) * 1e-6);
+				}
+			}
+
+			for (size_t p = 0; p < PhaseCount; p++)
+			{
+				recorded[p] += ring->recorded[p].load(std::memory_order_relaxed) - ring->recordedAtReset[p].load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	std::vector<PhaseSummary> summaries;
+	for (size_t p = 0; p < PhaseCount; p++)
+	{
+		auto& values = durations[p];
+		if (values.empty())
+		{
+			continue;
+		}
+		std::sort(values.begin(), values.end());
+
+		PhaseSummary summary;
+		summary.phase = static_cast<FramePhase>(p);
+		summary.samples = values.size();
+		summary.recorded = recorded[p];
+		double sum = 0.;
+		for (double const value : values)
+		{
+			sum += value;
+		}
+		summary.mean = sum / values.size();
+		summary.p50 = Percentile(values, 0.5);
+		summary.p95 = Percentile(values, 0.95);
+		summary.p99 = Percentile(values, 0.99);
+		summary.max = values.back();
+		summaries.push_back(summary);
+	}
+	return summaries;
+}
+
+std::string FrameProfiler::Format() const
+{
+	std::string text;
+	char line[256];
+	std::snprintf(line, sizeof(line), "%-36s %9s %9s %9s %9s %9s %9s\n", "phase (ms)", "samples", "mean", "p50", "p95", "p99", "max");
+	text += line;
+	for (auto const& summary : Summaries())
+	{
+		std::snprintf(line, sizeof(line), "%-36s %9zu %9.3f %9.3f %9.3f %9.3f %9.3f\n", PhaseName(summary.phase),
+			summary.samples, summary.mean, summary.p50, summary.p95, summary.p99, summary.max);
+		text += line;
+	}
+	return text;
+}
+
+void FrameProfiler::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto const& ring : m_rings)
+	{
+		ring->resetAt.store(ring->written.load(std::memory_order_acquire), std::memory_order_relaxed);
+		for (size_t p = 0; p < PhaseCount; p++)
+		{
+			ring->recordedAtReset[p].store(ring->recorded[p].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+}
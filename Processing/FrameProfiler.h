@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// The timed phases of a frame and of the surface processing off the frame loop.
+	enum class FramePhase : uint8_t
+	{
+		// SpatialMappingMain::Update and Render.
+		MainUpdate,
+		MainRender,
+
+		// RealtimeSurfaceMeshRenderer::Update, and SurfaceMesh::UpdateTransform per surface.
+		RendererUpdate,
+		UpdateTransform,
+
+		// RealtimeSurfaceMeshRenderer::Render, and SurfaceMesh::Draw per surface.
+		RendererRender,
+		Draw,
+
+		// The task of SurfaceMesh::UpdateVertexResources, which includes Ingest.
+		UpdateVertexResources,
+
+		// SurfaceIngest::Ingest and Restore, also in the tools.
+		Ingest,
+
+		Count
+	};
+
+	char const* PhaseName(FramePhase phase);
+
+	// Milliseconds over the samples still in the rings.
+	struct PhaseSummary
+	{
+		FramePhase phase = FramePhase::MainUpdate;
+
+		// In the rings, and recorded since the last Reset().
+		size_t samples = 0;
+		uint64_t recorded = 0;
+
+		double mean = 0.;
+		double p50 = 0.;
+		double p95 = 0.;
+		double p99 = 0.;
+		double max = 0.;
+	};
+
+	// Collects the durations of the phases above in one ring per thread, so that recording
+	// takes neither a lock nor an allocation once a thread has its ring: the owning thread
+	// writes its samples with relaxed atomics and publishes them with a release store, and
+	// readers drop whatever the owner overwrote while they read. A ring holds the last
+	// RingCapacity samples of its thread; the ring of a thread that exits is reused by the
+	// next new one.
+	//
+	// The app and the tools record through PROFILE_PHASE, which is compiled out unless
+	// SPATIAL_MAPPING_PROFILE is defined for the whole build.
+	class FrameProfiler
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+		static size_t const RingCapacity = 4096;
+
+		static FrameProfiler& Instance();
+
+		// Recording can also be switched off at runtime, at the cost of one relaxed load.
+		void Enable(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+		bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+		void Record(FramePhase phase, Clock::time_point start, Clock::time_point end);
+
+		// One entry per phase with samples.
+		std::vector<PhaseSummary> Summaries() const;
+
+		// The summaries as a table, one line per phase.
+		std::string Format() const;
+
+		// Forgets the samples recorded so far, without stopping the writers.
+		void Reset();
+
+	private:
+		struct Ring
+		{
+			std::atomic<uint64_t> samples[RingCapacity];
+			std::atomic<uint64_t> written{ 0 };
+			std::atomic<uint64_t> resetAt{ 0 };
+			std::atomic<uint64_t> recorded[static_cast<size_t>(FramePhase::Count)];
+			std::atomic<uint64_t> recordedAtReset[static_cast<size_t>(FramePhase::Count)];
+			std::atomic<bool> inUse{ true };
+
+			Ring();
+		};
+
+		// Returns the ring of a thread to the pool when the thread exits.
+		struct RingLease
+		{
+			Ring* ring = nullptr;
+			~RingLease();
+		};
+
+		Ring& ThreadRing();
+
+		std::atomic<bool> m_enabled{ true };
+		mutable std::mutex m_mutex;
+		std::vector<std::unique_ptr<Ring>> m_rings;
+	};
+
+	// Records the time from its construction to its destruction.
+	class ScopedPhase
+	{
+	public:
+		explicit ScopedPhase(FramePhase const phase) :
+			m_phase(phase),
+			m_active(FrameProfiler::Instance().IsEnabled())
+		{
+			if (m_active)
+			{
+				m_start = FrameProfiler::Clock::now();
+			}
+		}
+
+		~ScopedPhase()
+		{
+			if (m_active)
+			{
+				FrameProfiler::Instance().Record(m_phase, m_start, FrameProfiler::Clock::now());
+			}
+		}
+
+		ScopedPhase(ScopedPhase const&) = delete;
+		ScopedPhase& operator=(ScopedPhase const&) = delete;
+
+	private:
+		FramePhase const m_phase;
+		bool const m_active;
+		FrameProfiler::Clock::time_point m_start;
+	};
+}
+
+#define PROFILE_PHASE_NAME_(line) profilePhase##line
+#define PROFILE_PHASE_NAME(line) PROFILE_PHASE_NAME_(line)
+
+// Times the rest of the enclosing scope as FramePhase::phase.
+#ifdef SPATIAL_MAPPING_PROFILE
+#define PROFILE_PHASE(phase) ::SpatialMapping::ScopedPhase const PROFILE_PHASE_NAME(__LINE__)(::SpatialMapping::FramePhase::phase)
+#else
+#define PROFILE_PHASE(phase) ((void)0)
+#endif
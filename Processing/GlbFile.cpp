@@ -0,0 +1,978 @@
+#include "GlbFile.h"
+
+#include "Json.h"
+#include "MappedFile.h"
+#include "MeshNormals.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	uint32_t const GlbMagic = 0x46546c67;
+	uint32_t const GlbVersion = 2;
+	uint32_t const JsonChunk = 0x4e4f534a;
+	uint32_t const BinaryChunk = 0x004e4942;
+
+	int const Byte = 5120;
+	int const UnsignedByte = 5121;
+	int const Short = 5122;
+	int const UnsignedShort = 5123;
+	int const UnsignedInt = 5125;
+	int const Float = 5126;
+
+	int const ArrayBuffer = 34962;
+	int const ElementArrayBuffer = 34963;
+	int const Triangles = 4;
+
+	// Vertex attributes must be aligned to 4 bytes, so SNORM16 positions are padded to 8.
+	size_t const PositionStride = 8;
+	size_t const NormalStride = 4;
+	size_t const ColorStride = 4;
+
+	float const Snorm16 = 32767.f;
+	float const Snorm8 = 127.f;
+
+	size_t Align4(size_t const offset)
+	{
+		return (offset + 3) & ~static_cast<size_t>(3);
+	}
+
+	// Matrices are row-major with row vectors, like DirectX and SpatialMapSurface::meshToWorld.
+	// Read as column-major they are the same matrix for column vectors, which is the glTF
+	// convention, so they are written to the JSON as they are.
+	Vector3 TransformPoint(float const* m, Vector3 const& p)
+	{
+		return {
+			p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12],
+			p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13],
+			p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]
+		};
+	}
+
+	int16_t QuantizeSnorm16(float const value)
+	{
+		return static_cast<int16_t>(std::lround(std::min(1.f, std::max(-1.f, value)) * Snorm16));
+	}
+
+	// Quantizes world-space positions to their bounding box. The matrix scales the box back
+	// from [-1, 1] and moves it to its center.
+	void QuantizeBoundingBox(Vector3 const* const* positions, size_t const* counts, size_t const ranges, float* matrix, std::vector<int16_t>& quantized)
+	{
+		Vector3 minimum{ INFINITY, INFINITY, INFINITY };
+		Vector3 maximum{ -INFINITY, -INFINITY, -INFINITY };
+		for (size_t r = 0; r < ranges; r++)
+		{
+			for (size_t v = 0; v < counts[r]; v++)
+			{
+				auto const& p = positions[r][v];
+				minimum = { std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z) };
+				maximum = { std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z) };
+			}
+		}
+
+		Vector3 const center = (minimum + maximum) * 0.5f;
+		Vector3 half = (maximum - minimum) * 0.5f;
+		half = { half.x > 0.f ? half.x : 1.f, half.y > 0.f ? half.y : 1.f, half.z > 0.f ? half.z : 1.f };
+
+		float const boxToWorld[16] = {
+			half.x, 0.f, 0.f, 0.f,
+			0.f, half.y, 0.f, 0.f,
+			0.f, 0.f, half.z, 0.f,
+			center.x, center.y, center.z, 1.f
+		};
+		std::copy(boxToWorld, boxToWorld + 16, matrix);
+
+		quantized.clear();
+		for (size_t r = 0; r < ranges; r++)
+		{
+			for (size_t v = 0; v < counts[r]; v++)
+			{
+				auto const& p = positions[r][v];
+				quantized.push_back(QuantizeSnorm16((p.x - center.x) / half.x));
+				quantized.push_back(QuantizeSnorm16((p.y - center.y) / half.y));
+				quantized.push_back(QuantizeSnorm16((p.z - center.z) / half.z));
+				quantized.push_back(0);
+			}
+		}
+	}
+
+	// Accessor bounds of the positions, in the stored integers.
+	void QuantizedBounds(std::vector<int16_t> const& positions, int16_t* minimum, int16_t* maximum)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			minimum[axis] = INT16_MAX;
+			maximum[axis] = INT16_MIN;
+			for (size_t v = 0; v < positions.size() / 4; v++)
+			{
+				minimum[axis] = std::min(minimum[axis], positions[4 * v + axis]);
+				maximum[axis] = std::max(maximum[axis], positions[4 * v + axis]);
+			}
+		}
+	}
+
+	// Normals of the quantized mesh. Viewers transform them with the inverse transpose of the
+	// node matrix, which gives the normals of the world-space mesh.
+	void QuantizeNormals(std::vector<int16_t> const& positions, std::vector<uint32_t> const& indices, std::vector<int8_t>& quantized)
+	{
+		size_t const vertexCount = positions.size() / 4;
+		std::vector<Vector3> points(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			points[v] = { static_cast<float>(positions[4 * v]), static_cast<float>(positions[4 * v + 1]), static_cast<float>(positions[4 * v + 2]) };
+		}
+
+		std::vector<Vector3> normals;
+		ComputeVertexNormals(points.data(), vertexCount, indices.data(), indices.size(), normals);
+
+		quantized.resize(4 * vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			// Unreferenced vertices have no normal, but glTF requires unit length.
+			Vector3 const n = LengthSquared(normals[v]) > 0.f ? normals[v] : Vector3{ 0.f, 1.f, 0.f };
+			quantized[4 * v] = static_cast<int8_t>(std::lround(n.x * Snorm8));
+			quantized[4 * v + 1] = static_cast<int8_t>(std::lround(n.y * Snorm8));
+			quantized[4 * v + 2] = static_cast<int8_t>(std::lround(n.z * Snorm8));
+			quantized[4 * v + 3] = 0;
+		}
+	}
+
+	// Application-specific vertex attributes must start with an underscore, and are upper case
+	// by convention.
+	std::string AttributeSemantic(std::string const& name)
+	{
+		std::string semantic = "_";
+		for (char const c : name)
+		{
+			semantic += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+		}
+		return semantic;
+	}
+
+	void AppendNumber(std::string& out, double const value)
+	{
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.9g", value);
+		out += text;
+	}
+
+	void AppendUnsigned(std::string& out, size_t const value)
+	{
+		out += std::to_string(value);
+	}
+
+	void AppendPadded(std::string& out, void const* data, size_t const bytes)
+	{
+		out.append(static_cast<char const*>(data), bytes);
+		out.append(Align4(bytes) - bytes, '\0');
+	}
+
+	void AppendUint32(std::string& out, uint32_t const value)
+	{
+		out.append(reinterpret_cast<char const*>(&value), sizeof(value));
+	}
+
+	// Column-major 4x4 matrices for the reader, as glTF stores them.
+	void Multiply(float const* a, float const* b, float* result)
+	{
+		float product[16];
+		for (int column = 0; column < 4; column++)
+		{
+			for (int row = 0; row < 4; row++)
+			{
+				float sum = 0.f;
+				for (int k = 0; k < 4; k++)
+				{
+					sum += a[k * 4 + row] * b[column * 4 + k];
+				}
+				product[column * 4 + row] = sum;
+			}
+		}
+		std::copy(product, product + 16, result);
+	}
+
+	void NodeMatrix(JsonValue const& node, float* matrix)
+	{
+		float const identity[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+		std::copy(identity, identity + 16, matrix);
+
+		auto const* const values = node.Find("matrix");
+		if (values && values->array.size() == 16)
+		{
+			for (size_t i = 0; i < 16; i++)
+			{
+				matrix[i] = static_cast<float>(values->array[i].number);
+			}
+			return;
+		}
+
+		auto const component = [](JsonValue const* array, size_t const i, float const fallback)
+		{
+			return array && i < array->array.size() ? static_cast<float>(array->array[i].number) : fallback;
+		};
+		auto const* const t = node.Find("translation");
+		auto const* const r = node.Find("rotation");
+		auto const* const s = node.Find("scale");
+		float const x = component(r, 0, 0.f);
+		float const y = component(r, 1, 0.f);
+		float const z = component(r, 2, 0.f);
+		float const w = component(r, 3, 1.f);
+		float const scale[3] = { component(s, 0, 1.f), component(s, 1, 1.f), component(s, 2, 1.f) };
+
+		// T * R * S
+		float const rotation[9] = {
+			1.f - 2.f * (y * y + z * z), 2.f * (x * y + z * w), 2.f * (x * z - y * w),
+			2.f * (x * y - z * w), 1.f - 2.f * (x * x + z * z), 2.f * (y * z + x * w),
+			2.f * (x * z + y * w), 2.f * (y * z - x * w), 1.f - 2.f * (x * x + y * y)
+		};
+		for (int column = 0; column < 3; column++)
+		{
+			for (int row = 0; row < 3; row++)
+			{
+				matrix[column * 4 + row] = rotation[column * 3 + row] * scale[column];
+			}
+		}
+		matrix[12] = component(t, 0, 0.f);
+		matrix[13] = component(t, 1, 0.f);
+		matrix[14] = component(t, 2, 0.f);
+	}
+
+	size_t ComponentSize(int const componentType)
+	{
+		switch (componentType)
+		{
+		case Byte:
+		case UnsignedByte:
+			return 1;
+		case Short:
+		case UnsignedShort:
+			return 2;
+		case UnsignedInt:
+		case Float:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	double ReadComponent(char const* data, int const componentType, bool const normalized)
+	{
+		switch (componentType)
+		{
+		case Byte:
+		{
+			int8_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return normalized ? std::max(value / 127., -1.) : value;
+		}
+		case UnsignedByte:
+		{
+			uint8_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return normalized ? value / 255. : value;
+		}
+		case Short:
+		{
+			int16_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return normalized ? std::max(value / 32767., -1.) : value;
+		}
+		case UnsignedShort:
+		{
+			uint16_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return normalized ? value / 65535. : value;
+		}
+		case UnsignedInt:
+		{
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		default:
+		{
+			float value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+		}
+	}
+
+	class GlbAccessors
+	{
+	public:
+		GlbAccessors(JsonValue const& gltf, char const* binary, size_t const binarySize) :
+			m_accessors(gltf.Find("accessors")),
+			m_bufferViews(gltf.Find("bufferViews")),
+			m_binary(binary),
+			m_binarySize(binarySize)
+		{
+		}
+
+		// Calls read(element, component, value) for every component of every element.
+		template <typename TRead>
+		bool Read(size_t const index, size_t const componentCount, size_t& count, TRead read) const
+		{
+			if (!m_accessors || index >= m_accessors->array.size())
+			{
+				return false;
+			}
+			auto const& accessor = m_accessors->array[index];
+			auto const* const viewIndex = accessor.Find("bufferView");
+			int const componentType = static_cast<int>(accessor.Number("componentType"));
+			auto const* const normalized = accessor.Find("normalized");
+			size_t const componentSize = ComponentSize(componentType);
+			count = static_cast<size_t>(accessor.Number("count"));
+			if (!viewIndex || !m_bufferViews || viewIndex->number >= m_bufferViews->array.size() || componentSize == 0)
+			{
+				return false;
+			}
+
+			auto const& view = m_bufferViews->array[static_cast<size_t>(viewIndex->number)];
+			size_t const viewOffset = static_cast<size_t>(view.Number("byteOffset"));
+			size_t const viewLength = static_cast<size_t>(view.Number("byteLength"));
+			size_t const elementSize = componentCount * componentSize;
+			size_t const stride = static_cast<size_t>(view.Number("byteStride", static_cast<double>(elementSize)));
+			size_t const offset = static_cast<size_t>(accessor.Number("byteOffset"));
+			if (view.Number("buffer") != 0. || viewOffset > m_binarySize || viewLength > m_binarySize - viewOffset ||
+				(count > 0 && offset + (count - 1) * stride + elementSize > viewLength))
+			{
+				return false;
+			}
+
+			char const* const data = m_binary + viewOffset + offset;
+			bool const isNormalized = normalized && normalized->boolean;
+			for (size_t e = 0; e < count; e++)
+			{
+				for (size_t c = 0; c < componentCount; c++)
+				{
+					read(e, c, ReadComponent(data + e * stride + c * componentSize, componentType, isNormalized));
+				}
+			}
+			return true;
+		}
+
+	private:
+		JsonValue const* m_accessors;
+		JsonValue const* m_bufferViews;
+		char const* m_binary;
+		size_t m_binarySize;
+	};
+}
+
+void GlbWriter::Quantize(SpatialMapSurface const& surface, GlbOptions const& options, QuantizedMesh& mesh)
+{
+	mesh.name = "mesh_" + std::to_string(surface.id);
+	mesh.vertexCount = surface.vertexCount;
+	VisitIndices(surface.indices, [&](auto const* const indices)
+		{
+			ConvertIndices(indices, surface.indices.count, mesh.indices);
+		});
+
+	Vector3 const& scale = surface.vertexPositionScale;
+	bool deviceFrame = surface.localPositions && scale.x != 0.f && scale.y != 0.f && scale.z != 0.f;
+	if (deviceFrame)
+	{
+		// Undoing the scale gives back the SNORM16 values of the device.
+		mesh.positions.resize(4 * surface.vertexCount);
+		for (size_t v = 0; v < surface.vertexCount; v++)
+		{
+			auto const& p = surface.localPositions[v];
+			mesh.positions[4 * v] = QuantizeSnorm16(p.x / scale.x);
+			mesh.positions[4 * v + 1] = QuantizeSnorm16(p.y / scale.y);
+			mesh.positions[4 * v + 2] = QuantizeSnorm16(p.z / scale.z);
+			mesh.positions[4 * v + 3] = 0;
+		}
+
+		float const scales[3] = { scale.x, scale.y, scale.z };
+		for (int row = 0; row < 4; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				mesh.matrix[row * 4 + column] = surface.meshToWorld[row * 4 + column] * (row < 3 ? scales[row] : 1.f);
+			}
+		}
+
+		// Within a quantization step of the cached world positions, or the cache was changed
+		// after the transform and the local positions no longer describe it.
+		float const step = std::max(std::fabs(scale.x), std::max(std::fabs(scale.y), std::fabs(scale.z))) / Snorm16;
+		for (size_t v = 0; deviceFrame && v < surface.vertexCount; v++)
+		{
+			Vector3 const q{ mesh.positions[4 * v] / Snorm16, mesh.positions[4 * v + 1] / Snorm16, mesh.positions[4 * v + 2] / Snorm16 };
+			deviceFrame = LengthSquared(TransformPoint(mesh.matrix, q) - surface.positions[v]) <= step * step;
+		}
+	}
+
+	if (!deviceFrame)
+	{
+		QuantizeBoundingBox(&surface.positions, &surface.vertexCount, 1, mesh.matrix, mesh.positions);
+	}
+
+	QuantizedBounds(mesh.positions, mesh.minimum, mesh.maximum);
+
+	mesh.normals.clear();
+	if (options.normals)
+	{
+		QuantizeNormals(mesh.positions, mesh.indices, mesh.normals);
+	}
+
+	mesh.colors.clear();
+	AttributeChannel const* const color = options.colorAttribute.empty() ? nullptr : FindAttribute(surface.attributes, surface.attributeCount, options.colorAttribute);
+	if (color)
+	{
+		VertexColors(*color, surface.vertexCount, surface.indices, mesh.colors);
+	}
+
+	mesh.attributes.resize(options.attributes ? surface.attributeCount : 0);
+	for (size_t a = 0; a < mesh.attributes.size(); a++)
+	{
+		mesh.attributes[a].name = AttributeSemantic(surface.attributes[a].name);
+		VertexValues(surface.attributes[a], surface.vertexCount, surface.indices, mesh.attributes[a].values);
+	}
+}
+
+void GlbWriter::QuantizeCombined(std::vector<SpatialMapSurface> const& surfaces, GlbOptions const& options, QuantizedMesh& mesh)
+{
+	std::vector<Vector3 const*> positions;
+	std::vector<size_t> counts;
+	mesh.name = "combined";
+	mesh.vertexCount = 0;
+	mesh.indices.clear();
+	for (auto const& surface : surfaces)
+	{
+		if (surface.vertexCount == 0 || surface.indices.count < 3)
+		{
+			continue;
+		}
+		VisitIndices(surface.indices, [&](auto const* const indices)
+			{
+				for (size_t i = 0; i < surface.indices.count; i++)
+				{
+					mesh.indices.push_back(static_cast<uint32_t>(mesh.vertexCount + indices[i]));
+				}
+			});
+		mesh.vertexCount += surface.vertexCount;
+		positions.push_back(surface.positions);
+		counts.push_back(surface.vertexCount);
+	}
+
+	QuantizeBoundingBox(positions.data(), counts.data(), positions.size(), mesh.matrix, mesh.positions);
+
+	QuantizedBounds(mesh.positions, mesh.minimum, mesh.maximum);
+
+	mesh.normals.clear();
+	if (options.normals)
+	{
+		QuantizeNormals(mesh.positions, mesh.indices, mesh.normals);
+	}
+
+	// Channels of the first surface that all the others have too.
+	std::vector<SpatialMapSurface const*> parts;
+	for (auto const& surface : surfaces)
+	{
+		if (surface.vertexCount > 0 && surface.indices.count >= 3)
+		{
+			parts.push_back(&surface);
+		}
+	}
+	auto const sharedByAll = [&](std::string const& name)
+	{
+		return std::all_of(parts.begin(), parts.end(), [&](SpatialMapSurface const* part) { return FindAttribute(part->attributes, part->attributeCount, name) != nullptr; });
+	};
+
+	std::vector<uint8_t> colors;
+	mesh.colors.clear();
+	if (!options.colorAttribute.empty() && !parts.empty() && sharedByAll(options.colorAttribute))
+	{
+		for (auto const* part : parts)
+		{
+			VertexColors(*FindAttribute(part->attributes, part->attributeCount, options.colorAttribute), part->vertexCount, part->indices, colors);
+			mesh.colors.insert(mesh.colors.end(), colors.begin(), colors.end());
+		}
+	}
+
+	std::vector<float> values;
+	mesh.attributes.clear();
+	for (size_t a = 0; options.attributes && !parts.empty() && a < parts[0]->attributeCount; a++)
+	{
+		std::string const& name = parts[0]->attributes[a].name;
+		if (!sharedByAll(name))
+		{
+			continue;
+		}
+		mesh.attributes.push_back({ AttributeSemantic(name), {} });
+		for (auto const* part : parts)
+		{
+			VertexValues(*FindAttribute(part->attributes, part->attributeCount, name), part->vertexCount, part->indices, values);
+			mesh.attributes.back().values.insert(mesh.attributes.back().values.end(), values.begin(), values.end());
+		}
+	}
+}
+
+void GlbWriter::Format(std::vector<SpatialMapSurface> const& surfaces, GlbOptions const& options, std::string& glb)
+{
+	// Empty surfaces are left out, glTF does not allow empty accessors.
+	size_t meshCount = 0;
+	for (auto const& surface : surfaces)
+	{
+		meshCount += surface.vertexCount > 0 && surface.indices.count >= 3 ? 1 : 0;
+	}
+	bool const combined = options.combinedScene && meshCount > 0;
+	m_meshes.resize(meshCount + (combined ? 1 : 0));
+
+	size_t m = 0;
+	for (auto const& surface : surfaces)
+	{
+		if (surface.vertexCount > 0 && surface.indices.count >= 3)
+		{
+			Quantize(surface, options, m_meshes[m++]);
+		}
+	}
+	if (combined)
+	{
+		QuantizeCombined(surfaces, options, m_meshes.back());
+	}
+
+	// The binary chunk holds one buffer view for the positions of all meshes, then one each
+	// for the normals, colors and float attributes if any mesh has them, and one for the
+	// indices. Indices that do not fit 16 bits are stored with 32, 0xffff is reserved for
+	// restarts.
+	size_t const NoView = SIZE_MAX;
+	std::string views;
+	size_t viewCount = 0;
+	auto const endView = [&](size_t const begin, size_t const stride, int const target)
+	{
+		if (m_binary.size() == begin)
+		{
+			return NoView;
+		}
+		views += viewCount > 0 ? ",{\"buffer\":0," : "{\"buffer\":0,";
+		if (begin > 0)
+		{
+			views += "\"byteOffset\":";
+			AppendUnsigned(views, begin);
+			views += ",";
+		}
+		views += "\"byteLength\":";
+		AppendUnsigned(views, m_binary.size() - begin);
+		if (stride > 0)
+		{
+			views += ",\"byteStride\":";
+			AppendUnsigned(views, stride);
+		}
+		views += ",\"target\":";
+		AppendUnsigned(views, static_cast<size_t>(target));
+		views += "}";
+		return viewCount++;
+	};
+
+	size_t const meshTotal = m_meshes.size();
+	std::vector<size_t> positionOffsets(meshTotal);
+	std::vector<size_t> normalOffsets(meshTotal);
+	std::vector<size_t> colorOffsets(meshTotal);
+	std::vector<size_t> attributeOffsets;
+	std::vector<size_t> indexOffsets(meshTotal);
+
+	m_binary.clear();
+	for (size_t i = 0; i < meshTotal; i++)
+	{
+		positionOffsets[i] = m_binary.size();
+		m_binary.append(reinterpret_cast<char const*>(m_meshes[i].positions.data()), m_meshes[i].positions.size() * sizeof(int16_t));
+	}
+	size_t const positionView = endView(0, PositionStride, ArrayBuffer);
+
+	size_t begin = m_binary.size();
+	for (size_t i = 0; i < meshTotal; i++)
+	{
+		normalOffsets[i] = m_binary.size() - begin;
+		m_binary.append(reinterpret_cast<char const*>(m_meshes[i].normals.data()), m_meshes[i].normals.size());
+	}
+	size_t const normalView = endView(begin, NormalStride, ArrayBuffer);
+
+	begin = m_binary.size();
+	for (size_t i = 0; i < meshTotal; i++)
+	{
+		colorOffsets[i] = m_binary.size() - begin;
+		m_binary.append(reinterpret_cast<char const*>(m_meshes[i].colors.data()), m_meshes[i].colors.size());
+	}
+	size_t const colorView = endView(begin, ColorStride, ArrayBuffer);
+
+	begin = m_binary.size();
+	for (auto const& mesh : m_meshes)
+	{
+		for (auto const& attribute : mesh.attributes)
+		{
+			attributeOffsets.push_back(m_binary.size() - begin);
+			m_binary.append(reinterpret_cast<char const*>(attribute.values.data()), attribute.values.size() * sizeof(float));
+		}
+	}
+	size_t const attributeView = endView(begin, sizeof(float), ArrayBuffer);
+
+	begin = m_binary.size();
+	std::vector<uint16_t> indices16;
+	for (size_t i = 0; i < meshTotal; i++)
+	{
+		auto const& mesh = m_meshes[i];
+		indexOffsets[i] = m_binary.size() - begin;
+		if (mesh.vertexCount <= UINT16_MAX)
+		{
+			indices16.assign(mesh.indices.begin(), mesh.indices.end());
+			AppendPadded(m_binary, indices16.data(), indices16.size() * sizeof(uint16_t));
+		}
+		else
+		{
+			AppendPadded(m_binary, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		}
+	}
+	size_t const indexView = endView(begin, 0, ElementArrayBuffer);
+
+	std::string& json = m_json;
+	json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"SpatialMapping GlbWriter\"},"
+		"\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"],"
+		"\"scene\":0,\"scenes\":[{\"name\":\"surfaces\"";
+	if (meshCount > 0)
+	{
+		json += ",\"nodes\":[";
+		for (size_t i = 0; i < meshCount; i++)
+		{
+			json += i > 0 ? "," : "";
+			AppendUnsigned(json, i);
+		}
+		json += "]";
+	}
+	json += "}";
+	if (combined)
+	{
+		json += ",{\"name\":\"combined\",\"nodes\":[";
+		AppendUnsigned(json, meshCount);
+		json += "]}";
+	}
+	json += "]";
+
+	if (!m_meshes.empty())
+	{
+		json += ",\"nodes\":[";
+		for (size_t i = 0; i < meshTotal; i++)
+		{
+			json += i > 0 ? ",{\"name\":" : "{\"name\":";
+			AppendJsonString(json, m_meshes[i].name);
+			json += ",\"mesh\":";
+			AppendUnsigned(json, i);
+			json += ",\"matrix\":[";
+			for (int e = 0; e < 16; e++)
+			{
+				json += e > 0 ? "," : "";
+				AppendNumber(json, m_meshes[i].matrix[e]);
+			}
+			json += "]}";
+		}
+
+		// The accessors are numbered in the order the meshes reference them.
+		std::string accessors;
+		size_t accessorCount = 0;
+		auto const addAccessor = [&](size_t const view, size_t const offset, int const componentType, bool const normalized, size_t const count, char const* type)
+		{
+			accessors += accessorCount > 0 ? ",{\"bufferView\":" : "{\"bufferView\":";
+			AppendUnsigned(accessors, view);
+			accessors += ",\"byteOffset\":";
+			AppendUnsigned(accessors, offset);
+			accessors += ",\"componentType\":";
+			AppendUnsigned(accessors, static_cast<size_t>(componentType));
+			accessors += normalized ? ",\"normalized\":true,\"count\":" : ",\"count\":";
+			AppendUnsigned(accessors, count);
+			accessors += ",\"type\":\"";
+			accessors += type;
+			accessors += "\"";
+			return accessorCount++;
+		};
+
+		json += "],\"meshes\":[";
+		size_t attribute = 0;
+		for (size_t i = 0; i < meshTotal; i++)
+		{
+			auto const& mesh = m_meshes[i];
+			json += i > 0 ? ",{\"name\":" : "{\"name\":";
+			AppendJsonString(json, mesh.name);
+			json += ",\"primitives\":[{\"attributes\":{\"POSITION\":";
+			AppendUnsigned(json, addAccessor(positionView, positionOffsets[i], Short, true, mesh.vertexCount, "VEC3"));
+			accessors += ",\"min\":[";
+			for (int axis = 0; axis < 3; axis++)
+			{
+				accessors += axis > 0 ? "," : "";
+				accessors += std::to_string(mesh.minimum[axis]);
+			}
+			accessors += "],\"max\":[";
+			for (int axis = 0; axis < 3; axis++)
+			{
+				accessors += axis > 0 ? "," : "";
+				accessors += std::to_string(mesh.maximum[axis]);
+			}
+			accessors += "]}";
+
+			if (!mesh.normals.empty())
+			{
+				json += ",\"NORMAL\":";
+				AppendUnsigned(json, addAccessor(normalView, normalOffsets[i], Byte, true, mesh.vertexCount, "VEC3"));
+				accessors += "}";
+			}
+			if (!mesh.colors.empty())
+			{
+				json += ",\"COLOR_0\":";
+				AppendUnsigned(json, addAccessor(colorView, colorOffsets[i], UnsignedByte, true, mesh.vertexCount, "VEC4"));
+				accessors += "}";
+			}
+			for (auto const& values : mesh.attributes)
+			{
+				json += ",";
+				AppendJsonString(json, values.name);
+				json += ":";
+				AppendUnsigned(json, addAccessor(attributeView, attributeOffsets[attribute++], Float, false, mesh.vertexCount, "SCALAR"));
+				accessors += "}";
+			}
+
+			json += "},\"indices\":";
+			AppendUnsigned(json, addAccessor(indexView, indexOffsets[i], mesh.vertexCount <= UINT16_MAX ? UnsignedShort : UnsignedInt, false, mesh.indices.size(), "SCALAR"));
+			accessors += "}";
+			json += ",\"mode\":";
+			AppendUnsigned(json, Triangles);
+			json += "}]}";
+		}
+
+		json += "],\"accessors\":[";
+		json += accessors;
+		json += "],\"bufferViews\":[";
+		json += views;
+		json += "],\"buffers\":[{\"byteLength\":";
+		AppendUnsigned(json, m_binary.size());
+		json += "}]";
+	}
+	json += "}";
+
+	// Header, then the JSON chunk padded with spaces and the binary chunk padded with zeros.
+	size_t const jsonChunk = Align4(json.size());
+	json.append(jsonChunk - json.size(), ' ');
+	size_t const binaryChunk = m_binary.empty() ? 0 : 8 + m_binary.size();
+
+	glb.clear();
+	glb.reserve(12 + 8 + jsonChunk + binaryChunk);
+	AppendUint32(glb, GlbMagic);
+	AppendUint32(glb, GlbVersion);
+	AppendUint32(glb, static_cast<uint32_t>(12 + 8 + jsonChunk + binaryChunk));
+	AppendUint32(glb, static_cast<uint32_t>(jsonChunk));
+	AppendUint32(glb, JsonChunk);
+	glb += json;
+	if (!m_binary.empty())
+	{
+		AppendUint32(glb, static_cast<uint32_t>(m_binary.size()));
+		AppendUint32(glb, BinaryChunk);
+		glb += m_binary;
+	}
+}
+
+bool GlbWriter::Write(std::string const& path, std::vector<SpatialMapSurface> const& surfaces, GlbOptions const& options)
+{
+	std::string glb;
+	Format(surfaces, options, glb);
+
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+	file.write(glb.data(), static_cast<std::streamsize>(glb.size()));
+	file.close();
+	return !file.fail();
+}
+
+bool SpatialMapping::ReadGlb(std::string const& path, MeshData& mesh, int const scene)
+{
+	mesh = {};
+
+	MappedFile file;
+	if (!file.Open(path) || file.Size() < 20)
+	{
+		return false;
+	}
+	char const* const data = file.Data();
+	size_t const size = file.Size();
+
+	uint32_t header[5];
+	std::memcpy(header, data, sizeof(header));
+	if (header[0] != GlbMagic || header[1] != GlbVersion || header[2] > size || header[4] != JsonChunk || header[3] > header[2] - 20)
+	{
+		return false;
+	}
+
+	JsonValue gltf;
+	if (!ParseJson(data + 20, header[3], gltf))
+	{
+		return false;
+	}
+
+	char const* binary = nullptr;
+	size_t binarySize = 0;
+	size_t const binaryHeader = 20 + Align4(header[3]);
+	if (binaryHeader + 8 <= header[2])
+	{
+		uint32_t chunk[2];
+		std::memcpy(chunk, data + binaryHeader, sizeof(chunk));
+		if (chunk[1] == BinaryChunk && chunk[0] <= header[2] - binaryHeader - 8)
+		{
+			binary = data + binaryHeader + 8;
+			binarySize = chunk[0];
+		}
+	}
+
+	auto const* const scenes = gltf.Find("scenes");
+	auto const* const nodes = gltf.Find("nodes");
+	auto const* const meshes = gltf.Find("meshes");
+	size_t const sceneIndex = scene >= 0 ? static_cast<size_t>(scene) : static_cast<size_t>(gltf.Number("scene"));
+	if (!scenes || sceneIndex >= scenes->array.size())
+	{
+		return false;
+	}
+	auto const* const roots = scenes->array[sceneIndex].Find("nodes");
+	if (!roots || !nodes)
+	{
+		return true;
+	}
+
+	struct PendingNode
+	{
+		size_t index;
+		float parent[16];
+	};
+	std::vector<PendingNode> pending;
+	for (auto it = roots->array.rbegin(); it != roots->array.rend(); ++it)
+	{
+		PendingNode root{ static_cast<size_t>(it->number), { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f } };
+		pending.push_back(root);
+	}
+
+	GlbAccessors const accessors(gltf, binary, binarySize);
+	std::vector<Vector3> positions;
+	size_t visited = 0;
+	while (!pending.empty())
+	{
+		PendingNode const current = pending.back();
+		pending.pop_back();
+
+		// Node hierarchies must be trees, more visits than nodes means a cycle.
+		if (current.index >= nodes->array.size() || ++visited > nodes->array.size())
+		{
+			return false;
+		}
+		auto const& node = nodes->array[current.index];
+
+		float world[16];
+		NodeMatrix(node, world);
+		Multiply(current.parent, world, world);
+
+		if (auto const* const children = node.Find("children"))
+		{
+			for (auto it = children->array.rbegin(); it != children->array.rend(); ++it)
+			{
+				PendingNode child;
+				child.index = static_cast<size_t>(it->number);
+				std::copy(world, world + 16, child.parent);
+				pending.push_back(child);
+			}
+		}
+
+		auto const* const meshIndex = node.Find("mesh");
+		if (!meshIndex)
+		{
+			continue;
+		}
+		if (!meshes || meshIndex->number >= meshes->array.size())
+		{
+			return false;
+		}
+		auto const& gltfMesh = meshes->array[static_cast<size_t>(meshIndex->number)];
+
+		MeshObject object;
+		auto const* const name = node.Find("name") ? node.Find("name") : gltfMesh.Find("name");
+		object.name = name ? name->string : "node_" + std::to_string(current.index);
+		object.firstVertex = static_cast<uint32_t>(mesh.positions.size());
+		object.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+
+		auto const* const primitives = gltfMesh.Find("primitives");
+		for (size_t p = 0; primitives && p < primitives->array.size(); p++)
+		{
+			auto const& primitive = primitives->array[p];
+			auto const* const attributes = primitive.Find("attributes");
+			auto const* const position = attributes ? attributes->Find("POSITION") : nullptr;
+			if (!position || primitive.Number("mode", Triangles) != Triangles)
+			{
+				continue;
+			}
+
+			size_t vertexCount = 0;
+			positions.clear();
+			bool const read = accessors.Read(static_cast<size_t>(position->number), 3, vertexCount, [&](size_t, size_t const c, double const value)
+				{
+					if (c == 0)
+					{
+						positions.emplace_back();
+					}
+					(&positions.back().x)[c] = static_cast<float>(value);
+				});
+			if (!read)
+			{
+				return false;
+			}
+
+			uint32_t const base = static_cast<uint32_t>(mesh.positions.size());
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				mesh.positions.push_back(TransformPoint(world, positions[v]));
+			}
+
+			size_t const firstIndex = mesh.indices.size();
+			if (auto const* const indices = primitive.Find("indices"))
+			{
+				size_t indexCount = 0;
+				bool valid = true;
+				bool const readIndices = accessors.Read(static_cast<size_t>(indices->number), 1, indexCount, [&](size_t, size_t, double const value)
+					{
+						valid = valid && value < vertexCount;
+						mesh.indices.push_back(base + static_cast<uint32_t>(value));
+					});
+				if (!readIndices || !valid)
+				{
+					return false;
+				}
+			}
+			else
+			{
+				for (size_t v = 0; v < vertexCount; v++)
+				{
+					mesh.indices.push_back(base + static_cast<uint32_t>(v));
+				}
+			}
+			mesh.indices.resize(firstIndex + (mesh.indices.size() - firstIndex) / 3 * 3);
+		}
+
+		object.vertexCount = static_cast<uint32_t>(mesh.positions.size()) - object.firstVertex;
+		object.indexCount = static_cast<uint32_t>(mesh.indices.size()) - object.firstIndex;
+		mesh.objects.push_back(std::move(object));
+	}
+
+	mesh.faceNormals.resize(mesh.TriangleCount());
+	for (size_t t = 0; t < mesh.faceNormals.size(); t++)
+	{
+		auto const& a = mesh.positions[mesh.indices[3 * t]];
+		auto const& b = mesh.positions[mesh.indices[3 * t + 1]];
+		auto const& c = mesh.positions[mesh.indices[3 * t + 2]];
+		mesh.faceNormals[t] = Normalize(Cross(b - a, c - a));
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "SpatialMapFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct GlbOptions
+	{
+		// SNORM8 vertex normals. Without them viewers shade every triangle flat, which is what
+		// the one-normal-per-face OBJ export looks like anyway.
+		bool normals = true;
+
+		// Adds a second scene with all surfaces merged into one world-space mesh, for tools that
+		// want a single object. The default scene keeps one node per surface.
+		bool combinedScene = false;
+
+		// The attribute channels of the surfaces as float vertex attributes named after the
+		// channel, e.g. "_PLANE_DISTANCE". Face channels are averaged to the vertices.
+		bool attributes = true;
+
+		// Writes this attribute as gray COLOR_0, mapped from the range of the channel.
+		std::string colorAttribute;
+	};
+
+	// Writes a surface collection as binary glTF 2.0 with KHR_mesh_quantization: positions are
+	// SNORM16 with stride 8, normals SNORM8 with stride 4, and 16 bit indices where the
+	// vertex count allows. Every surface is a node named mesh_<id> whose matrix maps the
+	// quantized positions to world space.
+	//
+	// Surfaces with local positions that reproduce their world positions through
+	// vertexPositionScale and meshToWorld keep the SNORM16 values the device delivered, and
+	// the node matrix is scale times meshToWorld. The others, e.g. surfaces whose cached
+	// positions were aligned or denoised, are quantized to their world-space bounding box.
+	//
+	// The combined scene carries the attributes that all surfaces have.
+	class GlbWriter
+	{
+	public:
+		bool Write(std::string const& path, std::vector<SpatialMapSurface> const& surfaces, GlbOptions const& options = {});
+
+		// Formats the whole file into memory.
+		void Format(std::vector<SpatialMapSurface> const& surfaces, GlbOptions const& options, std::string& glb);
+
+	private:
+		struct NamedValues
+		{
+			std::string name;
+			std::vector<float> values;
+		};
+
+		struct QuantizedMesh
+		{
+			std::string name;
+			float matrix[16];
+			size_t vertexCount = 0;
+			int16_t minimum[3];
+			int16_t maximum[3];
+
+			// x, y, z and a padding component per vertex.
+			std::vector<int16_t> positions;
+			std::vector<int8_t> normals;
+			std::vector<uint32_t> indices;
+
+			// RGBA per vertex, and one float per vertex for each attribute.
+			std::vector<uint8_t> colors;
+			std::vector<NamedValues> attributes;
+		};
+
+		static void Quantize(SpatialMapSurface const& surface, GlbOptions const& options, QuantizedMesh& mesh);
+		static void QuantizeCombined(std::vector<SpatialMapSurface> const& surfaces, GlbOptions const& options, QuantizedMesh& mesh);
+
+		// Reused between calls.
+		std::vector<QuantizedMesh> m_meshes;
+		std::string m_json;
+		std::string m_binary;
+	};
+
+	// Reads the triangle meshes of a GLB scene into world space, one object per node. Float
+	// and quantized positions and 8, 16 and 32 bit indices are supported. Face normals are
+	// computed from the triangles. A scene of -1 reads the default scene.
+	bool ReadGlb(std::string const& path, MeshData& mesh, int scene = -1);
+}
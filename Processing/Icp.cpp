@@ -0,0 +1,220 @@
+#include "Icp.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	// Index of (row, column) in the packed upper triangle of a symmetric 6x6 matrix.
+	int Packed(int const row, int const column)
+	{
+		int const r = row < column ? row : column;
+		int const c = row < column ? column : row;
+		return r * 6 - r * (r - 1) / 2 + (c - r);
+	}
+}
+
+RigidTransform RigidTransform::FromRotationVector(Vector3 const& r, Vector3 const& t)
+{
+	RigidTransform transform;
+	transform.translation = t;
+
+	float const angle = Length(r);
+	if (angle < 1e-12f)
+	{
+		return transform;
+	}
+
+	// Rodrigues' formula.
+	Vector3 const k = r * (1.f / angle);
+	float const c = std::cos(angle);
+	float const s = std::sin(angle);
+	float const v = 1.f - c;
+
+	float* m = transform.rotation;
+	m[0] = k.x * k.x * v + c;       m[1] = k.x * k.y * v - k.z * s; m[2] = k.x * k.z * v + k.y * s;
+	m[3] = k.y * k.x * v + k.z * s; m[4] = k.y * k.y * v + c;       m[5] = k.y * k.z * v - k.x * s;
+	m[6] = k.z * k.x * v - k.y * s; m[7] = k.z * k.y * v + k.x * s; m[8] = k.z * k.z * v + c;
+	return transform;
+}
+
+RigidTransform SpatialMapping::operator*(RigidTransform const& a, RigidTransform const& b)
+{
+	RigidTransform result;
+	for (int row = 0; row < 3; row++)
+	{
+		for (int column = 0; column < 3; column++)
+		{
+			result.rotation[row * 3 + column] =
+				a.rotation[row * 3] * b.rotation[column] +
+				a.rotation[row * 3 + 1] * b.rotation[3 + column] +
+				a.rotation[row * 3 + 2] * b.rotation[6 + column];
+		}
+	}
+	result.translation = a.Apply(b.translation);
+	return result;
+}
+
+void SpatialMapping::ApplyTransform(RigidTransform const& transform, Vector3* points, size_t const count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		points[i] = transform.Apply(points[i]);
+	}
+}
+
+void IcpNormalEquations::Add(Vector3 const& p, Vector3 const& q, Vector3 const& n)
+{
+	// Linearized around the current pose: r(x) = n . (p + rx * p + t - q)
+	Vector3 const c = Cross(p, n);
+	double const row[6] = { c.x, c.y, c.z, n.x, n.y, n.z };
+	double const residual = Dot(p - q, n);
+
+	for (int i = 0; i < 6; i++)
+	{
+		for (int j = i; j < 6; j++)
+		{
+			ata[Packed(i, j)] += row[i] * row[j];
+		}
+		atb[i] += row[i] * residual;
+	}
+
+	residualSquared += residual * residual;
+	count++;
+}
+
+void IcpNormalEquations::Merge(IcpNormalEquations const& other)
+{
+	for (int i = 0; i < 21; i++)
+	{
+		ata[i] += other.ata[i];
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		atb[i] += other.atb[i];
+	}
+	residualSquared += other.residualSquared;
+	count += other.count;
+}
+
+bool IcpNormalEquations::Solve(double const damping, double x[6]) const
+{
+	double largest = 0.;
+	for (int i = 0; i < 6; i++)
+	{
+		largest = std::max(largest, ata[Packed(i, i)]);
+	}
+	double const lambda = damping * largest;
+
+	// Cholesky decomposition A + lambda I = L L^T.
+	double l[6][6] = {};
+	for (int i = 0; i < 6; i++)
+	{
+		for (int j = 0; j <= i; j++)
+		{
+			double sum = ata[Packed(i, j)] + (i == j ? lambda : 0.);
+			for (int k = 0; k < j; k++)
+			{
+				sum -= l[i][k] * l[j][k];
+			}
+
+			if (i == j)
+			{
+				if (sum <= 1e-12)
+				{
+					// Flat or otherwise degenerate geometry leaves a direction unconstrained.
+					return false;
+				}
+				l[i][i] = std::sqrt(sum);
+			}
+			else
+			{
+				l[i][j] = sum / l[j][j];
+			}
+		}
+	}
+
+	// L y = -b, then L^T x = y.
+	double y[6];
+	for (int i = 0; i < 6; i++)
+	{
+		double sum = -atb[i];
+		for (int k = 0; k < i; k++)
+		{
+			sum -= l[i][k] * y[k];
+		}
+		y[i] = sum / l[i][i];
+	}
+
+	for (int i = 5; i >= 0; i--)
+	{
+		double sum = y[i];
+		for (int k = i + 1; k < 6; k++)
+		{
+			sum -= l[k][i] * x[k];
+		}
+		x[i] = sum / l[i][i];
+	}
+	return true;
+}
+
+IcpResult SpatialMapping::AlignToIndex(
+	Vector3 const* source,
+	size_t const count,
+	SpatialIndex const& target,
+	IcpOptions const& options,
+	RigidTransform const& initial)
+{
+	auto const& normals = target.Normals();
+	if (normals.empty())
+	{
+		return {};
+	}
+
+	return AlignPointToPlane(source, count, [&](Vector3 const& p, Vector3& q, Vector3& n)
+		{
+			Neighbor nearest;
+			if (!target.Tree().Nearest(p, options.maxCorrespondenceDistance, nearest))
+			{
+				return false;
+			}
+
+			n = normals[nearest.index];
+			q = target.Points()[nearest.index];
+			return LengthSquared(n) > 0.f;
+		}, options, initial);
+}
+
+IcpResult SpatialMapping::AlignToMap(
+	Vector3 const* source,
+	size_t const count,
+	SpatialIndexSnapshot const& map,
+	int const surfaceId,
+	IcpOptions const& options)
+{
+	return AlignPointToPlane(source, count, [&](Vector3 const& p, Vector3& q, Vector3& n)
+		{
+			SurfaceNeighbor nearest;
+			if (!map.Nearest(p, options.maxCorrespondenceDistance, surfaceId, nearest))
+			{
+				return false;
+			}
+
+			for (auto const& [id, index] : map.surfaces)
+			{
+				if (id == nearest.surfaceId)
+				{
+					if (index->Normals().empty())
+					{
+						return false;
+					}
+					n = index->Normals()[nearest.index];
+					q = index->Points()[nearest.index];
+					return LengthSquared(n) > 0.f;
+				}
+			}
+			return false;
+		}, options);
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "ParallelFor.h"
+#include "SpatialIndex.h"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct RigidTransform
+	{
+		// Row-major rotation matrix.
+		float rotation[9] = { 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f };
+		Vector3 translation;
+
+		Vector3 Rotate(Vector3 const& v) const
+		{
+			return {
+				rotation[0] * v.x + rotation[1] * v.y + rotation[2] * v.z,
+				rotation[3] * v.x + rotation[4] * v.y + rotation[5] * v.z,
+				rotation[6] * v.x + rotation[7] * v.y + rotation[8] * v.z
+			};
+		}
+
+		Vector3 Apply(Vector3 const& p) const { return Rotate(p) + translation; }
+
+		// Rotation by |r| radians around r, followed by the translation t.
+		static RigidTransform FromRotationVector(Vector3 const& r, Vector3 const& t);
+	};
+
+	// a * b applies b first.
+	RigidTransform operator*(RigidTransform const& a, RigidTransform const& b);
+
+	void ApplyTransform(RigidTransform const& transform, Vector3* points, size_t count);
+
+	struct IcpOptions
+	{
+		int maxIterations = 30;
+
+		// Pairs further apart than this are not used, which keeps non-overlapping parts of the
+		// two surfaces from pulling the alignment.
+		float maxCorrespondenceDistance = 0.1f;
+
+		// Stops before starting an iteration that would exceed the budget, judged by the
+		// duration of the previous iteration. 0 disables the budget.
+		double timeBudgetMilliseconds = 0.;
+
+		// Converged once an iteration moves less than this, in radians and meters.
+		float minRotationStep = 1e-5f;
+		float minTranslationStep = 1e-5f;
+
+		size_t minCorrespondences = 32;
+
+		// See IcpNormalEquations::Solve.
+		double damping = 1e-4;
+	};
+
+	struct IcpIteration
+	{
+		double milliseconds = 0.;
+		size_t correspondences = 0;
+
+		// Point-to-plane RMS of the pairs found in this iteration, before its update is applied.
+		double rms = 0.;
+	};
+
+	struct IcpResult
+	{
+		RigidTransform transform;
+		std::vector<IcpIteration> iterations;
+		bool converged = false;
+	};
+
+	// Sums of the point-to-plane normal equations J^T J x = -J^T r for one block of points.
+	struct IcpNormalEquations
+	{
+		double ata[21] = {};
+		double atb[6] = {};
+		double residualSquared = 0.;
+		size_t count = 0;
+
+		// p is relative to the center of rotation, q to the same origin as p.
+		void Add(Vector3 const& p, Vector3 const& q, Vector3 const& n);
+		void Merge(IcpNormalEquations const& other);
+
+		// Solves for [rx, ry, rz, tx, ty, tz]. The damping is added to the diagonal relative to
+		// its largest entry, so that directions the geometry does not constrain (sliding along
+		// a wall) stay put instead of following noise. Returns false if the system is degenerate.
+		bool Solve(double damping, double x[6]) const;
+	};
+
+	// Point-to-plane ICP of the source points onto a target that is only known through
+	// find(p, q, n): the closest target point q to p, with its normal n. Correspondence search
+	// and the reduction of the normal equations run in parallel blocks.
+	template <typename FindCorrespondence>
+	IcpResult AlignPointToPlane(
+		Vector3 const* source,
+		size_t const count,
+		FindCorrespondence&& find,
+		IcpOptions const& options,
+		RigidTransform const& initial = {})
+	{
+		using Clock = std::chrono::steady_clock;
+		size_t const blockSize = 2048;
+
+		IcpResult result;
+		result.transform = initial;
+
+		auto const start = Clock::now();
+		double lastIteration = 0.;
+
+		Vector3 centroid;
+		for (size_t i = 0; i < count; i++)
+		{
+			centroid = centroid + source[i];
+		}
+		if (count > 0)
+		{
+			centroid = centroid * (1.f / count);
+		}
+
+		for (int iteration = 0; iteration < options.maxIterations; iteration++)
+		{
+			auto const iterationStart = Clock::now();
+			double const elapsed = std::chrono::duration<double, std::milli>(iterationStart - start).count();
+			if (options.timeBudgetMilliseconds > 0. && elapsed + lastIteration > options.timeBudgetMilliseconds)
+			{
+				break;
+			}
+
+			// Rotations are linearized around the centroid of the source rather than the origin of
+			// the coordinate system, which keeps small surfaces far from the origin well conditioned.
+			RigidTransform const current = result.transform;
+			Vector3 const center = current.Apply(centroid);
+			std::vector<IcpNormalEquations> blocks(BlockCount(count, blockSize));
+			ParallelFor(count, blockSize, [&](size_t const begin, size_t const end, size_t const block)
+				{
+					auto& equations = blocks[block];
+					Vector3 q;
+					Vector3 n;
+					for (size_t i = begin; i < end; i++)
+					{
+						Vector3 const p = current.Apply(source[i]);
+						if (find(p, q, n))
+						{
+							equations.Add(p - center, q - center, n);
+						}
+					}
+				});
+
+			IcpNormalEquations equations;
+			for (auto const& block : blocks)
+			{
+				equations.Merge(block);
+			}
+
+			double x[6];
+			bool const solved = equations.count >= options.minCorrespondences && equations.Solve(options.damping, x);
+			if (solved)
+			{
+				Vector3 const r{ static_cast<float>(x[0]), static_cast<float>(x[1]), static_cast<float>(x[2]) };
+				Vector3 const t{ static_cast<float>(x[3]), static_cast<float>(x[4]), static_cast<float>(x[5]) };
+				RigidTransform step = RigidTransform::FromRotationVector(r, t);
+				step.translation = step.translation + center - step.Rotate(center);
+				result.transform = step * current;
+				result.converged = Length(r) < options.minRotationStep && Length(t) < options.minTranslationStep;
+			}
+
+			lastIteration = std::chrono::duration<double, std::milli>(Clock::now() - iterationStart).count();
+
+			IcpIteration record;
+			record.milliseconds = lastIteration;
+			record.correspondences = equations.count;
+			record.rms = equations.count > 0 ? std::sqrt(equations.residualSquared / equations.count) : 0.;
+			result.iterations.push_back(record);
+
+			if (!solved || result.converged)
+			{
+				break;
+			}
+		}
+
+		return result;
+	}
+
+	// Aligns source to the surface in target, which must have been built with normals.
+	IcpResult AlignToIndex(
+		Vector3 const* source,
+		size_t count,
+		SpatialIndex const& target,
+		IcpOptions const& options,
+		RigidTransform const& initial = {});
+
+	// Aligns one surface to the rest of the map. The surface's own entry is skipped, surfaces
+	// built without normals cannot provide correspondences.
+	IcpResult AlignToMap(
+		Vector3 const* source,
+		size_t count,
+		SpatialIndexSnapshot const& map,
+		int surfaceId,
+		IcpOptions const& options);
+}
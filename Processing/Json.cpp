@@ -0,0 +1,263 @@
+#include "Json.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	// Nesting deeper than this is rejected instead of overflowing the stack.
+	int const MaxDepth = 64;
+
+	class Parser
+	{
+	public:
+		Parser(char const* text, size_t const length) : m_position(text), m_end(text + length) {}
+
+		bool ParseDocument(JsonValue& value)
+		{
+			if (!ParseValue(value, 0))
+			{
+				return false;
+			}
+			SkipWhitespace();
+			return m_position == m_end;
+		}
+
+	private:
+		void SkipWhitespace()
+		{
+			while (m_position < m_end && (*m_position == ' ' || *m_position == '\t' || *m_position == '\n' || *m_position == '\r'))
+			{
+				m_position++;
+			}
+		}
+
+		bool Consume(char const c)
+		{
+			SkipWhitespace();
+			if (m_position < m_end && *m_position == c)
+			{
+				m_position++;
+				return true;
+			}
+			return false;
+		}
+
+		bool ConsumeLiteral(char const* literal)
+		{
+			size_t const length = std::strlen(literal);
+			if (static_cast<size_t>(m_end - m_position) < length || std::memcmp(m_position, literal, length) != 0)
+			{
+				return false;
+			}
+			m_position += length;
+			return true;
+		}
+
+		bool ParseValue(JsonValue& value, int const depth)
+		{
+			value = {};
+			SkipWhitespace();
+			if (m_position == m_end || depth > MaxDepth)
+			{
+				return false;
+			}
+
+			switch (*m_position)
+			{
+			case '{':
+				m_position++;
+				value.type = JsonValue::Type::Object;
+				if (Consume('}'))
+				{
+					return true;
+				}
+				do
+				{
+					std::pair<std::string, JsonValue> member;
+					SkipWhitespace();
+					if (!ParseString(member.first) || !Consume(':') || !ParseValue(member.second, depth + 1))
+					{
+						return false;
+					}
+					value.object.push_back(std::move(member));
+				} while (Consume(','));
+				return Consume('}');
+
+			case '[':
+				m_position++;
+				value.type = JsonValue::Type::Array;
+				if (Consume(']'))
+				{
+					return true;
+				}
+				do
+				{
+					value.array.emplace_back();
+					if (!ParseValue(value.array.back(), depth + 1))
+					{
+						return false;
+					}
+				} while (Consume(','));
+				return Consume(']');
+
+			case '"':
+				value.type = JsonValue::Type::String;
+				return ParseString(value.string);
+
+			case 't':
+				value.type = JsonValue::Type::Boolean;
+				value.boolean = true;
+				return ConsumeLiteral("true");
+
+			case 'f':
+				value.type = JsonValue::Type::Boolean;
+				return ConsumeLiteral("false");
+
+			case 'n':
+				return ConsumeLiteral("null");
+
+			default:
+			{
+				value.type = JsonValue::Type::Number;
+				// from_chars does not accept the leading '+' JSON forbids anyway.
+				auto const result = std::from_chars(m_position, m_end, value.number);
+				if (result.ec != std::errc())
+				{
+					return false;
+				}
+				m_position = result.ptr;
+				return true;
+			}
+			}
+		}
+
+		bool ParseString(std::string& out)
+		{
+			if (m_position == m_end || *m_position != '"')
+			{
+				return false;
+			}
+			m_position++;
+
+			while (m_position < m_end)
+			{
+				char const c = *m_position++;
+				if (c == '"')
+				{
+					return true;
+				}
+				if (c != '\\')
+				{
+					out.push_back(c);
+					continue;
+				}
+				if (m_position == m_end)
+				{
+					return false;
+				}
+
+				char const escaped = *m_position++;
+				switch (escaped)
+				{
+				case 'b': out.push_back('\b'); break;
+				case 'f': out.push_back('\f'); break;
+				case 'n': out.push_back('\n'); break;
+				case 'r': out.push_back('\r'); break;
+				case 't': out.push_back('\t'); break;
+				case 'u':
+				{
+					unsigned codePoint = 0;
+					if (m_end - m_position < 4 || std::from_chars(m_position, m_position + 4, codePoint, 16).ptr != m_position + 4)
+					{
+						return false;
+					}
+					m_position += 4;
+
+					// Encoded as UTF-8. Surrogate pairs are kept as two separate code points,
+					// none of the names we read contain any.
+					if (codePoint < 0x80)
+					{
+						out.push_back(static_cast<char>(codePoint));
+					}
+					else if (codePoint < 0x800)
+					{
+						out.push_back(static_cast<char>(0xc0 | (codePoint >> 6)));
+						out.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+					}
+					else
+					{
+						out.push_back(static_cast<char>(0xe0 | (codePoint >> 12)));
+						out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+						out.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+					}
+					break;
+				}
+				default:
+					out.push_back(escaped);
+					break;
+				}
+			}
+			return false;
+		}
+
+		char const* m_position;
+		char const* const m_end;
+	};
+}
+
+JsonValue const* JsonValue::Find(char const* key) const
+{
+	for (auto const& member : object)
+	{
+		if (member.first == key)
+		{
+			return &member.second;
+		}
+	}
+	return nullptr;
+}
+
+double JsonValue::Number(char const* key, double const fallback) const
+{
+	auto const* const member = Find(key);
+	return member && member->type == Type::Number ? member->number : fallback;
+}
+
+bool SpatialMapping::ParseJson(char const* text, size_t const length, JsonValue& value)
+{
+	Parser parser(text, length);
+	return parser.ParseDocument(value);
+}
+
+void SpatialMapping::AppendJsonString(std::string& out, std::string const& value)
+{
+	out.push_back('"');
+	for (char const c : value)
+	{
+		switch (c)
+		{
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+				out += escaped;
+			}
+			else
+			{
+				out.push_back(c);
+			}
+			break;
+		}
+	}
+	out.push_back('"');
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// Minimal JSON document model, enough to read the JSON chunk of the GLB exports back.
+	struct JsonValue
+	{
+		enum class Type
+		{
+			Null,
+			Boolean,
+			Number,
+			String,
+			Array,
+			Object
+		};
+
+		Type type = Type::Null;
+		bool boolean = false;
+		double number = 0.;
+		std::string string;
+		std::vector<JsonValue> array;
+		std::vector<std::pair<std::string, JsonValue>> object;
+
+		// The member with the given key, nullptr if this is not an object or has no such member.
+		JsonValue const* Find(char const* key) const;
+
+		// The member as a number, or the fallback if it is missing or not a number.
+		double Number(char const* key, double fallback = 0.) const;
+	};
+
+	// Parses a complete document. Returns false on a syntax error or trailing garbage.
+	bool ParseJson(char const* text, size_t length, JsonValue& value);
+
+	// Appends the string as a quoted JSON string.
+	void AppendJsonString(std::string& out, std::string const& value);
+}
@@ -0,0 +1,418 @@
+#include "MapJournal.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	char const EntryMagic[8] = { 'S', 'P', 'M', 'A', 'P', 'J', 'N', 'L' };
+	uint32_t const EntryVersion = 1;
+	uint32_t const FullEntry = 1;
+
+	// Offsets are from the start of the entry.
+	struct EntryHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t saveIndex;
+		int64_t saveTime;
+		uint32_t flags;
+		uint32_t expiredCount;
+		uint64_t mapOffset;
+		uint64_t mapSize;
+		uint64_t entrySize;
+		uint64_t reserved;
+	};
+
+	static_assert(sizeof(EntryHeader) == SpatialMapFile::SectionAlignment, "The entry header layout is part of the format");
+
+	uint64_t Align(uint64_t const offset)
+	{
+		return (offset + SpatialMapFile::SectionAlignment - 1) & ~static_cast<uint64_t>(SpatialMapFile::SectionAlignment - 1);
+	}
+
+	void Pad(std::ostream& out, uint64_t const bytes)
+	{
+		char const zeros[SpatialMapFile::SectionAlignment] = {};
+		out.write(zeros, static_cast<std::streamsize>(bytes));
+	}
+
+	// Writes one entry to a stream positioned at a multiple of the section alignment and
+	// returns its size.
+	uint64_t WriteEntry(std::ostream& out, uint32_t const saveIndex, int64_t const saveTime, bool const isFull,
+		std::vector<int32_t> const& expired, std::vector<SpatialMapSurface> const& surfaces)
+	{
+		EntryHeader header = {};
+		std::memcpy(header.magic, EntryMagic, sizeof(EntryMagic));
+		header.version = EntryVersion;
+		header.saveIndex = saveIndex;
+		header.saveTime = saveTime;
+		header.flags = isFull ? FullEntry : 0;
+		header.expiredCount = static_cast<uint32_t>(expired.size());
+		header.mapOffset = Align(sizeof(EntryHeader) + expired.size() * sizeof(int32_t));
+		header.mapSize = SpatialMapFile::SerializedSize(surfaces);
+		header.entrySize = Align(header.mapOffset + header.mapSize);
+
+		out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+		out.write(reinterpret_cast<char const*>(expired.data()), static_cast<std::streamsize>(expired.size() * sizeof(int32_t)));
+		Pad(out, header.mapOffset - sizeof(EntryHeader) - expired.size() * sizeof(int32_t));
+		SpatialMapFile::Write(out, surfaces);
+		Pad(out, header.entrySize - header.mapOffset - header.mapSize);
+		return header.entrySize;
+	}
+
+	std::string SnapshotPath(std::string const& path) { return path + ".snapshot"; }
+	std::string CompactingPath(std::string const& path) { return path + ".compacting"; }
+	std::string JournalPath(std::string const& path) { return path + ".journal"; }
+
+	bool Exists(std::string const& path)
+	{
+		std::error_code error;
+		return std::filesystem::exists(path, error);
+	}
+}
+
+uint64_t MapReplay::ReadEntries(MappedFile const& file)
+{
+	char const* const data = file.Data();
+	uint64_t const size = file.Size();
+
+	uint64_t offset = 0;
+	while (size - offset >= sizeof(EntryHeader))
+	{
+		EntryHeader header;
+		std::memcpy(&header, data + offset, sizeof(header));
+
+		uint64_t const available = size - offset;
+		bool const valid = std::memcmp(header.magic, EntryMagic, sizeof(EntryMagic)) == 0 &&
+			header.version != 0 && header.version <= EntryVersion &&
+			header.entrySize <= available && header.entrySize % SpatialMapFile::SectionAlignment == 0 &&
+			header.mapOffset % SpatialMapFile::SectionAlignment == 0 &&
+			header.mapOffset >= sizeof(EntryHeader) + static_cast<uint64_t>(header.expiredCount) * sizeof(int32_t) &&
+			header.mapOffset <= header.entrySize && header.mapSize <= header.entrySize - header.mapOffset;
+		if (!valid)
+		{
+			break;
+		}
+
+		Entry entry;
+		entry.saveIndex = header.saveIndex;
+		entry.saveTime = header.saveTime;
+		entry.isFull = (header.flags & FullEntry) != 0;
+		entry.expired = reinterpret_cast<int32_t const*>(data + offset + sizeof(EntryHeader));
+		entry.expiredCount = header.expiredCount;
+		if (!SpatialMapFile::Parse(data + offset + header.mapOffset, header.mapSize, entry.surfaces, &entry.decoded))
+		{
+			break;
+		}
+		offset += header.entrySize;
+
+		// Already read from an earlier file, e.g. after an interrupted compaction.
+		if (!m_entries.empty() && entry.saveIndex <= m_entries.back().saveIndex)
+		{
+			continue;
+		}
+		m_entries.push_back(std::move(entry));
+	}
+	return offset;
+}
+
+bool MapReplay::Open(std::string const& path, bool const includeJournal)
+{
+	Close();
+
+	std::string const paths[3] = { SnapshotPath(path), CompactingPath(path), JournalPath(path) };
+	size_t const fileCount = includeJournal ? 3 : 2;
+	for (size_t f = 0; f < fileCount; f++)
+	{
+		if (Exists(paths[f]) && m_files[f].Open(paths[f]))
+		{
+			uint64_t const validBytes = ReadEntries(m_files[f]);
+			if (f == 2)
+			{
+				m_journalBytes = validBytes;
+			}
+		}
+	}
+
+	// Only the ids are needed to count the surfaces of every save.
+	std::unordered_map<int, bool> ids;
+	for (auto const& entry : m_entries)
+	{
+		if (entry.isFull)
+		{
+			ids.clear();
+		}
+		for (size_t i = 0; i < entry.expiredCount; i++)
+		{
+			ids.erase(entry.expired[i]);
+		}
+		for (auto const& surface : entry.surfaces)
+		{
+			ids[surface.id] = true;
+		}
+
+		SavePoint point;
+		point.saveIndex = entry.saveIndex;
+		point.saveTime = entry.saveTime;
+		point.surfaceCount = ids.size();
+		point.writtenSurfaces = entry.surfaces.size();
+		point.expiredSurfaces = entry.expiredCount;
+		m_savePoints.push_back(point);
+	}
+
+	return !m_entries.empty();
+}
+
+void MapReplay::Close()
+{
+	m_entries.clear();
+	m_savePoints.clear();
+	m_journalBytes = 0;
+	for (auto& file : m_files)
+	{
+		file.Close();
+	}
+}
+
+bool MapReplay::Reconstruct(uint32_t const saveIndex, std::vector<SpatialMapSurface>& surfaces) const
+{
+	surfaces.clear();
+	if (m_entries.empty() || saveIndex < m_entries.front().saveIndex || saveIndex > m_entries.back().saveIndex)
+	{
+		return false;
+	}
+
+	std::map<int, SpatialMapSurface const*> state;
+	for (auto const& entry : m_entries)
+	{
+		if (entry.saveIndex > saveIndex)
+		{
+			break;
+		}
+		if (entry.isFull)
+		{
+			state.clear();
+		}
+		for (size_t i = 0; i < entry.expiredCount; i++)
+		{
+			state.erase(entry.expired[i]);
+		}
+		for (auto const& surface : entry.surfaces)
+		{
+			state[surface.id] = &surface;
+		}
+	}
+
+	surfaces.reserve(state.size());
+	for (auto const& [id, surface] : state)
+	{
+		surfaces.push_back(*surface);
+	}
+	return true;
+}
+
+bool MapReplay::ReconstructLatest(std::vector<SpatialMapSurface>& surfaces) const
+{
+	if (m_entries.empty())
+	{
+		surfaces.clear();
+		return false;
+	}
+	return Reconstruct(m_entries.back().saveIndex, surfaces);
+}
+
+bool MapJournal::Open(std::string const& path)
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	m_path = path;
+	m_savedUpdateTimes.clear();
+	m_nextSaveIndex = 1;
+	m_journalBytes = 0;
+
+	MapReplay replay;
+	if (replay.Open(path))
+	{
+		std::vector<SpatialMapSurface> surfaces;
+		replay.ReconstructLatest(surfaces);
+		for (auto const& surface : surfaces)
+		{
+			m_savedUpdateTimes[surface.id] = surface.updateTime;
+		}
+		m_nextSaveIndex = replay.SavePoints().back().saveIndex + 1;
+		m_journalBytes = replay.JournalBytes();
+	}
+	replay.Close();
+
+	// New entries are appended after the last valid one.
+	std::string const journalPath = JournalPath(path);
+	std::error_code error;
+	if (Exists(journalPath) && std::filesystem::file_size(journalPath, error) != m_journalBytes)
+	{
+		std::filesystem::resize_file(journalPath, m_journalBytes, error);
+		if (error)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool MapJournal::Save(std::vector<SpatialMapSurface> const& surfaces, int64_t const saveTime, JournalSaveResult* const result)
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	m_changed.clear();
+	m_expired.clear();
+
+	size_t added = 0;
+	for (auto const& surface : surfaces)
+	{
+		auto const saved = m_savedUpdateTimes.find(surface.id);
+		if (saved == m_savedUpdateTimes.end())
+		{
+			m_changed.push_back(surface);
+			added++;
+		}
+		else if (saved->second != surface.updateTime)
+		{
+			m_changed.push_back(surface);
+		}
+	}
+
+	// Every saved surface that is still in the map was found above, so the lookup for
+	// expired ones is only needed if some were not.
+	if (surfaces.size() - added < m_savedUpdateTimes.size())
+	{
+		m_present.clear();
+		for (auto const& surface : surfaces)
+		{
+			m_present.insert(surface.id);
+		}
+		for (auto const& [id, updateTime] : m_savedUpdateTimes)
+		{
+			if (m_present.find(id) == m_present.end())
+			{
+				m_expired.push_back(id);
+			}
+		}
+	}
+
+	if (result)
+	{
+		*result = {};
+		result->writtenSurfaces = m_changed.size();
+		result->expiredSurfaces = m_expired.size();
+		result->unchangedSurfaces = surfaces.size() - m_changed.size();
+	}
+	if (m_changed.empty() && m_expired.empty())
+	{
+		return true;
+	}
+
+	std::ofstream file(JournalPath(m_path), std::ios::out | std::ios::binary | std::ios::app);
+	if (!file)
+	{
+		return false;
+	}
+	uint64_t const bytes = WriteEntry(file, m_nextSaveIndex, saveTime, false, m_expired, m_changed);
+	file.close();
+	if (file.fail())
+	{
+		// A partial entry is dropped by the next Open().
+		return false;
+	}
+
+	for (auto const& surface : m_changed)
+	{
+		m_savedUpdateTimes[surface.id] = surface.updateTime;
+	}
+	for (int32_t const id : m_expired)
+	{
+		m_savedUpdateTimes.erase(id);
+	}
+	m_nextSaveIndex++;
+	m_journalBytes += bytes;
+
+	if (result)
+	{
+		result->saveIndex = m_nextSaveIndex - 1;
+		result->bytes = bytes;
+	}
+	return true;
+}
+
+bool MapJournal::Compact()
+{
+	std::unique_lock<std::mutex> compacting(m_compactMutex, std::try_to_lock);
+	if (!compacting.owns_lock())
+	{
+		return false;
+	}
+
+	std::string const snapshotPath = SnapshotPath(m_path);
+	std::string const compactingPath = CompactingPath(m_path);
+	std::string const journalPath = JournalPath(m_path);
+	std::error_code error;
+
+	// Saves go to a new journal from here on. A journal left over from an interrupted
+	// compaction is folded first, the current one the next time.
+	{
+		std::lock_guard<std::mutex> guard(m_mutex);
+		if (!Exists(compactingPath))
+		{
+			if (m_journalBytes == 0)
+			{
+				return true;
+			}
+			std::filesystem::rename(journalPath, compactingPath, error);
+			if (error)
+			{
+				return false;
+			}
+			m_journalBytes = 0;
+		}
+	}
+
+	MapReplay replay;
+	if (replay.Open(m_path, false))
+	{
+		std::vector<SpatialMapSurface> surfaces;
+		replay.ReconstructLatest(surfaces);
+		SavePoint const latest = replay.SavePoints().back();
+
+		std::string const temporaryPath = snapshotPath + ".tmp";
+		{
+			std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+			WriteEntry(file, latest.saveIndex, latest.saveTime, true, {}, surfaces);
+			file.close();
+			if (file.fail())
+			{
+				return false;
+			}
+		}
+
+		// The snapshot is still mapped by the replay, which Windows does not allow to replace.
+		replay.Close();
+		std::filesystem::rename(temporaryPath, snapshotPath, error);
+		if (error)
+		{
+			return false;
+		}
+	}
+	replay.Close();
+
+	std::filesystem::remove(compactingPath, error);
+	return !error;
+}
+
+uint64_t MapJournal::JournalBytes() const
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+	return m_journalBytes;
+}
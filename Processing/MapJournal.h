@@ -0,0 +1,122 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "SpatialMapFile.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// One save of a journaled map.
+	struct SavePoint
+	{
+		uint32_t saveIndex = 0;
+		int64_t saveTime = 0;
+
+		// Surfaces in the map after the save, and how many of them the save wrote.
+		size_t surfaceCount = 0;
+		size_t writtenSurfaces = 0;
+		size_t expiredSurfaces = 0;
+	};
+
+	struct JournalSaveResult
+	{
+		// 0 if nothing changed and no entry was written.
+		uint32_t saveIndex = 0;
+		size_t writtenSurfaces = 0;
+		size_t expiredSurfaces = 0;
+		size_t unchangedSurfaces = 0;
+		uint64_t bytes = 0;
+	};
+
+	// A journaled map is stored in three files next to each other:
+	//
+	//   <path>.snapshot     one full entry, the map as of the last compaction
+	//   <path>.compacting   the journal while it is being folded into the snapshot
+	//   <path>.journal      one entry per save since then
+	//
+	// An entry is a header, the ids of the surfaces that expired with this save and a
+	// SpatialMapFile with the surfaces that were added or updated, all aligned to
+	// SpatialMapFile::SectionAlignment so that they can be read in place.
+	//
+	// Save indices increase by one per save. Entries of a save that is already covered by an
+	// earlier file are skipped, so a compaction interrupted at any point loses nothing.
+
+	// Reads a journaled map and reconstructs the map of any save since the last compaction.
+	class MapReplay
+	{
+	public:
+		// Maps the files that exist and reads their entries up to the first incomplete one.
+		// Returns false if there is no valid entry at all.
+		bool Open(std::string const& path, bool includeJournal = true);
+		void Close();
+
+		std::vector<SavePoint> const& SavePoints() const { return m_savePoints; }
+
+		// The surfaces as they were after the given save, sorted by id. The views point into
+		// the mapped files and are valid until Close().
+		bool Reconstruct(uint32_t saveIndex, std::vector<SpatialMapSurface>& surfaces) const;
+		bool ReconstructLatest(std::vector<SpatialMapSurface>& surfaces) const;
+
+		// Size of the valid entries of <path>.journal, anything after it is a torn write.
+		uint64_t JournalBytes() const { return m_journalBytes; }
+
+	private:
+		struct Entry
+		{
+			uint32_t saveIndex = 0;
+			int64_t saveTime = 0;
+			bool isFull = false;
+			int32_t const* expired = nullptr;
+			size_t expiredCount = 0;
+			std::vector<SpatialMapSurface> surfaces;
+			std::vector<DecodedMesh> decoded;
+		};
+
+		uint64_t ReadEntries(MappedFile const& file);
+
+		MappedFile m_files[3];
+		std::vector<Entry> m_entries;
+		std::vector<SavePoint> m_savePoints;
+		uint64_t m_journalBytes = 0;
+	};
+
+	// Appends the changes of every save to the journal, so that the cost of a save depends on
+	// how much of the map changed rather than on its size.
+	class MapJournal
+	{
+	public:
+		// Resumes the journal of an earlier session and drops a torn entry at its end.
+		bool Open(std::string const& path);
+
+		// Writes the surfaces whose update time differs from the one they were last saved with
+		// and the ids of the saved surfaces that are no longer in the map. Nothing is written
+		// if nothing changed.
+		bool Save(std::vector<SpatialMapSurface> const& surfaces, int64_t saveTime, JournalSaveResult* result = nullptr);
+
+		// Folds the journal into the snapshot. Meant for a background thread: saves continue
+		// into a new journal meanwhile, and a second concurrent call returns false at once.
+		bool Compact();
+
+		uint64_t JournalBytes() const;
+
+	private:
+		std::string m_path;
+		std::unordered_map<int, int64_t> m_savedUpdateTimes;
+		uint32_t m_nextSaveIndex = 1;
+		uint64_t m_journalBytes = 0;
+
+		// Reused between saves.
+		std::vector<SpatialMapSurface> m_changed;
+		std::vector<int32_t> m_expired;
+		std::unordered_set<int> m_present;
+
+		mutable std::mutex m_mutex;
+		std::mutex m_compactMutex;
+	};
+}
@@ -0,0 +1,128 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace SpatialMapping;
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+// The *FromApp variants are the ones available to UWP apps as well as desktop tools.
+bool MappedFile::Open(std::string const& path)
+{
+	Close();
+
+	int const length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+	std::wstring widePath(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], length);
+
+	HANDLE const file = CreateFile2(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	if (m_size == 0)
+	{
+		return true;
+	}
+
+	m_mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+	m_data = m_mapping ? MapViewOfFileFromApp(m_mapping, FILE_MAP_READ, 0, 0) : nullptr;
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file)
+	{
+		CloseHandle(m_file);
+	}
+	m_file = nullptr;
+	m_mapping = nullptr;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#else
+
+bool MappedFile::Open(std::string const& path)
+{
+	Close();
+
+	m_file = open(path.c_str(), O_RDONLY);
+	if (m_file < 0)
+	{
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(m_file, &status) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(status.st_size);
+	if (m_size == 0)
+	{
+		return true;
+	}
+
+	void* const data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_data = data;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+	{
+		munmap(const_cast<void*>(m_data), m_size);
+	}
+	if (m_file >= 0)
+	{
+		close(m_file);
+	}
+	m_file = -1;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#endif
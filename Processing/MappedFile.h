@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace SpatialMapping
+{
+	// Read-only memory mapping of a whole file. The mapping lives as long as the object.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(MappedFile const&) = delete;
+		MappedFile& operator=(MappedFile const&) = delete;
+
+		// Returns false if the file cannot be opened or mapped. An empty file maps to
+		// Data() == nullptr and Size() == 0.
+		bool Open(std::string const& path);
+		void Close();
+
+		char const* Data() const { return static_cast<char const*>(m_data); }
+		size_t Size() const { return m_size; }
+
+	private:
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#else
+		int m_file = -1;
+#endif
+		void const* m_data = nullptr;
+		size_t m_size = 0;
+	};
+}
@@ -0,0 +1,131 @@
+#include "MemoryAccounting.h"
+
+#include <string>
+
+using namespace SpatialMapping;
+
+char const* SpatialMapping::MemoryCategoryName(MemoryCategory const category)
+{
+	switch (category)
+	{
+	case MemoryCategory::CpuCaches:
+		return "cpu_caches";
+	case MemoryCategory::ExportData:
+		return "export_data";
+	case MemoryCategory::SpatialIndex:
+		return "spatial_index";
+	case MemoryCategory::Clusters:
+		return "clusters";
+	case MemoryCategory::GpuBuffers:
+		return "gpu_buffers";
+	case MemoryCategory::GpuUpdatedBuffers:
+		return "gpu_updated_buffers";
+	case MemoryCategory::PendingMesh:
+		return "pending_mesh";
+	default:
+		return "unknown";
+	}
+}
+
+size_t MemoryUsage::Total() const
+{
+	size_t total = 0;
+	for (size_t const b : bytes)
+	{
+		total += b;
+	}
+	return total;
+}
+
+MemoryAccounting& MemoryAccounting::Instance()
+{
+	static MemoryAccounting accounting;
+	return accounting;
+}
+
+MemoryAccounting::MemoryAccounting() :
+	m_total(MetricsRegistry::Instance().AddGauge("memory.total", "bytes")),
+	m_totalHighWater(MetricsRegistry::Instance().AddGauge("memory.total.peak", "bytes"))
+{
+	for (size_t c = 0; c < MemoryCategoryCount; c++)
+	{
+		std::string const name = std::string("memory.") + MemoryCategoryName(static_cast<MemoryCategory>(c));
+		m_current[c] = &MetricsRegistry::Instance().AddGauge(name, "bytes");
+		m_highWater[c] = &MetricsRegistry::Instance().AddGauge(name + ".peak", "bytes");
+	}
+}
+
+void MemoryAccounting::Add(MemoryCategory const category, int64_t const delta)
+{
+	if (delta == 0)
+	{
+		return;
+	}
+	size_t const c = static_cast<size_t>(category);
+	m_highWater[c]->SetMax(m_current[c]->Add(delta));
+	m_totalHighWater.SetMax(m_total.Add(delta));
+}
+
+MemoryUsage MemoryAccounting::Current() const
+{
+	MemoryUsage usage;
+	for (size_t c = 0; c < MemoryCategoryCount; c++)
+	{
+		usage.bytes[c] = static_cast<size_t>(m_current[c]->Value());
+	}
+	return usage;
+}
+
+MemoryUsage MemoryAccounting::HighWater() const
+{
+	MemoryUsage usage;
+	for (size_t c = 0; c < MemoryCategoryCount; c++)
+	{
+		usage.bytes[c] = static_cast<size_t>(m_highWater[c]->Value());
+	}
+	return usage;
+}
+
+size_t MemoryAccounting::TotalHighWater() const
+{
+	return static_cast<size_t>(m_totalHighWater.Value());
+}
+
+void MemoryAccounting::ResetHighWater()
+{
+	for (size_t c = 0; c < MemoryCategoryCount; c++)
+	{
+		m_highWater[c]->Set(m_current[c]->Value());
+	}
+	m_totalHighWater.Set(m_total.Value());
+}
+
+SurfaceMemory::~SurfaceMemory()
+{
+	for (size_t c = 0; c < MemoryCategoryCount; c++)
+	{
+		MemoryAccounting::Instance().Add(static_cast<MemoryCategory>(c), -m_bytes[c].load(std::memory_order_relaxed));
+	}
+}
+
+void SurfaceMemory::Set(MemoryCategory const category, size_t const bytes)
+{
+	int64_t const previous = m_bytes[static_cast<size_t>(category)].exchange(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+	MemoryAccounting::Instance().Add(category, static_cast<int64_t>(bytes) - previous);
+}
+
+void SurfaceMemory::Add(MemoryCategory const category, int64_t const delta)
+{
+	m_bytes[static_cast<size_t>(category)].fetch_add(delta, std::memory_order_relaxed);
+	MemoryAccounting::Instance().Add(category, delta);
+}
+
+MemoryUsage SurfaceMemory::Usage() const
+{
+	MemoryUsage usage;
+	for (size_t c = 0; c < MemoryCategoryCount; c++)
+	{
+		usage.bytes[c] = static_cast<size_t>(m_bytes[c].load(std::memory_order_relaxed));
+	}
+	return usage;
+}
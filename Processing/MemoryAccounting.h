@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Metrics.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace SpatialMapping
+{
+	enum class MemoryCategory
+	{
+		// The position, normal, index, floater and attribute caches of SurfaceIngest.
+		CpuCaches,
+
+		// The published SurfaceData, SpatialIndex and MeshClusters, which exports and readers
+		// of the map may keep alive after the surface replaced them.
+		ExportData,
+		SpatialIndex,
+		Clusters,
+
+		// The buffers SurfaceMesh draws, and the ones of an update waiting to be swapped in.
+		GpuBuffers,
+		GpuUpdatedBuffers,
+
+		// The buffers of the observer's SpatialSurfaceMesh of updates that are not uploaded yet.
+		PendingMesh,
+
+		Count
+	};
+
+	size_t const MemoryCategoryCount = static_cast<size_t>(MemoryCategory::Count);
+
+	// "cpu_caches", "export_data", ...
+	char const* MemoryCategoryName(MemoryCategory category);
+
+	struct MemoryUsage
+	{
+		size_t bytes[MemoryCategoryCount] = {};
+
+		size_t& operator[](MemoryCategory const category) { return bytes[static_cast<size_t>(category)]; }
+		size_t operator[](MemoryCategory const category) const { return bytes[static_cast<size_t>(category)]; }
+		size_t Total() const;
+	};
+
+	// The bytes of all surfaces per category and their high-water marks. They are gauges of
+	// MetricsRegistry::Instance(), memory.<category> and memory.total with a .peak each, so
+	// that every metrics snapshot includes them.
+	class MemoryAccounting
+	{
+	public:
+		static MemoryAccounting& Instance();
+
+		void Add(MemoryCategory category, int64_t delta);
+
+		MemoryUsage Current() const;
+		MemoryUsage HighWater() const;
+
+		// The peak of the sum, which is lower than the sum of the peaks.
+		size_t TotalHighWater() const;
+
+		// Restarts the high-water marks at the current usage.
+		void ResetHighWater();
+
+	private:
+		MemoryAccounting();
+
+		Gauge* m_current[MemoryCategoryCount];
+		Gauge* m_highWater[MemoryCategoryCount];
+		Gauge& m_total;
+		Gauge& m_totalHighWater;
+	};
+
+	// The bytes one surface holds per category. Every change moves the totals of
+	// MemoryAccounting by its difference, and the destructor takes them back, so that the
+	// totals are the sum over the living surfaces. Safe to update from any thread.
+	class SurfaceMemory
+	{
+	public:
+		SurfaceMemory() = default;
+		~SurfaceMemory();
+
+		SurfaceMemory(SurfaceMemory const&) = delete;
+		SurfaceMemory& operator=(SurfaceMemory const&) = delete;
+
+		void Set(MemoryCategory category, size_t bytes);
+		void Add(MemoryCategory category, int64_t delta);
+
+		MemoryUsage Usage() const;
+
+	private:
+		std::atomic<int64_t> m_bytes[MemoryCategoryCount] = {};
+	};
+}
@@ -0,0 +1,163 @@
+#include "MeshAttributes.h"
+
+#include "Plane.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	// Residuals beyond this are clamped in the colors, walls of a capture deviate by a few
+	// centimeters from their plane.
+	float const PlaneDistanceRange = 0.05f;
+
+	void ComputeGradient(size_t const faceCount, AttributeChannel& channel)
+	{
+		// Material m of the export has the gray value (m - 1) / 1000. The float accumulation
+		// of ObjWriter is replicated, so that every face gets the gray of its material.
+		channel.values.resize(faceCount);
+		float const increment = 1000.f / static_cast<float>(faceCount);
+		float number = 1.f;
+		for (size_t f = 0; f < faceCount; f++)
+		{
+			channel.values[f] = (std::floor(number) - 1.f) / 1000.f;
+			number += increment;
+		}
+	}
+
+	void ComputeSurface(int const surfaceId, size_t const vertexCount, AttributeChannel& channel)
+	{
+		// Fibonacci hashing spreads consecutive and similar ids over the whole range.
+		uint32_t const hash = static_cast<uint32_t>(surfaceId) * 2654435769u;
+		float const value = static_cast<float>(hash >> 8) / static_cast<float>(1u << 24);
+		channel.values.assign(vertexCount, value);
+	}
+
+	void ComputePlaneDistance(Vector3 const* positions, size_t const vertexCount, AttributeChannel& channel)
+	{
+		Plane const plane = FitPlane(positions, vertexCount);
+		channel.values.resize(vertexCount);
+		float* const values = channel.values.data();
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			values[v] = plane.normal.x * positions[v].x + plane.normal.y * positions[v].y + plane.normal.z * positions[v].z + plane.d;
+		}
+	}
+}
+
+char const* SpatialMapping::AttributeName(AttributeKind const kind)
+{
+	switch (kind)
+	{
+	case AttributeKind::Gradient:
+		return "gradient";
+	case AttributeKind::Surface:
+		return "surface";
+	default:
+		return "plane_distance";
+	}
+}
+
+void SpatialMapping::ComputeAttribute(
+	AttributeKind const kind,
+	int const surfaceId,
+	Vector3 const* const positions,
+	size_t const vertexCount,
+	IndexView const& indices,
+	AttributeChannel& channel)
+{
+	channel.name = AttributeName(kind);
+	switch (kind)
+	{
+	case AttributeKind::Gradient:
+		channel.domain = AttributeDomain::Face;
+		channel.minimum = 0.f;
+		channel.maximum = 1.f;
+		ComputeGradient(indices.count / 3, channel);
+		break;
+	case AttributeKind::Surface:
+		channel.domain = AttributeDomain::Vertex;
+		channel.minimum = 0.f;
+		channel.maximum = 1.f;
+		ComputeSurface(surfaceId, vertexCount, channel);
+		break;
+	default:
+		channel.domain = AttributeDomain::Vertex;
+		channel.minimum = -PlaneDistanceRange;
+		channel.maximum = PlaneDistanceRange;
+		ComputePlaneDistance(positions, vertexCount, channel);
+		break;
+	}
+}
+
+AttributeChannel const* SpatialMapping::FindAttribute(AttributeChannel const* const channels, size_t const count, std::string const& name)
+{
+	for (size_t c = 0; c < count; c++)
+	{
+		if (channels[c].name == name)
+		{
+			return &channels[c];
+		}
+	}
+	return nullptr;
+}
+
+void SpatialMapping::VertexValues(AttributeChannel const& channel, size_t const vertexCount, IndexView const& indices, std::vector<float>& values)
+{
+	values.assign(vertexCount, 0.f);
+	if (channel.domain == AttributeDomain::Vertex)
+	{
+		std::copy(channel.values.begin(), channel.values.begin() + std::min(vertexCount, channel.values.size()), values.begin());
+	}
+	else
+	{
+		std::vector<uint32_t> faces(vertexCount, 0);
+		size_t const faceCount = std::min(indices.count / 3, channel.values.size());
+		VisitIndices(indices, [&](auto const* const typed)
+			{
+				for (size_t f = 0; f < faceCount; f++)
+				{
+					for (size_t corner = 0; corner < 3; corner++)
+					{
+						uint32_t const v = typed[3 * f + corner];
+						values[v] += channel.values[f];
+						faces[v]++;
+					}
+				}
+			});
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			values[v] = faces[v] > 0 ? values[v] / faces[v] : 0.f;
+		}
+	}
+}
+
+void SpatialMapping::NormalizedVertexValues(AttributeChannel const& channel, size_t const vertexCount, IndexView const& indices, std::vector<float>& values)
+{
+	VertexValues(channel, vertexCount, indices, values);
+
+	float const offset = channel.minimum;
+	float const scale = channel.maximum > channel.minimum ? 1.f / (channel.maximum - channel.minimum) : 0.f;
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		values[v] = std::min(1.f, std::max(0.f, (values[v] - offset) * scale));
+	}
+}
+
+void SpatialMapping::VertexColors(AttributeChannel const& channel, size_t const vertexCount, IndexView const& indices, std::vector<uint8_t>& rgba)
+{
+	std::vector<float> values;
+	NormalizedVertexValues(channel, vertexCount, indices, values);
+
+	rgba.resize(4 * vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		uint8_t const gray = static_cast<uint8_t>(std::lround(values[v] * 255.f));
+		rgba[4 * v] = gray;
+		rgba[4 * v + 1] = gray;
+		rgba[4 * v + 2] = gray;
+		rgba[4 * v + 3] = 255;
+	}
+}
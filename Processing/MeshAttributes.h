@@ -0,0 +1,65 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	enum class AttributeDomain : uint8_t
+	{
+		Vertex,
+		Face
+	};
+
+	// A scalar per vertex or per face of a surface, e.g. a distance or a confidence. minimum
+	// and maximum are the range the exports map to colors, values outside it are clamped.
+	struct AttributeChannel
+	{
+		std::string name;
+		AttributeDomain domain = AttributeDomain::Vertex;
+		std::vector<float> values;
+		float minimum = 0.f;
+		float maximum = 1.f;
+	};
+
+	enum class AttributeKind : uint8_t
+	{
+		// "gradient", per face: the gray ramp over the faces of a surface that the 1000 usemtl
+		// materials of the OBJ export encode, 0 for the first face and 0.999 for the last.
+		Gradient,
+
+		// "surface", per vertex: one value in [0, 1) per surface id, to tell surfaces apart.
+		Surface,
+
+		// "plane_distance", per vertex: signed distance in meters to the least-squares plane
+		// of the surface, which shows how flat a wall or floor was captured.
+		PlaneDistance
+	};
+
+	char const* AttributeName(AttributeKind kind);
+
+	// The channels are computed in flat passes over the caches of a surface and reuse the
+	// storage of channel.
+	void ComputeAttribute(
+		AttributeKind kind,
+		int surfaceId,
+		Vector3 const* positions,
+		size_t vertexCount,
+		IndexView const& indices,
+		AttributeChannel& channel);
+
+	AttributeChannel const* FindAttribute(AttributeChannel const* channels, size_t count, std::string const& name);
+
+	// The channel per vertex. Face values are averaged over the faces around each vertex;
+	// vertices without faces get 0.
+	void VertexValues(AttributeChannel const& channel, size_t vertexCount, IndexView const& indices, std::vector<float>& values);
+
+	// VertexValues() mapped from the range of the channel to [0, 1].
+	void NormalizedVertexValues(AttributeChannel const& channel, size_t vertexCount, IndexView const& indices, std::vector<float>& values);
+
+	// 8 bit RGBA per vertex on the gray ramp of the OBJ materials, see NormalizedVertexValues.
+	void VertexColors(AttributeChannel const& channel, size_t vertexCount, IndexView const& indices, std::vector<uint8_t>& rgba);
+}
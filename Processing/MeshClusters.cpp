@@ -0,0 +1,299 @@
+#include "MeshClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	uint8_t const NoLocal = 0xFF;
+}
+
+void MeshClusterBuilder::Build(Vector3 const* const positions, size_t const vertexCount, IndexView const& indices, ClusterOptions const& options, MeshClusters& result)
+{
+	VisitIndices(indices, [&](auto const* const typed)
+		{
+			Build(positions, vertexCount, typed, indices.count, options, result);
+		});
+}
+
+template <typename TIndex>
+void MeshClusterBuilder::Build(Vector3 const* const positions, size_t const vertexCount, TIndex const* const indices, size_t const indexCount,
+	ClusterOptions const& options, MeshClusters& result)
+{
+	result.clusters.clear();
+	result.vertices.clear();
+	result.triangles.clear();
+
+	size_t const triangleCount = indexCount / 3;
+	size_t const maxVertices = std::min<size_t>(std::max<size_t>(options.maxVertices, 3), NoLocal);
+	size_t const maxTriangles = std::max<size_t>(options.maxTriangles, 1);
+
+	// Counted into the next row, filled by moving every offset to the end of its row, and
+	// moved back by one row.
+	m_offsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < 3 * triangleCount; i++)
+	{
+		m_offsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		m_offsets[v + 1] += m_offsets[v];
+	}
+	m_adjacency.resize(3 * triangleCount);
+	for (size_t i = 0; i < 3 * triangleCount; i++)
+	{
+		m_adjacency[m_offsets[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+	for (size_t v = vertexCount; v > 0; v--)
+	{
+		m_offsets[v] = m_offsets[v - 1];
+	}
+	m_offsets[0] = 0;
+
+	m_assigned.assign(triangleCount, 0);
+	m_live.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		m_live[v] = m_offsets[v + 1] - m_offsets[v];
+	}
+	m_local.assign(vertexCount, NoLocal);
+	m_inFrontier.assign(triangleCount, 0);
+	m_missing.resize(triangleCount);
+	m_frontier.clear();
+
+	m_centroids.resize(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		m_centroids[t] = (positions[indices[3 * t]] + positions[indices[3 * t + 1]] + positions[indices[3 * t + 2]]) * (1.f / 3.f);
+	}
+
+	size_t cursor = 0;
+	for (;;)
+	{
+		// The next cluster starts next to the last one, at the triangle with the fewest
+		// unassigned neighbors, so that corners and slivers left between clusters are taken
+		// before they become clusters of their own. Else at the first triangle left in index
+		// order.
+		uint32_t next = UINT32_MAX;
+		uint32_t fewestNeighbors = UINT32_MAX;
+		for (uint32_t const t : m_frontier)
+		{
+			uint32_t const neighbors = m_live[indices[3 * t]] + m_live[indices[3 * t + 1]] + m_live[indices[3 * t + 2]];
+			if (!m_assigned[t] && neighbors < fewestNeighbors)
+			{
+				next = t;
+				fewestNeighbors = neighbors;
+			}
+		}
+		if (next == UINT32_MAX)
+		{
+			while (cursor < triangleCount && m_assigned[cursor])
+			{
+				cursor++;
+			}
+			if (cursor == triangleCount)
+			{
+				break;
+			}
+			next = static_cast<uint32_t>(cursor);
+		}
+		m_frontier.clear();
+
+		MeshCluster cluster;
+		cluster.firstVertex = static_cast<uint32_t>(result.vertices.size());
+		cluster.firstTriangle = static_cast<uint32_t>(result.triangles.size() / 3);
+		uint32_t const stamp = static_cast<uint32_t>(result.clusters.size() + 1);
+		Vector3 centroids;
+		while (next != UINT32_MAX)
+		{
+			m_assigned[next] = 1;
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				TIndex const v = indices[3 * next + corner];
+				m_live[v]--;
+				if (m_local[v] == NoLocal)
+				{
+					m_local[v] = static_cast<uint8_t>(cluster.vertexCount++);
+					result.vertices.push_back(static_cast<uint32_t>(v));
+					for (uint32_t a = m_offsets[v]; a < m_offsets[v + 1]; a++)
+					{
+						uint32_t const t = m_adjacency[a];
+						if (m_assigned[t])
+						{
+							continue;
+						}
+						if (m_inFrontier[t] != stamp)
+						{
+							m_inFrontier[t] = stamp;
+							m_missing[t] = 3;
+							m_frontier.push_back(t);
+						}
+						m_missing[t]--;
+					}
+				}
+				result.triangles.push_back(m_local[v]);
+			}
+			cluster.triangleCount++;
+			centroids = centroids + m_centroids[next];
+			if (cluster.triangleCount == maxTriangles)
+			{
+				break;
+			}
+
+			// The neighbor that adds the fewest vertices, then the one closest to the center,
+			// its distance scaled by its unassigned neighbors so that triangles which would be
+			// left stranded are taken first. Those around the last triangle are tried first, so
+			// that the whole frontier is only searched when the cluster cannot grow there.
+			Vector3 const center = centroids * (1.f / cluster.triangleCount);
+			size_t bestAdded = 4;
+			float bestDistance = std::numeric_limits<float>::max();
+			uint32_t best = UINT32_MAX;
+			auto const consider = [&](uint32_t const t)
+				{
+					size_t const added = m_missing[t];
+					if (cluster.vertexCount + added > maxVertices || added > bestAdded)
+					{
+						return;
+					}
+					uint32_t const neighbors = m_live[indices[3 * t]] + m_live[indices[3 * t + 1]] + m_live[indices[3 * t + 2]];
+					float const distance = LengthSquared(m_centroids[t] - center) * (1.f + neighbors);
+					if (added < bestAdded || distance < bestDistance)
+					{
+						best = t;
+						bestAdded = added;
+						bestDistance = distance;
+					}
+				};
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				TIndex const v = indices[3 * next + corner];
+				for (uint32_t a = m_offsets[v]; a < m_offsets[v + 1]; a++)
+				{
+					if (!m_assigned[m_adjacency[a]])
+					{
+						consider(m_adjacency[a]);
+					}
+				}
+			}
+			if (best == UINT32_MAX)
+			{
+				size_t kept = 0;
+				for (uint32_t const t : m_frontier)
+				{
+					if (!m_assigned[t])
+					{
+						m_frontier[kept++] = t;
+						consider(t);
+					}
+				}
+				m_frontier.resize(kept);
+			}
+			next = best;
+		}
+
+		for (uint32_t v = cluster.firstVertex; v < result.vertices.size(); v++)
+		{
+			m_local[result.vertices[v]] = NoLocal;
+		}
+		ComputeBounds(positions, result, cluster);
+		result.clusters.push_back(cluster);
+	}
+}
+
+void MeshClusterBuilder::ComputeBounds(Vector3 const* const positions, MeshClusters const& result, MeshCluster& cluster)
+{
+	uint32_t const* const vertices = result.vertices.data() + cluster.firstVertex;
+	uint8_t const* const triangles = result.triangles.data() + 3 * static_cast<size_t>(cluster.firstTriangle);
+
+	// Around the center of the bounding box, which is within a factor of sqrt(3) of the
+	// smallest sphere and does not depend on the order of the vertices.
+	float const max = std::numeric_limits<float>::max();
+	Vector3 low{ max, max, max };
+	Vector3 high{ -max, -max, -max };
+	for (uint32_t v = 0; v < cluster.vertexCount; v++)
+	{
+		Vector3 const& p = positions[vertices[v]];
+		low = { std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z) };
+		high = { std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z) };
+	}
+	cluster.center = (low + high) * 0.5f;
+	float radiusSquared = 0.f;
+	for (uint32_t v = 0; v < cluster.vertexCount; v++)
+	{
+		radiusSquared = std::max(radiusSquared, LengthSquared(positions[vertices[v]] - cluster.center));
+	}
+	cluster.radius = std::sqrt(radiusSquared);
+
+	// The axis is the mean of the unit normals, the cone spans the one furthest from it.
+	m_normals.resize(cluster.triangleCount);
+	Vector3 axis;
+	for (uint32_t t = 0; t < cluster.triangleCount; t++)
+	{
+		Vector3 const& a = positions[vertices[triangles[3 * t]]];
+		Vector3 const& b = positions[vertices[triangles[3 * t + 1]]];
+		Vector3 const& c = positions[vertices[triangles[3 * t + 2]]];
+		m_normals[t] = Normalize(Cross(b - a, c - a));
+		axis = axis + m_normals[t];
+	}
+	cluster.coneAxis = Normalize(axis);
+	cluster.coneCutoff = 1.f;
+	if (LengthSquared(cluster.coneAxis) == 0.f)
+	{
+		return;
+	}
+
+	float minDot = 1.f;
+	for (Vector3 const& n : m_normals)
+	{
+		if (LengthSquared(n) > 0.f)
+		{
+			minDot = std::min(minDot, Dot(cluster.coneAxis, n));
+		}
+	}
+
+	// The triangles face away from every view direction within 90 degrees minus the half
+	// angle of the cone around the axis, whose cosine is the sine of the half angle.
+	cluster.coneCutoff = minDot <= 0.f ? 1.f : std::sqrt(1.f - minDot * minDot);
+}
+
+ClusterView ClusterView::FromLookAt(Vector3 const& eye, Vector3 const& forward, Vector3 const& up,
+	float const horizontalFov, float const verticalFov, float const nearDistance, float const farDistance)
+{
+	Vector3 const f = Normalize(forward);
+	Vector3 const right = Normalize(Cross(f, up));
+	Vector3 const u = Cross(right, f);
+	float const tanX = std::tan(horizontalFov * 0.5f);
+	float const tanY = std::tan(verticalFov * 0.5f);
+
+	// The side planes go through the eye and contain the edges f + right * tanX, ...
+	ClusterView view;
+	view.eye = eye;
+	view.planes[0] = Plane::FromPointAndNormal(eye, Normalize(f * tanX - right));
+	view.planes[1] = Plane::FromPointAndNormal(eye, Normalize(f * tanX + right));
+	view.planes[2] = Plane::FromPointAndNormal(eye, Normalize(f * tanY - u));
+	view.planes[3] = Plane::FromPointAndNormal(eye, Normalize(f * tanY + u));
+	view.planes[4] = Plane::FromPointAndNormal(eye + f * nearDistance, f);
+	view.planes[5] = Plane::FromPointAndNormal(eye + f * farDistance, f * -1.f);
+	return view;
+}
+
+bool SpatialMapping::IsOutsideView(MeshCluster const& cluster, ClusterView const& view)
+{
+	for (Plane const& plane : view.planes)
+	{
+		if (plane.SignedDistance(cluster.center) < -cluster.radius)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SpatialMapping::IsFacingAway(MeshCluster const& cluster, Vector3 const& eye)
+{
+	Vector3 const toCenter = cluster.center - eye;
+	return Dot(toCenter, cluster.coneAxis) >= cluster.coneCutoff * Length(toCenter) + cluster.radius;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "MeshTypes.h"
+#include "Plane.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct ClusterOptions
+	{
+		// At most 255, the local indices of a cluster are 8 bit. 64 and 124 are the sizes
+		// recommended for mesh shaders, 124 triangles keep their indices a multiple of 4 bytes.
+		size_t maxVertices = 64;
+		size_t maxTriangles = 124;
+	};
+
+	struct MeshCluster
+	{
+		// Into MeshClusters::vertices and, three per triangle, MeshClusters::triangles.
+		uint32_t firstVertex = 0;
+		uint32_t vertexCount = 0;
+		uint32_t firstTriangle = 0;
+		uint32_t triangleCount = 0;
+
+		// Bounding sphere of the vertices.
+		Vector3 center;
+		float radius = 0.f;
+
+		// Every outward triangle normal lies within the cone around the axis whose sine of the
+		// half angle is coneCutoff. 1 for clusters that span a hemisphere or more, which are
+		// never culled by it.
+		Vector3 coneAxis;
+		float coneCutoff = 1.f;
+	};
+
+	// A surface partitioned into clusters of neighboring triangles, like the meshlets of mesh
+	// shaders: every cluster lists the surface vertices it uses and its triangles in indices
+	// into that list.
+	struct MeshClusters
+	{
+		std::vector<MeshCluster> clusters;
+		std::vector<uint32_t> vertices;
+		std::vector<uint8_t> triangles;
+
+		size_t Bytes() const
+		{
+			return clusters.capacity() * sizeof(MeshCluster) + vertices.capacity() * sizeof(uint32_t) + triangles.capacity();
+		}
+	};
+
+	// Partitions surfaces into MeshClusters. Grows every cluster from a seed triangle by the
+	// neighbor that adds the fewest vertices, then the one closest to the cluster, so that
+	// clusters are compact and their bounds tight, and starts the next one where the last
+	// left triangles with the fewest unassigned neighbors. The result only depends on the input, and
+	// one builder per surface runs in parallel with the others. Keeps its buffers between
+	// calls.
+	class MeshClusterBuilder
+	{
+	public:
+		// The triangles of indices in the winding of the exports, whose cross product points
+		// out of the surface.
+		void Build(Vector3 const* positions, size_t vertexCount, IndexView const& indices, ClusterOptions const& options, MeshClusters& result);
+
+	private:
+		template <typename TIndex>
+		void Build(Vector3 const* positions, size_t vertexCount, TIndex const* indices, size_t indexCount, ClusterOptions const& options, MeshClusters& result);
+
+		void ComputeBounds(Vector3 const* positions, MeshClusters const& result, MeshCluster& cluster);
+
+		// Triangles of every vertex, in compressed rows.
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_adjacency;
+
+		std::vector<Vector3> m_centroids;
+		std::vector<uint8_t> m_assigned;
+
+		// Unassigned triangles of every vertex.
+		std::vector<uint32_t> m_live;
+
+		// Index of every vertex in the cluster that is being grown, NoLocal if it is not in it.
+		std::vector<uint8_t> m_local;
+
+		// Unassigned triangles next to the cluster, marked with the cluster they were added for,
+		// and how many vertices each would add to it.
+		std::vector<uint32_t> m_frontier;
+		std::vector<uint32_t> m_inFrontier;
+		std::vector<uint8_t> m_missing;
+
+		// Of the triangles of the cluster whose bounds are computed.
+		std::vector<Vector3> m_normals;
+	};
+
+	// What a viewer sees: six planes whose normals point into the view volume, and its position.
+	struct ClusterView
+	{
+		Vector3 eye;
+		Plane planes[6];
+
+		// A symmetric perspective frustum looking along forward, the field of view in radians.
+		static ClusterView FromLookAt(Vector3 const& eye, Vector3 const& forward, Vector3 const& up,
+			float horizontalFov, float verticalFov, float nearDistance, float farDistance);
+	};
+
+	// Whether the bounding sphere of the cluster lies outside one of the planes of the view.
+	bool IsOutsideView(MeshCluster const& cluster, ClusterView const& view);
+
+	// Whether the viewer sees the backs of all triangles of the cluster, conservatively over
+	// its bounding sphere.
+	bool IsFacingAway(MeshCluster const& cluster, Vector3 const& eye);
+}
@@ -0,0 +1,1050 @@
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	char const Magic[4] = { 'S', 'P', 'M', 'C' };
+
+	uint32_t const Indices32Bit = 1;
+	uint32_t const HasLocalPositions = 2;
+	uint32_t const Lossless = 4;
+
+	struct BlobHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t size;
+		uint32_t flags;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t faceNormalCount;
+		float step;
+		float origin[3];
+		float localOrigin[3];
+	};
+
+	static_assert(sizeof(BlobHeader) == 56, "The blob header layout is part of the format");
+
+	// The streams follow the header in this order.
+	enum Stream
+	{
+		TriangleCodes,
+		VertexCodes,
+		ExplicitIndices,
+		PositionsX,
+		LocalPositionsX = PositionsX + 3,
+		NormalsX = LocalPositionsX + 3,
+		StreamCount = NormalsX + 3
+	};
+
+	// Triangle codes: 0 for three vertex references, otherwise 1 + 3 * edge + rotation for a
+	// triangle that shares the reversed edge with a recent one and needs one more vertex.
+	// Vertex codes: 0 for the next unused vertex, 1 + position in the vertex FIFO, or an
+	// explicit index relative to the next unused vertex.
+	size_t const EdgeFifoSize = 16;
+	size_t const VertexFifoSize = 16;
+	uint8_t const NextVertex = 0;
+	uint8_t const ExplicitVertex = 1 + VertexFifoSize;
+
+	float const NormalScale = 2047.f;
+
+	uint32_t const ProbabilityBits = 12;
+	uint32_t const ProbabilityScale = 1u << ProbabilityBits;
+	uint32_t const RansLow = 1u << 23;
+
+	uint8_t const RawStream = 0;
+	uint8_t const RansStream = 1;
+	uint8_t const ConstantStream = 2;
+
+	using Bytes = std::vector<uint8_t>;
+
+	uint32_t ZigZag(int32_t const value)
+	{
+		return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+	}
+
+	int32_t UnZigZag(uint32_t const value)
+	{
+		return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+	}
+
+	template <typename TBuffer>
+	void PutVarint(TBuffer& out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	class ByteReader
+	{
+	public:
+		ByteReader(uint8_t const* data, size_t const size) : m_position(data), m_end(data + size) {}
+
+		bool Valid() const { return m_valid; }
+		uint8_t const* Position() const { return m_position; }
+		size_t Remaining() const { return static_cast<size_t>(m_end - m_position); }
+
+		uint8_t Byte()
+		{
+			if (m_position == m_end)
+			{
+				m_valid = false;
+				return 0;
+			}
+			return *m_position++;
+		}
+
+		uint32_t Varint()
+		{
+			uint32_t value = 0;
+			for (int shift = 0; shift < 35; shift += 7)
+			{
+				uint8_t const byte = Byte();
+				value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+				if ((byte & 0x80) == 0)
+				{
+					return value;
+				}
+			}
+			m_valid = false;
+			return 0;
+		}
+
+		void Skip(size_t const bytes)
+		{
+			if (bytes > Remaining())
+			{
+				m_valid = false;
+				m_position = m_end;
+				return;
+			}
+			m_position += bytes;
+		}
+
+	private:
+		uint8_t const* m_position;
+		uint8_t const* m_end;
+		bool m_valid = true;
+	};
+
+	// Scales the symbol counts to frequencies that sum to ProbabilityScale, keeping every
+	// symbol that occurs at a frequency of at least 1.
+	void NormalizeFrequencies(std::array<uint32_t, 256> const& counts, size_t const total, std::array<uint32_t, 256>& frequencies)
+	{
+		uint32_t sum = 0;
+		size_t largest = 0;
+		for (size_t s = 0; s < 256; s++)
+		{
+			frequencies[s] = counts[s] == 0 ? 0 : std::max<uint32_t>(1, static_cast<uint32_t>(static_cast<uint64_t>(counts[s]) * ProbabilityScale / total));
+			sum += frequencies[s];
+			largest = frequencies[s] > frequencies[largest] ? s : largest;
+		}
+
+		// The rounding error goes to the most frequent symbol, where it costs the least. If
+		// that is not enough, the other symbols above 1 give up one each.
+		while (sum > ProbabilityScale)
+		{
+			uint32_t const excess = std::min(sum - ProbabilityScale, frequencies[largest] - 1);
+			frequencies[largest] -= excess;
+			sum -= excess;
+			for (size_t s = 0; s < 256 && sum > ProbabilityScale; s++)
+			{
+				if (frequencies[s] > 1)
+				{
+					frequencies[s]--;
+					sum--;
+				}
+			}
+		}
+		frequencies[largest] += ProbabilityScale - sum;
+	}
+
+	// A stream is its mode and size followed by the raw bytes, the repeated byte, or the
+	// frequency table and the rANS payload.
+	void EncodeStream(Bytes const& raw, std::string& out)
+	{
+		std::array<uint32_t, 256> counts = {};
+		for (uint8_t const symbol : raw)
+		{
+			counts[symbol]++;
+		}
+
+		size_t const symbolCount = static_cast<size_t>(std::count_if(counts.begin(), counts.end(), [](uint32_t const c) { return c > 0; }));
+		if (symbolCount == 1)
+		{
+			out.push_back(static_cast<char>(ConstantStream));
+			PutVarint(out, static_cast<uint32_t>(raw.size()));
+			out.push_back(static_cast<char>(raw[0]));
+			return;
+		}
+
+		size_t const start = out.size();
+		if (symbolCount > 1)
+		{
+			std::array<uint32_t, 256> frequencies;
+			std::array<uint32_t, 256> starts;
+			NormalizeFrequencies(counts, raw.size(), frequencies);
+			uint32_t cumulative = 0;
+			for (size_t s = 0; s < 256; s++)
+			{
+				starts[s] = cumulative;
+				cumulative += frequencies[s];
+			}
+
+			// rANS encodes backwards, every symbol takes at most ProbabilityBits bits. Even and odd
+			// symbols go to two interleaved states, which halves the dependency chain.
+			Bytes payload(raw.size() * 2 + 8);
+			uint8_t* position = payload.data() + payload.size();
+			uint32_t states[2] = { RansLow, RansLow };
+			for (size_t i = raw.size(); i-- > 0;)
+			{
+				uint32_t& state = states[i & 1];
+				uint32_t const frequency = frequencies[raw[i]];
+				uint32_t const limit = ((RansLow >> ProbabilityBits) << 8) * frequency;
+				while (state >= limit)
+				{
+					*--position = static_cast<uint8_t>(state);
+					state >>= 8;
+				}
+				uint32_t const quotient = state / frequency;
+				state = (quotient << ProbabilityBits) + state - quotient * frequency + starts[raw[i]];
+			}
+			position -= 8;
+			std::memcpy(position, states, sizeof(states));
+			size_t const payloadSize = static_cast<size_t>(payload.data() + payload.size() - position);
+
+			out.push_back(static_cast<char>(RansStream));
+			PutVarint(out, static_cast<uint32_t>(raw.size()));
+			uint8_t present[32] = {};
+			for (size_t s = 0; s < 256; s++)
+			{
+				present[s / 8] |= frequencies[s] > 0 ? static_cast<uint8_t>(1 << (s % 8)) : 0;
+			}
+			out.append(reinterpret_cast<char const*>(present), sizeof(present));
+			for (size_t s = 0; s < 256; s++)
+			{
+				if (frequencies[s] > 0)
+				{
+					PutVarint(out, frequencies[s] - 1);
+				}
+			}
+			PutVarint(out, static_cast<uint32_t>(payloadSize));
+			out.append(reinterpret_cast<char const*>(position), payloadSize);
+
+			if (out.size() - start < raw.size() + 1 + 5)
+			{
+				return;
+			}
+			out.resize(start);
+		}
+
+		// Empty, or too short or too random to gain anything.
+		out.push_back(static_cast<char>(RawStream));
+		PutVarint(out, static_cast<uint32_t>(raw.size()));
+		out.append(reinterpret_cast<char const*>(raw.data()), raw.size());
+	}
+
+	bool DecodeStream(ByteReader& in, size_t const maxSize, Bytes& raw)
+	{
+		uint8_t const mode = in.Byte();
+		uint32_t const size = in.Varint();
+		if (!in.Valid() || size > maxSize)
+		{
+			return false;
+		}
+
+		if (mode == RawStream)
+		{
+			if (size > in.Remaining())
+			{
+				return false;
+			}
+			raw.assign(in.Position(), in.Position() + size);
+			in.Skip(size);
+			return true;
+		}
+		if (mode == ConstantStream)
+		{
+			raw.assign(size, in.Byte());
+			return in.Valid();
+		}
+		if (mode != RansStream || in.Remaining() < 32)
+		{
+			return false;
+		}
+
+		uint8_t present[32];
+		std::memcpy(present, in.Position(), sizeof(present));
+		in.Skip(sizeof(present));
+
+		uint32_t frequencies[256] = {};
+		uint32_t starts[256] = {};
+		uint8_t symbols[ProbabilityScale];
+		uint32_t cumulative = 0;
+		for (size_t s = 0; s < 256; s++)
+		{
+			if ((present[s / 8] & (1 << (s % 8))) == 0)
+			{
+				continue;
+			}
+			frequencies[s] = in.Varint() + 1;
+			starts[s] = cumulative;
+			if (!in.Valid() || frequencies[s] > ProbabilityScale - cumulative)
+			{
+				return false;
+			}
+			std::memset(symbols + cumulative, static_cast<int>(s), frequencies[s]);
+			cumulative += frequencies[s];
+		}
+
+		uint32_t const payloadSize = in.Varint();
+		if (!in.Valid() || cumulative != ProbabilityScale || payloadSize < 8 || payloadSize > in.Remaining())
+		{
+			return false;
+		}
+		uint8_t const* position = in.Position();
+		uint8_t const* const end = position + payloadSize;
+		in.Skip(payloadSize);
+
+		uint32_t states[2];
+		std::memcpy(states, position, sizeof(states));
+		position += 8;
+
+		raw.resize(size);
+		uint8_t* const out = raw.data();
+		for (uint32_t i = 0; i < size; i++)
+		{
+			uint32_t& state = states[i & 1];
+			uint32_t const slot = state & (ProbabilityScale - 1);
+			uint8_t const symbol = symbols[slot];
+			out[i] = symbol;
+			state = frequencies[symbol] * (state >> ProbabilityBits) + slot - starts[symbol];
+			while (state < RansLow && position < end)
+			{
+				state = (state << 8) | *position++;
+			}
+		}
+
+		// The encoder started from RansLow, anything else is a corrupt stream.
+		return states[0] == RansLow && states[1] == RansLow && position == end;
+	}
+
+	// Octahedral mapping of a unit vector to the square [-1, 1]^2.
+	void EncodeOctahedral(Vector3 const& n, int32_t& u, int32_t& v)
+	{
+		float const sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (!(sum > 0.f) || !std::isfinite(sum))
+		{
+			u = 0;
+			v = 0;
+			return;
+		}
+		float x = n.x / sum;
+		float y = n.y / sum;
+		if (n.z < 0.f)
+		{
+			float const foldedX = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+			float const foldedY = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+			x = foldedX;
+			y = foldedY;
+		}
+		u = static_cast<int32_t>(std::lround(x * NormalScale));
+		v = static_cast<int32_t>(std::lround(y * NormalScale));
+	}
+
+	Vector3 DecodeOctahedral(int32_t const u, int32_t const v)
+	{
+		float x = u / NormalScale;
+		float y = v / NormalScale;
+		float const z = 1.f - std::fabs(x) - std::fabs(y);
+		if (z < 0.f)
+		{
+			float const unfoldedX = (1.f - std::fabs(y)) * (x >= 0.f ? 1.f : -1.f);
+			float const unfoldedY = (1.f - std::fabs(x)) * (y >= 0.f ? 1.f : -1.f);
+			x = unfoldedX;
+			y = unfoldedY;
+		}
+		return Normalize({ x, y, z });
+	}
+
+	// Grid coordinates of the positions relative to their minimum, or their bits if they do
+	// not fit 31 bits at that spacing. Returns false in the second case.
+	bool QuantizePositions(Vector3 const* positions, size_t const count, float const step, float* origin, std::vector<uint32_t>& values)
+	{
+		Vector3 minimum{ INFINITY, INFINITY, INFINITY };
+		for (size_t v = 0; v < count; v++)
+		{
+			minimum = { std::min(minimum.x, positions[v].x), std::min(minimum.y, positions[v].y), std::min(minimum.z, positions[v].z) };
+		}
+		origin[0] = count > 0 ? minimum.x : 0.f;
+		origin[1] = count > 0 ? minimum.y : 0.f;
+		origin[2] = count > 0 ? minimum.z : 0.f;
+
+		values.resize(3 * count);
+		bool fits = step > 0.f;
+		for (size_t i = 0; fits && i < 3 * count; i++)
+		{
+			double const q = std::round((static_cast<double>((&positions[i / 3].x)[i % 3]) - origin[i % 3]) / step);
+			fits = q >= 0. && q < 2147483647.;
+			values[i] = fits ? static_cast<uint32_t>(q) : 0;
+		}
+		if (!fits)
+		{
+			std::memcpy(values.data(), positions, values.size() * sizeof(float));
+		}
+		return fits;
+	}
+
+	void DequantizePositions(std::vector<uint32_t> const& values, bool const lossless, float const step, float const* origin, std::vector<Vector3>& positions)
+	{
+		positions.resize(values.size() / 3);
+		if (lossless)
+		{
+			std::memcpy(static_cast<void*>(positions.data()), values.data(), values.size() * sizeof(float));
+			return;
+		}
+		for (size_t v = 0; v < positions.size(); v++)
+		{
+			positions[v] = {
+				origin[0] + static_cast<float>(values[3 * v]) * step,
+				origin[1] + static_cast<float>(values[3 * v + 1]) * step,
+				origin[2] + static_cast<float>(values[3 * v + 2]) * step
+			};
+		}
+	}
+
+	uint32_t const None = UINT32_MAX;
+
+	// A vertex across an edge shared with a decoded triangle is predicted as the parallelogram
+	// p + q - o, one next to a decoded vertex as p, and any other as the previous vertex.
+	struct Prediction
+	{
+		uint32_t p = None;
+		uint32_t q = None;
+		uint32_t o = None;
+	};
+
+	// Walks a triangle list with a FIFO of recent edges and one of recent vertices. The encoder
+	// and the decoder add the same triangles, so they see the same FIFO contents and derive
+	// the same traversal: the order in which the vertices are first referenced, how each of
+	// their positions is predicted, and which earlier triangle predicts each face normal.
+	class TriangleWalker
+	{
+	public:
+		struct Edge
+		{
+			uint32_t a = None;
+			uint32_t b = None;
+			uint32_t opposite = None;
+			uint32_t triangle = None;
+		};
+
+		explicit TriangleWalker(size_t const vertexCount) :
+			m_pushedAt(vertexCount, 0),
+			m_seen(vertexCount, 0)
+		{
+			m_vertices.fill(None);
+			order.reserve(vertexCount);
+			predictions.reserve(vertexCount);
+		}
+
+		// 0 is the most recent.
+		Edge const& RecentEdge(size_t const i) const { return m_edges[(m_edgePushes - 1 - i) % EdgeFifoSize]; }
+		uint32_t RecentVertex(size_t const i) const { return m_vertices[(m_vertexPushes - 1 - i) % VertexFifoSize]; }
+
+		// VertexFifoSize if the vertex is not in the FIFO.
+		size_t RecentVertexPosition(uint32_t const vertex) const
+		{
+			size_t const age = m_pushedAt[vertex] == 0 ? VertexFifoSize : m_vertexPushes - m_pushedAt[vertex];
+			return std::min(age, VertexFifoSize);
+		}
+
+		// The shared edge, if any, is the FIFO edge starting at corner rotation + 1 and ending at
+		// corner rotation.
+		void Add(uint32_t const* corners, size_t const edge, size_t const rotation)
+		{
+			bool const shared = edge < EdgeFifoSize;
+			Edge const across = shared ? RecentEdge(edge) : Edge();
+			uint32_t const third = shared ? corners[(rotation + 2) % 3] : None;
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				uint32_t const vertex = corners[k];
+				if (m_seen[vertex])
+				{
+					continue;
+				}
+
+				Prediction prediction;
+				if (vertex == third)
+				{
+					prediction = { corners[rotation], corners[(rotation + 1) % 3], across.opposite };
+				}
+				else
+				{
+					for (size_t j = 0; j < 3 && prediction.p == None; j++)
+					{
+						prediction.p = m_seen[corners[j]] ? corners[j] : None;
+					}
+				}
+				m_seen[vertex] = 1;
+				order.push_back(vertex);
+				predictions.push_back(prediction);
+			}
+
+			uint32_t const triangle = static_cast<uint32_t>(normalSources.size());
+			normalSources.push_back(shared ? across.triangle : (triangle > 0 ? triangle - 1 : None));
+
+			PushEdge({ corners[0], corners[1], corners[2], triangle });
+			PushEdge({ corners[1], corners[2], corners[0], triangle });
+			PushEdge({ corners[2], corners[0], corners[1], triangle });
+			for (size_t k = 0; k < 3; k++)
+			{
+				if (RecentVertexPosition(corners[k]) == VertexFifoSize)
+				{
+					m_vertices[m_vertexPushes++ % VertexFifoSize] = corners[k];
+					m_pushedAt[corners[k]] = m_vertexPushes;
+				}
+			}
+		}
+
+		// Appends the vertices no triangle references, after the last triangle.
+		void Finish()
+		{
+			for (uint32_t vertex = 0; vertex < m_seen.size(); vertex++)
+			{
+				if (!m_seen[vertex])
+				{
+					order.push_back(vertex);
+					predictions.emplace_back();
+				}
+			}
+		}
+
+		std::vector<uint32_t> order;
+		std::vector<Prediction> predictions;
+		std::vector<uint32_t> normalSources;
+
+	private:
+		void PushEdge(Edge const& edge) { m_edges[m_edgePushes++ % EdgeFifoSize] = edge; }
+
+		std::array<Edge, EdgeFifoSize> m_edges;
+		size_t m_edgePushes = 0;
+		std::array<uint32_t, VertexFifoSize> m_vertices;
+		size_t m_vertexPushes = 0;
+
+		// 1 + the number of pushes before the vertex was last pushed, 0 if never.
+		std::vector<size_t> m_pushedAt;
+		std::vector<uint8_t> m_seen;
+	};
+
+	template <typename TIndex>
+	void EncodeIndices(TIndex const* const indices, size_t const indexCount, Bytes* streams, TriangleWalker& walker)
+	{
+		uint32_t next = 0;
+		auto const encodeVertex = [&](uint32_t const vertex)
+		{
+			size_t const recent = walker.RecentVertexPosition(vertex);
+			if (vertex == next)
+			{
+				streams[VertexCodes].push_back(NextVertex);
+			}
+			else if (recent < VertexFifoSize)
+			{
+				streams[VertexCodes].push_back(static_cast<uint8_t>(1 + recent));
+			}
+			else
+			{
+				streams[VertexCodes].push_back(ExplicitVertex);
+				PutVarint(streams[ExplicitIndices], ZigZag(static_cast<int32_t>(vertex - next)));
+			}
+			next = std::max(next, vertex + 1);
+		};
+
+		for (size_t t = 0; t + 2 < indexCount; t += 3)
+		{
+			uint32_t const corners[3] = { indices[t], indices[t + 1], indices[t + 2] };
+
+			size_t edge = EdgeFifoSize;
+			size_t rotation = 0;
+			for (size_t e = 0; e < EdgeFifoSize && edge == EdgeFifoSize; e++)
+			{
+				auto const& recent = walker.RecentEdge(e);
+				for (size_t r = 0; r < 3; r++)
+				{
+					if (recent.a == corners[(r + 1) % 3] && recent.b == corners[r])
+					{
+						edge = e;
+						rotation = r;
+						break;
+					}
+				}
+			}
+
+			if (edge < EdgeFifoSize)
+			{
+				streams[TriangleCodes].push_back(static_cast<uint8_t>(1 + 3 * edge + rotation));
+				encodeVertex(corners[(rotation + 2) % 3]);
+			}
+			else
+			{
+				streams[TriangleCodes].push_back(0);
+				encodeVertex(corners[0]);
+				encodeVertex(corners[1]);
+				encodeVertex(corners[2]);
+			}
+			walker.Add(corners, edge, rotation);
+		}
+		walker.Finish();
+	}
+
+	template <typename TIndex>
+	bool DecodeIndices(Bytes const* streams, size_t const vertexCount, std::vector<TIndex>& indices, TriangleWalker& walker)
+	{
+		uint64_t next = 0;
+		ByteReader vertexCodes(streams[VertexCodes].data(), streams[VertexCodes].size());
+		ByteReader explicitIndices(streams[ExplicitIndices].data(), streams[ExplicitIndices].size());
+		bool valid = true;
+
+		auto const decodeVertex = [&]()
+		{
+			uint8_t const code = vertexCodes.Byte();
+			int64_t vertex;
+			if (code == NextVertex)
+			{
+				vertex = static_cast<int64_t>(next);
+			}
+			else if (code < ExplicitVertex)
+			{
+				vertex = walker.RecentVertex(code - 1);
+			}
+			else
+			{
+				vertex = static_cast<int64_t>(next) + UnZigZag(explicitIndices.Varint());
+			}
+			valid = valid && code <= ExplicitVertex && vertex >= 0 && static_cast<uint64_t>(vertex) < vertexCount;
+			next = std::max<uint64_t>(next, static_cast<uint64_t>(vertex) + 1);
+			return valid ? static_cast<uint32_t>(vertex) : 0;
+		};
+
+		for (size_t t = 0; t < indices.size() / 3 && valid; t++)
+		{
+			uint8_t const code = streams[TriangleCodes][t];
+			size_t const edge = code == 0 ? EdgeFifoSize : (code - 1) / 3u;
+			size_t const rotation = code == 0 ? 0 : (code - 1) % 3u;
+			uint32_t corners[3];
+			if (code == 0)
+			{
+				corners[0] = decodeVertex();
+				corners[1] = decodeVertex();
+				corners[2] = decodeVertex();
+			}
+			else
+			{
+				valid = edge < EdgeFifoSize && walker.RecentEdge(edge).a != None;
+				if (!valid)
+				{
+					break;
+				}
+				auto const& shared = walker.RecentEdge(edge);
+				corners[rotation] = shared.b;
+				corners[(rotation + 1) % 3] = shared.a;
+				corners[(rotation + 2) % 3] = decodeVertex();
+			}
+			if (!valid)
+			{
+				break;
+			}
+
+			indices[3 * t] = static_cast<TIndex>(corners[0]);
+			indices[3 * t + 1] = static_cast<TIndex>(corners[1]);
+			indices[3 * t + 2] = static_cast<TIndex>(corners[2]);
+			walker.Add(corners, edge, rotation);
+		}
+		walker.Finish();
+		return valid && vertexCodes.Valid() && explicitIndices.Valid();
+	}
+
+	// Positions in the order of the traversal, as residuals to their prediction. Lossless ones
+	// are float bits, for which a parallelogram is meaningless, so they use p alone.
+	void Predict(Prediction const& prediction, uint32_t const previous, uint32_t const* values, bool const parallelogram, uint32_t* predicted)
+	{
+		for (size_t c = 0; c < 3; c++)
+		{
+			if (prediction.p == None)
+			{
+				predicted[c] = previous == None ? 0 : values[3 * previous + c];
+			}
+			else if (prediction.o != None && parallelogram)
+			{
+				predicted[c] = values[3 * prediction.p + c] + values[3 * prediction.q + c] - values[3 * prediction.o + c];
+			}
+			else
+			{
+				predicted[c] = values[3 * prediction.p + c];
+			}
+		}
+	}
+
+	void EncodePositions(TriangleWalker const& walker, uint32_t const* values, bool const parallelogram, Bytes* streams)
+	{
+		uint32_t previous = None;
+		for (size_t i = 0; i < walker.order.size(); i++)
+		{
+			uint32_t const vertex = walker.order[i];
+			uint32_t predicted[3];
+			Predict(walker.predictions[i], previous, values, parallelogram, predicted);
+			for (size_t c = 0; c < 3; c++)
+			{
+				PutVarint(streams[c], ZigZag(static_cast<int32_t>(values[3 * vertex + c] - predicted[c])));
+			}
+			previous = vertex;
+		}
+	}
+
+	bool DecodePositions(TriangleWalker const& walker, Bytes const* streams, bool const parallelogram, uint32_t* values)
+	{
+		ByteReader in[3] = {
+			ByteReader(streams[0].data(), streams[0].size()),
+			ByteReader(streams[1].data(), streams[1].size()),
+			ByteReader(streams[2].data(), streams[2].size())
+		};
+		uint32_t previous = None;
+		for (size_t i = 0; i < walker.order.size(); i++)
+		{
+			uint32_t const vertex = walker.order[i];
+			uint32_t predicted[3];
+			Predict(walker.predictions[i], previous, values, parallelogram, predicted);
+			for (size_t c = 0; c < 3; c++)
+			{
+				values[3 * vertex + c] = predicted[c] + static_cast<uint32_t>(UnZigZag(in[c].Varint()));
+			}
+			previous = vertex;
+		}
+		return in[0].Valid() && in[1].Valid() && in[2].Valid();
+	}
+
+	// Quantized face normals are predicted from the normal of an earlier triangle across a
+	// shared edge, or from the triangle itself: SurfaceMesh computes its face normals with the
+	// y component negated, so that variant is tried as well.
+	uint32_t const NeighborNormals = 0;
+	uint32_t const TriangleNormals = 1;
+	uint32_t const FlippedTriangleNormals = 2;
+	uint32_t const NormalPredictionShift = 8;
+
+	// The normal of a triangle on the position grid, exact in integers up to the normalization.
+	void TriangleNormal(uint32_t const* values, uint32_t const* corners, bool const flipY, int32_t& u, int32_t& v)
+	{
+		int64_t edges[2][3];
+		for (size_t c = 0; c < 3; c++)
+		{
+			edges[0][c] = static_cast<int64_t>(values[3 * corners[1] + c]) - static_cast<int64_t>(values[3 * corners[0] + c]);
+			edges[1][c] = static_cast<int64_t>(values[3 * corners[2] + c]) - static_cast<int64_t>(values[3 * corners[0] + c]);
+		}
+		double const x = static_cast<double>(edges[0][1] * edges[1][2] - edges[0][2] * edges[1][1]);
+		double const y = static_cast<double>(edges[0][2] * edges[1][0] - edges[0][0] * edges[1][2]);
+		double const z = static_cast<double>(edges[0][0] * edges[1][1] - edges[0][1] * edges[1][0]);
+		double const length = std::sqrt(x * x + y * y + z * z);
+		if (length == 0.)
+		{
+			u = 0;
+			v = 0;
+			return;
+		}
+		Vector3 const n{ static_cast<float>(x / length), static_cast<float>((flipY ? -y : y) / length), static_cast<float>(z / length) };
+		EncodeOctahedral(n, u, v);
+	}
+
+	class NormalPredictor
+	{
+	public:
+		NormalPredictor(uint32_t const mode, TriangleWalker const& walker, uint32_t const* positions, uint32_t const* indices, size_t const triangleCount) :
+			m_mode(mode), m_walker(walker), m_positions(positions), m_indices(indices), m_triangleCount(triangleCount)
+		{
+		}
+
+		// Octahedral normals of the earlier triangles are already in normals.
+		void Predict(size_t const t, int32_t const* normals, int32_t& u, int32_t& v) const
+		{
+			if (m_mode != NeighborNormals && t < m_triangleCount)
+			{
+				TriangleNormal(m_positions, m_indices + 3 * t, m_mode == FlippedTriangleNormals, u, v);
+				return;
+			}
+			uint32_t const source = t < m_walker.normalSources.size() ? m_walker.normalSources[t] : static_cast<uint32_t>(t - 1);
+			u = source == None ? 0 : normals[2 * source];
+			v = source == None ? 0 : normals[2 * source + 1];
+		}
+
+	private:
+		uint32_t m_mode;
+		TriangleWalker const& m_walker;
+		uint32_t const* m_positions;
+		uint32_t const* m_indices;
+		size_t m_triangleCount;
+	};
+}
+
+void MeshCodec::Encode(SpatialMapSurface const& surface, MeshCodecOptions const& options, std::string& encoded)
+{
+	BlobHeader header = {};
+	std::memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.flags = (surface.indices.is32Bit ? Indices32Bit : 0) | (surface.localPositions ? HasLocalPositions : 0);
+	header.vertexCount = static_cast<uint32_t>(surface.vertexCount);
+	header.indexCount = static_cast<uint32_t>(surface.indices.count / 3 * 3);
+	header.faceNormalCount = static_cast<uint32_t>(surface.faceNormalCount);
+	header.step = options.positionPrecision;
+
+	Bytes streams[StreamCount];
+
+	TriangleWalker walker(surface.vertexCount);
+	VisitIndices(surface.indices, [&](auto const* const indices)
+		{
+			EncodeIndices(indices, surface.indices.count, streams, walker);
+		});
+
+	std::vector<uint32_t> positions;
+	std::vector<uint32_t> localPositions;
+	bool lossless = !QuantizePositions(surface.positions, surface.vertexCount, header.step, header.origin, positions);
+	if (surface.localPositions)
+	{
+		lossless = !QuantizePositions(surface.localPositions, surface.vertexCount, header.step, header.localOrigin, localPositions) || lossless;
+	}
+	if (lossless)
+	{
+		// Both are stored the same way, a surface that does not fit the grid is kept exactly.
+		QuantizePositions(surface.positions, surface.vertexCount, 0.f, header.origin, positions);
+		if (surface.localPositions)
+		{
+			QuantizePositions(surface.localPositions, surface.vertexCount, 0.f, header.localOrigin, localPositions);
+		}
+		header.flags |= Lossless;
+	}
+	EncodePositions(walker, positions.data(), !lossless, streams + PositionsX);
+	if (surface.localPositions)
+	{
+		EncodePositions(walker, localPositions.data(), !lossless, streams + LocalPositionsX);
+	}
+
+	if (lossless)
+	{
+		// Float bits relative to the normal of the neighbor.
+		std::vector<uint32_t> normals(3 * surface.faceNormalCount);
+		std::memcpy(normals.data(), surface.faceNormals, normals.size() * sizeof(float));
+		for (size_t n = 0; n < surface.faceNormalCount; n++)
+		{
+			uint32_t const source = n < walker.normalSources.size() ? walker.normalSources[n] : static_cast<uint32_t>(n - 1);
+			for (size_t c = 0; c < 3; c++)
+			{
+				uint32_t const predicted = source == None ? 0 : normals[3 * source + c];
+				PutVarint(streams[NormalsX + c], ZigZag(static_cast<int32_t>(normals[3 * n + c] - predicted)));
+			}
+		}
+	}
+	else
+	{
+		std::vector<int32_t> normals(2 * surface.faceNormalCount);
+		for (size_t n = 0; n < surface.faceNormalCount; n++)
+		{
+			EncodeOctahedral(surface.faceNormals[n], normals[2 * n], normals[2 * n + 1]);
+		}
+
+		// The cheapest of the predictions, by the sum of the residuals.
+		std::vector<uint32_t> indices(header.indexCount);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			indices[i] = surface.indices[i];
+		}
+		size_t const triangleCount = indices.size() / 3;
+		uint32_t mode = NeighborNormals;
+		uint64_t lowestCost = UINT64_MAX;
+		for (uint32_t const candidate : { NeighborNormals, TriangleNormals, FlippedTriangleNormals })
+		{
+			NormalPredictor const predictor(candidate, walker, positions.data(), indices.data(), triangleCount);
+			uint64_t cost = 0;
+			for (size_t n = 0; n < surface.faceNormalCount; n++)
+			{
+				int32_t u;
+				int32_t v;
+				predictor.Predict(n, normals.data(), u, v);
+				cost += static_cast<uint64_t>(std::abs(normals[2 * n] - u) + std::abs(normals[2 * n + 1] - v));
+			}
+			if (cost < lowestCost)
+			{
+				lowestCost = cost;
+				mode = candidate;
+			}
+		}
+		header.flags |= mode << NormalPredictionShift;
+
+		NormalPredictor const predictor(mode, walker, positions.data(), indices.data(), triangleCount);
+		for (size_t n = 0; n < surface.faceNormalCount; n++)
+		{
+			int32_t u;
+			int32_t v;
+			predictor.Predict(n, normals.data(), u, v);
+			PutVarint(streams[NormalsX], ZigZag(normals[2 * n] - u));
+			PutVarint(streams[NormalsX + 1], ZigZag(normals[2 * n + 1] - v));
+		}
+	}
+
+	encoded.assign(reinterpret_cast<char const*>(&header), sizeof(header));
+	for (auto const& stream : streams)
+	{
+		EncodeStream(stream, encoded);
+	}
+
+	header.size = static_cast<uint32_t>(encoded.size());
+	std::memcpy(&encoded[0], &header, sizeof(header));
+}
+
+size_t MeshCodec::EncodedSize(char const* const data, size_t const size)
+{
+	BlobHeader header;
+	if (size < sizeof(header))
+	{
+		return 0;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	bool const valid = std::memcmp(header.magic, Magic, sizeof(Magic)) == 0 && header.version != 0 &&
+		header.version <= Version && header.size >= sizeof(header) && header.size <= size;
+	return valid ? header.size : 0;
+}
+
+bool MeshCodec::Decode(char const* const data, size_t const size, DecodedMesh& mesh, SpatialMapSurface& surface)
+{
+	if (EncodedSize(data, size) == 0)
+	{
+		return false;
+	}
+	BlobHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	bool const is32Bit = (header.flags & Indices32Bit) != 0;
+	bool const lossless = (header.flags & Lossless) != 0;
+	bool const hasLocal = (header.flags & HasLocalPositions) != 0;
+	uint32_t const normalMode = (header.flags >> NormalPredictionShift) & 3;
+	if (header.indexCount % 3 != 0 || (!is32Bit && header.vertexCount > UINT16_MAX + 1) || normalMode > FlippedTriangleNormals)
+	{
+		return false;
+	}
+
+	// No stream holds more than a 5 byte varint per component of its largest array.
+	ByteReader in(reinterpret_cast<uint8_t const*>(data) + sizeof(header), header.size - sizeof(header));
+	size_t const maxStreamSize = 15 * static_cast<size_t>(std::max(header.vertexCount, std::max(header.indexCount, header.faceNormalCount)));
+	Bytes streams[StreamCount];
+	for (auto& stream : streams)
+	{
+		if (!DecodeStream(in, maxStreamSize, stream))
+		{
+			return false;
+		}
+	}
+
+	size_t const triangleCount = header.indexCount / 3;
+	if (streams[TriangleCodes].size() != triangleCount)
+	{
+		return false;
+	}
+
+	TriangleWalker walker(header.vertexCount);
+	std::vector<uint32_t> indices(header.indexCount);
+	if (!DecodeIndices(streams, header.vertexCount, indices, walker))
+	{
+		return false;
+	}
+	mesh.indices16.clear();
+	mesh.indices32.clear();
+	if (is32Bit)
+	{
+		mesh.indices32 = indices;
+	}
+	else
+	{
+		mesh.indices16.assign(indices.begin(), indices.end());
+	}
+
+	std::vector<uint32_t> positions(3 * static_cast<size_t>(header.vertexCount));
+	if (!DecodePositions(walker, streams + PositionsX, !lossless, positions.data()))
+	{
+		return false;
+	}
+	DequantizePositions(positions, lossless, header.step, header.origin, mesh.positions);
+
+	mesh.localPositions.clear();
+	if (hasLocal)
+	{
+		std::vector<uint32_t> localPositions(positions.size());
+		if (!DecodePositions(walker, streams + LocalPositionsX, !lossless, localPositions.data()))
+		{
+			return false;
+		}
+		DequantizePositions(localPositions, lossless, header.step, header.localOrigin, mesh.localPositions);
+	}
+
+	mesh.faceNormals.resize(header.faceNormalCount);
+	if (lossless)
+	{
+		ByteReader components[3] = {
+			ByteReader(streams[NormalsX].data(), streams[NormalsX].size()),
+			ByteReader(streams[NormalsX + 1].data(), streams[NormalsX + 1].size()),
+			ByteReader(streams[NormalsX + 2].data(), streams[NormalsX + 2].size())
+		};
+		std::vector<uint32_t> normals(3 * static_cast<size_t>(header.faceNormalCount));
+		for (size_t n = 0; n < header.faceNormalCount; n++)
+		{
+			uint32_t const source = n < walker.normalSources.size() ? walker.normalSources[n] : static_cast<uint32_t>(n - 1);
+			for (size_t c = 0; c < 3; c++)
+			{
+				uint32_t const predicted = source == None ? 0 : normals[3 * source + c];
+				normals[3 * n + c] = predicted + static_cast<uint32_t>(UnZigZag(components[c].Varint()));
+			}
+		}
+		if (!components[0].Valid() || !components[1].Valid() || !components[2].Valid())
+		{
+			return false;
+		}
+		std::memcpy(static_cast<void*>(mesh.faceNormals.data()), normals.data(), normals.size() * sizeof(float));
+	}
+	else
+	{
+		ByteReader components[2] = {
+			ByteReader(streams[NormalsX].data(), streams[NormalsX].size()),
+			ByteReader(streams[NormalsX + 1].data(), streams[NormalsX + 1].size())
+		};
+		std::vector<int32_t> normals(2 * static_cast<size_t>(header.faceNormalCount));
+		NormalPredictor const predictor(normalMode, walker, positions.data(), indices.data(), triangleCount);
+		for (size_t n = 0; n < header.faceNormalCount; n++)
+		{
+			int32_t u;
+			int32_t v;
+			predictor.Predict(n, normals.data(), u, v);
+			normals[2 * n] = u + UnZigZag(components[0].Varint());
+			normals[2 * n + 1] = v + UnZigZag(components[1].Varint());
+			mesh.faceNormals[n] = DecodeOctahedral(normals[2 * n], normals[2 * n + 1]);
+		}
+		if (!components[0].Valid() || !components[1].Valid())
+		{
+			return false;
+		}
+	}
+
+	surface.positions = mesh.positions.data();
+	surface.localPositions = hasLocal ? mesh.localPositions.data() : nullptr;
+	surface.vertexCount = header.vertexCount;
+	surface.faceNormals = mesh.faceNormals.data();
+	surface.faceNormalCount = header.faceNormalCount;
+	surface.indices = mesh.Indices();
+	return true;
+}
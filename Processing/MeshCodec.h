@@ -0,0 +1,51 @@
+#pragma once
+
+#include "SpatialMapFile.h"
+
+#include <cstdint>
+#include <string>
+
+namespace SpatialMapping
+{
+	struct MeshCodecOptions
+	{
+		// Grid spacing in meters that positions are rounded to, so the error is at most half of
+		// it per axis. The device delivers SNORM16 positions over a few meters, i.e. steps of
+		// about 0.05 mm. 0 stores positions and normals bit-exact.
+		float positionPrecision = 0.0001f;
+	};
+
+	// Compresses the geometry of one surface into a self-contained blob:
+	//
+	//   - Triangles are coded against a FIFO of recent edges and one of recent vertices, so
+	//     a triangle that shares an edge with one of the last few costs one vertex reference,
+	//     and a vertex seen lately or the next unused one costs a single small symbol. The
+	//     order of the indices is kept exactly.
+	//   - Positions are quantized to a grid and stored in the order the triangles first use
+	//     them, as ZigZag varints of the difference to a parallelogram prediction across the
+	//     shared edge, or to a vertex of the same triangle. Local positions get their own grid.
+	//   - Face normals are stored octahedral with 12 bits per component, relative to the normal
+	//     of the neighboring triangle or, for normals that belong to their triangles, to the
+	//     normal of the quantized triangle. Both the geometric normal and the one SurfaceMesh
+	//     computes, with y negated, are tried per surface.
+	//   - Every byte stream is entropy coded with a static order-0 rANS coder with two
+	//     interleaved states.
+	//
+	// Indices are always exact, positions and normals only with a positionPrecision of 0.
+	// Surfaces whose positions do not fit 31 bits at the precision are stored bit-exact too.
+	class MeshCodec
+	{
+	public:
+		static uint32_t const Version = 1;
+
+		// Replaces the contents of encoded.
+		static void Encode(SpatialMapSurface const& surface, MeshCodecOptions const& options, std::string& encoded);
+
+		// Size of the blob at data as recorded in its header, or 0 if it is not one.
+		static size_t EncodedSize(char const* data, size_t size);
+
+		// Fills the arrays of the mesh and points the geometry of the surface at them. The
+		// other fields of the surface are left alone. Returns false for a corrupt blob.
+		static bool Decode(char const* data, size_t size, DecodedMesh& mesh, SpatialMapSurface& surface);
+	};
+}
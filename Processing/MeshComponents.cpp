@@ -0,0 +1,89 @@
+#include "MeshComponents.h"
+
+#include <utility>
+
+using namespace SpatialMapping;
+
+void MeshComponents::Reset(size_t const vertexCount, size_t const triangleCount)
+{
+	// resize() and assign() keep the capacity, so this only allocates when a surface grows.
+	m_parent.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		m_parent[i] = static_cast<uint32_t>(i);
+	}
+	m_size.assign(vertexCount, 1);
+	m_rootComponents.assign(vertexCount, UINT32_MAX);
+	m_triangleComponents.resize(triangleCount);
+	m_componentTriangles.clear();
+	m_componentAreas.clear();
+}
+
+uint32_t MeshComponents::Find(uint32_t vertex)
+{
+	while (m_parent[vertex] != vertex)
+	{
+		m_parent[vertex] = m_parent[m_parent[vertex]];
+		vertex = m_parent[vertex];
+	}
+	return vertex;
+}
+
+void MeshComponents::Union(uint32_t const a, uint32_t const b)
+{
+	uint32_t rootA = Find(a);
+	uint32_t rootB = Find(b);
+	if (rootA == rootB)
+	{
+		return;
+	}
+
+	if (m_size[rootA] < m_size[rootB])
+	{
+		std::swap(rootA, rootB);
+	}
+	m_parent[rootB] = rootA;
+	m_size[rootA] += m_size[rootB];
+}
+
+void MeshComponents::AddTriangle(size_t const triangle, uint32_t const root, float const area)
+{
+	uint32_t component = m_rootComponents[root];
+	if (component == UINT32_MAX)
+	{
+		component = static_cast<uint32_t>(m_componentTriangles.size());
+		m_rootComponents[root] = component;
+		m_componentTriangles.push_back(0);
+		m_componentAreas.push_back(0.f);
+	}
+
+	m_triangleComponents[triangle] = component;
+	m_componentTriangles[component]++;
+	m_componentAreas[component] += area;
+}
+
+ComponentFilterResult MeshComponents::Summarize(ComponentFilterOptions const& options) const
+{
+	ComponentFilterResult result;
+	result.components = ComponentCount();
+	for (uint32_t c = 0; c < ComponentCount(); c++)
+	{
+		if (IsFloater(c, options))
+		{
+			result.removedComponents++;
+			result.removedTriangles += m_componentTriangles[c];
+			result.removedArea += m_componentAreas[c];
+		}
+	}
+	return result;
+}
+
+void MeshComponents::FlagFloaters(ComponentFilterOptions const& options, std::vector<uint8_t>& flags, ComponentFilterResult& result) const
+{
+	result = Summarize(options);
+	flags.resize(m_triangleComponents.size());
+	for (size_t t = 0; t < m_triangleComponents.size(); t++)
+	{
+		flags[t] = IsFloater(m_triangleComponents[t], options) ? 1 : 0;
+	}
+}
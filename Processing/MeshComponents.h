@@ -0,0 +1,118 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct ComponentFilterOptions
+	{
+		// Components with fewer triangles or less area (in m^2) than this are floaters.
+		size_t minTriangles = 20;
+		float minArea = 0.01f;
+	};
+
+	struct ComponentFilterResult
+	{
+		size_t components = 0;
+		size_t removedComponents = 0;
+		size_t removedTriangles = 0;
+		float removedArea = 0.f;
+	};
+
+	// Connected components of a triangle mesh, found with union-find over the vertices that
+	// triangles share. All buffers are kept between calls, so relabeling a surface of the same
+	// or smaller size does not allocate. Both passes are linear in the number of triangles
+	// (up to the inverse Ackermann factor of the union-find).
+	class MeshComponents
+	{
+	public:
+		template <typename TIndex>
+		void Label(Vector3 const* positions, size_t vertexCount, TIndex const* indices, size_t indexCount);
+
+		// Moves the triangles of components that are not floaters to the front of indices, in
+		// their original order, and returns the new index count. Requires a preceding Label()
+		// of the same indices.
+		template <typename TIndex>
+		size_t RemoveFloaters(TIndex* indices, size_t indexCount, ComponentFilterOptions const& options, ComponentFilterResult& result) const;
+
+		// One entry per triangle, 1 for triangles of floaters and 0 otherwise.
+		void FlagFloaters(ComponentFilterOptions const& options, std::vector<uint8_t>& flags, ComponentFilterResult& result) const;
+
+		size_t ComponentCount() const { return m_componentTriangles.size(); }
+		uint32_t TriangleComponent(size_t triangle) const { return m_triangleComponents[triangle]; }
+		uint32_t ComponentTriangles(uint32_t component) const { return m_componentTriangles[component]; }
+		float ComponentArea(uint32_t component) const { return m_componentAreas[component]; }
+
+		bool IsFloater(uint32_t component, ComponentFilterOptions const& options) const
+		{
+			return m_componentTriangles[component] < options.minTriangles || m_componentAreas[component] < options.minArea;
+		}
+
+	private:
+		void Reset(size_t vertexCount, size_t triangleCount);
+		uint32_t Find(uint32_t vertex);
+		void Union(uint32_t a, uint32_t b);
+		void AddTriangle(size_t triangle, uint32_t root, float area);
+		ComponentFilterResult Summarize(ComponentFilterOptions const& options) const;
+
+		// Union-find forest over the vertices, union by size with path halving.
+		std::vector<uint32_t> m_parent;
+		std::vector<uint32_t> m_size;
+
+		// Component number of every root vertex, UINT32_MAX until the root is first seen.
+		std::vector<uint32_t> m_rootComponents;
+
+		std::vector<uint32_t> m_triangleComponents;
+		std::vector<uint32_t> m_componentTriangles;
+		std::vector<float> m_componentAreas;
+	};
+
+	template <typename TIndex>
+	void MeshComponents::Label(Vector3 const* positions, size_t const vertexCount, TIndex const* indices, size_t const indexCount)
+	{
+		size_t const triangleCount = indexCount / 3;
+		Reset(vertexCount, triangleCount);
+
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			Union(indices[3 * t], indices[3 * t + 1]);
+			Union(indices[3 * t], indices[3 * t + 2]);
+		}
+
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			auto const& a = positions[indices[3 * t]];
+			float const area = 0.5f * Length(Cross(positions[indices[3 * t + 1]] - a, positions[indices[3 * t + 2]] - a));
+			AddTriangle(t, Find(indices[3 * t]), area);
+		}
+	}
+
+	template <typename TIndex>
+	size_t MeshComponents::RemoveFloaters(
+		TIndex* indices,
+		size_t const indexCount,
+		ComponentFilterOptions const& options,
+		ComponentFilterResult& result) const
+	{
+		result = Summarize(options);
+		if (result.removedComponents == 0)
+		{
+			return indexCount;
+		}
+
+		size_t kept = 0;
+		for (size_t t = 0; t < indexCount / 3; t++)
+		{
+			if (!IsFloater(m_triangleComponents[t], options))
+			{
+				indices[kept++] = indices[3 * t];
+				indices[kept++] = indices[3 * t + 1];
+				indices[kept++] = indices[3 * t + 2];
+			}
+		}
+		return kept;
+	}
+}
@@ -0,0 +1,85 @@
+#include "MeshDenoiser.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	size_t const VertexBlockSize = 1024;
+}
+
+float MeshDenoiser::MeanEdgeLength(Vector3 const* positions) const
+{
+	double sum = 0.;
+	size_t count = 0;
+	for (size_t v = 0; v < m_adjacency.VertexCount(); v++)
+	{
+		for (auto n = m_adjacency.NeighborsBegin(v); n != m_adjacency.NeighborsEnd(v); ++n)
+		{
+			sum += Length(positions[*n] - positions[v]);
+			count++;
+		}
+	}
+	return count > 0 ? static_cast<float>(sum / count) : 0.f;
+}
+
+void MeshDenoiser::FilterVertices(Vector3 const* positions, Vector3* filtered, float const spatialSigma, float const rangeSigma) const
+{
+	float const spatialScale = -0.5f / (spatialSigma * spatialSigma);
+
+	ParallelFor(m_adjacency.VertexCount(), VertexBlockSize, [&](size_t const begin, size_t const end, size_t)
+		{
+			for (size_t v = begin; v < end; v++)
+			{
+				Vector3 const& p = positions[v];
+				Vector3 const& n = m_normals[v];
+				filtered[v] = p;
+
+				uint32_t const degree = m_adjacency.Degree(v);
+				if (degree == 0 || LengthSquared(n) == 0.f)
+				{
+					continue;
+				}
+
+				float sigma = rangeSigma;
+				if (sigma <= 0.f)
+				{
+					float sum = 0.f;
+					float sumSquared = 0.f;
+					for (auto q = m_adjacency.NeighborsBegin(v); q != m_adjacency.NeighborsEnd(v); ++q)
+					{
+						float const h = Dot(positions[*q] - p, n);
+						sum += h;
+						sumSquared += h * h;
+					}
+					float const mean = sum / degree;
+					sigma = std::sqrt(std::max(sumSquared / degree - mean * mean, 0.f));
+					if (sigma < 1e-6f)
+					{
+						// Already flat.
+						continue;
+					}
+				}
+				float const rangeScale = -0.5f / (sigma * sigma);
+
+				float offset = 0.f;
+				float weight = 0.f;
+				for (auto q = m_adjacency.NeighborsBegin(v); q != m_adjacency.NeighborsEnd(v); ++q)
+				{
+					Vector3 const d = positions[*q] - p;
+					float const h = Dot(d, n);
+					float const w = std::exp(LengthSquared(d) * spatialScale + h * h * rangeScale);
+					offset += w * h;
+					weight += w;
+				}
+
+				if (weight > 0.f)
+				{
+					filtered[v] = p + n * (offset / weight);
+				}
+			}
+		});
+}
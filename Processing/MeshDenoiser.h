@@ -0,0 +1,90 @@
+#pragma once
+
+#include "MeshNormals.h"
+#include "MeshTypes.h"
+#include "VertexAdjacency.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct DenoiseOptions
+	{
+		int iterations = 3;
+
+		// Stops before starting an iteration that would exceed the budget, judged by the
+		// duration of the previous iteration. 0 disables the budget.
+		double timeBudgetMilliseconds = 0.;
+
+		// Width of the spatial weight in meters. 0 uses the mean edge length of the mesh.
+		float spatialSigma = 0.f;
+
+		// Width of the weight on the offset along the normal in meters. Neighbors further off
+		// the tangent plane than a few times this, like the other side of a corner, have
+		// almost no influence. 0 uses the standard deviation of the offsets of each one-ring.
+		float rangeSigma = 0.f;
+	};
+
+	struct DenoiseResult
+	{
+		int iterations = 0;
+		double milliseconds = 0.;
+	};
+
+	// Feature preserving bilateral mesh denoising (Fleishman et al. 2003): every vertex moves
+	// along its normal by the bilaterally weighted mean offset of its one-ring neighbors. The
+	// adjacency and scratch buffers are kept between calls.
+	class MeshDenoiser
+	{
+	public:
+		template <typename TIndex>
+		DenoiseResult Denoise(Vector3* positions, size_t vertexCount, TIndex const* indices, size_t indexCount, DenoiseOptions const& options);
+
+	private:
+		float MeanEdgeLength(Vector3 const* positions) const;
+		void FilterVertices(Vector3 const* positions, Vector3* filtered, float spatialSigma, float rangeSigma) const;
+
+		VertexAdjacency m_adjacency;
+		std::vector<Vector3> m_normals;
+		std::vector<Vector3> m_filtered;
+	};
+
+	template <typename TIndex>
+	DenoiseResult MeshDenoiser::Denoise(
+		Vector3* positions,
+		size_t const vertexCount,
+		TIndex const* indices,
+		size_t const indexCount,
+		DenoiseOptions const& options)
+	{
+		using Clock = std::chrono::steady_clock;
+		auto const start = Clock::now();
+
+		m_adjacency.Build(vertexCount, indices, indexCount);
+		float const spatialSigma = options.spatialSigma > 0.f ? options.spatialSigma : MeanEdgeLength(positions);
+		m_filtered.resize(vertexCount);
+
+		DenoiseResult result;
+		double lastIteration = 0.;
+		for (; result.iterations < options.iterations; result.iterations++)
+		{
+			auto const iterationStart = Clock::now();
+			double const elapsed = std::chrono::duration<double, std::milli>(iterationStart - start).count();
+			if (options.timeBudgetMilliseconds > 0. && elapsed + lastIteration > options.timeBudgetMilliseconds)
+			{
+				break;
+			}
+
+			ComputeVertexNormals(positions, vertexCount, indices, indexCount, m_normals);
+			FilterVertices(positions, m_filtered.data(), spatialSigma, options.rangeSigma);
+			std::copy(m_filtered.begin(), m_filtered.end(), positions);
+
+			lastIteration = std::chrono::duration<double, std::milli>(Clock::now() - iterationStart).count();
+		}
+
+		result.milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		return result;
+	}
+}
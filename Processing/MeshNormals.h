@@ -0,0 +1,38 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+#include <vector>
+
+namespace SpatialMapping
+{
+	// Area weighted vertex normals: every triangle adds its unnormalized cross product to its
+	// three corners. Vertices that no triangle references get a zero normal.
+	template <typename TIndex>
+	void ComputeVertexNormals(
+		Vector3 const* positions,
+		size_t const vertexCount,
+		TIndex const* indices,
+		size_t const indexCount,
+		std::vector<Vector3>& normals)
+	{
+		normals.assign(vertexCount, Vector3{});
+
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			auto const& a = positions[indices[i]];
+			Vector3 const n = Cross(positions[indices[i + 1]] - a, positions[indices[i + 2]] - a);
+
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				auto& normal = normals[indices[i + corner]];
+				normal = normal + n;
+			}
+		}
+
+		for (auto& normal : normals)
+		{
+			normal = Normalize(normal);
+		}
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Platform independent mesh types shared by the processing code and the offline tools.
+// Nothing in the Processing folder may depend on WinRT or Direct3D, so that it can be
+// built and profiled on Linux against the captures in Data/.
+namespace SpatialMapping
+{
+	// Laid out exactly like Windows::Foundation::Numerics::float3, so the CPU caches of a
+	// SurfaceMesh can be handed to the processing code without copying.
+	struct Vector3
+	{
+		float x = 0.f;
+		float y = 0.f;
+		float z = 0.f;
+	};
+
+	inline Vector3 operator+(Vector3 const& a, Vector3 const& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	inline Vector3 operator-(Vector3 const& a, Vector3 const& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline Vector3 operator*(Vector3 const& a, float const s) { return { a.x * s, a.y * s, a.z * s }; }
+
+	inline float Dot(Vector3 const& a, Vector3 const& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline float LengthSquared(Vector3 const& v) { return Dot(v, v); }
+	inline float Length(Vector3 const& v) { return std::sqrt(LengthSquared(v)); }
+
+	inline Vector3 Cross(Vector3 const& a, Vector3 const& b)
+	{
+		return {
+			a.y * b.z - a.z * b.y,
+			a.z * b.x - a.x * b.z,
+			a.x * b.y - a.y * b.x
+		};
+	}
+
+	inline Vector3 Normalize(Vector3 const& v)
+	{
+		float const l = Length(v);
+		return l > 0.f ? v * (1.f / l) : Vector3{};
+	}
+
+	// Read-only view of a triangle list stored with 16 or 32 bit indices, like the surfaces
+	// of the app, whose width depends on their vertex count, and the 32 bit indices of MeshData.
+	struct IndexView
+	{
+		void const* data = nullptr;
+		size_t count = 0;
+		bool is32Bit = true;
+
+		IndexView() = default;
+		IndexView(uint16_t const* indices, size_t const indexCount) : data(indices), count(indexCount), is32Bit(false) {}
+		IndexView(uint32_t const* indices, size_t const indexCount) : data(indices), count(indexCount), is32Bit(true) {}
+
+		// Tests the width for every index, loops should use VisitIndices().
+		uint32_t operator[](size_t const i) const
+		{
+			return is32Bit ? static_cast<uint32_t const*>(data)[i] : static_cast<uint16_t const*>(data)[i];
+		}
+	};
+
+	// Whether 16 bit indices can address all vertices of a surface.
+	inline bool FitsIn16BitIndices(size_t const vertexCount)
+	{
+		return vertexCount <= 65536;
+	}
+
+	// Calls f once with the indices of the view as uint16_t const* or uint32_t const*, so that
+	// a loop over them is compiled for each width instead of testing the width per index.
+	template <typename F>
+	decltype(auto) VisitIndices(IndexView const& indices, F&& f)
+	{
+		if (indices.is32Bit)
+		{
+			return f(static_cast<uint32_t const*>(indices.data));
+		}
+		return f(static_cast<uint16_t const*>(indices.data));
+	}
+
+	// Replaces converted with the indices in another width. Narrowing is up to the caller,
+	// see FitsIn16BitIndices().
+	template <typename TFrom, typename TTo>
+	void ConvertIndices(TFrom const* const indices, size_t const indexCount, std::vector<TTo>& converted)
+	{
+		converted.resize(indexCount);
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			converted[i] = static_cast<TTo>(indices[i]);
+		}
+	}
+
+	// One "o mesh_<id>" block of an export, i.e. one SurfaceMesh of the collection.
+	struct MeshObject
+	{
+		std::string name;
+		uint32_t firstVertex = 0;
+		uint32_t vertexCount = 0;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+	};
+
+	// CPU-side triangle mesh with the same layout as the caches kept by SurfaceMesh:
+	// positions, one normal per face and a flat triangle list. Indices are global, i.e.
+	// already offset by MeshObject::firstVertex.
+	struct MeshData
+	{
+		std::vector<Vector3> positions;
+		std::vector<Vector3> faceNormals;
+		std::vector<uint32_t> indices;
+		std::vector<MeshObject> objects;
+
+		// Only filled on request by ReadObj: the "usemtl" names in order of first use, and the
+		// one of every triangle, NoMaterial before the first "usemtl".
+		static uint32_t const NoMaterial = UINT32_MAX;
+		std::vector<std::string> materials;
+		std::vector<uint32_t> faceMaterials;
+
+		size_t TriangleCount() const { return indices.size() / 3; }
+	};
+}
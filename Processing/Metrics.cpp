@@ -0,0 +1,350 @@
+#include "Metrics.h"
+
+#include "Json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	double const HistogramMinimum = 1e-3;
+	double const BucketsPerOctave = 5.;
+
+	double BucketCenter(size_t const bucket)
+	{
+		return HistogramMinimum * std::exp2((bucket + 0.5) / BucketsPerOctave);
+	}
+
+	char const* KindName(MetricKind const kind)
+	{
+		switch (kind)
+		{
+		case MetricKind::Counter:
+			return "counter";
+		case MetricKind::Gauge:
+			return "gauge";
+		default:
+			return "histogram";
+		}
+	}
+
+	void AppendNumber(std::string& out, char const* const key, double const value)
+	{
+		char text[64];
+		std::snprintf(text, sizeof(text), ",\"%s\":%.10g", key, value);
+		out += text;
+	}
+}
+
+Histogram::Histogram()
+{
+	for (auto& bucket : m_buckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+void Histogram::Record(double const value)
+{
+	size_t bucket = 0;
+	if (value > HistogramMinimum)
+	{
+		double const position = std::log2(value / HistogramMinimum) * BucketsPerOctave;
+		bucket = std::min(static_cast<size_t>(position), BucketCount - 1);
+	}
+	m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t const units = static_cast<uint64_t>(std::max(0., value) / HistogramMinimum + 0.5);
+	m_sum.fetch_add(units, std::memory_order_relaxed);
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (units > max && !m_max.compare_exchange_weak(max, units, std::memory_order_relaxed))
+	{
+	}
+}
+
+HistogramSummary Histogram::Summary() const
+{
+	// The buckets are read while they are written, so the total is taken from them.
+	uint64_t counts[BucketCount];
+	HistogramSummary summary;
+	for (size_t b = 0; b < BucketCount; b++)
+	{
+		counts[b] = m_buckets[b].load(std::memory_order_relaxed);
+		summary.count += counts[b];
+	}
+	if (summary.count == 0)
+	{
+		return summary;
+	}
+
+	summary.max = m_max.load(std::memory_order_relaxed) * HistogramMinimum;
+	summary.mean = m_sum.load(std::memory_order_relaxed) * HistogramMinimum / summary.count;
+	auto const percentile = [&](double const p)
+	{
+		uint64_t const rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * summary.count)));
+		uint64_t cumulative = 0;
+		for (size_t b = 0; b < BucketCount; b++)
+		{
+			cumulative += counts[b];
+			if (cumulative >= rank)
+			{
+				return std::min(BucketCenter(b), summary.max);
+			}
+		}
+		return summary.max;
+	};
+	summary.p50 = percentile(0.5);
+	summary.p95 = percentile(0.95);
+	summary.p99 = percentile(0.99);
+	return summary;
+}
+
+MetricsRegistry::MetricsRegistry() :
+	m_created(std::chrono::steady_clock::now())
+{
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+	StopSnapshots();
+}
+
+MetricsRegistry& MetricsRegistry::Instance()
+{
+	static MetricsRegistry registry;
+	return registry;
+}
+
+MetricsRegistry::Metric& MetricsRegistry::Add(std::string const& name, std::string const& unit, MetricKind const kind)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& metric : m_metrics)
+	{
+		if (metric.name == name)
+		{
+			return metric;
+		}
+	}
+	m_metrics.emplace_back();
+	Metric& metric = m_metrics.back();
+	metric.name = name;
+	metric.unit = unit;
+	metric.kind = kind;
+	return metric;
+}
+
+Counter& MetricsRegistry::AddCounter(std::string const& name, std::string const& unit)
+{
+	return Add(name, unit, MetricKind::Counter).counter;
+}
+
+Gauge& MetricsRegistry::AddGauge(std::string const& name, std::string const& unit)
+{
+	return Add(name, unit, MetricKind::Gauge).gauge;
+}
+
+Histogram& MetricsRegistry::AddHistogram(std::string const& name, std::string const& unit)
+{
+	return Add(name, unit, MetricKind::Histogram).histogram;
+}
+
+MetricsSnapshot MetricsRegistry::Snapshot() const
+{
+	MetricsSnapshot snapshot;
+	snapshot.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_created).count();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	snapshot.values.reserve(m_metrics.size());
+	for (auto const& metric : m_metrics)
+	{
+		MetricValue value;
+		value.name = metric.name;
+		value.unit = metric.unit;
+		value.kind = metric.kind;
+		switch (metric.kind)
+		{
+		case MetricKind::Counter:
+			value.value = static_cast<double>(metric.counter.Value());
+			break;
+		case MetricKind::Gauge:
+			value.value = static_cast<double>(metric.gauge.Value());
+			break;
+		default:
+			value.histogram = metric.histogram.Summary();
+			value.value = static_cast<double>(value.histogram.count);
+			break;
+		}
+		snapshot.values.push_back(value);
+	}
+	return snapshot;
+}
+
+void MetricsRegistry::ComputeRates(MetricsSnapshot const& previous, MetricsSnapshot& current)
+{
+	double const seconds = current.seconds - previous.seconds;
+	for (auto& value : current.values)
+	{
+		if (value.kind != MetricKind::Counter || seconds <= 0.)
+		{
+			continue;
+		}
+		auto const found = std::find_if(previous.values.begin(), previous.values.end(), [&](MetricValue const& v) { return v.name == value.name; });
+		double const before = found != previous.values.end() ? found->value : 0.;
+		value.rate = (value.value - before) / seconds;
+	}
+}
+
+std::string MetricsRegistry::Format(MetricsSnapshot const& snapshot)
+{
+	std::string text;
+	char line[256];
+	for (auto const& value : snapshot.values)
+	{
+		if (value.kind == MetricKind::Histogram)
+		{
+			std::snprintf(line, sizeof(line), "%-32s %10llu  mean %9.3f  p50 %9.3f  p95 %9.3f  p99 %9.3f  max %9.3f %s\n", value.name.c_str(),
+				static_cast<unsigned long long>(value.histogram.count), value.histogram.mean, value.histogram.p50,
+				value.histogram.p95, value.histogram.p99, value.histogram.max, value.unit.c_str());
+		}
+		else if (value.kind == MetricKind::Counter)
+		{
+			std::snprintf(line, sizeof(line), "%-32s %14.0f %s  %12.1f/s\n", value.name.c_str(), value.value, value.unit.c_str(), value.rate);
+		}
+		else
+		{
+			std::snprintf(line, sizeof(line), "%-32s %14.0f %s\n", value.name.c_str(), value.value, value.unit.c_str());
+		}
+		text += line;
+	}
+	return text;
+}
+
+std::string MetricsRegistry::ToJson(MetricsSnapshot const& snapshot)
+{
+	std::string json = "{";
+	AppendJsonString(json, "seconds");
+	char text[64];
+	std::snprintf(text, sizeof(text), ":%.3f,\"metrics\":{", snapshot.seconds);
+	json += text;
+	for (size_t v = 0; v < snapshot.values.size(); v++)
+	{
+		auto const& value = snapshot.values[v];
+		if (v > 0)
+		{
+			json += ",";
+		}
+		AppendJsonString(json, value.name);
+		json += ":{\"kind\":";
+		AppendJsonString(json, KindName(value.kind));
+		json += ",\"unit\":";
+		AppendJsonString(json, value.unit);
+		if (value.kind == MetricKind::Histogram)
+		{
+			AppendNumber(json, "count", static_cast<double>(value.histogram.count));
+			AppendNumber(json, "mean", value.histogram.mean);
+			AppendNumber(json, "p50", value.histogram.p50);
+			AppendNumber(json, "p95", value.histogram.p95);
+			AppendNumber(json, "p99", value.histogram.p99);
+			AppendNumber(json, "max", value.histogram.max);
+		}
+		else
+		{
+			AppendNumber(json, "value", value.value);
+			if (value.kind == MetricKind::Counter)
+			{
+				AppendNumber(json, "rate", value.rate);
+			}
+		}
+		json += "}";
+	}
+	json += "}}";
+	return json;
+}
+
+bool MetricsRegistry::StartSnapshots(std::string const& path, double const intervalSeconds, uint64_t const maxBytes)
+{
+	StopSnapshots();
+	if (!std::ofstream(path, std::ios::out | std::ios::app))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_snapshotMutex);
+	m_stopping = false;
+	m_snapshotThread = std::thread(&MetricsRegistry::WriteSnapshots, this, path, intervalSeconds, maxBytes);
+	return true;
+}
+
+void MetricsRegistry::StopSnapshots()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_snapshotMutex);
+		m_stopping = true;
+	}
+	m_snapshotChanged.notify_all();
+	if (m_snapshotThread.joinable())
+	{
+		m_snapshotThread.join();
+	}
+}
+
+void MetricsRegistry::WriteSnapshots(std::string const path, double const intervalSeconds, uint64_t const maxBytes)
+{
+	auto const interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(intervalSeconds));
+	std::error_code error;
+	uint64_t bytes = std::filesystem::file_size(path, error);
+	if (error)
+	{
+		bytes = 0;
+	}
+	MetricsSnapshot previous = Snapshot();
+	auto next = std::chrono::steady_clock::now() + interval;
+	for (bool stopping = false; !stopping;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_snapshotMutex);
+			stopping = m_snapshotChanged.wait_until(lock, next, [this]() { return m_stopping; });
+		}
+		next += interval;
+
+		// Appended and closed every time, so that the file survives the app being killed.
+		MetricsSnapshot current = Snapshot();
+		ComputeRates(previous, current);
+		std::string const line = ToJson(current) + "\n";
+		if (maxBytes > 0 && bytes > 0 && bytes + line.size() > maxBytes)
+		{
+			std::filesystem::rename(path, path + ".1", error);
+			bytes = 0;
+		}
+		std::ofstream file(path, std::ios::out | std::ios::app);
+		file << line;
+		bytes += line.size();
+		previous = std::move(current);
+	}
+}
+
+SurfaceMetrics& SurfaceMetrics::Instance()
+{
+	static SurfaceMetrics metrics;
+	return metrics;
+}
+
+SurfaceMetrics::SurfaceMetrics() :
+	surfacesResident(MetricsRegistry::Instance().AddGauge("surfaces.resident", "surfaces")),
+	surfacesActive(MetricsRegistry::Instance().AddGauge("surfaces.active", "surfaces")),
+	surfacesExpired(MetricsRegistry::Instance().AddGauge("surfaces.expired", "surfaces")),
+	surfacesPending(MetricsRegistry::Instance().AddGauge("surfaces.pending", "surfaces")),
+	updatesProcessed(MetricsRegistry::Instance().AddCounter("updates.processed", "updates")),
+	verticesProcessed(MetricsRegistry::Instance().AddCounter("vertices.processed", "vertices")),
+	trianglesProcessed(MetricsRegistry::Instance().AddCounter("triangles.processed", "triangles")),
+	meshProcessingMicroseconds(MetricsRegistry::Instance().AddCounter("mesh.processing", "us")),
+	updateQueueDepth(MetricsRegistry::Instance().AddGauge("updates.queue_depth", "tasks")),
+	observerToRenderMilliseconds(MetricsRegistry::Instance().AddHistogram("latency.observer_to_render", "ms")),
+	exportMilliseconds(MetricsRegistry::Instance().AddHistogram("export.duration", "ms"))
+{
+}
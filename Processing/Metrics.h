@@ -0,0 +1,239 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// A monotonic total, e.g. of processed triangles.
+	class Counter
+	{
+	public:
+		void Add(uint64_t const value = 1) { m_value.fetch_add(value, std::memory_order_relaxed); }
+		uint64_t Value() const { return m_value.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<uint64_t> m_value{ 0 };
+	};
+
+	// A current level, e.g. of resident surfaces, either set or moved by deltas.
+	class Gauge
+	{
+	public:
+		void Set(int64_t const value) { m_value.store(value, std::memory_order_relaxed); }
+
+		// Returns the new level.
+		int64_t Add(int64_t const delta) { return m_value.fetch_add(delta, std::memory_order_relaxed) + delta; }
+
+		// Raises the level to the value if it is lower, e.g. for a high-water mark.
+		void SetMax(int64_t const value)
+		{
+			int64_t current = m_value.load(std::memory_order_relaxed);
+			while (value > current && !m_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		int64_t Value() const { return m_value.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<int64_t> m_value{ 0 };
+	};
+
+	// Takes back a unit that was added to a gauge when it goes out of scope, e.g. at the end
+	// of a task that was counted when it was queued.
+	class GaugeRelease
+	{
+	public:
+		explicit GaugeRelease(Gauge& gauge) : m_gauge(gauge) {}
+		~GaugeRelease() { m_gauge.Add(-1); }
+
+		GaugeRelease(GaugeRelease const&) = delete;
+		GaugeRelease& operator=(GaugeRelease const&) = delete;
+
+	private:
+		Gauge& m_gauge;
+	};
+
+	// Adds the microseconds it is in scope to a counter, e.g. the CPU time of a kind of task
+	// summed over all threads.
+	class CounterTimer
+	{
+	public:
+		explicit CounterTimer(Counter& counter) : m_counter(counter), m_start(std::chrono::steady_clock::now()) {}
+		~CounterTimer()
+		{
+			auto const elapsed = std::chrono::steady_clock::now() - m_start;
+			m_counter.Add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+		}
+
+		CounterTimer(CounterTimer const&) = delete;
+		CounterTimer& operator=(CounterTimer const&) = delete;
+
+	private:
+		Counter& m_counter;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	struct HistogramSummary
+	{
+		uint64_t count = 0;
+		double mean = 0.;
+		double p50 = 0.;
+		double p95 = 0.;
+		double p99 = 0.;
+		double max = 0.;
+	};
+
+	// A distribution of values from 1e-3 to 1e6, e.g. of latencies in ms, in buckets a fifth
+	// of an octave wide. Percentiles are the geometric centers of their buckets, within 7%.
+	class Histogram
+	{
+	public:
+		static size_t const BucketCount = 150;
+
+		Histogram();
+
+		void Record(double value);
+		HistogramSummary Summary() const;
+
+	private:
+		std::atomic<uint64_t> m_buckets[BucketCount];
+
+		// In units of the smallest bucket, so that the sums are integers.
+		std::atomic<uint64_t> m_sum{ 0 };
+		std::atomic<uint64_t> m_max{ 0 };
+	};
+
+	enum class MetricKind
+	{
+		Counter,
+		Gauge,
+		Histogram
+	};
+
+	struct MetricValue
+	{
+		std::string name;
+		std::string unit;
+		MetricKind kind = MetricKind::Counter;
+
+		// The total of a counter and the level of a gauge.
+		double value = 0.;
+
+		// Of a counter per second since a previous snapshot, see ComputeRates(). 0 in
+		// Snapshot().
+		double rate = 0.;
+
+		HistogramSummary histogram;
+	};
+
+	struct MetricsSnapshot
+	{
+		// Since the registry was created.
+		double seconds = 0.;
+		std::vector<MetricValue> values;
+	};
+
+	// Named counters, gauges and histograms that are updated with relaxed atomics from any
+	// thread and read without stopping the writers. Metrics are registered once and live as
+	// long as the registry, so that the hot paths keep references to them. A snapshot is
+	// pulled with Snapshot(), or appended to a file as a line of JSON at an interval.
+	class MetricsRegistry
+	{
+	public:
+		MetricsRegistry();
+		~MetricsRegistry();
+
+		MetricsRegistry(MetricsRegistry const&) = delete;
+		MetricsRegistry& operator=(MetricsRegistry const&) = delete;
+
+		static MetricsRegistry& Instance();
+
+		// Returns the existing metric of the name.
+		Counter& AddCounter(std::string const& name, std::string const& unit);
+		Gauge& AddGauge(std::string const& name, std::string const& unit);
+		Histogram& AddHistogram(std::string const& name, std::string const& unit);
+
+		MetricsSnapshot Snapshot() const;
+
+		// One line per metric.
+		static std::string Format(MetricsSnapshot const& snapshot);
+
+		// Appends a snapshot to the file every interval on a thread of its own, and a last one
+		// when stopped. With maxBytes above 0, a file that would grow past it is renamed to
+		// path.1, replacing the previous one, and started over, so that at most twice maxBytes
+		// are kept. Returns false if the file cannot be opened.
+		bool StartSnapshots(std::string const& path, double intervalSeconds, uint64_t maxBytes = 0);
+		void StopSnapshots();
+
+		// The snapshot as one line of JSON, with the rates against the previous one.
+		static std::string ToJson(MetricsSnapshot const& snapshot);
+		static void ComputeRates(MetricsSnapshot const& previous, MetricsSnapshot& current);
+
+	private:
+		struct Metric
+		{
+			std::string name;
+			std::string unit;
+			MetricKind kind = MetricKind::Counter;
+			Counter counter;
+			Gauge gauge;
+			Histogram histogram;
+		};
+
+		Metric& Add(std::string const& name, std::string const& unit, MetricKind kind);
+		void WriteSnapshots(std::string path, double intervalSeconds, uint64_t maxBytes);
+
+		std::chrono::steady_clock::time_point const m_created;
+
+		// A deque keeps the addresses of the metrics when more are added.
+		mutable std::mutex m_mutex;
+		std::deque<Metric> m_metrics;
+
+		std::mutex m_snapshotMutex;
+		std::condition_variable m_snapshotChanged;
+		bool m_stopping = false;
+		std::thread m_snapshotThread;
+	};
+
+	// The metrics of the surface processing, in MetricsRegistry::Instance(). The gauges of
+	// the surfaces are set by RealtimeSurfaceMeshRenderer every frame, the others where the
+	// work is done. The memory of the surfaces is in MemoryAccounting.
+	struct SurfaceMetrics
+	{
+		static SurfaceMetrics& Instance();
+
+		// Surfaces in the collection, drawn this frame, erased after the retention since the
+		// start and with an update that is not on screen yet.
+		Gauge& surfacesResident;
+		Gauge& surfacesActive;
+		Gauge& surfacesExpired;
+		Gauge& surfacesPending;
+
+		// Of the observer updates that went through SurfaceIngest.
+		Counter& updatesProcessed;
+		Counter& verticesProcessed;
+		Counter& trianglesProcessed;
+
+		// CPU time of the tasks that process and upload updates, summed over all threads.
+		Counter& meshProcessingMicroseconds;
+
+		// TryComputeLatestMeshAsync calls and vertex resource tasks queued or running.
+		Gauge& updateQueueDepth;
+
+		// From the observer event to the frame that swaps in the buffers of the update.
+		Histogram& observerToRenderMilliseconds;
+		Histogram& exportMilliseconds;
+
+	private:
+		SurfaceMetrics();
+	};
+}
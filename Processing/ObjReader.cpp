@@ -0,0 +1,528 @@
+#include "ObjReader.h"
+
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	// Files are parsed in chunks of about this size, spread over the workers.
+	size_t const ChunkBytes = 1 << 20;
+
+	size_t const TriangleBlockSize = 16384;
+
+	uint32_t const NoNormal = UINT32_MAX;
+
+	// Material of the triangles before the first "usemtl" of a chunk: the last one of the
+	// chunks before it.
+	uint32_t const InheritedMaterial = UINT32_MAX - 1;
+
+	char const* SkipSpaces(char const* p, char const* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	// Like strtof, a value that does not parse is 0 and consumes nothing.
+	char const* ParseFloat(char const* p, char const* end, float& value)
+	{
+		p = SkipSpaces(p, end);
+		char const* const start = p < end && *p == '+' ? p + 1 : p;
+		auto const result = std::from_chars(start, end, value);
+		if (result.ec != std::errc() && result.ec != std::errc::result_out_of_range)
+		{
+			value = 0.f;
+			return p;
+		}
+		return result.ptr;
+	}
+
+	// Like strtol for the indices of a face, which are short. A value that does not parse or
+	// overflows is 0 and consumes nothing.
+	char const* ParseInteger(char const* const p, char const* const end, long& value)
+	{
+		char const* q = p;
+		bool const negative = q < end && *q == '-';
+		q += q < end && (*q == '-' || *q == '+') ? 1 : 0;
+
+		char const* const digits = q;
+		uint64_t magnitude = 0;
+		while (q < end && static_cast<unsigned>(*q - '0') < 10 && magnitude <= UINT32_MAX)
+		{
+			magnitude = magnitude * 10 + static_cast<unsigned>(*q - '0');
+			q++;
+		}
+		if (q == digits || magnitude > UINT32_MAX)
+		{
+			value = 0;
+			return p;
+		}
+		value = negative ? -static_cast<long>(magnitude) : static_cast<long>(magnitude);
+		return q;
+	}
+
+	// Parses one "v/vt/vn" corner. Missing entries are returned as 0.
+	char const* ParseCorner(char const* p, char const* end, long& v, long& vn)
+	{
+		p = ParseInteger(p, end, v);
+		vn = 0;
+
+		if (p < end && *p == '/')
+		{
+			p++;
+			if (p < end && *p != '/')
+			{
+				long vt;
+				p = ParseInteger(p, end, vt);
+			}
+			if (p < end && *p == '/')
+			{
+				p++;
+				p = ParseInteger(p, end, vn);
+			}
+		}
+		return p;
+	}
+
+	// An "o" record, or the implicit object of faces before the first one.
+	struct ObjectStart
+	{
+		std::string name;
+		uint32_t positionsBefore = 0;
+		uint32_t indicesBefore = 0;
+	};
+
+	// The records of one chunk. Counts are relative to the start of the chunk, the stitching
+	// adds the totals of the chunks before it.
+	struct Chunk
+	{
+		std::vector<Vector3> positions;
+		std::vector<Vector3> normals;
+		std::vector<uint32_t> indices;
+
+		// OBJ indices are 1-based, negative values are relative to the end of the list. The
+		// relative ones are stored against the chunk and listed here.
+		std::vector<uint32_t> relativeIndices;
+
+		// Per triangle: the normal of its first corner, the number of normals read before it,
+		// and the material.
+		std::vector<uint32_t> normalRefs;
+		std::vector<uint32_t> normalsBefore;
+		std::vector<uint32_t> relativeNormalRefs;
+		std::vector<uint32_t> materials;
+
+		std::vector<ObjectStart> objects;
+		bool facesBeforeObject = false;
+		ObjectStart firstFace;
+
+		std::vector<std::string> materialNames;
+		uint32_t lastMaterial = InheritedMaterial;
+
+		// Where the stitched arrays of the chunk start.
+		uint32_t positionBase = 0;
+		uint32_t normalBase = 0;
+		uint32_t indexBase = 0;
+		std::vector<uint32_t> materialIds;
+		uint32_t inheritedMaterial = MeshData::NoMaterial;
+	};
+
+	uint32_t Resolve(long const index, size_t const count, bool& relative)
+	{
+		relative = index < 0;
+		return static_cast<uint32_t>(index < 0 ? static_cast<long>(count) + index : index - 1);
+	}
+
+	void ParseFace(char const* p, char const* const lineEnd, uint32_t const material, Chunk& chunk)
+	{
+		if (chunk.objects.empty() && !chunk.facesBeforeObject)
+		{
+			chunk.facesBeforeObject = true;
+			chunk.firstFace.positionsBefore = static_cast<uint32_t>(chunk.positions.size());
+			chunk.firstFace.indicesBefore = static_cast<uint32_t>(chunk.indices.size());
+		}
+
+		uint32_t corners[3];
+		bool relative[3];
+		uint32_t normalRef = NoNormal;
+		bool relativeNormal = false;
+		int cornerCount = 0;
+
+		char const* q = SkipSpaces(p + 1, lineEnd);
+		while (q < lineEnd && *q != '\r')
+		{
+			long v = 0;
+			long vn = 0;
+			char const* const next = ParseCorner(q, lineEnd, v, vn);
+			if (next == q || v == 0)
+			{
+				// Not a vertex reference, ignore the rest of the record.
+				break;
+			}
+			q = SkipSpaces(next, lineEnd);
+
+			bool isRelative;
+			uint32_t const index = Resolve(v, chunk.positions.size(), isRelative);
+			if (cornerCount == 0 && vn != 0)
+			{
+				normalRef = Resolve(vn, chunk.normals.size(), relativeNormal);
+			}
+
+			if (cornerCount < 2)
+			{
+				corners[cornerCount] = index;
+				relative[cornerCount] = isRelative;
+			}
+			else
+			{
+				// Fan triangulation: (0, n-1, n)
+				corners[2] = index;
+				relative[2] = isRelative;
+				for (int k = 0; k < 3; k++)
+				{
+					if (relative[k])
+					{
+						chunk.relativeIndices.push_back(static_cast<uint32_t>(chunk.indices.size()));
+					}
+					chunk.indices.push_back(corners[k]);
+				}
+
+				if (relativeNormal)
+				{
+					chunk.relativeNormalRefs.push_back(static_cast<uint32_t>(chunk.normalRefs.size()));
+				}
+				chunk.normalRefs.push_back(normalRef);
+				chunk.normalsBefore.push_back(static_cast<uint32_t>(chunk.normals.size()));
+				if (material != MeshData::NoMaterial)
+				{
+					chunk.materials.push_back(material);
+				}
+
+				corners[1] = index;
+				relative[1] = isRelative;
+			}
+			cornerCount++;
+		}
+	}
+
+	// The lines that start in [p, end) of the text.
+	void ParseChunk(char const* p, char const* const end, char const* const textEnd, bool const materials, Chunk& chunk)
+	{
+		// About what the exports need, so that the arrays rarely grow.
+		size_t const bytes = static_cast<size_t>(end - p);
+		chunk.positions.reserve(bytes / 64);
+		chunk.normals.reserve(bytes / 64);
+		chunk.indices.reserve(bytes / 16);
+		chunk.normalRefs.reserve(bytes / 48);
+		chunk.normalsBefore.reserve(bytes / 48);
+
+		// NoMaterial skips the per-triangle materials. The names are views into the text,
+		// and the exports repeat the same one for several faces in a row.
+		uint32_t material = materials ? InheritedMaterial : MeshData::NoMaterial;
+		std::unordered_map<std::string_view, uint32_t> materialIds;
+		std::string_view materialName;
+
+		while (p < end)
+		{
+			char const* lineEnd = static_cast<char const*>(std::memchr(p, '\n', static_cast<size_t>(textEnd - p)));
+			lineEnd = lineEnd ? lineEnd : textEnd;
+
+			if (p[0] == 'v' && lineEnd - p > 2 && (p[1] == ' ' || (p[1] == 'n' && p[2] == ' ')))
+			{
+				bool const isNormal = p[1] == 'n';
+				char const* next = p + (isNormal ? 2 : 1);
+
+				Vector3 value;
+				next = ParseFloat(next, lineEnd, value.x);
+				next = ParseFloat(next, lineEnd, value.y);
+				ParseFloat(next, lineEnd, value.z);
+
+				(isNormal ? chunk.normals : chunk.positions).push_back(value);
+			}
+			else if (p[0] == 'f' && lineEnd - p > 1 && p[1] == ' ')
+			{
+				ParseFace(p, lineEnd, material, chunk);
+			}
+			else if (p[0] == 'o' && lineEnd - p > 1 && p[1] == ' ')
+			{
+				char const* nameEnd = lineEnd;
+				if (nameEnd > p && nameEnd[-1] == '\r')
+				{
+					nameEnd--;
+				}
+				char const* nameBegin = SkipSpaces(p + 1, nameEnd);
+
+				ObjectStart object;
+				object.name.assign(nameBegin, nameEnd);
+				object.positionsBefore = static_cast<uint32_t>(chunk.positions.size());
+				object.indicesBefore = static_cast<uint32_t>(chunk.indices.size());
+				chunk.objects.push_back(std::move(object));
+			}
+			else if (materials && lineEnd - p > 7 && std::memcmp(p, "usemtl ", 7) == 0)
+			{
+				char const* nameEnd = lineEnd;
+				if (nameEnd[-1] == '\r')
+				{
+					nameEnd--;
+				}
+				char const* const nameBegin = SkipSpaces(p + 7, nameEnd);
+				std::string_view const name(nameBegin, static_cast<size_t>(nameEnd - nameBegin));
+				if (material == InheritedMaterial || name != materialName)
+				{
+					auto const inserted = materialIds.emplace(name, static_cast<uint32_t>(chunk.materialNames.size()));
+					if (inserted.second)
+					{
+						chunk.materialNames.emplace_back(name);
+					}
+					material = inserted.first->second;
+					materialName = name;
+					chunk.lastMaterial = material;
+				}
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	// Start of the first line that begins at or after offset.
+	size_t LineStart(char const* data, size_t const size, size_t const offset)
+	{
+		if (offset == 0 || offset >= size)
+		{
+			return std::min(offset, size);
+		}
+		void const* const newline = std::memchr(data + offset - 1, '\n', size - offset + 1);
+		return newline ? static_cast<size_t>(static_cast<char const*>(newline) - data) + 1 : size;
+	}
+
+	void AddObject(MeshData& mesh, std::string name, uint32_t const firstVertex, uint32_t const firstIndex)
+	{
+		MeshObject object;
+		object.name = std::move(name);
+		object.firstVertex = firstVertex;
+		object.firstIndex = firstIndex;
+		mesh.objects.push_back(std::move(object));
+	}
+}
+
+void SpatialMapping::ParseObj(char const* const data, size_t const size, MeshData& mesh, ObjReadOptions const& options)
+{
+	// Keeps the capacity of a mesh that is read again.
+	mesh.positions.clear();
+	mesh.faceNormals.clear();
+	mesh.indices.clear();
+	mesh.objects.clear();
+	mesh.materials.clear();
+	mesh.faceMaterials.clear();
+
+	size_t const chunkCount = std::max<size_t>(1, (size + ChunkBytes - 1) / ChunkBytes);
+	std::vector<size_t> starts(chunkCount + 1);
+	for (size_t c = 0; c <= chunkCount; c++)
+	{
+		starts[c] = LineStart(data, size, size / chunkCount * c + (c == chunkCount ? size % chunkCount : 0));
+	}
+
+	std::vector<Chunk> chunks(chunkCount);
+	ParallelFor(chunkCount, 1, options.maxWorkers, [&](size_t const begin, size_t const end, size_t)
+		{
+			for (size_t c = begin; c < end; c++)
+			{
+				ParseChunk(data + starts[c], data + starts[c + 1], data + size, options.materials, chunks[c]);
+			}
+		});
+
+	// Offsets, objects and materials in file order.
+	size_t positionCount = 0;
+	size_t normalCount = 0;
+	size_t indexCount = 0;
+	std::unordered_map<std::string, uint32_t> materialIds;
+	uint32_t material = MeshData::NoMaterial;
+	for (auto& chunk : chunks)
+	{
+		chunk.positionBase = static_cast<uint32_t>(positionCount);
+		chunk.normalBase = static_cast<uint32_t>(normalCount);
+		chunk.indexBase = static_cast<uint32_t>(indexCount);
+
+		if (chunk.facesBeforeObject && mesh.objects.empty())
+		{
+			AddObject(mesh, "default", chunk.positionBase + chunk.firstFace.positionsBefore, chunk.indexBase + chunk.firstFace.indicesBefore);
+		}
+		for (auto& object : chunk.objects)
+		{
+			AddObject(mesh, std::move(object.name), chunk.positionBase + object.positionsBefore, chunk.indexBase + object.indicesBefore);
+		}
+
+		chunk.inheritedMaterial = material;
+		for (auto& name : chunk.materialNames)
+		{
+			auto const inserted = materialIds.emplace(name, static_cast<uint32_t>(mesh.materials.size()));
+			if (inserted.second)
+			{
+				mesh.materials.push_back(std::move(name));
+			}
+			chunk.materialIds.push_back(inserted.first->second);
+		}
+		if (chunk.lastMaterial != InheritedMaterial)
+		{
+			material = chunk.materialIds[chunk.lastMaterial];
+		}
+
+		positionCount += chunk.positions.size();
+		normalCount += chunk.normals.size();
+		indexCount += chunk.indices.size();
+	}
+
+	for (size_t o = 0; o < mesh.objects.size(); o++)
+	{
+		auto& object = mesh.objects[o];
+		bool const last = o + 1 == mesh.objects.size();
+		object.vertexCount = (last ? static_cast<uint32_t>(positionCount) : mesh.objects[o + 1].firstVertex) - object.firstVertex;
+		object.indexCount = (last ? static_cast<uint32_t>(indexCount) : mesh.objects[o + 1].firstIndex) - object.firstIndex;
+	}
+
+	mesh.positions.resize(positionCount);
+	mesh.indices.resize(indexCount);
+	mesh.faceNormals.resize(indexCount / 3);
+	if (options.materials)
+	{
+		mesh.faceMaterials.resize(indexCount / 3);
+	}
+	std::vector<Vector3> normals(normalCount);
+	std::vector<uint32_t> normalRefs(indexCount / 3);
+
+	ParallelFor(chunkCount, 1, options.maxWorkers, [&](size_t const begin, size_t const end, size_t)
+		{
+			for (size_t c = begin; c < end; c++)
+			{
+				auto& chunk = chunks[c];
+				std::copy(chunk.positions.begin(), chunk.positions.end(), mesh.positions.begin() + chunk.positionBase);
+				std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase);
+
+				for (uint32_t const i : chunk.relativeIndices)
+				{
+					chunk.indices[i] += chunk.positionBase;
+				}
+				std::copy(chunk.indices.begin(), chunk.indices.end(), mesh.indices.begin() + chunk.indexBase);
+
+				for (uint32_t const t : chunk.relativeNormalRefs)
+				{
+					chunk.normalRefs[t] += chunk.normalBase;
+				}
+
+				// A normal is only used if it was read before the face, like a sequential reader.
+				size_t const firstTriangle = chunk.indexBase / 3;
+				for (size_t t = 0; t < chunk.normalRefs.size(); t++)
+				{
+					bool const known = chunk.normalRefs[t] < chunk.normalBase + chunk.normalsBefore[t];
+					normalRefs[firstTriangle + t] = known ? chunk.normalRefs[t] : NoNormal;
+				}
+
+				for (size_t t = 0; t < chunk.materials.size(); t++)
+				{
+					uint32_t const local = chunk.materials[t];
+					mesh.faceMaterials[firstTriangle + t] = local == InheritedMaterial ? chunk.inheritedMaterial : chunk.materialIds[local];
+				}
+			}
+		});
+
+	ParallelFor(mesh.faceNormals.size(), TriangleBlockSize, options.maxWorkers, [&](size_t const begin, size_t const end, size_t)
+		{
+			for (size_t t = begin; t < end; t++)
+			{
+				if (normalRefs[t] != NoNormal)
+				{
+					mesh.faceNormals[t] = normals[normalRefs[t]];
+					continue;
+				}
+
+				uint32_t const* const corners = &mesh.indices[3 * t];
+				bool const valid = corners[0] < positionCount && corners[1] < positionCount && corners[2] < positionCount;
+				auto const& a = valid ? mesh.positions[corners[0]] : Vector3{};
+				mesh.faceNormals[t] = valid ? Normalize(Cross(mesh.positions[corners[1]] - a, mesh.positions[corners[2]] - a)) : Vector3{};
+			}
+		});
+}
+
+bool SpatialMapping::ReadObj(std::string const& path, MeshData& mesh, ObjReadOptions const& options)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		return false;
+	}
+	ParseObj(file.Data(), file.Size(), mesh, options);
+	return true;
+}
+
+bool SpatialMapping::ReadObjTransforms(std::string const& path, std::vector<ObjTransform>& transforms)
+{
+	transforms.clear();
+	std::ifstream file(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		std::istringstream values(line);
+		ObjTransform transform;
+		values >> transform.name;
+		for (float& element : transform.matrix)
+		{
+			values >> element;
+		}
+		if (values.fail())
+		{
+			return false;
+		}
+		transforms.push_back(transform);
+	}
+	return true;
+}
+
+size_t SpatialMapping::ApplyObjTransforms(std::vector<ObjTransform> const& transforms, MeshData& mesh)
+{
+	std::unordered_map<std::string, float const*> byName;
+	for (auto const& transform : transforms)
+	{
+		byName[transform.name] = transform.matrix;
+	}
+
+	size_t transformed = 0;
+	for (auto const& object : mesh.objects)
+	{
+		auto const found = byName.find(object.name);
+		if (found == byName.end())
+		{
+			continue;
+		}
+		float const* const m = found->second;
+		for (uint32_t v = object.firstVertex; v < object.firstVertex + object.vertexCount; v++)
+		{
+			Vector3 const p = mesh.positions[v];
+			mesh.positions[v] = {
+				p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12],
+				p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13],
+				p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]
+			};
+		}
+		transformed++;
+	}
+	return transformed;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct ObjReadOptions
+	{
+		// Fills MeshData::materials and MeshData::faceMaterials from the "usemtl" records.
+		bool materials = false;
+
+		// Threads parsing the file, 0 means all of them.
+		size_t maxWorkers = 0;
+	};
+
+	// Reads the subset of Wavefront OBJ written by SpatialMappingMain::SaveAppState and by the
+	// Blender exports under Data/: "o", "v", "vn", "f" and "usemtl" records. Polygons are fanned
+	// into triangles and the normal referenced by the first corner of a face becomes its face
+	// normal. Faces without a normal reference get their normal from the triangle winding.
+	// Returns false if the file cannot be opened.
+	//
+	// The file is memory-mapped and split into chunks at line boundaries that are parsed in
+	// parallel. Every chunk collects its records with chunk-relative counts, and the chunks
+	// are then stitched in file order, so the result is the same as reading the file line by
+	// line, including the object ranges of SaveAppState exports and relative indices.
+	bool ReadObj(std::string const& path, MeshData& mesh, ObjReadOptions const& options = {});
+
+	// Parses OBJ text in memory, see ReadObj().
+	void ParseObj(char const* data, size_t size, MeshData& mesh, ObjReadOptions const& options = {});
+
+	// The transform of one object, row-major with row vectors like SurfaceData::meshToWorld.
+	struct ObjTransform
+	{
+		std::string name;
+		float matrix[16];
+	};
+
+	// Reads the transforms ObjWriter::WriteWithTransforms() writes next to a not-transformed
+	// export. Returns false if the file cannot be opened or a line is malformed.
+	bool ReadObjTransforms(std::string const& path, std::vector<ObjTransform>& transforms);
+
+	// Transforms the positions of the objects of mesh that have a transform of the same name,
+	// which turns a not-transformed export into the transformed one. Face normals are kept.
+	// Returns the number of objects transformed.
+	size_t ApplyObjTransforms(std::vector<ObjTransform> const& transforms, MeshData& mesh);
+}
@@ -0,0 +1,504 @@
+#include "ObjWriter.h"
+#include "ParallelFor.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	// Upper bounds of the formatted lengths, used to size the buffers before formatting.
+	size_t const MaxFloatLength = 16;
+	size_t const MaxIntLength = 11;
+	size_t const MaxVectorLineLength = 3 + 3 * (MaxFloatLength + 1);
+	size_t const MaxColorLength = 3 * 6;
+	size_t const MaxFaceLength = 16 + MaxIntLength + 1 + 2 + 3 * (2 * MaxIntLength + 3);
+
+	char* Append(char* out, char const* text, size_t const length)
+	{
+		std::memcpy(out, text, length);
+		return out + length;
+	}
+
+	template <size_t N>
+	char* Append(char* out, char const (&text)[N])
+	{
+		return Append(out, text, N - 1);
+	}
+
+	char* AppendInt(char* out, int const value)
+	{
+		return std::to_chars(out, out + MaxIntLength, value).ptr;
+	}
+
+	// Exactly representable powers of ten for the fast path of AppendFloat.
+	double const Pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	// Same text as std::ostream << float with the default flags and precision: %g with six
+	// significant digits.
+	char* AppendFloatPrecise(char* out, float const value)
+	{
+		// Degenerate triangles have NaN face normals. The device produces positive NaNs, which
+		// every standard library prints as "nan".
+		if (std::isnan(value))
+		{
+			return std::signbit(value) ? Append(out, "-nan") : Append(out, "nan");
+		}
+		return std::to_chars(out, out + MaxFloatLength, value, std::chars_format::general, 6).ptr;
+	}
+
+	// to_chars with a precision is several times slower than shortest round trip formatting,
+	// and it is most of the export time. The six digits are computed in double instead: the
+	// scaled value is off by far less than 1e-6, so unless it lies that close to a rounding
+	// tie the rounded digits are exact. Ties, and values outside the range of exactly
+	// representable powers of ten, take the precise path.
+	char* AppendFloat(char* out, float const value)
+	{
+		double const v = std::fabs(static_cast<double>(value));
+		if (!(v >= 1e-15 && v < 1e15))
+		{
+			return AppendFloatPrecise(out, value);
+		}
+
+		// The binary exponent times log10(2) ~ 1233 / 4096 can be off by one; the loop below
+		// corrects that.
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		int const binaryExponent = static_cast<int>((bits >> 23) & 0xff) - 127;
+		int exponent = (binaryExponent * 1233) >> 12;
+		double scaled = 0.;
+		for (int attempt = 0; attempt < 3; attempt++)
+		{
+			scaled = exponent <= 5 ? v * Pow10[5 - exponent] : v / Pow10[exponent - 5];
+			if (scaled < 1e5)
+			{
+				exponent--;
+			}
+			else if (scaled >= 1e6)
+			{
+				exponent++;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		double const whole = std::floor(scaled);
+		double const fraction = scaled - whole;
+		if (scaled < 1e5 || scaled >= 1e6 || std::fabs(fraction - 0.5) < 1e-6)
+		{
+			return AppendFloatPrecise(out, value);
+		}
+
+		uint32_t digits = static_cast<uint32_t>(whole) + (fraction > 0.5 ? 1 : 0);
+		if (digits == 1000000)
+		{
+			digits = 100000;
+			exponent++;
+		}
+
+		char text[6];
+		uint32_t const high = digits / 1000;
+		uint32_t const low = digits % 1000;
+		text[0] = static_cast<char>('0' + high / 100);
+		text[1] = static_cast<char>('0' + high / 10 % 10);
+		text[2] = static_cast<char>('0' + high % 10);
+		text[3] = static_cast<char>('0' + low / 100);
+		text[4] = static_cast<char>('0' + low / 10 % 10);
+		text[5] = static_cast<char>('0' + low % 10);
+		int significant = 6;
+		while (significant > 1 && text[significant - 1] == '0')
+		{
+			significant--;
+		}
+
+		if (value < 0.f)
+		{
+			*out++ = '-';
+		}
+
+		if (exponent < -4 || exponent >= 6)
+		{
+			*out++ = text[0];
+			if (significant > 1)
+			{
+				*out++ = '.';
+				out = Append(out, text + 1, significant - 1);
+			}
+			*out++ = 'e';
+			*out++ = exponent < 0 ? '-' : '+';
+			int const magnitude = exponent < 0 ? -exponent : exponent;
+			if (magnitude < 10)
+			{
+				*out++ = '0';
+			}
+			return std::to_chars(out, out + 3, magnitude).ptr;
+		}
+
+		if (exponent >= 0)
+		{
+			out = Append(out, text, exponent + 1);
+			if (significant > exponent + 1)
+			{
+				*out++ = '.';
+				out = Append(out, text + exponent + 1, significant - exponent - 1);
+			}
+			return out;
+		}
+
+		out = Append(out, "0.");
+		for (int i = -1; i > exponent; i--)
+		{
+			*out++ = '0';
+		}
+		return Append(out, text, significant);
+	}
+
+	char* AppendVectorLine(char* out, char const* prefix, size_t const prefixLength, Vector3 const& v)
+	{
+		out = Append(out, prefix, prefixLength);
+		out = AppendFloat(out, v.x);
+		*out++ = ' ';
+		out = AppendFloat(out, v.y);
+		*out++ = ' ';
+		out = AppendFloat(out, v.z);
+		*out++ = '\n';
+		return out;
+	}
+
+	// A value in [0, 1] with three decimals, like a color channel in most OBJ exporters.
+	char* AppendUnit(char* out, float const value)
+	{
+		int const thousandths = static_cast<int>(std::lround(value * 1000.f));
+		if (thousandths >= 1000)
+		{
+			*out++ = '1';
+			return out;
+		}
+		out = Append(out, "0.");
+		*out++ = static_cast<char>('0' + thousandths / 100);
+		*out++ = static_cast<char>('0' + thousandths / 10 % 10);
+		*out++ = static_cast<char>('0' + thousandths % 10);
+		return out;
+	}
+
+	// Gray vertex colors follow the position on the same line if colors is not null.
+	void FormatVertices(Vector3 const* positions, float const* colors, size_t const count, std::string& text)
+	{
+		text.resize(count * (MaxVectorLineLength + (colors ? MaxColorLength : 0)));
+		char* out = &text[0];
+		for (size_t i = 0; i < count; i++)
+		{
+			out = AppendVectorLine(out, "v ", 2, positions[i]);
+			if (colors)
+			{
+				out--;
+				for (size_t channel = 0; channel < 3; channel++)
+				{
+					*out++ = ' ';
+					out = AppendUnit(out, colors[i]);
+				}
+				*out++ = '\n';
+			}
+		}
+		text.resize(out - text.data());
+	}
+
+	void FormatNormals(Vector3 const* normals, size_t const count, std::string& text)
+	{
+		text.resize(count * MaxVectorLineLength);
+		char* out = &text[0];
+		for (size_t i = 0; i < count; i++)
+		{
+			out = AppendVectorLine(out, "vn ", 3, normals[i]);
+		}
+		text.resize(out - text.data());
+	}
+
+	// Whether meshToWorld maps the local positions to the world positions within a tenth of
+	// a millimeter, which is far above the rounding of the transform.
+	bool ReproducesPositions(float const* m, Vector3 const* local, Vector3 const* world, size_t const count)
+	{
+		float const tolerance = 1e-4f;
+		for (size_t v = 0; v < count; v++)
+		{
+			Vector3 const& p = local[v];
+			Vector3 const transformed{
+				p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12],
+				p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13],
+				p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]
+			};
+			if (!(LengthSquared(transformed - world[v]) <= tolerance * tolerance))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Shortest round trip formatting, so that the transform is read back exactly.
+	void FormatTransform(int const id, float const* m, std::string& line)
+	{
+		char buffer[32];
+		line = "mesh_" + std::to_string(id);
+		for (int e = 0; e < 16; e++)
+		{
+			line += ' ';
+			line.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), m[e]).ptr);
+		}
+		line += '\n';
+	}
+}
+
+void ObjWriter::FormatVerticesAndNormals(ObjSurface const& surface, ObjWriteOptions const& options, bool const withTransforms, SurfaceText& text)
+{
+	std::vector<float> colors;
+	if (!options.colorAttribute.empty())
+	{
+		AttributeChannel const* const channel = FindAttribute(surface.attributes, surface.attributeCount, options.colorAttribute);
+		if (channel)
+		{
+			NormalizedVertexValues(*channel, surface.vertexCount, surface.indices, colors);
+		}
+		else
+		{
+			colors.assign(surface.vertexCount, 0.f);
+		}
+	}
+	float const* const vertexColors = colors.empty() ? nullptr : colors.data();
+
+	text.header = "o mesh_" + std::to_string(surface.id) + "\n";
+	if (withTransforms)
+	{
+		text.worldFrame = !surface.meshToWorld ||
+			!ReproducesPositions(surface.meshToWorld, surface.positionsNotTransformed, surface.positionsTransformed, surface.vertexCount);
+		FormatVertices(text.worldFrame ? surface.positionsTransformed : surface.positionsNotTransformed, vertexColors, surface.vertexCount, text.notTransformedVertices);
+		text.transformedVertices.clear();
+	}
+	else
+	{
+		text.worldFrame = false;
+		FormatVertices(surface.positionsTransformed, vertexColors, surface.vertexCount, text.transformedVertices);
+		FormatVertices(surface.positionsNotTransformed, vertexColors, surface.vertexCount, text.notTransformedVertices);
+	}
+
+	text.faceNormals.clear();
+	if (!options.deduplicateNormals)
+	{
+		text.normalCount = surface.faceNormalCount;
+		FormatNormals(surface.faceNormals, surface.faceNormalCount, text.normals);
+		return;
+	}
+
+	// The quantized components of a normal packed into the key of the table.
+	float const scale = 1.f / options.normalPrecision;
+	std::unordered_map<uint64_t, uint32_t> distinct;
+	distinct.reserve(surface.faceNormalCount);
+	std::vector<Vector3> normals;
+	text.faceNormals.resize(surface.faceNormalCount);
+	for (size_t f = 0; f < surface.faceNormalCount; f++)
+	{
+		Vector3 const& n = surface.faceNormals[f];
+		uint64_t key = UINT64_MAX;
+		Vector3 quantized = n;
+		if (!std::isnan(n.x) && !std::isnan(n.y) && !std::isnan(n.z))
+		{
+			int32_t const x = static_cast<int32_t>(std::lround(std::min(1.f, std::max(-1.f, n.x)) * scale));
+			int32_t const y = static_cast<int32_t>(std::lround(std::min(1.f, std::max(-1.f, n.y)) * scale));
+			int32_t const z = static_cast<int32_t>(std::lround(std::min(1.f, std::max(-1.f, n.z)) * scale));
+			key = static_cast<uint64_t>(static_cast<uint32_t>(x) & 0x1fffff) |
+				static_cast<uint64_t>(static_cast<uint32_t>(y) & 0x1fffff) << 21 |
+				static_cast<uint64_t>(static_cast<uint32_t>(z) & 0x1fffff) << 42;
+			quantized = { x * options.normalPrecision, y * options.normalPrecision, z * options.normalPrecision };
+		}
+
+		// Degenerate triangles have NaN normals, which all share the reserved key.
+		auto const inserted = distinct.emplace(key, static_cast<uint32_t>(normals.size()));
+		if (inserted.second)
+		{
+			normals.push_back(quantized);
+		}
+		text.faceNormals[f] = inserted.first->second;
+	}
+	text.normalCount = normals.size();
+	FormatNormals(normals.data(), normals.size(), text.normals);
+}
+
+void ObjWriter::FormatFaces(ObjSurface const& surface, int const indexBaseOffset, int const normalBaseOffset, ObjWriteOptions const& options, SurfaceText& text)
+{
+	size_t const faceCount = surface.indices.count / 3;
+	text.faces.resize(8 + faceCount * MaxFaceLength);
+	char* out = &text.faces[0];
+	out = Append(out, "s off\n");
+
+	// Replicates the float accumulation of the original exporter exactly.
+	float const noFaces = surface.indices.count / 3.f;
+	float const mtlIncrement = 1000.f / noFaces;
+	float mtlNumber = 1.f;
+
+	VisitIndices(surface.indices, [&](auto const* const indices)
+		{
+			for (size_t i = 0; i + 2 < surface.indices.count; i += 3)
+			{
+				if (options.materials)
+				{
+					out = Append(out, "usemtl Material.");
+					int const material = static_cast<int>(std::floor(mtlNumber));
+					for (int digits = material < 10 ? 1 : material < 100 ? 2 : material < 1000 ? 3 : 4; digits < 4; digits++)
+					{
+						*out++ = '0';
+					}
+					out = AppendInt(out, material);
+					*out++ = '\n';
+				}
+
+				// +1 to get .obj format. Faces without a normal of their own only occur with
+				// deduplicated normals, the legacy indices run past the normals of the surface.
+				size_t const face = i / 3;
+				bool const hasNormal = !options.deduplicateNormals || face < text.faceNormals.size();
+				int const normalIndex = (options.deduplicateNormals ? (hasNormal ? static_cast<int>(text.faceNormals[face]) : 0) : static_cast<int>(face)) + normalBaseOffset + 1;
+				out = Append(out, "f ");
+				for (size_t corner = 0; corner < 3; corner++)
+				{
+					out = AppendInt(out, static_cast<int>(indices[i + corner]) + indexBaseOffset + 1);
+					if (hasNormal)
+					{
+						out = Append(out, "//");
+						out = AppendInt(out, normalIndex);
+					}
+					*out++ = corner < 2 ? ' ' : '\n';
+				}
+
+				mtlNumber += mtlIncrement;
+			}
+		});
+
+	text.faces.resize(out - text.faces.data());
+}
+
+void ObjWriter::FormatSurfaces(std::vector<ObjSurface> const& surfaces, ObjWriteOptions const& options, bool const withTransforms)
+{
+	// Only grows, so that the buffers of earlier exports are reused.
+	if (m_text.size() < surfaces.size())
+	{
+		m_text.resize(surfaces.size());
+	}
+
+	ParallelFor(surfaces.size(), 1, m_maxWorkers, [&](size_t const begin, size_t const end, size_t)
+		{
+			for (size_t s = begin; s < end; s++)
+			{
+				FormatVerticesAndNormals(surfaces[s], options, withTransforms, m_text[s]);
+			}
+		});
+
+	// The legacy exporter offsets the normal indices by the vertex count of the preceding
+	// surfaces, like the vertex indices. Deduplicated normals are counted correctly.
+	std::vector<int> indexBaseOffsets(surfaces.size());
+	std::vector<int> normalBaseOffsets(surfaces.size());
+	int indexBaseOffset = 0;
+	int normalBaseOffset = 0;
+	for (size_t s = 0; s < surfaces.size(); s++)
+	{
+		indexBaseOffsets[s] = indexBaseOffset;
+		normalBaseOffsets[s] = options.deduplicateNormals ? normalBaseOffset : indexBaseOffset;
+		indexBaseOffset += static_cast<int>(surfaces[s].vertexCount);
+		normalBaseOffset += static_cast<int>(m_text[s].normalCount);
+	}
+
+	ParallelFor(surfaces.size(), 1, m_maxWorkers, [&](size_t const begin, size_t const end, size_t)
+		{
+			for (size_t s = begin; s < end; s++)
+			{
+				FormatFaces(surfaces[s], indexBaseOffsets[s], normalBaseOffsets[s], options, m_text[s]);
+			}
+		});
+}
+
+void ObjWriter::Format(std::vector<ObjSurface> const& surfaces, std::string& transformed, std::string& notTransformed, ObjWriteOptions const& options)
+{
+	FormatSurfaces(surfaces, options, false);
+
+	transformed = options.materials ? "mtllib Mesh.mtl\n" : "";
+	notTransformed = transformed;
+	for (size_t s = 0; s < surfaces.size(); s++)
+	{
+		auto const& text = m_text[s];
+		transformed += text.header;
+		transformed += text.transformedVertices;
+		transformed += text.normals;
+		transformed += text.faces;
+		notTransformed += text.header;
+		notTransformed += text.notTransformedVertices;
+		notTransformed += text.normals;
+		notTransformed += text.faces;
+	}
+}
+
+bool ObjWriter::Write(std::vector<ObjSurface> const& surfaces, std::string const& transformedPath, std::string const& notTransformedPath, ObjWriteOptions const& options)
+{
+	FormatSurfaces(surfaces, options, false);
+
+	// Text mode like the original exporter, so that line endings match on every platform.
+	std::ofstream fileOutTransformed(transformedPath, std::ios::out);
+	std::ofstream fileOutNotTransformed(notTransformedPath, std::ios::out);
+
+	if (options.materials)
+	{
+		fileOutTransformed << "mtllib Mesh.mtl\n";
+		fileOutNotTransformed << "mtllib Mesh.mtl\n";
+	}
+
+	for (size_t s = 0; s < surfaces.size(); s++)
+	{
+		auto const& text = m_text[s];
+		fileOutTransformed.write(text.header.data(), text.header.size());
+		fileOutTransformed.write(text.transformedVertices.data(), text.transformedVertices.size());
+		fileOutTransformed.write(text.normals.data(), text.normals.size());
+		fileOutTransformed.write(text.faces.data(), text.faces.size());
+		fileOutNotTransformed.write(text.header.data(), text.header.size());
+		fileOutNotTransformed.write(text.notTransformedVertices.data(), text.notTransformedVertices.size());
+		fileOutNotTransformed.write(text.normals.data(), text.normals.size());
+		fileOutNotTransformed.write(text.faces.data(), text.faces.size());
+	}
+
+	fileOutTransformed.close();
+	fileOutNotTransformed.close();
+	return !fileOutTransformed.fail() && !fileOutNotTransformed.fail();
+}
+
+bool ObjWriter::WriteWithTransforms(std::vector<ObjSurface> const& surfaces, std::string const& notTransformedPath, std::string const& transformsPath, ObjWriteOptions const& options)
+{
+	FormatSurfaces(surfaces, options, true);
+
+	std::ofstream fileOut(notTransformedPath, std::ios::out);
+	std::ofstream transformsOut(transformsPath, std::ios::out);
+
+	if (options.materials)
+	{
+		fileOut << "mtllib Mesh.mtl\n";
+	}
+
+	float const identity[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+	std::string line;
+	for (size_t s = 0; s < surfaces.size(); s++)
+	{
+		auto const& text = m_text[s];
+		fileOut.write(text.header.data(), text.header.size());
+		fileOut.write(text.notTransformedVertices.data(), text.notTransformedVertices.size());
+		fileOut.write(text.normals.data(), text.normals.size());
+		fileOut.write(text.faces.data(), text.faces.size());
+
+		FormatTransform(surfaces[s].id, text.worldFrame ? identity : surfaces[s].meshToWorld, line);
+		transformsOut.write(line.data(), line.size());
+	}
+
+	fileOut.close();
+	transformsOut.close();
+	return !fileOut.fail() && !transformsOut.fail();
+}
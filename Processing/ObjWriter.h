@@ -0,0 +1,105 @@
+#pragma once
+
+#include "MeshAttributes.h"
+#include "MeshTypes.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// The CPU caches of one SurfaceMesh, as SaveAppState exports them.
+	struct ObjSurface
+	{
+		int id = 0;
+		Vector3 const* positionsTransformed = nullptr;
+		Vector3 const* positionsNotTransformed = nullptr;
+		size_t vertexCount = 0;
+		Vector3 const* faceNormals = nullptr;
+		size_t faceNormalCount = 0;
+		IndexView indices;
+
+		// Maps positionsNotTransformed to positionsTransformed, row-major with row vectors.
+		// Only needed by WriteWithTransforms().
+		float const* meshToWorld = nullptr;
+
+		AttributeChannel const* attributes = nullptr;
+		size_t attributeCount = 0;
+	};
+
+	struct ObjWriteOptions
+	{
+		// The "mtllib" line and a "usemtl" line before every face. Viewers load the gray ramp
+		// of the surfaces faster from vertex colors.
+		bool materials = true;
+
+		// Writes this attribute of the surfaces as gray vertex colors, "v x y z r g b". Surfaces
+		// without it get black vertices.
+		std::string colorAttribute;
+
+		// One "vn" per distinct face normal of a surface instead of one per face. Normals are
+		// quantized to normalPrecision per component and deduplicated with a hash table, and
+		// the faces reference them with indices that count the normals of all preceding
+		// surfaces, which fixes the legacy normal indices.
+		bool deduplicateNormals = false;
+
+		// At least 1e-6.
+		float normalPrecision = 1e-3f;
+	};
+
+	// Writes the transformed and the not-transformed OBJ export of a surface collection in one
+	// pass. Surfaces are formatted in parallel into reusable buffers with std::to_chars and
+	// written in their original order.
+	//
+	// The output is byte-identical to the std::ofstream code SaveAppState used before, quirks
+	// included: one "vn" per face but normal indices offset by the vertex count of the
+	// preceding surfaces, and a "usemtl" line before every face that steps through 1000
+	// materials per surface. ObjWriteOptions can replace the materials with vertex colors.
+	class ObjWriter
+	{
+	public:
+		// maxWorkers limits the formatting threads, 0 uses all of them.
+		explicit ObjWriter(size_t maxWorkers = 0) : m_maxWorkers(maxWorkers) {}
+
+		bool Write(std::vector<ObjSurface> const& surfaces, std::string const& transformedPath, std::string const& notTransformedPath, ObjWriteOptions const& options = {});
+
+		// Formats both files into memory.
+		void Format(std::vector<ObjSurface> const& surfaces, std::string& transformed, std::string& notTransformed, ObjWriteOptions const& options = {});
+
+		// Writes only the not-transformed export, and next to it the meshToWorld of every
+		// surface as text, one "mesh_<id> m00 m01 ... m33" line per surface, see
+		// ReadObjTransforms(). Surfaces whose transformed positions are not their
+		// not-transformed ones times meshToWorld, e.g. because they were denoised or aligned,
+		// are written with their transformed positions and the identity, so that the
+		// transforms always reproduce the transformed export.
+		bool WriteWithTransforms(std::vector<ObjSurface> const& surfaces, std::string const& notTransformedPath, std::string const& transformsPath, ObjWriteOptions const& options = {});
+
+	private:
+		// Everything but the vertices is the same in both files and only formatted once.
+		struct SurfaceText
+		{
+			std::string header;
+			std::string transformedVertices;
+			std::string notTransformedVertices;
+			std::string normals;
+			std::string faces;
+
+			// The distinct normal of every face when normals are deduplicated.
+			std::vector<uint32_t> faceNormals;
+			size_t normalCount = 0;
+
+			// Whether notTransformedVertices holds the transformed positions, see
+			// WriteWithTransforms().
+			bool worldFrame = false;
+		};
+
+		// Either both variants of the vertices or only the ones WriteWithTransforms() writes.
+		void FormatSurfaces(std::vector<ObjSurface> const& surfaces, ObjWriteOptions const& options, bool withTransforms);
+		static void FormatVerticesAndNormals(ObjSurface const& surface, ObjWriteOptions const& options, bool withTransforms, SurfaceText& text);
+		static void FormatFaces(ObjSurface const& surface, int indexBaseOffset, int normalBaseOffset, ObjWriteOptions const& options, SurfaceText& text);
+
+		std::vector<SurfaceText> m_text;
+		size_t m_maxWorkers;
+	};
+}
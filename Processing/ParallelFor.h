@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// Number of workers used by ParallelFor. Never less than one.
+	inline size_t WorkerCount()
+	{
+		return std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+
+	// Number of blocks ParallelFor will split [0, count) into. maxWorkers == 0 means all of them.
+	inline size_t BlockCount(size_t const count, size_t const minBlockSize, size_t const maxWorkers = 0)
+	{
+		if (count == 0)
+		{
+			return 0;
+		}
+
+		size_t const workers = maxWorkers == 0 ? WorkerCount() : std::min(WorkerCount(), maxWorkers);
+		size_t const maxBlocks = (count + minBlockSize - 1) / std::max<size_t>(1, minBlockSize);
+		return std::max<size_t>(1, std::min(workers, maxBlocks));
+	}
+
+	// Splits [0, count) into contiguous blocks and calls fn(begin, end, blockIndex) for each
+	// of them on its own thread. The calling thread runs the first block. Blocks are never
+	// smaller than minBlockSize, so small inputs stay on the calling thread.
+	// Per-block results can be collected in a vector sized with BlockCount().
+	//
+	// Background work that must leave cores to the frame loop limits itself to maxWorkers
+	// threads, 0 means all of them.
+	template <typename Fn>
+	void ParallelFor(size_t const count, size_t const minBlockSize, size_t const maxWorkers, Fn&& fn)
+	{
+		size_t const blocks = BlockCount(count, minBlockSize, maxWorkers);
+		if (blocks == 0)
+		{
+			return;
+		}
+
+		size_t const blockSize = (count + blocks - 1) / blocks;
+
+		std::vector<std::thread> workers;
+		workers.reserve(blocks - 1);
+
+		for (size_t b = 1; b < blocks; b++)
+		{
+			size_t const begin = b * blockSize;
+			size_t const end = std::min(count, begin + blockSize);
+			if (begin >= end)
+			{
+				break;
+			}
+			workers.emplace_back([&fn, begin, end, b]() { fn(begin, end, b); });
+		}
+
+		fn(0, std::min(count, blockSize), 0);
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	template <typename Fn>
+	void ParallelFor(size_t const count, size_t const minBlockSize, Fn&& fn)
+	{
+		ParallelFor(count, minBlockSize, 0, std::forward<Fn>(fn));
+	}
+}
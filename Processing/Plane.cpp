@@ -0,0 +1,128 @@
+#include "Plane.h"
+
+#include <cmath>
+
+using namespace SpatialMapping;
+
+Plane Plane::FromPointAndNormal(Vector3 const& point, Vector3 const& normal)
+{
+	Plane plane;
+	plane.normal = Normalize(normal);
+	plane.d = -Dot(plane.normal, point);
+	return plane;
+}
+
+Plane SpatialMapping::FitPlane(Vector3 const* points, size_t const count)
+{
+	if (count < 3)
+	{
+		return {};
+	}
+
+	double centroid[3] = {};
+	for (size_t i = 0; i < count; i++)
+	{
+		centroid[0] += points[i].x;
+		centroid[1] += points[i].y;
+		centroid[2] += points[i].z;
+	}
+	for (double& c : centroid)
+	{
+		c /= count;
+	}
+
+	double a[3][3] = {};
+	for (size_t i = 0; i < count; i++)
+	{
+		double const p[3] = { points[i].x - centroid[0], points[i].y - centroid[1], points[i].z - centroid[2] };
+		for (int r = 0; r < 3; r++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				a[r][c] += p[r] * p[c];
+			}
+		}
+	}
+
+	// Cyclic Jacobi rotations; the columns of v converge to the eigenvectors.
+	double v[3][3] = { { 1., 0., 0. }, { 0., 1., 0. }, { 0., 0., 1. } };
+	for (int sweep = 0; sweep < 32; sweep++)
+	{
+		double const offDiagonal = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+		if (offDiagonal < 1e-24)
+		{
+			break;
+		}
+
+		for (int p = 0; p < 2; p++)
+		{
+			for (int q = p + 1; q < 3; q++)
+			{
+				if (a[p][q] == 0.)
+				{
+					continue;
+				}
+
+				double const theta = (a[q][q] - a[p][p]) / (2. * a[p][q]);
+				double const t = (theta >= 0. ? 1. : -1.) / (std::fabs(theta) + std::sqrt(theta * theta + 1.));
+				double const c = 1. / std::sqrt(t * t + 1.);
+				double const s = t * c;
+
+				for (int k = 0; k < 3; k++)
+				{
+					double const akp = a[k][p];
+					double const akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double const apk = a[p][k];
+					double const aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					double const vkp = v[k][p];
+					double const vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	int smallest = 0;
+	for (int i = 1; i < 3; i++)
+	{
+		if (a[i][i] < a[smallest][smallest])
+		{
+			smallest = i;
+		}
+	}
+
+	Vector3 const normal{
+		static_cast<float>(v[0][smallest]), static_cast<float>(v[1][smallest]), static_cast<float>(v[2][smallest]) };
+	Vector3 const center{ static_cast<float>(centroid[0]), static_cast<float>(centroid[1]), static_cast<float>(centroid[2]) };
+	return Plane::FromPointAndNormal(center, normal);
+}
+
+size_t SpatialMapping::SnapToPlanes(Vector3* const points, size_t const count, Plane const* const planes, size_t const planeCount, float const threshold)
+{
+	size_t snapped = 0;
+	for (size_t p = 0; p < planeCount; p++)
+	{
+		Plane const& plane = planes[p];
+		for (size_t i = 0; i < count; i++)
+		{
+			float const distance = plane.SignedDistance(points[i]);
+			if (std::abs(distance) <= threshold)
+			{
+				points[i] = points[i] - plane.normal * distance;
+				snapped++;
+			}
+		}
+	}
+	return snapped;
+}
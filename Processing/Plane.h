@@ -0,0 +1,25 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+namespace SpatialMapping
+{
+	// The plane Dot(normal, p) + d = 0 with a unit normal.
+	struct Plane
+	{
+		Vector3 normal{ 0.f, 1.f, 0.f };
+		float d = 0.f;
+
+		float SignedDistance(Vector3 const& p) const { return Dot(normal, p) + d; }
+
+		static Plane FromPointAndNormal(Vector3 const& point, Vector3 const& normal);
+	};
+
+	// Least-squares plane through the points: through their centroid, normal along the
+	// eigenvector of the smallest eigenvalue of their covariance.
+	Plane FitPlane(Vector3 const* points, size_t count);
+
+	// Projects the points within threshold of a plane onto it, plane by plane in the given
+	// order like Python/Improvement.py. Returns the number of projections.
+	size_t SnapToPlanes(Vector3* points, size_t count, Plane const* planes, size_t planeCount, float threshold);
+}
@@ -0,0 +1,459 @@
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	uint64_t const EmptySlot = UINT64_MAX;
+
+	uint64_t HashKey(uint64_t key)
+	{
+		// Finalizer of MurmurHash3, spreads neighboring cells over the table.
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdull;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ull;
+		key ^= key >> 33;
+		return key;
+	}
+
+	float Component(Vector3 const& v, int const axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	bool CloserNeighbor(Neighbor const& a, Neighbor const& b)
+	{
+		return a.distanceSquared < b.distanceSquared;
+	}
+
+	bool CloserSurfaceNeighbor(SurfaceNeighbor const& a, SurfaceNeighbor const& b)
+	{
+		return a.distanceSquared < b.distanceSquared;
+	}
+}
+
+uint64_t UniformGrid::CellKey(int32_t const x, int32_t const y, int32_t const z)
+{
+	// 21 bits per axis covers +-1M cells, i.e. +-50 km at 5 cm.
+	uint64_t const mask = (1ull << 21) - 1;
+	return ((static_cast<uint64_t>(x) & mask) << 42) | ((static_cast<uint64_t>(y) & mask) << 21) | (static_cast<uint64_t>(z) & mask);
+}
+
+uint32_t UniformGrid::FindSlot(uint64_t const key) const
+{
+	for (uint64_t slot = HashKey(key) & m_slotMask;; slot = (slot + 1) & m_slotMask)
+	{
+		if (m_slotKeys[slot] == key)
+		{
+			return static_cast<uint32_t>(slot);
+		}
+		if (m_slotKeys[slot] == EmptySlot)
+		{
+			return UINT32_MAX;
+		}
+	}
+}
+
+void UniformGrid::Build(Vector3 const* points, size_t const count, float const cellSize)
+{
+	m_cellSize = cellSize;
+	m_inverseCellSize = 1.f / cellSize;
+
+	// The table is at most half full, so probing stays short.
+	size_t slotCount = 16;
+	while (slotCount < 2 * count)
+	{
+		slotCount *= 2;
+	}
+	m_slotKeys.assign(slotCount, EmptySlot);
+	m_slotCells.resize(slotCount);
+	m_slotMask = slotCount - 1;
+
+	// Assign every point to a cell, numbering cells in order of first appearance.
+	std::vector<uint32_t> pointCells(count);
+	std::vector<uint32_t> cellCounts;
+	cellCounts.reserve(count / 4 + 1);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t const key = CellKey(CellCoordinate(points[i].x), CellCoordinate(points[i].y), CellCoordinate(points[i].z));
+
+		uint64_t slot = HashKey(key) & m_slotMask;
+		while (m_slotKeys[slot] != key && m_slotKeys[slot] != EmptySlot)
+		{
+			slot = (slot + 1) & m_slotMask;
+		}
+
+		if (m_slotKeys[slot] == EmptySlot)
+		{
+			m_slotKeys[slot] = key;
+			m_slotCells[slot] = static_cast<uint32_t>(cellCounts.size());
+			cellCounts.push_back(0);
+		}
+
+		pointCells[i] = m_slotCells[slot];
+		cellCounts[pointCells[i]]++;
+	}
+
+	// Counting sort of the points by cell.
+	m_cellBegin.assign(cellCounts.size() + 1, 0);
+	for (size_t c = 0; c < cellCounts.size(); c++)
+	{
+		m_cellBegin[c + 1] = m_cellBegin[c] + cellCounts[c];
+	}
+
+	std::vector<uint32_t> cursor(m_cellBegin.begin(), m_cellBegin.end() - 1);
+	m_points.resize(count);
+	m_pointIndices.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t const target = cursor[pointCells[i]]++;
+		m_points[target] = points[i];
+		m_pointIndices[target] = static_cast<uint32_t>(i);
+	}
+}
+
+void UniformGrid::RadiusQuery(Vector3 const& center, float const radius, std::vector<uint32_t>& result) const
+{
+	result.clear();
+	ForEachInRadius(center, radius, [&result](uint32_t const index, float) { result.push_back(index); });
+}
+
+size_t UniformGrid::Bytes() const
+{
+	return m_slotKeys.capacity() * sizeof(uint64_t) + m_slotCells.capacity() * sizeof(uint32_t) + m_cellBegin.capacity() * sizeof(uint32_t) +
+		m_points.capacity() * sizeof(Vector3) + m_pointIndices.capacity() * sizeof(uint32_t);
+}
+
+void KdTree::Build(Vector3 const* points, size_t const count)
+{
+	// Points are partitioned together with their index, which keeps the partitioning cache friendly.
+	std::vector<Entry> entries(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		entries[i] = { points[i], static_cast<uint32_t>(i) };
+	}
+
+	m_axes.assign(count, 0);
+	BuildRange(entries, 0, static_cast<uint32_t>(count));
+
+	m_points.resize(count);
+	m_pointIndices.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		m_points[i] = entries[i].point;
+		m_pointIndices[i] = entries[i].index;
+	}
+}
+
+void KdTree::BuildRange(std::vector<Entry>& entries, uint32_t const begin, uint32_t const end)
+{
+	if (end - begin <= 1)
+	{
+		return;
+	}
+
+	Vector3 boundsMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+	Vector3 boundsMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t i = begin; i < end; i++)
+	{
+		auto const& p = entries[i].point;
+		boundsMin = { std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z) };
+		boundsMax = { std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z) };
+	}
+
+	Vector3 const extent = boundsMax - boundsMin;
+	int const axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+	uint32_t const middle = begin + (end - begin) / 2;
+	std::nth_element(
+		entries.begin() + begin,
+		entries.begin() + middle,
+		entries.begin() + end,
+		[axis](Entry const& a, Entry const& b) { return Component(a.point, axis) < Component(b.point, axis); });
+
+	m_axes[middle] = static_cast<uint8_t>(axis);
+
+	BuildRange(entries, begin, middle);
+	BuildRange(entries, middle + 1, end);
+}
+
+void KdTree::KNearest(Vector3 const& query, size_t const k, float const maxDistance, std::vector<Neighbor>& result) const
+{
+	result.clear();
+	if (k == 0 || m_points.empty())
+	{
+		return;
+	}
+
+	result.reserve(k);
+	float worst = maxDistance * maxDistance;
+	SearchRange(0, static_cast<uint32_t>(m_points.size()), query, k, result, worst);
+	std::sort_heap(result.begin(), result.end(), CloserNeighbor);
+}
+
+void KdTree::SearchRange(
+	uint32_t const begin,
+	uint32_t const end,
+	Vector3 const& query,
+	size_t const k,
+	std::vector<Neighbor>& heap,
+	float& worst) const
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	uint32_t const middle = begin + (end - begin) / 2;
+	float const d = LengthSquared(m_points[middle] - query);
+
+	// 'heap' is a max-heap on distance, 'worst' is the radius that can still improve it.
+	if (d < worst)
+	{
+		heap.push_back({ m_pointIndices[middle], d });
+		std::push_heap(heap.begin(), heap.end(), CloserNeighbor);
+		if (heap.size() > k)
+		{
+			std::pop_heap(heap.begin(), heap.end(), CloserNeighbor);
+			heap.pop_back();
+		}
+		if (heap.size() == k)
+		{
+			worst = heap.front().distanceSquared;
+		}
+	}
+
+	if (end - begin == 1)
+	{
+		return;
+	}
+
+	int const axis = m_axes[middle];
+	float const delta = Component(query, axis) - Component(m_points[middle], axis);
+
+	if (delta < 0.f)
+	{
+		SearchRange(begin, middle, query, k, heap, worst);
+		if (delta * delta < worst)
+		{
+			SearchRange(middle + 1, end, query, k, heap, worst);
+		}
+	}
+	else
+	{
+		SearchRange(middle + 1, end, query, k, heap, worst);
+		if (delta * delta < worst)
+		{
+			SearchRange(begin, middle, query, k, heap, worst);
+		}
+	}
+}
+
+bool KdTree::Nearest(Vector3 const& query, float const maxDistance, Neighbor& result) const
+{
+	result.index = UINT32_MAX;
+	result.distanceSquared = maxDistance * maxDistance;
+	NearestRange(0, static_cast<uint32_t>(m_points.size()), query, result);
+	return result.index != UINT32_MAX;
+}
+
+void KdTree::NearestRange(uint32_t const begin, uint32_t const end, Vector3 const& query, Neighbor& best) const
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	uint32_t const middle = begin + (end - begin) / 2;
+	float const d = LengthSquared(m_points[middle] - query);
+	if (d < best.distanceSquared)
+	{
+		best.index = m_pointIndices[middle];
+		best.distanceSquared = d;
+	}
+
+	if (end - begin == 1)
+	{
+		return;
+	}
+
+	int const axis = m_axes[middle];
+	float const delta = Component(query, axis) - Component(m_points[middle], axis);
+	uint32_t const nearBegin = delta < 0.f ? begin : middle + 1;
+	uint32_t const nearEnd = delta < 0.f ? middle : end;
+	uint32_t const farBegin = delta < 0.f ? middle + 1 : begin;
+	uint32_t const farEnd = delta < 0.f ? end : middle;
+
+	NearestRange(nearBegin, nearEnd, query, best);
+	if (delta * delta < best.distanceSquared)
+	{
+		NearestRange(farBegin, farEnd, query, best);
+	}
+}
+
+void SpatialIndex::Build(Vector3 const* points, size_t const count, float const cellSize, Vector3 const* normals)
+{
+	m_boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+	m_boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = 0; i < count; i++)
+	{
+		m_boundsMin = { std::min(m_boundsMin.x, points[i].x), std::min(m_boundsMin.y, points[i].y), std::min(m_boundsMin.z, points[i].z) };
+		m_boundsMax = { std::max(m_boundsMax.x, points[i].x), std::max(m_boundsMax.y, points[i].y), std::max(m_boundsMax.z, points[i].z) };
+	}
+
+	m_grid.Build(points, count, cellSize);
+	m_tree.Build(points, count);
+
+	if (normals)
+	{
+		m_points.assign(points, points + count);
+		m_normals.assign(normals, normals + count);
+	}
+	else
+	{
+		m_points.clear();
+		m_normals.clear();
+	}
+}
+
+size_t KdTree::Bytes() const
+{
+	return m_points.capacity() * sizeof(Vector3) + m_pointIndices.capacity() * sizeof(uint32_t) + m_axes.capacity();
+}
+
+size_t SpatialIndex::Bytes() const
+{
+	return sizeof(SpatialIndex) + m_grid.Bytes() + m_tree.Bytes() + (m_points.capacity() + m_normals.capacity()) * sizeof(Vector3);
+}
+
+float SpatialIndex::DistanceSquaredToBounds(Vector3 const& p) const
+{
+	float const dx = std::max(std::max(m_boundsMin.x - p.x, 0.f), p.x - m_boundsMax.x);
+	float const dy = std::max(std::max(m_boundsMin.y - p.y, 0.f), p.y - m_boundsMax.y);
+	float const dz = std::max(std::max(m_boundsMin.z - p.z, 0.f), p.z - m_boundsMax.z);
+	return dx * dx + dy * dy + dz * dz;
+}
+
+void SpatialIndexSnapshot::RadiusQuery(Vector3 const& center, float const radius, std::vector<SurfaceNeighbor>& result) const
+{
+	result.clear();
+	for (auto const& [id, index] : surfaces)
+	{
+		if (index->DistanceSquaredToBounds(center) > radius * radius)
+		{
+			continue;
+		}
+
+		int const surfaceId = id;
+		index->Grid().ForEachInRadius(center, radius, [&](uint32_t const i, float const d)
+			{
+				result.push_back({ surfaceId, i, d });
+			});
+	}
+}
+
+void SpatialIndexSnapshot::KNearest(Vector3 const& query, size_t const k, float const maxDistance, std::vector<SurfaceNeighbor>& result) const
+{
+	result.clear();
+
+	// Visit surfaces nearest first so that the search radius shrinks quickly.
+	std::vector<std::pair<float, size_t>> order;
+	order.reserve(surfaces.size());
+	for (size_t s = 0; s < surfaces.size(); s++)
+	{
+		order.emplace_back(surfaces[s].second->DistanceSquaredToBounds(query), s);
+	}
+	std::sort(order.begin(), order.end());
+
+	float worst = maxDistance * maxDistance;
+	std::vector<Neighbor> neighbors;
+
+	for (auto const& [boundsDistance, s] : order)
+	{
+		if (boundsDistance >= worst)
+		{
+			break;
+		}
+
+		surfaces[s].second->Tree().KNearest(query, k, std::sqrt(worst), neighbors);
+		for (auto const& neighbor : neighbors)
+		{
+			result.push_back({ surfaces[s].first, neighbor.index, neighbor.distanceSquared });
+		}
+
+		std::sort(result.begin(), result.end(), CloserSurfaceNeighbor);
+		if (result.size() > k)
+		{
+			result.resize(k);
+		}
+		if (result.size() == k)
+		{
+			worst = result.back().distanceSquared;
+		}
+	}
+}
+
+bool SpatialIndexSnapshot::Nearest(Vector3 const& query, float const maxDistance, int const excludedSurfaceId, SurfaceNeighbor& result) const
+{
+	result.distanceSquared = maxDistance * maxDistance;
+	bool found = false;
+
+	for (auto const& [id, index] : surfaces)
+	{
+		if (id == excludedSurfaceId || index->DistanceSquaredToBounds(query) >= result.distanceSquared)
+		{
+			continue;
+		}
+
+		Neighbor neighbor;
+		if (index->Tree().Nearest(query, std::sqrt(result.distanceSquared), neighbor))
+		{
+			result = { id, neighbor.index, neighbor.distanceSquared };
+			found = true;
+		}
+	}
+	return found;
+}
+
+SpatialIndexCollection::SpatialIndexCollection() :
+	m_snapshot(std::make_shared<SpatialIndexSnapshot const>())
+{
+}
+
+std::shared_ptr<SpatialIndexSnapshot const> SpatialIndexCollection::Snapshot() const
+{
+	return std::atomic_load(&m_snapshot);
+}
+
+void SpatialIndexCollection::Update(int const surfaceId, std::shared_ptr<SpatialIndex const> index)
+{
+	std::lock_guard<std::mutex> lock(m_writerMutex);
+
+	auto snapshot = std::make_shared<SpatialIndexSnapshot>(*std::atomic_load(&m_snapshot));
+	auto& surfaces = snapshot->surfaces;
+
+	auto const existing = std::find_if(surfaces.begin(), surfaces.end(), [surfaceId](auto const& entry) { return entry.first == surfaceId; });
+	if (existing != surfaces.end())
+	{
+		if (index)
+		{
+			existing->second = std::move(index);
+		}
+		else
+		{
+			surfaces.erase(existing);
+		}
+	}
+	else if (index)
+	{
+		surfaces.emplace_back(surfaceId, std::move(index));
+	}
+
+	std::atomic_store(&m_snapshot, std::shared_ptr<SpatialIndexSnapshot const>(std::move(snapshot)));
+}
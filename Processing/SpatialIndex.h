@@ -0,0 +1,195 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// Hashed uniform grid over a point set, answering radius queries. The grid copies the points
+	// into cell order so that a query touches contiguous memory. Immutable once built.
+	class UniformGrid
+	{
+	public:
+		void Build(Vector3 const* points, size_t count, float cellSize);
+
+		// Calls fn(pointIndex, distanceSquared) for every point within radius of center.
+		template <typename Fn>
+		void ForEachInRadius(Vector3 const& center, float radius, Fn&& fn) const;
+
+		void RadiusQuery(Vector3 const& center, float radius, std::vector<uint32_t>& result) const;
+
+		float CellSize() const { return m_cellSize; }
+		size_t CellCount() const { return m_cellBegin.empty() ? 0 : m_cellBegin.size() - 1; }
+
+		// Allocated by the table and the sorted points.
+		size_t Bytes() const;
+
+	private:
+		static uint64_t CellKey(int32_t x, int32_t y, int32_t z);
+		int32_t CellCoordinate(float v) const { return static_cast<int32_t>(std::floor(v * m_inverseCellSize)); }
+		uint32_t FindSlot(uint64_t key) const;
+
+		float m_cellSize = 0.f;
+		float m_inverseCellSize = 0.f;
+
+		// Open addressing table from cell key to cell number.
+		std::vector<uint64_t> m_slotKeys;
+		std::vector<uint32_t> m_slotCells;
+		uint64_t m_slotMask = 0;
+
+		// Points of cell c are [m_cellBegin[c], m_cellBegin[c + 1]).
+		std::vector<uint32_t> m_cellBegin;
+		std::vector<Vector3> m_points;
+		std::vector<uint32_t> m_pointIndices;
+	};
+
+	struct Neighbor
+	{
+		uint32_t index = 0;
+		float distanceSquared = 0.f;
+	};
+
+	// Static, balanced KD-tree over a point set for k-nearest-neighbor queries. The tree is
+	// stored implicitly: the median of every range is its node. Immutable once built.
+	class KdTree
+	{
+	public:
+		void Build(Vector3 const* points, size_t count);
+
+		// The k nearest points within maxDistance, sorted by increasing distance.
+		void KNearest(Vector3 const& query, size_t k, float maxDistance, std::vector<Neighbor>& result) const;
+
+		// The nearest point within maxDistance. Returns false if there is none.
+		bool Nearest(Vector3 const& query, float maxDistance, Neighbor& result) const;
+
+		size_t Size() const { return m_points.size(); }
+		size_t Bytes() const;
+
+	private:
+		struct Entry
+		{
+			Vector3 point;
+			uint32_t index;
+		};
+
+		void BuildRange(std::vector<Entry>& entries, uint32_t begin, uint32_t end);
+		void SearchRange(uint32_t begin, uint32_t end, Vector3 const& query, size_t k, std::vector<Neighbor>& heap, float& worst) const;
+		void NearestRange(uint32_t begin, uint32_t end, Vector3 const& query, Neighbor& best) const;
+
+		std::vector<Vector3> m_points;
+		std::vector<uint32_t> m_pointIndices;
+		std::vector<uint8_t> m_axes;
+	};
+
+	// Grid and KD-tree over the world-space vertices of one surface. Vertex normals are
+	// optional; when given, the points and normals are also kept in input order for queries
+	// that need the local surface orientation.
+	class SpatialIndex
+	{
+	public:
+		void Build(Vector3 const* points, size_t count, float cellSize, Vector3 const* normals = nullptr);
+
+		UniformGrid const& Grid() const { return m_grid; }
+		KdTree const& Tree() const { return m_tree; }
+		Vector3 const& BoundsMin() const { return m_boundsMin; }
+		Vector3 const& BoundsMax() const { return m_boundsMax; }
+		size_t Size() const { return m_tree.Size(); }
+		std::vector<Vector3> const& Points() const { return m_points; }
+		std::vector<Vector3> const& Normals() const { return m_normals; }
+		size_t Bytes() const;
+
+		// Squared distance from p to the bounding box of the indexed points.
+		float DistanceSquaredToBounds(Vector3 const& p) const;
+
+	private:
+		UniformGrid m_grid;
+		KdTree m_tree;
+		std::vector<Vector3> m_points;
+		std::vector<Vector3> m_normals;
+		Vector3 m_boundsMin;
+		Vector3 m_boundsMax;
+	};
+
+	struct SurfaceNeighbor
+	{
+		int surfaceId = 0;
+		uint32_t index = 0;
+		float distanceSquared = 0.f;
+	};
+
+	// Immutable view of the per-surface indices at one point in time.
+	struct SpatialIndexSnapshot
+	{
+		std::vector<std::pair<int, std::shared_ptr<SpatialIndex const>>> surfaces;
+
+		void RadiusQuery(Vector3 const& center, float radius, std::vector<SurfaceNeighbor>& result) const;
+		void KNearest(Vector3 const& query, size_t k, float maxDistance, std::vector<SurfaceNeighbor>& result) const;
+
+		// The nearest point within maxDistance on any surface other than excludedSurfaceId.
+		bool Nearest(Vector3 const& query, float maxDistance, int excludedSurfaceId, SurfaceNeighbor& result) const;
+	};
+
+	// Publishes the per-surface spatial indices to any number of readers. Readers take a
+	// snapshot and query it without locking; a surface update only replaces the index of that
+	// surface and publishes a new snapshot that shares all the other ones.
+	class SpatialIndexCollection
+	{
+	public:
+		SpatialIndexCollection();
+
+		std::shared_ptr<SpatialIndexSnapshot const> Snapshot() const;
+
+		// Replaces the index of a surface. Passing nullptr removes the surface.
+		void Update(int surfaceId, std::shared_ptr<SpatialIndex const> index);
+
+	private:
+		std::shared_ptr<SpatialIndexSnapshot const> m_snapshot;
+
+		// Serializes writers only.
+		std::mutex m_writerMutex;
+	};
+
+	template <typename Fn>
+	void UniformGrid::ForEachInRadius(Vector3 const& center, float const radius, Fn&& fn) const
+	{
+		if (m_points.empty())
+		{
+			return;
+		}
+
+		float const radiusSquared = radius * radius;
+		int32_t const x0 = CellCoordinate(center.x - radius), x1 = CellCoordinate(center.x + radius);
+		int32_t const y0 = CellCoordinate(center.y - radius), y1 = CellCoordinate(center.y + radius);
+		int32_t const z0 = CellCoordinate(center.z - radius), z1 = CellCoordinate(center.z + radius);
+
+		for (int32_t z = z0; z <= z1; z++)
+		{
+			for (int32_t y = y0; y <= y1; y++)
+			{
+				for (int32_t x = x0; x <= x1; x++)
+				{
+					uint32_t const slot = FindSlot(CellKey(x, y, z));
+					if (slot == UINT32_MAX)
+					{
+						continue;
+					}
+
+					uint32_t const cell = m_slotCells[slot];
+					for (uint32_t i = m_cellBegin[cell]; i < m_cellBegin[cell + 1]; i++)
+					{
+						float const d = LengthSquared(m_points[i] - center);
+						if (d <= radiusSquared)
+						{
+							fn(m_pointIndices[i], d);
+						}
+					}
+				}
+			}
+		}
+	}
+}
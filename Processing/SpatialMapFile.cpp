@@ -0,0 +1,407 @@
+#include "SpatialMapFile.h"
+
+#include "MeshCodec.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	char const Magic[8] = { 'S', 'P', 'A', 'T', 'M', 'A', 'P', '\0' };
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t surfaceCount;
+		uint64_t tocOffset;
+		uint64_t fileSize;
+	};
+
+	uint32_t const Indices32Bit = 1;
+
+	// The geometry is one MeshCodec blob at positionsOffset.
+	uint32_t const Compressed = 2;
+
+	// Offsets are from the start of the file, 0 for an absent section.
+	struct TocEntry
+	{
+		int32_t id;
+		uint32_t flags;
+		int64_t updateTime;
+		float meshToWorld[16];
+		float vertexPositionScale[3];
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t faceNormalCount;
+		uint64_t positionsOffset;
+		uint64_t localPositionsOffset;
+		uint64_t indicesOffset;
+		uint64_t faceNormalsOffset;
+	};
+
+	static_assert(sizeof(FileHeader) == 32, "The file header layout is part of the format");
+	static_assert(sizeof(TocEntry) == 136, "The table of contents layout is part of the format");
+	static_assert(sizeof(Vector3) == 12, "Positions and normals are stored as three floats");
+
+	uint64_t Align(uint64_t const offset)
+	{
+		return (offset + SpatialMapFile::SectionAlignment - 1) & ~static_cast<uint64_t>(SpatialMapFile::SectionAlignment - 1);
+	}
+
+	// Places a section of the given size at the next aligned offset.
+	uint64_t Allocate(uint64_t& end, size_t const bytes)
+	{
+		if (bytes == 0)
+		{
+			return 0;
+		}
+		uint64_t const offset = Align(end);
+		end = offset + bytes;
+		return offset;
+	}
+
+	class SectionWriter
+	{
+	public:
+		explicit SectionWriter(std::ostream& file) : m_file(file) {}
+
+		void Write(uint64_t const offset, void const* data, size_t const bytes)
+		{
+			if (bytes == 0)
+			{
+				return;
+			}
+			char const zeros[SpatialMapFile::SectionAlignment] = {};
+			m_file.write(zeros, static_cast<std::streamsize>(offset - m_position));
+			m_file.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes));
+			m_position = offset + bytes;
+		}
+
+	private:
+		std::ostream& m_file;
+		uint64_t m_position = 0;
+	};
+
+	bool IsSection(uint64_t const offset, uint64_t const bytes, uint64_t const fileSize)
+	{
+		return offset % SpatialMapFile::SectionAlignment == 0 && offset <= fileSize && bytes <= fileSize - offset;
+	}
+
+	// The readers of a map index the positions with the indices and the face normals with the
+	// triangles without checking them, so that a corrupt file must not get past Parse().
+	// Either there is no face normal or one per triangle.
+	bool IsConsistent(SpatialMapSurface const& surface)
+	{
+		size_t const indexCount = surface.indices.count;
+		if (surface.faceNormalCount != 0 && surface.faceNormalCount != indexCount / 3)
+		{
+			return false;
+		}
+
+		uint32_t largest = 0;
+		VisitIndices(surface.indices, [&](auto const* const indices)
+			{
+				for (size_t i = 0; i < indexCount; i++)
+				{
+					largest = std::max<uint32_t>(largest, indices[i]);
+				}
+			});
+		return indexCount == 0 || largest < surface.vertexCount;
+	}
+
+	// Places every section of the file, returns the file size. Surfaces with a blob are stored
+	// compressed.
+	uint64_t Layout(std::vector<SpatialMapSurface> const& surfaces, std::vector<std::string> const& blobs, FileHeader& header, std::vector<TocEntry>& toc)
+	{
+		header = {};
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = blobs.empty() ? 1 : SpatialMapFile::Version;
+		header.surfaceCount = static_cast<uint32_t>(surfaces.size());
+
+		uint64_t end = sizeof(FileHeader);
+		header.tocOffset = Allocate(end, surfaces.size() * sizeof(TocEntry));
+
+		toc.resize(surfaces.size());
+		for (size_t s = 0; s < surfaces.size(); s++)
+		{
+			auto const& surface = surfaces[s];
+			auto& entry = toc[s];
+			entry = {};
+			entry.id = surface.id;
+			entry.flags = surface.indices.is32Bit ? Indices32Bit : 0;
+			entry.updateTime = surface.updateTime;
+			std::memcpy(entry.meshToWorld, surface.meshToWorld, sizeof(entry.meshToWorld));
+			entry.vertexPositionScale[0] = surface.vertexPositionScale.x;
+			entry.vertexPositionScale[1] = surface.vertexPositionScale.y;
+			entry.vertexPositionScale[2] = surface.vertexPositionScale.z;
+			entry.vertexCount = static_cast<uint32_t>(surface.vertexCount);
+			entry.indexCount = static_cast<uint32_t>(surface.indices.count);
+			entry.faceNormalCount = static_cast<uint32_t>(surface.faceNormalCount);
+
+			if (!blobs.empty())
+			{
+				entry.flags |= Compressed;
+				entry.positionsOffset = Allocate(end, blobs[s].size());
+				continue;
+			}
+
+			size_t const vertexBytes = surface.vertexCount * sizeof(Vector3);
+			entry.positionsOffset = Allocate(end, vertexBytes);
+			entry.localPositionsOffset = surface.localPositions ? Allocate(end, vertexBytes) : 0;
+			entry.indicesOffset = Allocate(end, surface.indices.count * (surface.indices.is32Bit ? 4 : 2));
+			entry.faceNormalsOffset = Allocate(end, surface.faceNormalCount * sizeof(Vector3));
+		}
+		header.fileSize = end;
+		return end;
+	}
+}
+
+uint64_t SpatialMapFile::SerializedSize(std::vector<SpatialMapSurface> const& surfaces)
+{
+	FileHeader header;
+	std::vector<TocEntry> toc;
+	return Layout(surfaces, {}, header, toc);
+}
+
+bool SpatialMapFile::Write(std::ostream& out, std::vector<SpatialMapSurface> const& surfaces, MeshCodecOptions const* const compression)
+{
+	std::vector<std::string> blobs;
+	if (compression)
+	{
+		blobs.resize(surfaces.size());
+		for (size_t s = 0; s < surfaces.size(); s++)
+		{
+			MeshCodec::Encode(surfaces[s], *compression, blobs[s]);
+		}
+	}
+
+	FileHeader header;
+	std::vector<TocEntry> toc;
+	Layout(surfaces, blobs, header, toc);
+
+	SectionWriter writer(out);
+	writer.Write(0, &header, sizeof(header));
+	writer.Write(header.tocOffset, toc.data(), toc.size() * sizeof(TocEntry));
+	for (size_t s = 0; s < surfaces.size(); s++)
+	{
+		auto const& surface = surfaces[s];
+		auto const& entry = toc[s];
+		if (!blobs.empty())
+		{
+			writer.Write(entry.positionsOffset, blobs[s].data(), blobs[s].size());
+			continue;
+		}
+
+		size_t const vertexBytes = surface.vertexCount * sizeof(Vector3);
+		writer.Write(entry.positionsOffset, surface.positions, vertexBytes);
+		if (surface.localPositions)
+		{
+			writer.Write(entry.localPositionsOffset, surface.localPositions, vertexBytes);
+		}
+		writer.Write(entry.indicesOffset, surface.indices.data, surface.indices.count * (surface.indices.is32Bit ? 4 : 2));
+		writer.Write(entry.faceNormalsOffset, surface.faceNormals, surface.faceNormalCount * sizeof(Vector3));
+	}
+	return !out.fail();
+}
+
+bool SpatialMapFile::Write(std::string const& path, std::vector<SpatialMapSurface> const& surfaces, MeshCodecOptions const* const compression)
+{
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file || !Write(file, surfaces, compression))
+	{
+		return false;
+	}
+	file.close();
+	return !file.fail();
+}
+
+bool SpatialMapFile::Parse(char const* const data, size_t const size, std::vector<SpatialMapSurface>& surfaces, std::vector<DecodedMesh>* const decoded)
+{
+	surfaces.clear();
+	if (decoded)
+	{
+		decoded->clear();
+	}
+
+	FileHeader header;
+	if (size < sizeof(FileHeader))
+	{
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+
+	if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version == 0 || header.version > Version ||
+		header.fileSize != size || !IsSection(header.tocOffset, static_cast<uint64_t>(header.surfaceCount) * sizeof(TocEntry), size))
+	{
+		return false;
+	}
+
+	auto const* const toc = reinterpret_cast<TocEntry const*>(data + header.tocOffset);
+	surfaces.resize(header.surfaceCount);
+	if (decoded)
+	{
+		// Sized once, the surfaces point into its elements.
+		decoded->resize(header.surfaceCount);
+	}
+	std::vector<uint32_t> compressed;
+	for (uint32_t s = 0; s < header.surfaceCount; s++)
+	{
+		auto const& entry = toc[s];
+		if ((entry.flags & Compressed) != 0)
+		{
+			auto& surface = surfaces[s];
+			surface.id = entry.id;
+			surface.updateTime = entry.updateTime;
+			std::memcpy(surface.meshToWorld, entry.meshToWorld, sizeof(surface.meshToWorld));
+			surface.vertexPositionScale = { entry.vertexPositionScale[0], entry.vertexPositionScale[1], entry.vertexPositionScale[2] };
+
+			if (!decoded || entry.positionsOffset % SectionAlignment != 0 || entry.positionsOffset >= size)
+			{
+				surfaces.clear();
+				return false;
+			}
+			compressed.push_back(s);
+			continue;
+		}
+
+		bool const is32Bit = (entry.flags & Indices32Bit) != 0;
+		uint64_t const vertexBytes = static_cast<uint64_t>(entry.vertexCount) * sizeof(Vector3);
+		uint64_t const indexBytes = static_cast<uint64_t>(entry.indexCount) * (is32Bit ? 4 : 2);
+		uint64_t const normalBytes = static_cast<uint64_t>(entry.faceNormalCount) * sizeof(Vector3);
+
+		// Empty sections have offset 0, which passes the check with 0 bytes.
+		bool const valid = entry.indexCount % 3 == 0 &&
+			IsSection(entry.positionsOffset, vertexBytes, size) &&
+			IsSection(entry.localPositionsOffset, entry.localPositionsOffset ? vertexBytes : 0, size) &&
+			IsSection(entry.indicesOffset, indexBytes, size) &&
+			IsSection(entry.faceNormalsOffset, normalBytes, size);
+		if (!valid)
+		{
+			surfaces.clear();
+			return false;
+		}
+
+		auto& surface = surfaces[s];
+		surface.id = entry.id;
+		surface.updateTime = entry.updateTime;
+		std::memcpy(surface.meshToWorld, entry.meshToWorld, sizeof(surface.meshToWorld));
+		surface.vertexPositionScale = { entry.vertexPositionScale[0], entry.vertexPositionScale[1], entry.vertexPositionScale[2] };
+		surface.positions = reinterpret_cast<Vector3 const*>(data + entry.positionsOffset);
+		surface.localPositions = entry.localPositionsOffset ? reinterpret_cast<Vector3 const*>(data + entry.localPositionsOffset) : nullptr;
+		surface.vertexCount = entry.vertexCount;
+		surface.faceNormals = reinterpret_cast<Vector3 const*>(data + entry.faceNormalsOffset);
+		surface.faceNormalCount = entry.faceNormalCount;
+		surface.indices = is32Bit ?
+			IndexView(reinterpret_cast<uint32_t const*>(data + entry.indicesOffset), entry.indexCount) :
+			IndexView(reinterpret_cast<uint16_t const*>(data + entry.indicesOffset), entry.indexCount);
+		if (!IsConsistent(surface))
+		{
+			surfaces.clear();
+			return false;
+		}
+	}
+
+	// The blobs are independent, decoding them is most of the time spent opening such a file.
+	std::atomic<bool> valid{ true };
+	ParallelFor(compressed.size(), 4, [&](size_t const begin, size_t const end, size_t)
+		{
+			for (size_t i = begin; i < end && valid.load(std::memory_order_relaxed); i++)
+			{
+				uint32_t const s = compressed[i];
+				auto const& entry = toc[s];
+				auto& surface = surfaces[s];
+				if (!MeshCodec::Decode(data + entry.positionsOffset, size - entry.positionsOffset, (*decoded)[s], surface) ||
+					surface.vertexCount != entry.vertexCount || surface.indices.count != entry.indexCount || !IsConsistent(surface))
+				{
+					valid = false;
+				}
+			}
+		});
+	if (!valid)
+	{
+		surfaces.clear();
+		decoded->clear();
+		return false;
+	}
+	return true;
+}
+
+bool SpatialMapFile::Open(std::string const& path)
+{
+	Close();
+	if (!m_file.Open(path) || !Parse(m_file.Data(), m_file.Size(), m_surfaces, &m_decoded))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SpatialMapFile::Close()
+{
+	m_surfaces.clear();
+	m_decoded.clear();
+	m_file.Close();
+}
+
+void SpatialMapping::ToMeshData(std::vector<SpatialMapSurface> const& surfaces, MeshData& mesh)
+{
+	mesh = {};
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (auto const& surface : surfaces)
+	{
+		vertexCount += surface.vertexCount;
+		indexCount += surface.indices.count;
+	}
+	mesh.positions.reserve(vertexCount);
+	mesh.faceNormals.reserve(indexCount / 3);
+	mesh.indices.reserve(indexCount);
+	mesh.objects.reserve(surfaces.size());
+
+	for (auto const& surface : surfaces)
+	{
+		MeshObject object;
+		object.name = "mesh_" + std::to_string(surface.id);
+		object.firstVertex = static_cast<uint32_t>(mesh.positions.size());
+		object.vertexCount = static_cast<uint32_t>(surface.vertexCount);
+		object.firstIndex = static_cast<uint32_t>(mesh.indices.size());
+		object.indexCount = static_cast<uint32_t>(surface.indices.count);
+
+		mesh.positions.insert(mesh.positions.end(), surface.positions, surface.positions + surface.vertexCount);
+		VisitIndices(surface.indices, [&](auto const* const indices)
+			{
+				for (size_t i = 0; i < surface.indices.count; i++)
+				{
+					mesh.indices.push_back(indices[i] + object.firstVertex);
+				}
+			});
+
+		// Like ObjReader, every triangle gets a normal: the stored one if there is one per
+		// triangle, the geometric one otherwise.
+		size_t const triangleCount = surface.indices.count / 3;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			if (surface.faceNormalCount == triangleCount)
+			{
+				mesh.faceNormals.push_back(surface.faceNormals[t]);
+			}
+			else
+			{
+				auto const& a = surface.positions[surface.indices[3 * t]];
+				auto const& b = surface.positions[surface.indices[3 * t + 1]];
+				auto const& c = surface.positions[surface.indices[3 * t + 2]];
+				mesh.faceNormals.push_back(Normalize(Cross(b - a, c - a)));
+			}
+		}
+
+		mesh.objects.push_back(std::move(object));
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "MeshAttributes.h"
+#include "MeshTypes.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// The state of one SurfaceMesh in a spatial map file. When writing, the pointers refer to
+	// the caller's arrays; when reading, they point straight into the mapped file.
+	struct SpatialMapSurface
+	{
+		int id = 0;
+
+		// Windows::Foundation::DateTime::UniversalTime of the last update, 100 ns ticks.
+		int64_t updateTime = 0;
+
+		// Mesh to world coordinate system, a row-major float4x4 used with row vectors like
+		// Windows::Foundation::Numerics::transform.
+		float meshToWorld[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+		Vector3 vertexPositionScale{ 1.f, 1.f, 1.f };
+
+		// World-space positions, and optionally the scaled mesh-space ones they came from.
+		Vector3 const* positions = nullptr;
+		Vector3 const* localPositions = nullptr;
+		size_t vertexCount = 0;
+
+		Vector3 const* faceNormals = nullptr;
+		size_t faceNormalCount = 0;
+
+		IndexView indices;
+
+		// Only written by the GLB export, the map file does not store attributes.
+		AttributeChannel const* attributes = nullptr;
+		size_t attributeCount = 0;
+	};
+
+	// The arrays of a surface decoded from a compressed section, which the SpatialMapSurface
+	// views point into.
+	struct DecodedMesh
+	{
+		std::vector<Vector3> positions;
+		std::vector<Vector3> localPositions;
+		std::vector<Vector3> faceNormals;
+
+		// Only one of them is used, matching the index format of the encoded surface.
+		std::vector<uint16_t> indices16;
+		std::vector<uint32_t> indices32;
+
+		IndexView Indices() const
+		{
+			return indices16.empty() ? IndexView(indices32.data(), indices32.size()) : IndexView(indices16.data(), indices16.size());
+		}
+	};
+
+	struct MeshCodecOptions;
+
+	// Versioned binary container for a spatial map:
+	//
+	//   header | table of contents: one entry per surface | sections
+	//
+	// Every array is its own section, aligned to SpatialMapFile::SectionAlignment, so that a
+	// mapped file can be read in place. All values are little-endian, like every platform
+	// the app and the tools run on.
+	//
+	// Version 2 adds compressed surfaces, see Processing/MeshCodec.h: their geometry is a single
+	// section that is decoded when the file is opened instead of being read in place. Files
+	// without compressed surfaces are still written as version 1.
+	class SpatialMapFile
+	{
+	public:
+		static uint32_t const Version = 2;
+		static size_t const SectionAlignment = 64;
+
+		// With compression options every surface is stored compressed.
+		static bool Write(std::string const& path, std::vector<SpatialMapSurface> const& surfaces, MeshCodecOptions const* compression = nullptr);
+
+		// Writes the file to a stream positioned at a multiple of SectionAlignment, so that a map
+		// can be embedded in another file and still be read in place.
+		static bool Write(std::ostream& out, std::vector<SpatialMapSurface> const& surfaces, MeshCodecOptions const* compression = nullptr);
+
+		// Size of the uncompressed file.
+		static uint64_t SerializedSize(std::vector<SpatialMapSurface> const& surfaces);
+
+		// Validates a map in memory, down to its indices, and returns views into it, the checks
+		// of Open(). Compressed surfaces are decoded into the given storage, without it they
+		// fail the parse.
+		static bool Parse(char const* data, size_t size, std::vector<SpatialMapSurface>& surfaces, std::vector<DecodedMesh>* decoded = nullptr);
+
+		// Maps the file and validates the header and every section bound. Returns false for a
+		// missing, truncated or foreign file, or one of a newer version.
+		bool Open(std::string const& path);
+		void Close();
+
+		size_t SurfaceCount() const { return m_surfaces.size(); }
+
+		// Zero-copy views into the mapping or the decoded surfaces, valid until Close().
+		SpatialMapSurface const& Surface(size_t i) const { return m_surfaces[i]; }
+		std::vector<SpatialMapSurface> const& Surfaces() const { return m_surfaces; }
+
+	private:
+		MappedFile m_file;
+		std::vector<SpatialMapSurface> m_surfaces;
+		std::vector<DecodedMesh> m_decoded;
+	};
+
+	// Copies the surfaces of a map into a MeshData, as if the map's world-space positions had
+	// been read from the OBJ export.
+	void ToMeshData(std::vector<SpatialMapSurface> const& surfaces, MeshData& mesh);
+}
@@ -0,0 +1,305 @@
+#include "SurfaceCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	char const CacheMagic[8] = { 'S', 'P', 'M', 'A', 'P', 'C', 'A', 'C' };
+	uint32_t const CacheVersion = 1;
+
+	// The map follows the header, which names the anchor the positions are relative to.
+	struct CacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t anchorSave;
+		uint64_t mapSize;
+		uint64_t reserved[5];
+	};
+
+	static_assert(sizeof(CacheHeader) == SpatialMapFile::SectionAlignment, "The cache header layout is part of the format");
+
+	bool IsValid(CacheHeader const& header, uint64_t const size)
+	{
+		return std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+			header.version != 0 && header.version <= CacheVersion &&
+			header.mapSize <= size - sizeof(CacheHeader);
+	}
+
+	// a * b with row vectors, i.e. a first.
+	void Multiply(float const* const a, float const* const b, float* const result)
+	{
+		for (size_t r = 0; r < 4; r++)
+		{
+			for (size_t c = 0; c < 4; c++)
+			{
+				result[4 * r + c] = a[4 * r] * b[c] + a[4 * r + 1] * b[4 + c] + a[4 * r + 2] * b[8 + c] + a[4 * r + 3] * b[12 + c];
+			}
+		}
+	}
+
+	// The inverse of an affine transform, which the transforms between the coordinate systems
+	// of the perception APIs are.
+	void InvertAffine(float const* const m, float* const result)
+	{
+		// The 3x3 part by its adjugate, in double precision.
+		double const a = m[0], b = m[1], c = m[2];
+		double const d = m[4], e = m[5], f = m[6];
+		double const g = m[8], h = m[9], k = m[10];
+		double const det = a * (e * k - f * h) - b * (d * k - f * g) + c * (d * h - e * g);
+		double const s = det != 0. ? 1. / det : 0.;
+		double const inverse[9] = {
+			(e * k - f * h) * s, (c * h - b * k) * s, (b * f - c * e) * s,
+			(f * g - d * k) * s, (a * k - c * g) * s, (c * d - a * f) * s,
+			(d * h - e * g) * s, (b * g - a * h) * s, (a * e - b * d) * s
+		};
+		for (size_t r = 0; r < 3; r++)
+		{
+			for (size_t col = 0; col < 3; col++)
+			{
+				result[4 * r + col] = static_cast<float>(inverse[3 * r + col]);
+			}
+			result[4 * r + 3] = 0.f;
+		}
+		for (size_t col = 0; col < 3; col++)
+		{
+			result[12 + col] = static_cast<float>(-(m[12] * inverse[col] + m[13] * inverse[3 + col] + m[14] * inverse[6 + col]));
+		}
+		result[15] = 1.f;
+	}
+
+	void TransformPositions(std::vector<Vector3> const& source, float const* const m, std::vector<Vector3>& positions)
+	{
+		positions.resize(source.size());
+		for (size_t i = 0; i < source.size(); i++)
+		{
+			Vector3 const& p = source[i];
+			positions[i] = {
+				p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12],
+				p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13],
+				p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]
+			};
+		}
+	}
+}
+
+bool SurfaceCache::Write(std::string const& path, SurfaceDataSnapshot const& surfaces, std::vector<CacheTransform> const& transforms, uint32_t const anchorSave)
+{
+	std::unordered_map<int, CacheTransform const*> byId;
+	for (auto const& transform : transforms)
+	{
+		byId[transform.id] = &transform;
+	}
+
+	// The world-space positions of the export data are in the frame of the session that
+	// computed them, the cache stores them in its own. They are moved rather than computed
+	// from the mesh-space ones again, which keeps the corrections of denoising and ICP.
+	std::vector<std::vector<Vector3>> positions;
+	std::vector<SpatialMapSurface> mapSurfaces;
+	positions.reserve(surfaces.size());
+	mapSurfaces.reserve(surfaces.size());
+	for (auto const& data : surfaces)
+	{
+		auto const found = byId.find(data->id);
+		if (found == byId.end() || found->second->updateTime != data->updateTime || data->positionsNotTransformed.size() != data->positionsTransformed.size())
+		{
+			continue;
+		}
+
+		float worldToMesh[16];
+		float worldToCache[16];
+		InvertAffine(data->meshToWorld, worldToMesh);
+		Multiply(worldToMesh, found->second->meshToCache, worldToCache);
+		positions.emplace_back();
+		TransformPositions(data->positionsTransformed, worldToCache, positions.back());
+
+		// Without face normals, they are recomputed in the frame the surface is restored in.
+		SpatialMapSurface surface;
+		surface.id = data->id;
+		surface.updateTime = data->updateTime;
+		std::memcpy(surface.meshToWorld, found->second->meshToCache, sizeof(surface.meshToWorld));
+		surface.vertexPositionScale = data->vertexPositionScale;
+		surface.positions = positions.back().data();
+		surface.localPositions = data->positionsNotTransformed.data();
+		surface.vertexCount = data->positionsNotTransformed.size();
+		surface.indices = data->Indices();
+		mapSurfaces.push_back(surface);
+	}
+
+	CacheHeader header = {};
+	std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = CacheVersion;
+	header.anchorSave = anchorSave;
+	header.mapSize = SpatialMapFile::SerializedSize(mapSurfaces);
+
+	// Written next to the cache and moved over it, so that a failed write leaves the last
+	// cache and its anchor as they were.
+	std::string const temporaryPath = path + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+		if (!file || !SpatialMapFile::Write(file, mapSurfaces))
+		{
+			return false;
+		}
+		file.close();
+		if (file.fail())
+		{
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+	return !error;
+}
+
+bool SurfaceCache::ReadAnchorSave(std::string const& path, uint32_t& anchorSave)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	CacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		return false;
+	}
+	file.seekg(0, std::ios::end);
+	if (!IsValid(header, static_cast<uint64_t>(file.tellg())))
+	{
+		return false;
+	}
+	anchorSave = header.anchorSave;
+	return true;
+}
+
+bool SurfaceCache::Open(std::string const& path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_surfaces.clear();
+	m_mapSurfaces.clear();
+	m_statistics = {};
+	m_anchorSave = 0;
+	m_file.Close();
+	if (!m_file.Open(path) || m_file.Size() < sizeof(CacheHeader))
+	{
+		m_file.Close();
+		return false;
+	}
+
+	CacheHeader header;
+	std::memcpy(&header, m_file.Data(), sizeof(header));
+	if (!IsValid(header, m_file.Size()) ||
+		!SpatialMapFile::Parse(m_file.Data() + sizeof(CacheHeader), header.mapSize, m_mapSurfaces))
+	{
+		m_mapSurfaces.clear();
+		m_file.Close();
+		return false;
+	}
+	m_anchorSave = header.anchorSave;
+
+	for (size_t s = 0; s < m_mapSurfaces.size(); s++)
+	{
+		// Surfaces without mesh-space positions cannot be uploaded again.
+		if (m_mapSurfaces[s].localPositions != nullptr)
+		{
+			m_surfaces[m_mapSurfaces[s].id] = s;
+		}
+	}
+	m_statistics.surfaces = m_surfaces.size();
+	return true;
+}
+
+void SurfaceCache::Close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_surfaces.clear();
+	m_mapSurfaces.clear();
+	m_file.Close();
+}
+
+bool SurfaceCache::IsOpen() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return !m_mapSurfaces.empty();
+}
+
+size_t SurfaceCache::Validate(int const* const ids, size_t const count)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::unordered_set<int> const observed(ids, ids + count);
+	size_t dropped = 0;
+	for (auto it = m_surfaces.begin(); it != m_surfaces.end();)
+	{
+		if (observed.count(it->first) == 0)
+		{
+			it = m_surfaces.erase(it);
+			dropped++;
+		}
+		else
+		{
+			++it;
+		}
+	}
+	m_statistics.dropped += dropped;
+	return dropped;
+}
+
+std::shared_ptr<SurfaceData const> SurfaceCache::Take(int const id, int64_t const updateTime)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto const found = m_surfaces.find(id);
+	if (found == m_surfaces.end())
+	{
+		return nullptr;
+	}
+	SpatialMapSurface const& surface = m_mapSurfaces[found->second];
+	m_surfaces.erase(found);
+
+	if (surface.updateTime != updateTime)
+	{
+		m_statistics.stale++;
+		return nullptr;
+	}
+	m_statistics.restored++;
+
+	auto data = std::make_shared<SurfaceData>();
+	data->id = surface.id;
+	data->updateTime = surface.updateTime;
+	std::memcpy(data->meshToWorld, surface.meshToWorld, sizeof(data->meshToWorld));
+	data->vertexPositionScale = surface.vertexPositionScale;
+	data->positionsTransformed.assign(surface.positions, surface.positions + surface.vertexCount);
+	data->positionsNotTransformed.assign(surface.localPositions, surface.localPositions + surface.vertexCount);
+	if (surface.indices.is32Bit)
+	{
+		data->SetIndices(static_cast<uint32_t const*>(surface.indices.data), surface.indices.count);
+	}
+	else
+	{
+		data->SetIndices(static_cast<uint16_t const*>(surface.indices.data), surface.indices.count);
+	}
+	return data;
+}
+
+size_t SurfaceCache::Remaining() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_surfaces.size();
+}
+
+uint32_t SurfaceCache::AnchorSave() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_anchorSave;
+}
+
+SurfaceCacheStatistics SurfaceCache::Statistics() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_statistics;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "ExportPipeline.h"
+#include "MappedFile.h"
+#include "SpatialMapFile.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct SurfaceCacheStatistics
+	{
+		size_t surfaces = 0;
+
+		// Taken with the update time the observer reports.
+		size_t restored = 0;
+
+		// Taken with a newer update time, these go through the full processing.
+		size_t stale = 0;
+
+		// Not among the surfaces of the observer any more.
+		size_t dropped = 0;
+	};
+
+	// The surfaces of the last session, for a warm start of the next one. The cache is an
+	// uncompressed SpatialMapFile whose world is a coordinate system that outlives the
+	// session, e.g. a persisted SpatialAnchor, because the observer's world frame does not.
+	// Its header names the save of that anchor, so that every save can store its own anchor
+	// and a cache is never paired with the anchor of a save that did not write it.
+	//
+	// Open() only maps the file and indexes the surfaces by id. A surface is copied out of
+	// the mapping when the observer reports it again with the same update time, so that it
+	// can be restored without recomputing the mesh, and every surface is taken at most once.
+	// All methods are safe to call from any thread.
+	class SurfaceCache
+	{
+	public:
+		// Writes the surfaces that have a transform for their current update. The positions
+		// are stored in the cache's coordinate system, that of the anchor of anchorSave. The
+		// file is replaced only once it is written completely.
+		static bool Write(std::string const& path, SurfaceDataSnapshot const& surfaces, std::vector<CacheTransform> const& transforms, uint32_t anchorSave = 0);
+
+		// The anchor save of the cache at the path without mapping it. False for a missing or
+		// invalid file.
+		static bool ReadAnchorSave(std::string const& path, uint32_t& anchorSave);
+
+		// Returns false for a missing or invalid file, the app then starts cold.
+		bool Open(std::string const& path);
+		void Close();
+
+		// Whether an opened cache had any surfaces.
+		bool IsOpen() const;
+
+		// The save whose anchor the positions of the opened cache are relative to.
+		uint32_t AnchorSave() const;
+
+		// Drops the surfaces that are not among the ids the observer reports. Returns how many.
+		size_t Validate(int const* ids, size_t count);
+
+		// The cached surface in the cache's coordinate system if it was saved with this update
+		// time, null otherwise.
+		std::shared_ptr<SurfaceData const> Take(int id, int64_t updateTime);
+
+		// Surfaces not taken or dropped yet.
+		size_t Remaining() const;
+
+		SurfaceCacheStatistics Statistics() const;
+
+	private:
+		mutable std::mutex m_mutex;
+		MappedFile m_file;
+		std::vector<SpatialMapSurface> m_mapSurfaces;
+		uint32_t m_anchorSave = 0;
+		std::unordered_map<int, size_t> m_surfaces;
+		SurfaceCacheStatistics m_statistics;
+	};
+}
@@ -0,0 +1,258 @@
+#include "SurfaceIngest.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace SpatialMapping;
+
+void SurfaceIngest::Clear()
+{
+	m_positionsTransformed.clear();
+	m_positionsNotTransformed.clear();
+	m_faceNormals.clear();
+	m_indices16.clear();
+	m_indices32.clear();
+	m_floaterFaces.clear();
+	m_attributes.clear();
+	std::atomic_store(&m_spatialIndex, std::shared_ptr<SpatialIndex const>());
+	std::atomic_store(&m_exportData, std::shared_ptr<SurfaceData const>());
+	std::atomic_store(&m_clusters, std::shared_ptr<MeshClusters const>());
+}
+
+size_t SurfaceIngest::CacheBytes() const
+{
+	size_t bytes = (m_positionsTransformed.capacity() + m_positionsNotTransformed.capacity() + m_faceNormals.capacity()) * sizeof(Vector3) +
+		m_indices16.capacity() * sizeof(uint16_t) + m_indices32.capacity() * sizeof(uint32_t) + m_floaterFaces.capacity();
+	for (auto const& channel : m_attributes)
+	{
+		bytes += channel.values.capacity() * sizeof(float);
+	}
+	return bytes;
+}
+
+void SurfaceIngest::ReportMemory(SurfaceMemory& memory) const
+{
+	auto const exportData = GetExportData();
+	auto const spatialIndex = GetSpatialIndex();
+	auto const clusters = GetClusters();
+	memory.Set(MemoryCategory::CpuCaches, CacheBytes());
+	memory.Set(MemoryCategory::ExportData, exportData ? exportData->Bytes() : 0);
+	memory.Set(MemoryCategory::SpatialIndex, spatialIndex ? spatialIndex->Bytes() : 0);
+	memory.Set(MemoryCategory::Clusters, clusters ? clusters->Bytes() : 0);
+}
+
+void SurfaceIngest::Restore(SurfaceData const& cached, float const* const cacheToWorld, IngestOptions const& options)
+{
+	PROFILE_PHASE(Ingest);
+
+	// meshToWorld = meshToCache * cacheToWorld, with row vectors.
+	float const* const a = cached.meshToWorld;
+	float const* const b = cacheToWorld;
+	for (size_t r = 0; r < 4; r++)
+	{
+		for (size_t c = 0; c < 4; c++)
+		{
+			m_meshToWorld[4 * r + c] = a[4 * r] * b[c] + a[4 * r + 1] * b[4 + c] + a[4 * r + 2] * b[8 + c] + a[4 * r + 3] * b[12 + c];
+		}
+	}
+	m_positionScale = cached.vertexPositionScale;
+
+	float const* const m = cacheToWorld;
+	m_positionsNotTransformed = cached.positionsNotTransformed;
+	m_positionsTransformed.resize(cached.positionsTransformed.size());
+	for (size_t i = 0; i < cached.positionsTransformed.size(); i++)
+	{
+		Vector3 const& p = cached.positionsTransformed[i];
+		m_positionsTransformed[i] = {
+			p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12],
+			p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13],
+			p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]
+		};
+	}
+
+	// The cached indices are already reversed and without floaters. A cache of a session
+	// that stored them in 32 bit is narrowed like an update.
+	if (!cached.indices16.empty())
+	{
+		IndexStorage(cached.indices16.data()) = cached.indices16;
+	}
+	else if (FitsIn16BitIndices(cached.positionsTransformed.size()))
+	{
+		ConvertIndices(cached.indices32.data(), cached.indices32.size(), IndexStorage(static_cast<uint16_t const*>(nullptr)));
+	}
+	else
+	{
+		IndexStorage(cached.indices32.data()) = cached.indices32;
+	}
+
+	// The flags are not cached, but the components of the cached triangles are the same.
+	m_floaterFaces.clear();
+	if (options.filterFloaters && !options.removeFloaters)
+	{
+		ComponentFilterResult floaters;
+		VisitIndices(Indices(), [&](auto const* const typed)
+			{
+				m_components.Label(m_positionsTransformed.data(), m_positionsTransformed.size(), typed, Indices().count);
+			});
+		m_components.FlagFloaters(options.floaters, m_floaterFaces, floaters);
+	}
+
+	ComputeFaceNormals(Indices());
+
+	SurfaceUpdate update;
+	update.id = cached.id;
+	update.updateTime = cached.updateTime;
+	Publish(update, options);
+}
+
+void SurfaceIngest::DecodePositions(SurfaceUpdate const& update)
+{
+	std::memcpy(m_meshToWorld, update.meshToWorld, sizeof(m_meshToWorld));
+	m_positionScale = update.vertexPositionScale;
+
+	float const* const m = m_meshToWorld;
+	Vector3 const scale = m_positionScale;
+
+	m_positionsTransformed.resize(update.vertexCount);
+	m_positionsNotTransformed.resize(update.vertexCount);
+	for (size_t i = 0; i < update.vertexCount; i++)
+	{
+		// Like XMLoadShortN4, which maps -32768 and -32767 both to -1.
+		int16_t const* const q = update.positions + i * 4;
+		float const x = std::max(static_cast<float>(q[0]) * (1.f / 32767.f), -1.f);
+		float const y = std::max(static_cast<float>(q[1]) * (1.f / 32767.f), -1.f);
+		float const z = std::max(static_cast<float>(q[2]) * (1.f / 32767.f), -1.f);
+
+		// Scale and transform, in the order of the float4x4 transform() of the app.
+		Vector3 const p{ x * scale.x, y * scale.y, z * scale.z };
+		m_positionsNotTransformed[i] = p;
+		m_positionsTransformed[i] = {
+			p.x * m[0] + p.y * m[4] + p.z * m[8] + m[12],
+			p.x * m[1] + p.y * m[5] + p.z * m[9] + m[13],
+			p.x * m[2] + p.y * m[6] + p.z * m[10] + m[14]
+		};
+	}
+}
+
+void SurfaceIngest::ComputeFaceNormals(IndexView const& view)
+{
+	VisitIndices(view, [&](auto const* const indices)
+		{
+			ComputeFaceNormals(indices, view.count);
+		});
+}
+
+template <typename TIndex>
+void SurfaceIngest::ComputeFaceNormals(TIndex const* const indices, size_t const indexCount)
+{
+	// The exports have always been written with this cross product, whose y component has
+	// the wrong sign, and normalized in double precision. Kept as is so that new exports
+	// compare with the captures in Data/.
+	m_faceNormals.resize(indexCount / 3);
+	for (size_t i = 0, f = 0; i + 2 < indexCount; i += 3, f++)
+	{
+		Vector3 const& v1 = m_positionsTransformed[indices[i]];
+		Vector3 const& v2 = m_positionsTransformed[indices[i + 1]];
+		Vector3 const& v3 = m_positionsTransformed[indices[i + 2]];
+
+		Vector3 const e1 = v2 - v1;
+		Vector3 const e2 = v3 - v1;
+		Vector3 const c{
+			e1.y * e2.z - e1.z * e2.y,
+			e1.x * e2.z - e1.z * e2.x,
+			e1.x * e2.y - e1.y * e2.x
+		};
+
+		double const l = std::sqrt(std::pow(c.x, 2) + std::pow(c.y, 2) + std::pow(c.z, 2));
+		m_faceNormals[f] = { static_cast<float>(c.x / l), static_cast<float>(c.y / l), static_cast<float>(c.z / l) };
+	}
+}
+
+// Aligns the world-space positions of this update to the other surfaces of the map. The
+// surfaces' coordinate systems drift relative to each other, which shows up as seams and
+// doubled walls in the exported map.
+IcpResult SurfaceIngest::CorrectDrift(int const surfaceId, IngestOptions const& options)
+{
+	auto const map = options.spatialMap->Snapshot();
+	if (map->surfaces.empty())
+	{
+		return {};
+	}
+
+	IcpResult result = AlignToMap(m_positionsTransformed.data(), m_positionsTransformed.size(), *map, surfaceId, options.icp);
+
+	// A surface that does not overlap enough of the map cannot be aligned reliably, and an
+	// alignment that did not converge is more likely wrong than the drift it would remove.
+	if (result.converged)
+	{
+		ApplyTransform(result.transform, m_positionsTransformed.data(), m_positionsTransformed.size());
+	}
+	return result;
+}
+
+void SurfaceIngest::Publish(SurfaceUpdate const& update, IngestOptions const& options)
+{
+	IndexView const indices = Indices();
+
+	if (options.buildSpatialIndex)
+	{
+		// Vertex normals make this surface a target for the drift correction of the others.
+		std::vector<Vector3> vertexNormals;
+		if (options.correctDrift)
+		{
+			VisitIndices(indices, [&](auto const* const typed)
+				{
+					ComputeVertexNormals(m_positionsTransformed.data(), m_positionsTransformed.size(), typed, indices.count, vertexNormals);
+				});
+		}
+
+		auto spatialIndex = std::make_shared<SpatialIndex>();
+		spatialIndex->Build(
+			m_positionsTransformed.data(),
+			m_positionsTransformed.size(),
+			options.spatialIndexCellSize,
+			vertexNormals.empty() ? nullptr : vertexNormals.data());
+		std::atomic_store(&m_spatialIndex, std::shared_ptr<SpatialIndex const>(std::move(spatialIndex)));
+	}
+
+	if (options.buildClusters)
+	{
+		auto clusters = std::make_shared<MeshClusters>();
+		m_clusterBuilder.Build(m_positionsTransformed.data(), m_positionsTransformed.size(), indices, options.clusters, *clusters);
+		std::atomic_store(&m_clusters, std::shared_ptr<MeshClusters const>(std::move(clusters)));
+	}
+
+	size_t const computed = options.attributes.size();
+	m_attributes.resize(computed + (m_floaterFaces.empty() ? 0 : 1));
+	for (size_t a = 0; a < computed; a++)
+	{
+		ComputeAttribute(options.attributes[a], update.id, m_positionsTransformed.data(), m_positionsTransformed.size(), indices, m_attributes[a]);
+	}
+
+	// Flagged floaters reach the exports as a face channel of 1 for their triangles.
+	if (!m_floaterFaces.empty())
+	{
+		AttributeChannel& channel = m_attributes[computed];
+		channel.name = FloaterAttributeName;
+		channel.domain = AttributeDomain::Face;
+		channel.minimum = 0.f;
+		channel.maximum = 1.f;
+		channel.values.assign(m_floaterFaces.begin(), m_floaterFaces.end());
+	}
+
+	// Copy of the caches for exports on other threads, which must not see them change.
+	auto exportData = std::make_shared<SurfaceData>();
+	exportData->id = update.id;
+	exportData->updateTime = update.updateTime;
+	std::memcpy(exportData->meshToWorld, m_meshToWorld, sizeof(exportData->meshToWorld));
+	exportData->vertexPositionScale = m_positionScale;
+	exportData->positionsTransformed = m_positionsTransformed;
+	exportData->positionsNotTransformed = m_positionsNotTransformed;
+	exportData->faceNormals = m_faceNormals;
+	exportData->attributes = m_attributes;
+	VisitIndices(indices, [&](auto const* const typed)
+		{
+			exportData->SetIndices(typed, indices.count);
+		});
+	std::atomic_store(&m_exportData, std::shared_ptr<SurfaceData const>(std::move(exportData)));
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "ExportPipeline.h"
+#include "FrameProfiler.h"
+#include "Icp.h"
+#include "MeshAttributes.h"
+#include "MeshClusters.h"
+#include "MeshComponents.h"
+#include "MeshDenoiser.h"
+#include "MeshNormals.h"
+#include "MeshTypes.h"
+#include "MemoryAccounting.h"
+#include "Metrics.h"
+#include "SpatialIndex.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// One surface update as the observer delivers it: the buffers of a SpatialSurfaceMesh and
+	// the transform of its coordinate system to the world at the time it was processed.
+	struct SurfaceUpdate
+	{
+		uint8_t guid[16] = {};
+
+		// Guid::GetHashCode(), the key of the surface in the app's collections.
+		int id = 0;
+
+		// SpatialSurfaceInfo::UpdateTime, in 100 ns ticks.
+		int64_t updateTime = 0;
+
+		// Row-major like float4x4, points are row vectors.
+		float meshToWorld[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+		Vector3 vertexPositionScale{ 1.f, 1.f, 1.f };
+
+		// SNORM16 x, y, z, w per vertex and, if present, SNORM8 x, y, z, w normals.
+		int16_t const* positions = nullptr;
+		int8_t const* normals = nullptr;
+		size_t vertexCount = 0;
+
+		// In the observer's winding, 16 or 32 bit like the observer's TriangleIndexFormat.
+		IndexView indices;
+	};
+
+	// The attribute channel of the faces of flagged floaters, see IngestOptions::removeFloaters.
+	char const* const FloaterAttributeName = "floater";
+
+	// What SurfaceMesh does with an update besides uploading it, mirroring Common/Settings.h.
+	struct IngestOptions
+	{
+		// Floaters are either removed or flagged in an attribute channel of the export data.
+		bool filterFloaters = false;
+		bool removeFloaters = true;
+		ComponentFilterOptions floaters;
+
+		bool denoise = false;
+		DenoiseOptions denoising;
+
+		// Aligns the update to the other surfaces of the map, which needs their indices.
+		bool correctDrift = false;
+		IcpOptions icp;
+		SpatialIndexCollection const* spatialMap = nullptr;
+
+		bool buildSpatialIndex = true;
+		float spatialIndexCellSize = 0.05f;
+
+		// Partitions the world-space triangles into clusters with culling bounds.
+		bool buildClusters = false;
+		ClusterOptions clusters;
+
+		// Computed on the world-space positions after all other processing and published
+		// with the export data.
+		std::vector<AttributeKind> attributes;
+	};
+
+	struct IngestResult
+	{
+		// Of the observer's buffer after floater removal.
+		size_t indexCount = 0;
+
+		ComponentFilterResult floaters;
+		DenoiseResult denoising;
+
+		// Empty iterations if the drift correction did not run.
+		IcpResult icp;
+	};
+
+	// Replaces reversed with the triangles in the opposite winding, from the observer's to
+	// the one of the exports, optionally narrowed to 16 bit, see FitsIn16BitIndices().
+	template <typename TIndex, typename TReversed = TIndex>
+	void ReverseWinding(TIndex const* const indices, size_t const indexCount, std::vector<TReversed>& reversed)
+	{
+		reversed.resize(indexCount - indexCount % 3);
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			reversed[i] = static_cast<TReversed>(indices[i + 2]);
+			reversed[i + 1] = static_cast<TReversed>(indices[i + 1]);
+			reversed[i + 2] = static_cast<TReversed>(indices[i]);
+		}
+	}
+
+	// The CPU side of a SurfaceMesh update: decodes the SNORM16 positions into the caches of
+	// scaled mesh-space and world-space positions, removes or flags floaters, reverses the
+	// winding into 16 bit indices unless the surface has too many vertices, denoises, corrects
+	// drift, computes the face normals, and publishes a spatial index, the clusters and the
+	// immutable export data. SurfaceMesh and the replay driver of the tools share it, so
+	// recorded updates go through exactly the code the headset runs.
+	class SurfaceIngest
+	{
+	public:
+		// Removing floaters compacts indices in place, so that they are neither uploaded nor
+		// cached. Returns the state of the update as in IngestResult. Publishes unconditionally,
+		// the caller drops updates older than the last one it ingested.
+		template <typename TIndex>
+		IngestResult Ingest(SurfaceUpdate const& update, TIndex* indices, size_t indexCount, IngestOptions const& options);
+
+		// Fills the caches from a surface of a SurfaceCache instead of an observer update, see
+		// Processing/SurfaceCache.h. The cached mesh-space positions are kept, the world-space
+		// ones are moved by cacheToWorld from the cache's coordinate system into the current
+		// world. Nothing but the face normals, the attributes and the published data is
+		// recomputed: the cached surface was processed when it was saved.
+		void Restore(SurfaceData const& cached, float const* cacheToWorld, IngestOptions const& options);
+
+		// Drops the caches, the published spatial index and the clusters.
+		void Clear();
+
+		// Allocated by the caches.
+		size_t CacheBytes() const;
+
+		// Sets the caches, the published export data, the spatial index and the clusters of the
+		// memory.
+		void ReportMemory(SurfaceMemory& memory) const;
+
+		std::vector<Vector3> const& PositionsTransformed() const { return m_positionsTransformed; }
+		std::vector<Vector3> const& PositionsNotTransformed() const { return m_positionsNotTransformed; }
+		std::vector<Vector3> const& FaceNormals() const { return m_faceNormals; }
+		std::vector<AttributeChannel> const& Attributes() const { return m_attributes; }
+		IndexView Indices() const
+		{
+			return m_indices16.empty() ? IndexView(m_indices32.data(), m_indices32.size()) : IndexView(m_indices16.data(), m_indices16.size());
+		}
+
+		// Only filled when floaters are flagged instead of removed, one entry per face. Published
+		// with the attributes as the face channel FloaterAttributeName.
+		std::vector<uint8_t> const& FloaterFaces() const { return m_floaterFaces; }
+
+		float const* MeshToWorld() const { return m_meshToWorld; }
+		Vector3 const& PositionScale() const { return m_positionScale; }
+
+		// Replaced atomically with every update, so readers never need a lock.
+		std::shared_ptr<SpatialIndex const> GetSpatialIndex() const { return std::atomic_load(&m_spatialIndex); }
+		std::shared_ptr<SurfaceData const> GetExportData() const { return std::atomic_load(&m_exportData); }
+		std::shared_ptr<MeshClusters const> GetClusters() const { return std::atomic_load(&m_clusters); }
+
+	private:
+		std::vector<uint16_t>& IndexStorage(uint16_t const*) { m_indices32.clear(); return m_indices16; }
+		std::vector<uint32_t>& IndexStorage(uint32_t const*) { m_indices16.clear(); return m_indices32; }
+
+		// The caches in the reversed winding of the exports, in the narrowest width for the vertices.
+		template <typename TIndex>
+		void ReverseIntoStorage(TIndex const* indices, size_t indexCount, size_t vertexCount);
+
+		void DecodePositions(SurfaceUpdate const& update);
+		void ComputeFaceNormals(IndexView const& view);
+		template <typename TIndex>
+		void ComputeFaceNormals(TIndex const* indices, size_t indexCount);
+		IcpResult CorrectDrift(int surfaceId, IngestOptions const& options);
+		void Publish(SurfaceUpdate const& update, IngestOptions const& options);
+
+		std::vector<Vector3> m_positionsTransformed;
+		std::vector<Vector3> m_positionsNotTransformed;
+		std::vector<Vector3> m_faceNormals;
+		std::vector<uint16_t> m_indices16;
+		std::vector<uint32_t> m_indices32;
+		std::vector<uint8_t> m_floaterFaces;
+		std::vector<AttributeChannel> m_attributes;
+
+		// The transform and scale the cached positions were computed with.
+		float m_meshToWorld[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+		Vector3 m_positionScale{ 1.f, 1.f, 1.f };
+
+		MeshComponents m_components;
+		MeshDenoiser m_denoiser;
+		MeshClusterBuilder m_clusterBuilder;
+
+		std::shared_ptr<SpatialIndex const> m_spatialIndex;
+		std::shared_ptr<SurfaceData const> m_exportData;
+		std::shared_ptr<MeshClusters const> m_clusters;
+	};
+
+	template <typename TIndex>
+	IngestResult SurfaceIngest::Ingest(SurfaceUpdate const& update, TIndex* const indices, size_t indexCount, IngestOptions const& options)
+	{
+		PROFILE_PHASE(Ingest);
+
+		IngestResult result;
+		DecodePositions(update);
+
+		if (options.filterFloaters)
+		{
+			m_components.Label(m_positionsTransformed.data(), m_positionsTransformed.size(), indices, indexCount);
+			if (options.removeFloaters)
+			{
+				indexCount = m_components.RemoveFloaters(indices, indexCount, options.floaters, result.floaters);
+				m_floaterFaces.clear();
+			}
+			else
+			{
+				m_components.FlagFloaters(options.floaters, m_floaterFaces, result.floaters);
+			}
+		}
+		result.indexCount = indexCount;
+
+		// Reverse index order
+		ReverseIntoStorage(indices, indexCount, update.vertexCount);
+
+		if (options.denoise)
+		{
+			VisitIndices(Indices(), [&](auto const* const cached)
+				{
+					result.denoising = m_denoiser.Denoise(m_positionsTransformed.data(), m_positionsTransformed.size(), cached, Indices().count, options.denoising);
+				});
+		}
+
+		if (options.correctDrift && options.spatialMap != nullptr)
+		{
+			result.icp = CorrectDrift(update.id, options);
+		}
+
+		ComputeFaceNormals(Indices());
+		Publish(update, options);
+
+		SurfaceMetrics& metrics = SurfaceMetrics::Instance();
+		metrics.updatesProcessed.Add();
+		metrics.verticesProcessed.Add(update.vertexCount);
+		metrics.trianglesProcessed.Add(indexCount / 3);
+		return result;
+	}
+
+	template <typename TIndex>
+	void SurfaceIngest::ReverseIntoStorage(TIndex const* const indices, size_t const indexCount, size_t const vertexCount)
+	{
+		if (sizeof(TIndex) > sizeof(uint16_t) && !FitsIn16BitIndices(vertexCount))
+		{
+			ReverseWinding(indices, indexCount, IndexStorage(static_cast<uint32_t const*>(nullptr)));
+		}
+		else
+		{
+			ReverseWinding(indices, indexCount, IndexStorage(static_cast<uint16_t const*>(nullptr)));
+		}
+	}
+}
@@ -0,0 +1,296 @@
+#include "SurfaceRecording.h"
+
+#include <cstring>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	char const Magic[8] = { 'S', 'U', 'R', 'F', 'R', 'E', 'C', '\0' };
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t reserved;
+	};
+
+	// The size is that of the payload after this header, without the padding.
+	struct RecordHeader
+	{
+		uint32_t kind;
+		uint32_t size;
+		int64_t captureTime;
+	};
+
+	uint32_t const HasNormals = 1;
+	uint32_t const Indices32Bit = 2;
+
+	// Followed by the positions, the normals if present, and the indices.
+	struct UpdateHeader
+	{
+		uint8_t guid[16];
+		int64_t updateTime;
+		int32_t id;
+		uint32_t flags;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		float meshToWorld[16];
+		float vertexPositionScale[3];
+		uint32_t reserved;
+	};
+
+	static_assert(sizeof(FileHeader) == 16, "The file header layout is part of the format");
+	static_assert(sizeof(RecordHeader) == 16, "The record header layout is part of the format");
+	static_assert(sizeof(UpdateHeader) == 120, "The update header layout is part of the format");
+
+	size_t Pad(size_t const bytes)
+	{
+		return (bytes + 7) & ~static_cast<size_t>(7);
+	}
+
+	void Append(std::vector<char>& payload, void const* data, size_t const bytes)
+	{
+		char const* const p = static_cast<char const*>(data);
+		payload.insert(payload.end(), p, p + bytes);
+	}
+}
+
+bool SurfaceRecorder::Open(std::string const& path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_file.close();
+	m_file.clear();
+	m_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_file)
+	{
+		return false;
+	}
+
+	FileHeader header = {};
+	std::memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	m_file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	m_bytes = sizeof(header);
+	m_start = std::chrono::steady_clock::now();
+	return !m_file.fail();
+}
+
+void SurfaceRecorder::Close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file.close();
+}
+
+bool SurfaceRecorder::IsOpen() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_file.is_open();
+}
+
+uint64_t SurfaceRecorder::Bytes() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bytes;
+}
+
+std::chrono::nanoseconds SurfaceRecorder::Elapsed() const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+}
+
+void SurfaceRecorder::RecordUpdate(SurfaceUpdate const& update)
+{
+	RecordUpdate(update, Elapsed());
+}
+
+void SurfaceRecorder::RecordObserved(int32_t const* const ids, size_t const count)
+{
+	RecordObserved(ids, count, Elapsed());
+}
+
+void SurfaceRecorder::RecordUpdate(SurfaceUpdate const& update, std::chrono::nanoseconds const captureTime)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_file.is_open())
+	{
+		return;
+	}
+
+	UpdateHeader header = {};
+	std::memcpy(header.guid, update.guid, sizeof(header.guid));
+	header.updateTime = update.updateTime;
+	header.id = update.id;
+	header.flags = (update.normals ? HasNormals : 0) | (update.indices.is32Bit ? Indices32Bit : 0);
+	header.vertexCount = static_cast<uint32_t>(update.vertexCount);
+	header.indexCount = static_cast<uint32_t>(update.indices.count);
+	std::memcpy(header.meshToWorld, update.meshToWorld, sizeof(header.meshToWorld));
+	header.vertexPositionScale[0] = update.vertexPositionScale.x;
+	header.vertexPositionScale[1] = update.vertexPositionScale.y;
+	header.vertexPositionScale[2] = update.vertexPositionScale.z;
+
+	m_payload.clear();
+	Append(m_payload, &header, sizeof(header));
+	Append(m_payload, update.positions, update.vertexCount * 4 * sizeof(int16_t));
+	if (update.normals)
+	{
+		Append(m_payload, update.normals, update.vertexCount * 4 * sizeof(int8_t));
+	}
+	Append(m_payload, update.indices.data, update.indices.count * (update.indices.is32Bit ? 4 : 2));
+	WriteRecord(RecordKind::Update, m_payload, captureTime);
+}
+
+void SurfaceRecorder::RecordObserved(int32_t const* const ids, size_t const count, std::chrono::nanoseconds const captureTime)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_file.is_open())
+	{
+		return;
+	}
+
+	uint32_t const count32 = static_cast<uint32_t>(count);
+	m_payload.clear();
+	Append(m_payload, &count32, sizeof(count32));
+	Append(m_payload, ids, count * sizeof(int32_t));
+	WriteRecord(RecordKind::Observed, m_payload, captureTime);
+}
+
+void SurfaceRecorder::WriteRecord(RecordKind const kind, std::vector<char> const& payload, std::chrono::nanoseconds const captureTime)
+{
+	RecordHeader header = {};
+	header.kind = static_cast<uint32_t>(kind);
+	header.size = static_cast<uint32_t>(payload.size());
+	header.captureTime = captureTime.count();
+
+	char const zeros[8] = {};
+	size_t const padding = Pad(payload.size()) - payload.size();
+	m_file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	m_file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+	m_file.write(zeros, static_cast<std::streamsize>(padding));
+
+	// Whole records reach the file, so a recording cut off by the app being suspended loses
+	// at most the one being written.
+	m_file.flush();
+	m_bytes += sizeof(header) + payload.size() + padding;
+}
+
+bool SurfaceRecording::Open(std::string const& path)
+{
+	Close();
+	if (!m_file.Open(path) || m_file.Size() < sizeof(FileHeader))
+	{
+		return false;
+	}
+
+	char const* const data = m_file.Data();
+	size_t const size = m_file.Size();
+
+	FileHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version == 0 || header.version > SurfaceRecorder::Version)
+	{
+		Close();
+		return false;
+	}
+
+	size_t offset = sizeof(FileHeader);
+	while (offset < size)
+	{
+		if (size - offset < sizeof(RecordHeader))
+		{
+			break;
+		}
+		RecordHeader record;
+		std::memcpy(&record, data + offset, sizeof(record));
+		char const* const payload = data + offset + sizeof(RecordHeader);
+		if (size - offset - sizeof(RecordHeader) < record.size)
+		{
+			break;
+		}
+
+		RecordedEvent event;
+		event.captureTime = std::chrono::nanoseconds(record.captureTime);
+		if (record.kind == static_cast<uint32_t>(RecordKind::Update))
+		{
+			if (record.size < sizeof(UpdateHeader))
+			{
+				break;
+			}
+			auto const& update = *reinterpret_cast<UpdateHeader const*>(payload);
+			bool const hasNormals = (update.flags & HasNormals) != 0;
+			bool const is32Bit = (update.flags & Indices32Bit) != 0;
+			uint64_t const positionBytes = static_cast<uint64_t>(update.vertexCount) * 4 * sizeof(int16_t);
+			uint64_t const normalBytes = hasNormals ? static_cast<uint64_t>(update.vertexCount) * 4 : 0;
+			uint64_t const indexBytes = static_cast<uint64_t>(update.indexCount) * (is32Bit ? 4 : 2);
+			if (sizeof(UpdateHeader) + positionBytes + normalBytes + indexBytes != record.size)
+			{
+				break;
+			}
+
+			event.kind = RecordKind::Update;
+			auto& surface = event.update;
+			std::memcpy(surface.guid, update.guid, sizeof(surface.guid));
+			surface.id = update.id;
+			surface.updateTime = update.updateTime;
+			std::memcpy(surface.meshToWorld, update.meshToWorld, sizeof(surface.meshToWorld));
+			surface.vertexPositionScale = { update.vertexPositionScale[0], update.vertexPositionScale[1], update.vertexPositionScale[2] };
+			surface.vertexCount = update.vertexCount;
+
+			char const* p = payload + sizeof(UpdateHeader);
+			surface.positions = reinterpret_cast<int16_t const*>(p);
+			p += positionBytes;
+			if (hasNormals)
+			{
+				surface.normals = reinterpret_cast<int8_t const*>(p);
+				p += normalBytes;
+			}
+			surface.indices = is32Bit
+				? IndexView(reinterpret_cast<uint32_t const*>(p), update.indexCount)
+				: IndexView(reinterpret_cast<uint16_t const*>(p), update.indexCount);
+		}
+		else if (record.kind == static_cast<uint32_t>(RecordKind::Observed))
+		{
+			uint32_t count = 0;
+			if (record.size < sizeof(count))
+			{
+				break;
+			}
+			std::memcpy(&count, payload, sizeof(count));
+			if (sizeof(count) + static_cast<uint64_t>(count) * sizeof(int32_t) != record.size)
+			{
+				break;
+			}
+			event.kind = RecordKind::Observed;
+			event.observedIds = reinterpret_cast<int32_t const*>(payload + sizeof(count));
+			event.observedCount = count;
+		}
+		else
+		{
+			break;
+		}
+
+		m_events.push_back(event);
+		offset += sizeof(RecordHeader) + Pad(record.size);
+	}
+
+	m_truncated = offset < size;
+	return true;
+}
+
+void SurfaceRecording::Close()
+{
+	m_events.clear();
+	m_truncated = false;
+	m_file.Close();
+}
+
+size_t SurfaceRecording::UpdateCount() const
+{
+	size_t count = 0;
+	for (auto const& event : m_events)
+	{
+		count += event.kind == RecordKind::Update ? 1 : 0;
+	}
+	return count;
+}
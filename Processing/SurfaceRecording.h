@@ -0,0 +1,102 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "SurfaceIngest.h"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	enum class RecordKind : uint32_t
+	{
+		// A SurfaceUpdate with its raw buffers.
+		Update = 1,
+
+		// The ids of the surfaces the observer reported in one OnSurfacesChanged.
+		Observed = 2
+	};
+
+	// One record of a recording. For updates the buffers of update point into the mapped file.
+	struct RecordedEvent
+	{
+		RecordKind kind = RecordKind::Update;
+
+		// Since the recording started.
+		std::chrono::nanoseconds captureTime{ 0 };
+
+		SurfaceUpdate update;
+
+		int32_t const* observedIds = nullptr;
+		size_t observedCount = 0;
+	};
+
+	// Writes what the surface observer delivers, so that a session on the headset can be
+	// replayed through SurfaceIngest on any machine:
+	//
+	//   header | record | record | ...
+	//
+	// Every record starts with its kind, its size and the time it was captured, and is padded
+	// to 8 bytes so that the arrays of a mapped recording can be read in place. Updates keep
+	// the SNORM16 positions, SNORM8 normals and indices exactly as the observer produced them,
+	// before any processing. All values are little-endian.
+	//
+	// Records are appended as they happen. A recording cut off by the app being suspended is
+	// still valid up to its last complete record.
+	class SurfaceRecorder
+	{
+	public:
+		static uint32_t const Version = 1;
+
+		bool Open(std::string const& path);
+		void Close();
+		bool IsOpen() const;
+
+		// Safe to call from any thread while the recorder is open. The capture time is the
+		// time since Open().
+		void RecordUpdate(SurfaceUpdate const& update);
+		void RecordObserved(int32_t const* ids, size_t count);
+
+		// With the capture time given, for recordings synthesized from exports.
+		void RecordUpdate(SurfaceUpdate const& update, std::chrono::nanoseconds captureTime);
+		void RecordObserved(int32_t const* ids, size_t count, std::chrono::nanoseconds captureTime);
+
+		uint64_t Bytes() const;
+
+	private:
+		std::chrono::nanoseconds Elapsed() const;
+		void WriteRecord(RecordKind kind, std::vector<char> const& payload, std::chrono::nanoseconds captureTime);
+
+		mutable std::mutex m_mutex;
+		std::ofstream m_file;
+		std::chrono::steady_clock::time_point m_start;
+		uint64_t m_bytes = 0;
+		std::vector<char> m_payload;
+	};
+
+	// A mapped recording. Open() validates every record and stops at the first one that is
+	// incomplete or inconsistent.
+	class SurfaceRecording
+	{
+	public:
+		bool Open(std::string const& path);
+		void Close();
+
+		std::vector<RecordedEvent> const& Events() const { return m_events; }
+
+		// Whether the file ends with something that is not a complete record.
+		bool IsTruncated() const { return m_truncated; }
+
+		size_t UpdateCount() const;
+		uint64_t Bytes() const { return m_file.Size(); }
+
+	private:
+		MappedFile m_file;
+		std::vector<RecordedEvent> m_events;
+		bool m_truncated = false;
+	};
+}
@@ -0,0 +1,285 @@
+#include "SurfaceTrace.h"
+
+#include "Json.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+using namespace SpatialMapping;
+
+namespace
+{
+	// Small ids in the order the threads first record, the trace viewers sort them.
+	uint32_t ThreadId()
+	{
+		static std::atomic<uint32_t> next{ 1 };
+		thread_local uint32_t const id = next.fetch_add(1, std::memory_order_relaxed);
+		return id;
+	}
+
+	struct AsyncEvent
+	{
+		TraceClock::time_point time;
+		bool isEnd = false;
+		char const* name = nullptr;
+	};
+
+	class TraceWriter
+	{
+	public:
+		explicit TraceWriter(TraceClock::time_point const start) :
+			m_start(start)
+		{
+			m_text = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			m_text += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"SpatialMapping\"}}";
+		}
+
+		std::string const& Finish()
+		{
+			m_text += "\n]}\n";
+			return m_text;
+		}
+
+		void ThreadName(uint32_t const thread)
+		{
+			char text[160];
+			std::snprintf(text, sizeof(text), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}", thread, thread);
+			m_text += text;
+		}
+
+		// The execution of a stage on its thread.
+		void Complete(TraceSpan const& span)
+		{
+			Begin(span.name, "X", span.start);
+			char text[256];
+			std::snprintf(text, sizeof(text), ",\"dur\":%.3f,\"tid\":%u,\"args\":{\"surface\":%d,\"flow\":%llu,\"wait_ms\":%.3f}}",
+				Microseconds(span.end) - Microseconds(span.start), span.thread, span.surfaceId,
+				static_cast<unsigned long long>(span.flow), (Microseconds(span.start) - Microseconds(span.queued)) * 1e-3);
+			m_text += text;
+		}
+
+		// An arrow of the flow, bound to the stage that runs at the time on the thread.
+		void Flow(TraceSpan const& span, char const* const phase)
+		{
+			Begin("update", phase, span.start);
+			char text[128];
+			std::snprintf(text, sizeof(text), ",\"tid\":%u,\"id\":%llu%s}", span.thread, static_cast<unsigned long long>(span.flow),
+				phase[0] == 'f' ? ",\"bp\":\"e\"" : "");
+			m_text += text;
+		}
+
+		// An event on the track of a flow, which nests them by time.
+		void Async(char const* const name, char const* const phase, uint64_t const flow, TraceClock::time_point const time)
+		{
+			Begin(name, phase, time);
+			char text[64];
+			std::snprintf(text, sizeof(text), ",\"tid\":0,\"id\":%llu}", static_cast<unsigned long long>(flow));
+			m_text += text;
+		}
+
+	private:
+		double Microseconds(TraceClock::time_point const time) const
+		{
+			return std::chrono::duration<double, std::micro>(time - m_start).count();
+		}
+
+		void Begin(char const* const name, char const* const phase, TraceClock::time_point const time)
+		{
+			m_text += ",\n{\"name\":";
+			AppendJsonString(m_text, name);
+			char text[96];
+			std::snprintf(text, sizeof(text), ",\"cat\":\"surface\",\"ph\":\"%s\",\"pid\":1,\"ts\":%.3f", phase, Microseconds(time));
+			m_text += text;
+		}
+
+		TraceClock::time_point const m_start;
+		std::string m_text;
+	};
+}
+
+SurfaceTrace& SurfaceTrace::Instance()
+{
+	static SurfaceTrace trace;
+	return trace;
+}
+
+void SurfaceTrace::Start(size_t const capacity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_start = TraceClock::now();
+	m_spans.clear();
+	m_capacity = capacity;
+	m_dropped = 0;
+	m_recording.store(true, std::memory_order_relaxed);
+}
+
+void SurfaceTrace::Stop()
+{
+	m_recording.store(false, std::memory_order_relaxed);
+}
+
+uint64_t SurfaceTrace::NewFlow()
+{
+	return IsRecording() ? m_nextFlow.fetch_add(1, std::memory_order_relaxed) : 0;
+}
+
+void SurfaceTrace::Record(TraceSpan span)
+{
+	span.thread = ThreadId();
+	Append(span);
+}
+
+void SurfaceTrace::RecordAsync(TraceSpan span)
+{
+	span.thread = 0;
+	Append(span);
+}
+
+void SurfaceTrace::Append(TraceSpan const& span)
+{
+	if (!IsRecording())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_spans.size() < m_capacity)
+	{
+		m_spans.push_back(span);
+	}
+	else
+	{
+		m_dropped++;
+	}
+}
+
+std::vector<TraceSpan> SurfaceTrace::Spans() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_spans;
+}
+
+size_t SurfaceTrace::Dropped() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_dropped;
+}
+
+bool SurfaceTrace::WriteChromeTrace(std::string const& path) const
+{
+	TraceClock::time_point start;
+	std::vector<TraceSpan> spans;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		start = m_start;
+		spans = m_spans;
+	}
+
+	TraceWriter writer(start);
+	std::map<uint64_t, std::vector<TraceSpan const*>> flows;
+	uint32_t threadCount = 0;
+	for (auto const& span : spans)
+	{
+		if (span.thread != 0)
+		{
+			writer.Complete(span);
+			threadCount = std::max(threadCount, span.thread);
+		}
+		if (span.flow != 0)
+		{
+			flows[span.flow].push_back(&span);
+		}
+	}
+	for (uint32_t thread = 1; thread <= threadCount; thread++)
+	{
+		writer.ThreadName(thread);
+	}
+
+	char name[64];
+	std::vector<AsyncEvent> events;
+	for (auto& [flow, stages] : flows)
+	{
+		std::stable_sort(stages.begin(), stages.end(), [](TraceSpan const* a, TraceSpan const* b) { return a->start < b->start; });
+
+		// Stages run one after another. One that runs within the previous, like the spatial
+		// index within the vertex task, is nested in it and did not wait, and the wait of the
+		// next begins when the previous ended at the earliest.
+		std::vector<TraceSpan const*> sequence;
+		TraceClock::time_point previousEnd = stages.front()->queued;
+		TraceClock::time_point end = stages.front()->end;
+		events.clear();
+		for (auto const* const stage : stages)
+		{
+			bool const nested = stage != stages.front() && stage->end <= previousEnd;
+			TraceClock::time_point const queued = std::max(stage->queued, previousEnd);
+			if (!nested && queued < stage->start)
+			{
+				char const* const waitName = stage->waitName != nullptr ? stage->waitName : "queued";
+				events.push_back({ queued, false, waitName });
+				events.push_back({ stage->start, true, waitName });
+			}
+			events.push_back({ stage->start, false, stage->name });
+			events.push_back({ stage->end, true, stage->name });
+			if (!nested)
+			{
+				previousEnd = stage->end;
+				if (stage->thread != 0)
+				{
+					sequence.push_back(stage);
+				}
+			}
+			end = std::max(end, stage->end);
+		}
+
+		// In time order, and at the same time ends before begins, so that they nest.
+		std::stable_sort(events.begin(), events.end(), [](AsyncEvent const& a, AsyncEvent const& b)
+			{
+				return a.time < b.time || (a.time == b.time && a.isEnd && !b.isEnd);
+			});
+		std::snprintf(name, sizeof(name), "surface %d", stages.front()->surfaceId);
+		writer.Async(name, "b", flow, std::min(stages.front()->queued, stages.front()->start));
+		for (auto const& event : events)
+		{
+			writer.Async(event.name, event.isEnd ? "e" : "b", flow, event.time);
+		}
+		writer.Async(name, "e", flow, end);
+
+		if (sequence.size() > 1)
+		{
+			for (size_t s = 0; s < sequence.size(); s++)
+			{
+				writer.Flow(*sequence[s], s == 0 ? "s" : s + 1 == sequence.size() ? "f" : "t");
+			}
+		}
+	}
+
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	std::string const& text = writer.Finish();
+	file.write(text.data(), static_cast<std::streamsize>(text.size()));
+	return file.good();
+}
+
+TraceScope::TraceScope(char const* const name, uint64_t const flow, int const surfaceId, TraceClock::time_point const queued, char const* const waitName) :
+	m_active(SurfaceTrace::Instance().IsRecording())
+{
+	if (m_active)
+	{
+		m_span.name = name;
+		m_span.waitName = waitName;
+		m_span.flow = flow;
+		m_span.surfaceId = surfaceId;
+		m_span.start = TraceClock::now();
+		m_span.queued = queued == TraceClock::time_point() ? m_span.start : queued;
+	}
+}
+
+TraceScope::~TraceScope()
+{
+	if (m_active)
+	{
+		m_span.end = TraceClock::now();
+		SurfaceTrace::Instance().Record(m_span);
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SpatialMapping
+{
+	using TraceClock = std::chrono::steady_clock;
+
+	// One stage of the processing of a surface update. It waited from queued to start, e.g.
+	// as a scheduled continuation, and ran from start to end. The names are string literals.
+	struct TraceSpan
+	{
+		char const* name = nullptr;
+
+		// What the stage waited for, "queued" for a scheduler.
+		char const* waitName = nullptr;
+
+		// The surface update the stage belongs to, 0 for work that is not part of one.
+		uint64_t flow = 0;
+		int surfaceId = 0;
+
+		// 0 for a stage that does not run on a thread of the app, e.g. an async operation.
+		uint32_t thread = 0;
+
+		TraceClock::time_point queued;
+		TraceClock::time_point start;
+		TraceClock::time_point end;
+	};
+
+	// Records the stages of every surface update for chrome://tracing and Perfetto. An update
+	// gets a flow id when the observer reports it, which each stage carries to the next from
+	// thread to thread: from the observer event through TryComputeLatestMeshAsync and the
+	// continuation of AddOrUpdateSurfaceAsync to the UpdateVertexResources task and the
+	// SwapVertexBuffers of the next frame. The trace shows the stages on their threads, the
+	// flow arrows between them, and per update a track that separates what each stage waited
+	// for from its execution.
+	//
+	// There are a handful of stages per update rather than per frame, so they are appended
+	// under a mutex. Recording stops when the capacity is reached.
+	class SurfaceTrace
+	{
+	public:
+		static SurfaceTrace& Instance();
+
+		// Forgets the spans recorded so far. Timestamps of the trace are relative to the start.
+		void Start(size_t capacity = 1 << 20);
+		void Stop();
+		bool IsRecording() const { return m_recording.load(std::memory_order_relaxed); }
+
+		// A new flow id, 0 while not recording.
+		uint64_t NewFlow();
+
+		// Records a stage that ran on the calling thread, and one that did not run on a thread
+		// of the app.
+		void Record(TraceSpan span);
+		void RecordAsync(TraceSpan span);
+
+		std::vector<TraceSpan> Spans() const;
+		size_t Dropped() const;
+
+		// Writes the Chrome trace event format, in JSON.
+		bool WriteChromeTrace(std::string const& path) const;
+
+	private:
+		void Append(TraceSpan const& span);
+
+		std::atomic<bool> m_recording{ false };
+		std::atomic<uint64_t> m_nextFlow{ 1 };
+
+		mutable std::mutex m_mutex;
+		TraceClock::time_point m_start;
+		std::vector<TraceSpan> m_spans;
+		size_t m_capacity = 0;
+		size_t m_dropped = 0;
+	};
+
+	// Records the rest of the enclosing scope as a stage of the flow. Without a queued time
+	// the stage did not wait.
+	class TraceScope
+	{
+	public:
+		TraceScope(char const* name, uint64_t flow, int surfaceId, TraceClock::time_point queued = {}, char const* waitName = "queued");
+		~TraceScope();
+
+		TraceScope(TraceScope const&) = delete;
+		TraceScope& operator=(TraceScope const&) = delete;
+
+	private:
+		TraceSpan m_span;
+		bool const m_active;
+	};
+}
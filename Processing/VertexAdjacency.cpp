@@ -0,0 +1,29 @@
+#include "VertexAdjacency.h"
+
+#include <algorithm>
+
+using namespace SpatialMapping;
+
+void VertexAdjacency::Compact()
+{
+	uint32_t write = 0;
+	for (size_t v = 0; v + 1 < m_offsets.size(); v++)
+	{
+		auto const begin = m_neighbors.begin() + m_offsets[v];
+		auto const end = m_neighbors.begin() + m_offsets[v + 1];
+		std::sort(begin, end);
+		auto const unique = std::unique(begin, end);
+
+		m_offsets[v] = write;
+		for (auto it = begin; it != unique; ++it)
+		{
+			m_neighbors[write++] = *it;
+		}
+	}
+
+	if (!m_offsets.empty())
+	{
+		m_offsets.back() = write;
+	}
+	m_neighbors.resize(write);
+}
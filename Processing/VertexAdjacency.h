@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace SpatialMapping
+{
+	// One-ring neighbors of every vertex of a triangle mesh in compressed sparse row form: the
+	// neighbors of v are m_neighbors[m_offsets[v] .. m_offsets[v + 1]), sorted and unique.
+	// Rebuilding keeps the buffers, so it does not allocate for a mesh of the same size.
+	class VertexAdjacency
+	{
+	public:
+		template <typename TIndex>
+		void Build(size_t vertexCount, TIndex const* indices, size_t indexCount);
+
+		size_t VertexCount() const { return m_offsets.empty() ? 0 : m_offsets.size() - 1; }
+		uint32_t const* NeighborsBegin(size_t vertex) const { return m_neighbors.data() + m_offsets[vertex]; }
+		uint32_t const* NeighborsEnd(size_t vertex) const { return m_neighbors.data() + m_offsets[vertex + 1]; }
+		uint32_t Degree(size_t vertex) const { return m_offsets[vertex + 1] - m_offsets[vertex]; }
+
+	private:
+		void Compact();
+
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_neighbors;
+		std::vector<uint32_t> m_fill;
+	};
+
+	template <typename TIndex>
+	void VertexAdjacency::Build(size_t const vertexCount, TIndex const* indices, size_t const indexCount)
+	{
+		size_t const triangleCount = indexCount / 3;
+
+		// Every corner adds its two edges, which counts interior edges twice; Compact() removes
+		// the duplicates.
+		m_offsets.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+		{
+			m_offsets[indices[i] + 1] += 2;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			m_offsets[v + 1] += m_offsets[v];
+		}
+
+		m_neighbors.resize(m_offsets[vertexCount]);
+		m_fill.assign(m_offsets.begin(), m_offsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t const v = indices[3 * t + corner];
+				m_neighbors[m_fill[v]++] = indices[3 * t + (corner + 1) % 3];
+				m_neighbors[m_fill[v]++] = indices[3 * t + (corner + 2) % 3];
+			}
+		}
+
+		Compact();
+	}
+}
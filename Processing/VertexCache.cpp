@@ -0,0 +1,245 @@
+#include "VertexCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+using namespace SpatialMapping;
+
+void VertexCacheOptimizer::Tipsify(size_t const vertexCount, size_t const cacheSize)
+{
+	size_t const triangleCount = m_indices.size() / 3;
+
+	m_liveTriangles.assign(vertexCount, 0);
+	for (uint32_t const v : m_indices)
+	{
+		m_liveTriangles[v]++;
+	}
+	m_offsets.resize(vertexCount + 1);
+	m_offsets[0] = 0;
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		m_offsets[v + 1] = m_offsets[v] + m_liveTriangles[v];
+	}
+	m_adjacency.resize(m_indices.size());
+	for (size_t i = 0; i < m_indices.size(); i++)
+	{
+		// Counts down to 0 again while filling every row in ascending triangle order.
+		m_adjacency[m_offsets[m_indices[i] + 1] - m_liveTriangles[m_indices[i]]--] = static_cast<uint32_t>(i / 3);
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		m_liveTriangles[v] = m_offsets[v + 1] - m_offsets[v];
+	}
+
+	uint32_t const k = static_cast<uint32_t>(cacheSize);
+	uint32_t time = k + 1;
+	m_cacheTime.assign(vertexCount, 0);
+	m_emitted.assign(triangleCount, 0);
+	m_deadEnd.clear();
+	m_order.clear();
+	m_cursor = 0;
+
+	// Fans around one vertex at a time and continues with the candidate that stays longest
+	// in the cache without being evicted by its own remaining triangles.
+	uint32_t fanning = SkipDeadEnd(vertexCount);
+	while (fanning != UINT32_MAX)
+	{
+		// The vertices of the fan, pushed onto the dead-end stack, are the candidates.
+		size_t const candidates = m_deadEnd.size();
+		for (uint32_t a = m_offsets[fanning]; a < m_offsets[fanning + 1]; a++)
+		{
+			uint32_t const t = m_adjacency[a];
+			if (m_emitted[t])
+			{
+				continue;
+			}
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t const v = m_indices[3 * t + corner];
+				m_deadEnd.push_back(v);
+				m_liveTriangles[v]--;
+				if (time - m_cacheTime[v] > k)
+				{
+					m_cacheTime[v] = time++;
+				}
+			}
+			m_emitted[t] = 1;
+			m_order.push_back(t);
+		}
+
+		uint32_t next = UINT32_MAX;
+		int64_t bestPriority = -1;
+		for (size_t c = candidates; c < m_deadEnd.size(); c++)
+		{
+			uint32_t const v = m_deadEnd[c];
+			if (m_liveTriangles[v] == 0)
+			{
+				continue;
+			}
+			int64_t priority = 0;
+			if (time - m_cacheTime[v] + 2 * m_liveTriangles[v] <= k)
+			{
+				priority = time - m_cacheTime[v];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+		fanning = next != UINT32_MAX ? next : SkipDeadEnd(vertexCount);
+	}
+}
+
+uint32_t VertexCacheOptimizer::SkipDeadEnd(size_t const vertexCount)
+{
+	while (!m_deadEnd.empty())
+	{
+		uint32_t const v = m_deadEnd.back();
+		m_deadEnd.pop_back();
+		if (m_liveTriangles[v] > 0)
+		{
+			return v;
+		}
+	}
+	while (m_cursor < vertexCount)
+	{
+		uint32_t const v = static_cast<uint32_t>(m_cursor++);
+		if (m_liveTriangles[v] > 0)
+		{
+			return v;
+		}
+	}
+	return UINT32_MAX;
+}
+
+// Cuts the vertex cache order into clusters and draws those that face away from the center
+// of the mesh first, which tend to occlude the others. Clusters start where the order jumps
+// to a triangle of three new vertices, and are cut further wherever their ACMR is already
+// within the threshold of the ACMR of the whole stretch, so that sorting them costs little
+// cache efficiency.
+void VertexCacheOptimizer::SortClusters(Vector3 const* const positions, VertexCacheOptions const& options)
+{
+	size_t const triangleCount = m_order.size();
+	uint32_t const k = static_cast<uint32_t>(options.cacheSize);
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// FIFO simulation like AnalyzeVertexCache(), restarted by skipping the timer ahead.
+	std::fill(m_cacheTime.begin(), m_cacheTime.end(), 0);
+	uint32_t misses = k + 1;
+	auto const triangleMisses = [&](uint32_t const t)
+		{
+			uint32_t count = 0;
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t const v = m_indices[3 * t + corner];
+				if (misses - m_cacheTime[v] > k)
+				{
+					m_cacheTime[v] = misses++;
+					count++;
+				}
+			}
+			return count;
+		};
+
+	std::vector<uint32_t>& hard = m_clusterOrder;
+	hard.clear();
+	std::vector<uint32_t> hardMisses;
+	for (size_t p = 0; p < triangleCount; p++)
+	{
+		uint32_t const count = triangleMisses(m_order[p]);
+		if (p == 0 || count == 3)
+		{
+			hard.push_back(static_cast<uint32_t>(p));
+			hardMisses.push_back(0);
+		}
+		hardMisses.back() += count;
+	}
+	hard.push_back(static_cast<uint32_t>(triangleCount));
+
+	m_clusters.clear();
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		uint32_t const begin = hard[h];
+		uint32_t const end = hard[h + 1];
+		double const limit = options.overdrawThreshold * static_cast<double>(hardMisses[h]) / (end - begin);
+
+		misses += k + 1;
+		m_clusters.push_back(begin);
+		size_t clusterMisses = 0;
+		size_t clusterTriangles = 0;
+		for (uint32_t p = begin; p < end; p++)
+		{
+			clusterMisses += triangleMisses(m_order[p]);
+			clusterTriangles++;
+			if (p + 1 < end && clusterMisses <= limit * clusterTriangles)
+			{
+				misses += k + 1;
+				m_clusters.push_back(p + 1);
+				clusterMisses = 0;
+				clusterTriangles = 0;
+			}
+		}
+	}
+	size_t const clusterCount = m_clusters.size();
+	m_clusters.push_back(static_cast<uint32_t>(triangleCount));
+
+	// Every cluster is keyed by how far its centroid lies out along its area-weighted normal.
+	Vector3 meshCentroid;
+	std::vector<Vector3> centroids(clusterCount);
+	std::vector<Vector3> normals(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		Vector3 centroid;
+		Vector3 normal;
+		for (uint32_t p = m_clusters[c]; p < m_clusters[c + 1]; p++)
+		{
+			uint32_t const* const triangle = &m_indices[3 * m_order[p]];
+			Vector3 const& a = positions[triangle[0]];
+			Vector3 const& b = positions[triangle[1]];
+			Vector3 const& d = positions[triangle[2]];
+			centroid = centroid + (a + b + d) * (1.f / 3.f);
+			normal = normal + Cross(b - a, d - a);
+		}
+		meshCentroid = meshCentroid + centroid;
+		centroids[c] = centroid * (1.f / (m_clusters[c + 1] - m_clusters[c]));
+		normals[c] = Normalize(options.reversedWinding ? normal * -1.f : normal);
+	}
+	meshCentroid = meshCentroid * (1.f / triangleCount);
+
+	m_clusterKeys.resize(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		m_clusterKeys[c] = Dot(centroids[c] - meshCentroid, normals[c]);
+	}
+	m_clusterOrder.resize(clusterCount);
+	std::iota(m_clusterOrder.begin(), m_clusterOrder.end(), 0u);
+	std::stable_sort(m_clusterOrder.begin(), m_clusterOrder.end(), [&](uint32_t const a, uint32_t const b)
+		{
+			return m_clusterKeys[a] > m_clusterKeys[b];
+		});
+
+	m_sortedOrder.clear();
+	for (uint32_t const c : m_clusterOrder)
+	{
+		m_sortedOrder.insert(m_sortedOrder.end(), m_order.begin() + m_clusters[c], m_order.begin() + m_clusters[c + 1]);
+	}
+	m_order.swap(m_sortedOrder);
+}
+
+void VertexCacheOptimizer::RemapVertices(void const* const vertices, size_t const stride, std::vector<uint8_t>& remapped) const
+{
+	auto const* const source = static_cast<uint8_t const*>(vertices);
+	remapped.resize(m_remappedCount * stride);
+	for (size_t v = 0; v < m_remap.size(); v++)
+	{
+		if (m_remap[v] != UINT32_MAX)
+		{
+			std::memcpy(remapped.data() + m_remap[v] * stride, source + v * stride, stride);
+		}
+	}
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "MeshTypes.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace SpatialMapping
+{
+	struct VertexCacheOptions
+	{
+		// Vertices the post-transform cache of the GPU is assumed to hold. Tipsify only needs
+		// an estimate, the order is good for a range of sizes around it.
+		size_t cacheSize = 16;
+
+		// Sorts clusters of triangles against overdraw, cutting them where the ACMR is within
+		// this factor of the one of the vertex cache order. 0 keeps the order of Tipsify.
+		float overdrawThreshold = 1.05f;
+
+		// The triangles are in the observer's winding, whose cross product points into the
+		// surface instead of out of it.
+		bool reversedWinding = false;
+	};
+
+	struct VertexCacheStatistics
+	{
+		size_t triangles = 0;
+		size_t vertices = 0;
+
+		// Cache misses, i.e. vertex shader invocations.
+		size_t transformed = 0;
+
+		// Average cache miss ratio, transformed vertices per triangle: 3 without any reuse,
+		// about 0.5 at best on a regular grid.
+		double Acmr() const { return triangles > 0 ? static_cast<double>(transformed) / triangles : 0.; }
+
+		// Average transform to vertex ratio: 1 is every vertex transformed once.
+		double Atvr() const { return vertices > 0 ? static_cast<double>(transformed) / vertices : 0.; }
+	};
+
+	// Simulates a FIFO post-transform cache of cacheSize vertices over the triangles.
+	template <typename TIndex>
+	VertexCacheStatistics AnalyzeVertexCache(TIndex const* indices, size_t indexCount, size_t vertexCount, size_t cacheSize);
+
+	// Reorders the triangles and vertices of a mesh before it is uploaded: Tipsify (Sander,
+	// Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw",
+	// 2007) for the post-transform cache, its clusters sorted outside-in against overdraw, and
+	// the vertices renumbered in order of first use for the pre-transform cache. All steps
+	// are linear in the triangles and keep their buffers between calls, so that every surface
+	// update can be reordered on its own as it arrives.
+	class VertexCacheOptimizer
+	{
+	public:
+		// Reorders the triangles of indices in place. The positions, in any rigid frame, are
+		// only needed for the overdraw order and may be null.
+		template <typename TIndex>
+		void OptimizeTriangles(TIndex* indices, size_t indexCount, Vector3 const* positions, size_t vertexCount, VertexCacheOptions const& options);
+
+		// Renumbers the vertices in the order the triangles first use them and returns how many
+		// are used. Vertices that no triangle references, e.g. of removed floaters, are dropped.
+		template <typename TIndex>
+		size_t OptimizeVertexFetch(TIndex* indices, size_t indexCount, size_t vertexCount);
+
+		// Copies vertices of stride bytes into the order of the last OptimizeVertexFetch().
+		void RemapVertices(void const* vertices, size_t stride, std::vector<uint8_t>& remapped) const;
+
+		// New number of every old vertex of the last OptimizeVertexFetch(), UINT32_MAX if unused.
+		std::vector<uint32_t> const& Remap() const { return m_remap; }
+
+	private:
+		// On the triangles copied into m_indices, fills m_order.
+		void Tipsify(size_t vertexCount, size_t cacheSize);
+		uint32_t SkipDeadEnd(size_t vertexCount);
+		void SortClusters(Vector3 const* positions, VertexCacheOptions const& options);
+
+		std::vector<uint32_t> m_indices;
+
+		// Triangles of every vertex, in compressed rows.
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_adjacency;
+
+		// Tipsify: triangles not emitted yet per vertex, the time each vertex entered the cache,
+		// the recently used vertices to continue from at a dead end and the next vertex to
+		// try after them.
+		std::vector<uint32_t> m_liveTriangles;
+		std::vector<uint32_t> m_cacheTime;
+		std::vector<uint8_t> m_emitted;
+		std::vector<uint32_t> m_deadEnd;
+		size_t m_cursor = 0;
+
+		// Triangles in the new order.
+		std::vector<uint32_t> m_order;
+
+		// Overdraw: first position in m_order of every cluster and their sort keys.
+		std::vector<uint32_t> m_clusters;
+		std::vector<float> m_clusterKeys;
+		std::vector<uint32_t> m_clusterOrder;
+		std::vector<uint32_t> m_sortedOrder;
+
+		std::vector<uint32_t> m_remap;
+		size_t m_remappedCount = 0;
+	};
+
+	template <typename TIndex>
+	VertexCacheStatistics AnalyzeVertexCache(TIndex const* const indices, size_t const indexCount, size_t const vertexCount, size_t const cacheSize)
+	{
+		VertexCacheStatistics statistics;
+		statistics.triangles = indexCount / 3;
+
+		// A vertex is in the cache if fewer than cacheSize misses happened since it entered.
+		std::vector<size_t> entered(vertexCount, 0);
+		std::vector<uint8_t> used(vertexCount, 0);
+		size_t misses = cacheSize + 1;
+		for (size_t i = 0; i < indexCount - indexCount % 3; i++)
+		{
+			TIndex const v = indices[i];
+			statistics.vertices += used[v] ? 0 : 1;
+			used[v] = 1;
+			if (misses - entered[v] > cacheSize)
+			{
+				entered[v] = misses++;
+				statistics.transformed++;
+			}
+		}
+		return statistics;
+	}
+
+	template <typename TIndex>
+	void VertexCacheOptimizer::OptimizeTriangles(TIndex* const indices, size_t const indexCount, Vector3 const* const positions, size_t const vertexCount, VertexCacheOptions const& options)
+	{
+		size_t const triangleCount = indexCount / 3;
+		m_indices.assign(indices, indices + 3 * triangleCount);
+
+		Tipsify(vertexCount, options.cacheSize);
+		if (positions != nullptr && options.overdrawThreshold > 0.f)
+		{
+			SortClusters(positions, options);
+		}
+
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			uint32_t const* const triangle = &m_indices[3 * m_order[t]];
+			indices[3 * t] = static_cast<TIndex>(triangle[0]);
+			indices[3 * t + 1] = static_cast<TIndex>(triangle[1]);
+			indices[3 * t + 2] = static_cast<TIndex>(triangle[2]);
+		}
+	}
+
+	template <typename TIndex>
+	size_t VertexCacheOptimizer::OptimizeVertexFetch(TIndex* const indices, size_t const indexCount, size_t const vertexCount)
+	{
+		m_remap.assign(vertexCount, UINT32_MAX);
+		uint32_t next = 0;
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			uint32_t& remapped = m_remap[indices[i]];
+			if (remapped == UINT32_MAX)
+			{
+				remapped = next++;
+			}
+			indices[i] = static_cast<TIndex>(remapped);
+		}
+		m_remappedCount = next;
+		return next;
+	}
+}
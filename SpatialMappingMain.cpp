@@ -17,10 +17,11 @@
 #include <windows.graphics.directx.direct3d11.interop.h>
 #include <Collection.h>
 
+#include <cwchar>
+#include <sstream>
 #include <string>
-#include <fstream>
-#include <iomanip>
 #include <unordered_map>
+#include <vector>
 
 using namespace SpatialMapping;
 using namespace concurrency;
@@ -39,10 +40,72 @@ using namespace Windows::Storage;
 
 using namespace std::placeholders;
 
+namespace
+{
+	// The anchors the positions of the surface cache are relative to, one per save followed
+	// by its number, see SurfaceCache::AnchorSave().
+	wchar_t const CacheAnchorPrefix[] = L"SpatialMappingSurfaceCache";
+
+	String^ CacheAnchorKey(uint32_t const save)
+	{
+		return StringReference(CacheAnchorPrefix) + save.ToString();
+	}
+
+	// The save of a cache anchor key, false for other keys and the key of older versions.
+	bool TryGetCacheAnchorSave(String^ const key, uint32_t& save)
+	{
+		std::wstring const text(key->Data());
+		std::wstring const prefix(CacheAnchorPrefix);
+		if (text.size() <= prefix.size() || text.compare(0, prefix.size(), prefix) != 0 ||
+			text.find_first_not_of(L"0123456789", prefix.size()) != std::wstring::npos)
+		{
+			return false;
+		}
+		save = static_cast<uint32_t>(std::wcstoul(text.c_str() + prefix.size(), nullptr, 10));
+		return true;
+	}
+
+	// Removes the cache anchors of the saves the predicate selects, and those of older versions.
+	template <typename TPredicate>
+	void RemoveCacheAnchors(SpatialAnchorStore^ const store, TPredicate const& remove)
+	{
+		std::vector<String^> keys;
+		for (auto const& pair : store->GetAllSavedAnchors())
+		{
+			std::wstring const text(pair->Key->Data());
+			uint32_t save = 0;
+			bool const isCacheAnchor = text.compare(0, std::wcslen(CacheAnchorPrefix), CacheAnchorPrefix) == 0;
+			if (isCacheAnchor && (!TryGetCacheAnchorSave(pair->Key, save) || remove(save)))
+			{
+				keys.push_back(pair->Key);
+			}
+		}
+		for (String^ const key : keys)
+		{
+			store->Remove(key);
+		}
+	}
+
+	DensityControllerOptions DensityOptionsFromSettings()
+	{
+		DensityControllerOptions options;
+		options.targetFrameMilliseconds = Settings::TARGET_FRAME_MS;
+		options.meshMillisecondsPerFrame = Settings::MESH_PROCESSING_MS_PER_FRAME;
+		options.memoryBudgetBytes = Settings::MAP_MEMORY_BUDGET_BYTES;
+		options.minTriangleDensity = Settings::MIN_TRIANGLE_RES;
+		options.maxTriangleDensity = Settings::MAX_TRIANGLE_RES;
+		options.maxConcurrentComputations = Settings::MAX_CONCURRENT_MESH_COMPUTATIONS;
+		options.minRetentionSeconds = Settings::MIN_INACTIVE_MESH_TIME;
+		options.maxRetentionSeconds = Settings::MAX_INACTIVE_MESH_TIME;
+		return options;
+	}
+}
+
 // Loads and initializes application assets when the application is loaded.
 SpatialMappingMain::SpatialMappingMain(
 	const std::shared_ptr<DX::DeviceResources>& deviceResources) :
-	m_deviceResources(deviceResources)
+	m_deviceResources(deviceResources),
+	m_densityController(DensityOptionsFromSettings())
 {
 	// Register to be notified if the device is lost or recreated.
 	m_deviceResources->RegisterDeviceNotify(this);
@@ -66,6 +129,39 @@ void SpatialMappingMain::SetHolographicSpace(
 	// Initialize the sample hologram.
 	m_meshRenderer = std::make_unique<RealtimeSurfaceMeshRenderer>(m_deviceResources);
 
+	if (Settings::TRACE_SURFACE_UPDATES && !SurfaceTrace::Instance().IsRecording())
+	{
+		SurfaceTrace::Instance().Start();
+	}
+
+	if (Settings::METRICS_SNAPSHOT_INTERVAL_SECONDS > 0.)
+	{
+		String^ const folder = ApplicationData::Current->LocalFolder->Path + "\\Meshes";
+		std::wstring const folderW(folder->Begin());
+		std::string const folderA(folderW.begin(), folderW.end());
+
+		char fileMetrics[512];
+		std::snprintf(fileMetrics, 512, "%s\\metrics_%d.jsonl", folderA.c_str(), (int)Settings::MAX_TRIANGLE_RES);
+		if (!MetricsRegistry::Instance().StartSnapshots(fileMetrics, Settings::METRICS_SNAPSHOT_INTERVAL_SECONDS, Settings::METRICS_FILE_MAX_BYTES))
+		{
+			Helper::LogMessage(std::string("Could not open ") + fileMetrics);
+		}
+	}
+
+	if (Settings::RECORD_SURFACES)
+	{
+		String^ const folder = ApplicationData::Current->LocalFolder->Path + "\\Meshes";
+		std::wstring const folderW(folder->Begin());
+		std::string const folderA(folderW.begin(), folderW.end());
+
+		char fileRecording[512];
+		std::snprintf(fileRecording, 512, "%s\\surfaces_%d.rec", folderA.c_str(), (int)Settings::MAX_TRIANGLE_RES);
+		if (m_surfaceRecorder.Open(fileRecording))
+		{
+			m_meshRenderer->SetRecorder(&m_surfaceRecorder);
+		}
+	}
+
 	m_spatialInputHandler = std::make_unique<SpatialInputHandler>();
 
 	// Use the default SpatialLocator to track the motion of the device.
@@ -119,6 +215,9 @@ void SpatialMappingMain::SetHolographicSpace(
 	//   indicates to be of special interest. Anchor positions do not drift, but can be corrected; the
 	//   anchor will use the corrected position starting in the next frame after the correction has
 	//   occurred.
+
+	// Activation does not raise Resuming, the cache of the last session is loaded here.
+	LoadAppState();
 }
 
 void SpatialMappingMain::UnregisterHolographicEventHandlers()
@@ -157,6 +256,9 @@ void SpatialMappingMain::OnSurfacesChanged(
 {
 	IMapView<Guid, SpatialSurfaceInfo^>^ const& surfaceCollection = sender->GetObservedSurfaces();
 	std::unordered_map<int, Guid> observedIDs;
+	TraceScope trace("OnSurfacesChanged", 0, 0);
+
+	ValidateSurfaceCache(surfaceCollection);
 
 
 	// Process surface adds and updates.
@@ -180,8 +282,20 @@ void SpatialMappingMain::OnSurfacesChanged(
 		else
 		{
 			// New surface.
-			m_meshRenderer->AddSurface(id, surfaceInfo);
+			AddSurface(id, surfaceInfo);
+		}
+	}
+	CloseSurfaceCacheIfDone();
+
+	if (m_surfaceRecorder.IsOpen())
+	{
+		std::vector<int32_t> ids;
+		ids.reserve(observedIDs.size());
+		for (auto const& [id, guid] : observedIDs)
+		{
+			ids.push_back(id);
 		}
+		m_surfaceRecorder.RecordObserved(ids.data(), ids.size());
 	}
 
 	// Sometimes, a mesh will fall outside the area that is currently visible to
@@ -192,9 +306,120 @@ void SpatialMappingMain::OnSurfacesChanged(
 	m_meshRenderer->HideInactiveMeshes(observedIDs, surfaceCollection);
 }
 
+void SpatialMappingMain::AddSurface(int const id, SpatialSurfaceInfo^ surfaceInfo)
+{
+	if (m_cacheCoordinateSystem != nullptr)
+	{
+		auto cached = m_surfaceCache.Take(id, surfaceInfo->UpdateTime.UniversalTime);
+		if (cached)
+		{
+			m_meshRenderer->RestoreSurface(id, std::move(cached), m_cacheCoordinateSystem);
+			return;
+		}
+	}
+	m_meshRenderer->AddSurface(id, surfaceInfo);
+}
+
+// Feeds the last frame to the DensityController and hands changed settings to the renderer.
+// The frame time is the CPU time of the last Update() and Render(), which are done by now.
+void SpatialMappingMain::UpdateDensity()
+{
+	uint64_t const meshMicroseconds = SurfaceMetrics::Instance().meshProcessingMicroseconds.Value();
+	uint64_t const frameWorkMicroseconds = m_frameWorkMicroseconds.Value();
+
+	DensityMeasurement measurement;
+	measurement.frameMilliseconds = (frameWorkMicroseconds - m_lastFrameWorkMicroseconds) / 1000.;
+	measurement.meshMilliseconds = (meshMicroseconds - m_lastMeshProcessingMicroseconds) / 1000.;
+	measurement.memoryBytes = MemoryAccounting::Instance().Current().Total();
+	m_lastMeshProcessingMicroseconds = meshMicroseconds;
+	m_lastFrameWorkMicroseconds = frameWorkMicroseconds;
+
+	if (m_densityController.Update(measurement))
+	{
+		DensitySettings const& settings = m_densityController.Current();
+		m_meshRenderer->ApplyDensity(settings);
+
+		std::ostringstream os;
+		os << "Density " << settings.triangleDensity << " triangles/m^3, "
+			<< settings.concurrentComputations << " computations, retention "
+			<< settings.retentionSeconds << " s (frame " << m_densityController.FrameLoad()
+			<< ", mesh " << m_densityController.MeshLoad() << ", memory " << m_densityController.MemoryLoad() << " of budget)";
+		Helper::LogMessage(os.str());
+	}
+}
+
+void SpatialMappingMain::ValidateSurfaceCache(IMapView<Guid, SpatialSurfaceInfo^>^ const& surfaceCollection)
+{
+	if (m_surfaceCacheValidated || m_cacheCoordinateSystem == nullptr || !m_surfaceCache.IsOpen())
+	{
+		return;
+	}
+
+	std::vector<int> ids;
+	ids.reserve(surfaceCollection->Size);
+	for (auto const& pair : surfaceCollection)
+	{
+		ids.push_back(pair->Key.GetHashCode());
+	}
+	m_surfaceCache.Validate(ids.data(), ids.size());
+	m_surfaceCacheValidated = true;
+}
+
+void SpatialMappingMain::CloseSurfaceCacheIfDone()
+{
+	if (!m_surfaceCacheValidated || !m_surfaceCache.IsOpen() || m_surfaceCache.Remaining() > 0)
+	{
+		return;
+	}
+
+	// The time from the launch until the whole map was queued for upload.
+	SurfaceCacheStatistics const statistics = m_surfaceCache.Statistics();
+	double const milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_warmStartTime).count();
+	std::ostringstream os;
+	os << "Warm start: " << statistics.restored << " of " << statistics.surfaces << " cached surfaces restored, "
+		<< statistics.stale << " stale, " << statistics.dropped << " dropped, map complete after " << milliseconds << " ms";
+	Helper::LogMessage(os.str());
+
+	m_surfaceCache.Close();
+}
+
+bool SpatialMappingMain::IsWarmStartReady(SpatialCoordinateSystem^ const currentCoordinateSystem)
+{
+	if (!Settings::WARM_START_CACHE || m_warmStartReady)
+	{
+		return true;
+	}
+
+	// The anchor store loads in the background. Creating the observer before would compute
+	// every surface the cache holds.
+	if (!m_warmStartLoaded.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	// A loaded anchor is located once the device recognizes the space it was saved in. If
+	// that takes too long, the session most likely started somewhere else.
+	if (m_cacheCoordinateSystem != nullptr && m_cacheCoordinateSystem->TryGetTransformTo(currentCoordinateSystem) == nullptr)
+	{
+		double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_warmStartTime).count();
+		if (seconds < Settings::WARM_START_ANCHOR_WAIT_SECONDS)
+		{
+			return false;
+		}
+		Helper::LogMessage("Warm start: the anchor of the cache was not located, all surfaces are computed");
+		m_cacheCoordinateSystem = nullptr;
+		m_surfaceCache.Close();
+	}
+	m_warmStartReady = true;
+	return true;
+}
+
 // Updates the application state once per frame.
 HolographicFrame^ SpatialMappingMain::Update()
 {
+	PROFILE_PHASE(MainUpdate);
+	CounterTimer const frameWork(m_frameWorkMicroseconds);
+
 	// Before doing the timer update, there is some work to do per-frame
 	// to maintain holographic rendering. First, we will get information
 	// about the current frame.
@@ -216,6 +441,7 @@ HolographicFrame^ SpatialMappingMain::Update()
 	// associated with the current frame. Later, this coordinate system is used for
 	// for creating the stereo view matrices when rendering the sample content.
 	SpatialCoordinateSystem^ currentCoordinateSystem = m_referenceFrame->GetStationaryCoordinateSystemAtTimestamp(prediction->Timestamp);
+	m_currentCoordinateSystem = currentCoordinateSystem;
 
 	// Only create a surface observer when you need to - do not create a new one each frame.
 	if (m_surfaceObserver == nullptr) {
@@ -245,7 +471,7 @@ HolographicFrame^ SpatialMappingMain::Update()
 		}
 	}
 
-	if (m_surfaceAccessAllowed)
+	if (m_surfaceAccessAllowed && IsWarmStartReady(currentCoordinateSystem))
 	{
 		SpatialBoundingVolume^ bounds = SpatialBoundingVolume::FromBox(currentCoordinateSystem, Settings::BOUNDING_BOX);
 
@@ -267,13 +493,11 @@ HolographicFrame^ SpatialMappingMain::Update()
 				m_surfaceMeshOptions->VertexNormalFormat = DirectXPixelFormat::R8G8B8A8IntNormalized;
 			}
 
-#ifdef USE_32BIT_INDICES
 			IVectorView<DirectXPixelFormat>^ supportedTriangleIndexFormats = m_surfaceMeshOptions->SupportedTriangleIndexFormats;
 			if (supportedTriangleIndexFormats->IndexOf(DirectXPixelFormat::R32UInt, &formatIndex))
 			{
 				m_surfaceMeshOptions->TriangleIndexFormat = DirectXPixelFormat::R32UInt;
 			}
-#endif
 
 			// Create the observer.
 			m_surfaceObserver = ref new SpatialSurfaceObserver();
@@ -284,6 +508,7 @@ HolographicFrame^ SpatialMappingMain::Update()
 				// If the surface observer was successfully created, we can initialize our
 				// collection by pulling the current data set.
 				IMapView<Guid, SpatialSurfaceInfo^>^ const& surfaceCollection = m_surfaceObserver->GetObservedSurfaces();
+				ValidateSurfaceCache(surfaceCollection);
 				for (const auto& pair : surfaceCollection)
 				{
 					// Store the ID and metadata for each surface.
@@ -292,8 +517,9 @@ HolographicFrame^ SpatialMappingMain::Update()
 
 					auto surfaceInfo = pair->Value;
 
-					m_meshRenderer->AddSurface(id, surfaceInfo);
+					AddSurface(id, surfaceInfo);
 				}
+				CloseSurfaceCacheIfDone();
 
 				if (!Settings::MOCK_IMPROVEMENT) {
 					// We then subscribe to an event to receive up-to-date data.
@@ -331,6 +557,27 @@ HolographicFrame^ SpatialMappingMain::Update()
 	m_timer.Tick([&]()
 		{
 			m_meshRenderer->Update(m_timer, currentCoordinateSystem);
+
+			if (Settings::AUTOSAVE_INTERVAL_SECONDS > 0. &&
+				m_timer.GetTotalSeconds() - m_lastAutosaveTime >= Settings::AUTOSAVE_INTERVAL_SECONDS)
+			{
+				m_lastAutosaveTime = m_timer.GetTotalSeconds();
+				SaveAppStateAsync();
+			}
+
+			if (Settings::ADAPTIVE_DENSITY)
+			{
+				UpdateDensity();
+			}
+
+#ifdef SPATIAL_MAPPING_PROFILE
+			if (m_timer.GetTotalSeconds() - m_lastProfileLogTime >= Settings::PROFILE_LOG_INTERVAL_SECONDS)
+			{
+				m_lastProfileLogTime = m_timer.GetTotalSeconds();
+				Helper::LogMessage(FrameProfiler::Instance().Format());
+				FrameProfiler::Instance().Reset();
+			}
+#endif
 		});
 
 	// This sample uses default image stabilization settings, and does not set the focus point.
@@ -346,6 +593,9 @@ HolographicFrame^ SpatialMappingMain::Update()
 bool SpatialMappingMain::Render(
 	HolographicFrame^ holographicFrame)
 {
+	PROFILE_PHASE(MainRender);
+	CounterTimer const frameWork(m_frameWorkMicroseconds);
+
 	// Don't try to render anything before the first Update.
 	if (m_timer.GetFrameCount() == 0)
 	{
@@ -427,6 +677,12 @@ bool SpatialMappingMain::Render(
 }
 
 void SpatialMappingMain::SaveAppState()
+{
+	// Called while suspending, the deferral is held until the files are written.
+	m_exportPipeline.Wait(SaveAppStateAsync());
+}
+
+uint64_t SpatialMappingMain::SaveAppStateAsync()
 {
 	String^ const folder = ApplicationData::Current->LocalFolder->Path + "\\Meshes";
 	std::wstring const folderW(folder->Begin());
@@ -435,87 +691,158 @@ void SpatialMappingMain::SaveAppState()
 
 	char fileTransformed[512];
 	char fileNotTransformed[512];
+	char fileBinary[512];
+	char fileGlb[512];
+	char fileJournal[512];
+	char fileTransforms[512];
+	char fileCache[512];
+	char fileTrace[512];
 	
 	std::snprintf(fileTransformed, 512, "%s\\meshes_transformed_%d.obj", charStr, (int)Settings::MAX_TRIANGLE_RES);
 	std::snprintf(fileNotTransformed, 512, "%s\\meshes_not_transformed_%d.obj", charStr, (int)Settings::MAX_TRIANGLE_RES);
-	
-	std::ofstream fileOutTransformed(fileTransformed, std::ios::out);
-	std::ofstream fileOutNotTransformed(fileNotTransformed, std::ios::out);
+	std::snprintf(fileBinary, 512, "%s\\meshes_%d.smap", charStr, (int)Settings::MAX_TRIANGLE_RES);
+	std::snprintf(fileGlb, 512, "%s\\meshes_%d.glb", charStr, (int)Settings::MAX_TRIANGLE_RES);
+	std::snprintf(fileJournal, 512, "%s\\meshes_%d", charStr, (int)Settings::MAX_TRIANGLE_RES);
+	std::snprintf(fileTransforms, 512, "%s\\meshes_transforms_%d.txt", charStr, (int)Settings::MAX_TRIANGLE_RES);
+	std::snprintf(fileCache, 512, "%s\\meshes_%d.cache", charStr, (int)Settings::MAX_TRIANGLE_RES);
+	std::snprintf(fileTrace, 512, "%s\\trace_%d.json", charStr, (int)Settings::MAX_TRIANGLE_RES);
+
+	// Only references to the immutable caches of the surfaces are collected here, the
+	// formatting and file I/O run on the export thread.
+	ExportRequest request;
+	m_meshRenderer->SnapshotSurfaces(request.surfaces);
+
+	Windows::Globalization::Calendar^ const calendar = ref new Windows::Globalization::Calendar();
+	calendar->SetToNow();
+	request.saveTime = calendar->GetDateTime().UniversalTime;
+
+	if (Settings::JOURNAL_EXPORT)
+	{
+		request.journalPath = fileJournal;
+		request.compactJournalBytes = Settings::JOURNAL_COMPACT_BYTES;
+	}
+	else
+	{
+		// With OBJ_MATERIALS, without a color attribute and without deduplicated normals the
+		// output is identical to the former std::ofstream export.
+		request.transformedPath = fileTransformed;
+		request.notTransformedPath = fileNotTransformed;
+		if (Settings::OBJ_TRANSFORMS_ONLY)
+		{
+			request.transformsPath = fileTransforms;
+		}
+		request.objOptions.materials = Settings::OBJ_MATERIALS;
+		request.objOptions.deduplicateNormals = Settings::OBJ_DEDUPLICATE_NORMALS;
+		request.objOptions.colorAttribute = Settings::COMPUTE_ATTRIBUTES ? Settings::COLOR_ATTRIBUTE : "";
+		if (Settings::SAVE_BINARY_MAP)
+		{
+			request.binaryPath = fileBinary;
+			request.compressBinary = Settings::COMPRESS_BINARY_MAP;
+			request.compression.positionPrecision = Settings::COMPRESSION_PRECISION;
+		}
+	}
+
+	if (Settings::SAVE_GLB)
+	{
+		request.glbPath = fileGlb;
+		request.glbOptions.normals = Settings::GLB_NORMALS;
+		request.glbOptions.combinedScene = Settings::GLB_COMBINED_SCENE;
+		request.glbOptions.colorAttribute = Settings::COMPUTE_ATTRIBUTES ? Settings::COLOR_ATTRIBUTE : "";
+	}
 
-	fileOutTransformed << "mtllib Mesh.mtl\n";
-	fileOutNotTransformed << "mtllib Mesh.mtl\n";
+	if (Settings::WARM_START_CACHE && m_warmStartLoaded.load(std::memory_order_acquire) &&
+		m_anchorStore != nullptr && m_currentCoordinateSystem != nullptr)
+	{
+		// The file is rewritten, whatever was not restored from it by now is computed.
+		m_surfaceCache.Close();
+
+		// The observer's world does not outlive the session, the cache is saved relative to
+		// a new anchor at the device that the next session can locate. The anchor is stored
+		// under the number of the save, which the cache records: the cache on disk keeps its
+		// own anchor until the export thread has replaced it.
+		SpatialAnchor^ const anchor = SpatialAnchor::TryCreateRelativeTo(m_currentCoordinateSystem);
+		uint32_t const save = m_lastCacheAnchorSave + 1;
+		if (anchor != nullptr && m_anchorStore->TrySave(CacheAnchorKey(save), anchor))
+		{
+			m_lastCacheAnchorSave = save;
+			request.cachePath = fileCache;
+			request.cacheAnchorSave = save;
+			m_meshRenderer->SnapshotCacheTransforms(anchor->CoordinateSystem, request.cacheTransforms);
+		}
 
-	std::lock_guard<std::mutex> guard(m_exportMutex);
+		// The caches are written in the order of the saves, the anchors of the saves before
+		// the one on disk are not needed any more.
+		uint32_t written = 0;
+		if (SurfaceCache::ReadAnchorSave(fileCache, written))
+		{
+			RemoveCacheAnchors(m_anchorStore, [written](uint32_t const other) { return other < written; });
+		}
+	}
 
-	auto const meshMap = m_meshRenderer->MeshCollection();
+	if (SurfaceTrace::Instance().IsRecording())
+	{
+		request.tracePath = fileTrace;
+	}
 
-	int index_base_offset = 0;
+	return m_exportPipeline.Submit(std::move(request));
+}
 
-	for (auto const& [id, mesh] : *meshMap) {
-		if (!mesh.Expired()) {
-			auto const positionsTransformed = mesh.PositionsTransformed();
-			auto const positionsNotTransformed = mesh.PositionsNotTransformed();
-			auto const faceNormals = mesh.FaceNormals();
-			auto const indices = mesh.Indices();
+void SpatialMappingMain::LoadAppState()
+{
+	// Only the surface cache persists between sessions. After a resume the surfaces are still
+	// in memory, so it is loaded once.
+	if (!Settings::WARM_START_CACHE || m_warmStartRequested)
+	{
+		return;
+	}
+	m_warmStartRequested = true;
+	m_warmStartTime = std::chrono::steady_clock::now();
 
-			fileOutTransformed << "o mesh_" << id << "\n";
-			fileOutNotTransformed << "o mesh_" << id << "\n";
+	String^ const folder = ApplicationData::Current->LocalFolder->Path + "\\Meshes";
+	std::wstring const folderW(folder->Begin());
+	std::string const folderA(folderW.begin(), folderW.end());
 
-			for (auto const& p : *positionsTransformed) {
-				fileOutTransformed << "v " << p.x << " " << p.y << " " << p.z << "\n";
-			}
+	char fileCache[512];
+	std::snprintf(fileCache, 512, "%s\\meshes_%d.cache", folderA.c_str(), (int)Settings::MAX_TRIANGLE_RES);
 
-			for (auto const& p : *positionsNotTransformed) {
-				fileOutNotTransformed << "v " << p.x << " " << p.y << " " << p.z << "\n";
-			}
+	// Only maps the file, the surfaces are copied out when the observer reports them.
+	bool const cacheOpened = m_surfaceCache.Open(fileCache);
 
-			for (auto const& n : *faceNormals) {
-				fileOutTransformed << "vn " << n.x << " " << n.y << " " << n.z << "\n";
-				fileOutNotTransformed << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+	// The observer is created once this has run, see IsWarmStartReady(). It runs even if the
+	// store cannot be loaded, so that the session starts without the cache instead.
+	create_task(SpatialAnchorManager::RequestStoreAsync()).then([this, cacheOpened](task<SpatialAnchorStore^> requested)
+		{
+			SpatialAnchorStore^ store = nullptr;
+			try
+			{
+				store = requested.get();
 			}
-
-			fileOutTransformed << "s off\n";
-			fileOutNotTransformed << "s off\n";
-
-			float const noFaces = (*indices).size() / 3.f;
-			float const mtlIncrement = 1000.f / noFaces;
-			float mtlNumber = 1.f;
-
-			for (int i = 0; i < (*indices).size(); i += 3) {
-				fileOutTransformed << "usemtl Material." << std::setw(4) << std::setfill('0') << (int)std::floor(mtlNumber) << "\n";
-				fileOutNotTransformed << "usemtl Material." << std::setw(4) << std::setfill('0') << (int)std::floor(mtlNumber) << "\n";
-
-				// +1 to get .obj format
-				int const i1 = (*indices)[i] + index_base_offset + 1;
-				int const i2 = (*indices)[i + 1] + index_base_offset + 1;
-				int const i3 = (*indices)[i + 2] + index_base_offset + 1;
-				int const n_index = (i / 3) + index_base_offset + 1;
-
-				fileOutTransformed
-					<< "f "
-					<< i1 << "//" << n_index << " "
-					<< i2 << "//" << n_index << " "
-					<< i3 << "//" << n_index << "\n";
-				fileOutNotTransformed
-					<< "f "
-					<< i1 << "//" << n_index << " "
-					<< i2 << "//" << n_index << " "
-					<< i3 << "//" << n_index << "\n";
-
-				mtlNumber += mtlIncrement;
+			catch (Exception^)
+			{
 			}
-
-			index_base_offset += (*positionsTransformed).size();
-		}
-	}
-
-	fileOutTransformed.close();
-	fileOutNotTransformed.close();
-}
-
-void SpatialMappingMain::LoadAppState()
-{
-	// This sample does not persist any state between sessions.
+			m_anchorStore = store;
+
+			// Only the anchor of the cache on disk is kept, those of saves that did not write
+			// their cache and of older versions are removed.
+			uint32_t const save = m_surfaceCache.AnchorSave();
+			String^ const key = CacheAnchorKey(save);
+			IMapView<String^, SpatialAnchor^>^ const anchors = store != nullptr ? store->GetAllSavedAnchors() : nullptr;
+			if (cacheOpened && anchors != nullptr && anchors->HasKey(key))
+			{
+				m_cacheCoordinateSystem = anchors->Lookup(key)->CoordinateSystem;
+				m_lastCacheAnchorSave = save;
+				RemoveCacheAnchors(store, [save](uint32_t const other) { return other != save; });
+			}
+			else
+			{
+				m_surfaceCache.Close();
+				if (store != nullptr)
+				{
+					RemoveCacheAnchors(store, [](uint32_t) { return true; });
+				}
+			}
+			m_warmStartLoaded.store(true, std::memory_order_release);
+		});
 }
 
 // Notifies classes that use Direct3D device resources that the device resources
@@ -15,6 +15,15 @@
 #include "Common\StepTimer.h"
 #include "Content\SpatialInputHandler.h"
 #include "Content\RealtimeSurfaceMeshRenderer.h"
+#include "Processing\DensityController.h"
+#include "Processing\ExportPipeline.h"
+#include "Processing\FrameProfiler.h"
+#include "Processing\Metrics.h"
+#include "Processing\SurfaceCache.h"
+#include "Processing\SurfaceTrace.h"
+
+#include <atomic>
+#include <chrono>
 
 // Updates, renders, and presents holographic content using Direct3D.
 namespace SpatialMapping
@@ -39,6 +48,9 @@ namespace SpatialMapping
 		void SaveAppState();
 		void LoadAppState();
 
+		// Queues an export of the current map and returns without waiting for it.
+		uint64_t SaveAppStateAsync();
+
 		// IDeviceNotify
 		virtual void OnDeviceLost();
 		virtual void OnDeviceRestored();
@@ -65,6 +77,23 @@ namespace SpatialMapping
 			Windows::Perception::Spatial::SpatialLocator^ sender,
 			Windows::Perception::Spatial::SpatialLocatorPositionalTrackingDeactivatingEventArgs^ args);
 
+		// Adds a new surface of the observer, from the SurfaceCache if it is unchanged since
+		// the last session.
+		void AddSurface(int const id, Windows::Perception::Spatial::Surfaces::SpatialSurfaceInfo^ surfaceInfo);
+
+		// Once per frame with Settings::ADAPTIVE_DENSITY, see Processing/DensityController.h.
+		void UpdateDensity();
+
+		// Whether the observer may be created: with Settings::WARM_START_CACHE once the anchor
+		// of the cache is loaded and located, so that the first collection is restored from it.
+		bool IsWarmStartReady(Windows::Perception::Spatial::SpatialCoordinateSystem^ currentCoordinateSystem);
+
+		// Drops the cached surfaces that the first observed collection no longer contains,
+		// and closes the cache once every surface was either restored or recomputed.
+		void ValidateSurfaceCache(
+			Windows::Foundation::Collections::IMapView<Platform::Guid, Windows::Perception::Spatial::Surfaces::SpatialSurfaceInfo^>^ const& surfaceCollection);
+		void CloseSurfaceCacheIfDone();
+
 		// Clears event registration state. Used when changing to a new HolographicSpace
 		// and when tearing down AppMain.
 		void UnregisterHolographicEventHandlers();
@@ -75,6 +104,9 @@ namespace SpatialMapping
 		// A data handler for surface meshes.
 		std::unique_ptr<SpatialMapping::RealtimeSurfaceMeshRenderer> m_meshRenderer;
 
+		// Outlives the renderer, whose surfaces record their updates on background threads.
+		SpatialMapping::SurfaceRecorder m_surfaceRecorder;
+
 		// Cached pointer to device resources.
 		std::shared_ptr<DX::DeviceResources> m_deviceResources;
 
@@ -108,6 +140,33 @@ namespace SpatialMapping
 
 		bool m_drawWireFrame = Settings::DRAW_WIREFRAME_INIT_VALUE;
 
-		std::mutex m_exportMutex;
+		// Writes the exports on a background thread, see Processing/ExportPipeline.h.
+		SpatialMapping::ExportPipeline m_exportPipeline{ Settings::EXPORT_QUEUE_DEPTH, Settings::EXPORT_WORKERS };
+		double m_lastAutosaveTime = 0.;
+		double m_lastProfileLogTime = 0.;
+
+		// Adapts the cost of the spatial mapping to its budgets with Settings::ADAPTIVE_DENSITY.
+		SpatialMapping::DensityController m_densityController;
+		uint64_t m_lastMeshProcessingMicroseconds = 0;
+
+		// The CPU time of Update() and Render(), which the controller takes as the frame time:
+		// the interval between frames is held at the vsync period however little they take.
+		SpatialMapping::Counter m_frameWorkMicroseconds;
+		uint64_t m_lastFrameWorkMicroseconds = 0;
+
+		// The surfaces of the last session and the anchor their positions are relative to. The
+		// store and the anchor are set by the continuation of LoadAppState() before it sets
+		// m_warmStartLoaded, and only read after it on other threads.
+		SpatialMapping::SurfaceCache m_surfaceCache;
+		Windows::Perception::Spatial::SpatialAnchorStore^ m_anchorStore;
+		Windows::Perception::Spatial::SpatialCoordinateSystem^ m_cacheCoordinateSystem;
+		// The save of the last cache anchor, each save stores its own, see SaveAppStateAsync().
+		uint32_t m_lastCacheAnchorSave = 0;
+		Windows::Perception::Spatial::SpatialCoordinateSystem^ m_currentCoordinateSystem;
+		std::chrono::steady_clock::time_point m_warmStartTime;
+		bool m_warmStartRequested = false;
+		std::atomic<bool> m_warmStartLoaded{ false };
+		bool m_warmStartReady = false;
+		bool m_surfaceCacheValidated = false;
 	};
 }
\ No newline at end of file